@@ -1030,6 +1030,10 @@ static bool common_params_parse_ex(int argc, char ** argv, common_params_context
         params.speculative.tensor_buft_overrides.push_back({nullptr, nullptr});
     }
 
+    if (!params.kv_type_overrides.empty()) {
+        params.kv_type_overrides.push_back({nullptr, GGML_TYPE_COUNT});
+    }
+
     if (!params.chat_template.empty() && !common_chat_verify_template(params.chat_template, params.use_jinja)) {
         throw std::runtime_error(string_format(
             "error: the supplied chat template is not supported: %s%s\n",
@@ -1402,6 +1406,14 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.cpuparams.poll = std::stoul(value);
         }
     ));
+    add_opt(common_arg(
+        {"--poll-adaptive"},
+        "poll for work while the tokens are generated back-to-back and sleep when idle, instead of --poll\n"
+        "(not available with OpenMP)",
+        [](common_params & params) {
+            params.cpuparams.poll_adaptive = true;
+        }
+    ).set_examples({LLAMA_EXAMPLE_MAIN, LLAMA_EXAMPLE_SERVER}));
     add_opt(common_arg(
         {"-Cb", "--cpu-mask-batch"}, "M",
         "CPU affinity mask: arbitrarily long hex. Complements cpu-range-batch (default: same as --cpu-mask)",
@@ -2149,6 +2161,13 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.no_extra_bufts = true;
         }
     ).set_env("LLAMA_ARG_NO_REPACK"));
+    add_opt(common_arg(
+        {"--repack-cache"}, "FNAME",
+        "path of a cache of the weights repacked for the CPU, written on the first run and mapped on the next ones (default: none)",
+        [](common_params & params, const std::string & value) {
+            params.repack_cache = value;
+        }
+    ).set_env("LLAMA_ARG_REPACK_CACHE"));
     add_opt(common_arg(
         {"-ctk", "--cache-type-k"}, "TYPE",
         string_format(
@@ -2175,6 +2194,24 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.cache_type_v = kv_cache_type_from_str(value);
         }
     ).set_env("LLAMA_ARG_CACHE_TYPE_V"));
+    add_opt(common_arg(
+        {"-cto", "--cache-type-override"}, "<tensor name pattern>=TYPE,...",
+        "KV cache data type for the KV cache tensors (cache_k_l<il>, cache_v_l<il>) that match a pattern,\n"
+        "e.g. keep the first and the last layers of a 32-layer model in F16 with -ctk q4_0 -ctv q4_0:\n"
+        "\"cache_[kv]_l(0|1|30|31)$=f16\"",
+        [](common_params & params, const std::string & value) {
+            for (const auto & override : string_split<std::string>(value, ',')) {
+                std::string::size_type pos = override.find('=');
+                if (pos == std::string::npos) {
+                    throw std::invalid_argument("invalid value");
+                }
+                // keep strings alive and avoid leaking memory by storing them in a static vector
+                static std::list<std::string> type_overrides;
+                type_overrides.push_back(override.substr(0, pos));
+                params.kv_type_overrides.push_back({type_overrides.back().c_str(), kv_cache_type_from_str(override.substr(pos + 1))});
+            }
+        }
+    ).set_env("LLAMA_ARG_CACHE_TYPE_OVERRIDE"));
     add_opt(common_arg(
         {"--hellaswag"},
         "compute HellaSwag score over random tasks from datafile supplied with -f",
@@ -2252,6 +2289,72 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.defrag_thold = std::stof(value);
         }
     ).set_env("LLAMA_ARG_DEFRAG_THOLD"));
+    add_opt(common_arg(
+        {"--defrag-max-cells"}, "N",
+        string_format("max KV cells moved per decode step, spreads the defragmentation over several steps (default: %d, 0 = all at once)", params.defrag_max_cells),
+        [](common_params & params, int value) {
+            params.defrag_max_cells = value;
+        }
+    ).set_env("LLAMA_ARG_DEFRAG_MAX_CELLS"));
+    add_opt(common_arg(
+        {"--kv-block-size"}, "N",
+        string_format("cells per block of the paged KV cache, sequences share the blocks of a common prefix (default: %d, 0 = disabled)\n"
+            "requires flash attention and a non-unified KV cache [EXPERIMENTAL]", params.kv_block_size),
+        [](common_params & params, int value) {
+            params.kv_block_size = value;
+        }
+    ).set_env("LLAMA_ARG_KV_BLOCK_SIZE"));
+    add_opt(common_arg(
+        {"--kv-spill"}, "N",
+        string_format("MiB of host memory for the sequences spilled out of a full KV cache, the least recently used ones are spilled first\n"
+            "and restored when they are used again (default: %d, 0 = disabled)\n"
+            "requires a unified or a paged KV cache [EXPERIMENTAL]", params.kv_spill_mib),
+        [](common_params & params, int value) {
+            params.kv_spill_mib = value;
+        }
+    ).set_env("LLAMA_ARG_KV_SPILL"));
+    add_opt(common_arg(
+        {"--kv-spill-type"}, "TYPE",
+        string_format(
+            "data type of the spilled K/V rows\n"
+            "allowed values: %s\n"
+            "(default: same as the KV cache)",
+            get_all_kv_cache_types().c_str()
+        ),
+        [](common_params & params, const std::string & value) {
+            params.cache_type_kv_spill = kv_cache_type_from_str(value);
+        }
+    ).set_env("LLAMA_ARG_KV_SPILL_TYPE"));
+    add_opt(common_arg(
+        {"--kv-spill-path"}, "DIR",
+        "spill the sequences to a new file in this directory instead of host memory, removed on exit (default: none)",
+        [](common_params & params, const std::string & value) {
+            params.kv_spill_path = value;
+        }
+    ).set_env("LLAMA_ARG_KV_SPILL_PATH"));
+    add_opt(common_arg(
+        {"--kv-evict-sink"}, "N",
+        string_format("KV eviction: number of cells kept at the start of each sequence (attention sinks) (default: %d)", params.kv_evict_sink),
+        [](common_params & params, int value) {
+            params.kv_evict_sink = value;
+        }
+    ).set_env("LLAMA_ARG_KV_EVICT_SINK"));
+    add_opt(common_arg(
+        {"--kv-evict-recent"}, "N",
+        string_format("KV eviction: number of most recent cells kept per sequence, the older ones are dropped when a sequence grows\n"
+            "beyond sink + recent + heavy cells (default: %d, 0 = disabled) [EXPERIMENTAL]", params.kv_evict_recent),
+        [](common_params & params, int value) {
+            params.kv_evict_recent = value;
+        }
+    ).set_env("LLAMA_ARG_KV_EVICT_RECENT"));
+    add_opt(common_arg(
+        {"--kv-evict-heavy"}, "N",
+        string_format("KV eviction: number of cells with the highest accumulated attention kept per sequence (heavy hitters)\n"
+            "(default: %d, not supported with flash attention)", params.kv_evict_heavy),
+        [](common_params & params, int value) {
+            params.kv_evict_heavy = value;
+        }
+    ).set_env("LLAMA_ARG_KV_EVICT_HEAVY"));
     add_opt(common_arg(
         {"-np", "--parallel"}, "N",
         string_format("number of parallel sequences to decode (default: %d)", params.n_parallel),
@@ -2346,12 +2449,14 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
         "- distribute: spread execution evenly over all nodes\n"
         "- isolate: only spawn threads on CPUs on the node that execution started on\n"
         "- numactl: use the CPU map provided by numactl\n"
+        "- split: split the rows of the weights across the nodes, the threads of each node compute its slice\n"
         "if run without this previously, it is recommended to drop the system page cache before using this\n"
         "see https://github.com/ggml-org/llama.cpp/issues/1437",
         [](common_params & params, const std::string & value) {
             /**/ if (value == "distribute" || value == "") { params.numa = GGML_NUMA_STRATEGY_DISTRIBUTE; }
             else if (value == "isolate") { params.numa = GGML_NUMA_STRATEGY_ISOLATE; }
             else if (value == "numactl") { params.numa = GGML_NUMA_STRATEGY_NUMACTL; }
+            else if (value == "split") { params.numa = GGML_NUMA_STRATEGY_SPLIT; }
             else { throw std::invalid_argument("invalid value"); }
         }
     ).set_env("LLAMA_ARG_NUMA"));
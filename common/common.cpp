@@ -1124,6 +1124,7 @@ struct llama_model_params common_model_params_to_llama(common_params & params) {
     mparams.use_mlock       = params.use_mlock;
     mparams.check_tensors   = params.check_tensors;
     mparams.use_extra_bufts = !params.no_extra_bufts;
+    mparams.repack_cache    = params.repack_cache.empty() ? nullptr : params.repack_cache.c_str();
 
     if (params.kv_overrides.empty()) {
         mparams.kv_overrides = NULL;
@@ -1167,6 +1168,12 @@ struct llama_context_params common_context_params_to_llama(const common_params &
     cparams.pooling_type      = params.pooling_type;
     cparams.attention_type    = params.attention_type;
     cparams.defrag_thold      = params.defrag_thold;
+    cparams.defrag_max_cells  = params.defrag_max_cells;
+    cparams.kv_block_size     = params.kv_block_size;
+    cparams.kv_spill_mib      = params.kv_spill_mib;
+    cparams.kv_evict_sink     = params.kv_evict_sink;
+    cparams.kv_evict_recent   = params.kv_evict_recent;
+    cparams.kv_evict_heavy    = params.kv_evict_heavy;
     cparams.cb_eval           = params.cb_eval;
     cparams.cb_eval_user_data = params.cb_eval_user_data;
     cparams.offload_kqv       = !params.no_kv_offload;
@@ -1179,6 +1186,16 @@ struct llama_context_params common_context_params_to_llama(const common_params &
     cparams.type_k = params.cache_type_k;
     cparams.type_v = params.cache_type_v;
 
+    if (params.kv_type_overrides.empty()) {
+        cparams.kv_type_overrides = NULL;
+    } else {
+        GGML_ASSERT(params.kv_type_overrides.back().pattern == nullptr && "KV cache type overrides not terminated with empty pattern");
+        cparams.kv_type_overrides = params.kv_type_overrides.data();
+    }
+
+    cparams.type_kv_spill = params.cache_type_kv_spill;
+    cparams.kv_spill_path = params.kv_spill_path.empty() ? nullptr : params.kv_spill_path.c_str();
+
     return cparams;
 }
 
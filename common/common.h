@@ -58,6 +58,7 @@ struct cpu_params {
     enum ggml_sched_priority  priority   = GGML_SCHED_PRIO_NORMAL;  // Scheduling prio : (0 - normal, 1 - medium, 2 - high, 3 - realtime)
     bool     strict_cpu                  = false;   // Use strict CPU placement
     uint32_t poll                        = 50;      // Polling (busywait) level (0 - no polling, 100 - mostly polling)
+    bool     poll_adaptive               = false;   // Poll while the graphs come back-to-back, sleep when idle (replaces poll)
 };
 
 int32_t cpu_get_num_physical_cores();
@@ -286,6 +287,12 @@ struct common_params {
     float   yarn_beta_slow        =  1.0f; // YaRN high correction dim
     int32_t yarn_orig_ctx         =     0; // YaRN original context length
     float   defrag_thold          =  0.1f; // KV cache defragmentation threshold
+    int32_t defrag_max_cells      =     0; // max KV cells moved per decode step (0 = defrag all at once)
+    int32_t kv_block_size         =     0; // cells per block of the paged KV cache (0 = not paged)
+    int32_t kv_spill_mib          =     0; // MiB of the spill tier of the KV cache (0 = disabled)
+    int32_t kv_evict_sink         =     4; // KV eviction: cells kept at the start of each sequence
+    int32_t kv_evict_recent       =     0; // KV eviction: most recent cells kept (0 = eviction disabled)
+    int32_t kv_evict_heavy        =     0; // KV eviction: cells with the highest accumulated attention kept
 
     // offload params
     std::vector<ggml_backend_dev_t> devices; // devices to use for offloading
@@ -326,11 +333,14 @@ struct common_params {
     std::string lookup_cache_static  = ""; // path of static ngram cache file for lookup decoding           // NOLINT
     std::string lookup_cache_dynamic = ""; // path of dynamic ngram cache file for lookup decoding          // NOLINT
     std::string logits_file          = ""; // file for saving *all* logits                                  // NOLINT
+    std::string repack_cache         = ""; // path of the cache of the weights repacked for the CPU         // NOLINT
+    std::string kv_spill_path        = ""; // directory of the spill file of the KV cache, empty = host memory  // NOLINT
 
     std::vector<std::string> in_files;   // all input files
     std::vector<std::string> antiprompt; // strings upon which more user input is prompted (a.k.a. reverse prompts)
     std::vector<llama_model_kv_override> kv_overrides;
     std::vector<llama_model_tensor_buft_override> tensor_buft_overrides;
+    std::vector<llama_kv_cache_type_override> kv_type_overrides; // per-layer KV cache data types
 
     bool lora_init_without_apply = false; // only load lora to memory, but do not apply it to ctx (user can manually apply lora later using llama_adapter_lora_apply)
     std::vector<common_adapter_lora_info> lora_adapters; // lora adapter path with user defined scale
@@ -392,6 +402,8 @@ struct common_params {
     ggml_type cache_type_k = GGML_TYPE_F16; // KV cache data type for the K
     ggml_type cache_type_v = GGML_TYPE_F16; // KV cache data type for the V
 
+    ggml_type cache_type_kv_spill = GGML_TYPE_COUNT; // data type of the spilled K/V rows (COUNT = same as the cache)
+
     common_conversation_mode conversation_mode = COMMON_CONVERSATION_MODE_AUTO;
 
     // multimodal models (see tools/mtmd)
@@ -7,6 +7,14 @@
 extern "C" {
 #endif
 
+    // execution time of a graph node, see ggml_cplan.node_timing
+    // the nodes computed together (fused) share the time of their group in proportion to their bytes
+    struct ggml_cpu_node_timing {
+        int64_t t_wall_ns; // from the start of the node until all threads finished it
+        int64_t t_busy_ns; // time spent computing the node, summed over all threads
+        size_t  nbytes;    // bytes touched by the node (sources + destination)
+    };
+
     // the compute plan that needs to be prepared for ggml_graph_compute()
     // since https://github.com/ggml-org/ggml/issues/287
     struct ggml_cplan {
@@ -19,6 +27,14 @@ extern "C" {
         // abort ggml_graph_compute when true
         ggml_abort_callback abort_callback;
         void *              abort_callback_data;
+
+        // optional, when set ggml_graph_compute() measures every node with the cycle counter
+        // and fills one entry per node of the graph
+        struct ggml_cpu_node_timing * node_timing;
+
+        // optional, when set ggml_graph_compute() fills one entry per thread with the time the thread spent
+        // computing nodes, i.e. not waiting at the barriers
+        int64_t * thread_busy_ns;
     };
 
     // numa strategies
@@ -28,12 +44,25 @@ extern "C" {
         GGML_NUMA_STRATEGY_ISOLATE    = 2,
         GGML_NUMA_STRATEGY_NUMACTL    = 3,
         GGML_NUMA_STRATEGY_MIRROR     = 4,
+        GGML_NUMA_STRATEGY_SPLIT      = 5, // split the rows of the weights across the nodes, each node computes its own slice
         GGML_NUMA_STRATEGY_COUNT
     };
 
+    // bytes of the weights read by mul_mat with GGML_NUMA_STRATEGY_SPLIT, local or remote to the node of the reading
+    // thread according to the node the pages are on (move_pages(2)), pages not resident yet are not counted
+    struct ggml_numa_traffic {
+        uint64_t bytes_local;
+        uint64_t bytes_remote;
+    };
+
     GGML_BACKEND_API void    ggml_numa_init(enum ggml_numa_strategy numa); // call once for better performance on NUMA systems
     GGML_BACKEND_API bool    ggml_is_numa(void); // true if init detected that system has >1 NUMA node
 
+    // with GGML_NUMA_STRATEGY_SPLIT, move the slice of the rows of each matrix of a weight to the node that computes it
+    GGML_BACKEND_API void    ggml_numa_place_tensor(const struct ggml_tensor * tensor);
+    GGML_BACKEND_API void    ggml_numa_get_traffic(struct ggml_numa_traffic * traffic);
+    GGML_BACKEND_API void    ggml_numa_reset_traffic(void);
+
     GGML_BACKEND_API struct ggml_tensor * ggml_new_i32(struct ggml_context * ctx, int32_t value);
     GGML_BACKEND_API struct ggml_tensor * ggml_new_f32(struct ggml_context * ctx, float value);
 
@@ -52,12 +81,33 @@ extern "C" {
     GGML_BACKEND_API float   ggml_get_f32_nd(const struct ggml_tensor * tensor, int i0, int i1, int i2, int i3);
     GGML_BACKEND_API void    ggml_set_f32_nd(const struct ggml_tensor * tensor, int i0, int i1, int i2, int i3, float value);
 
+    // how the workers of a threadpool wait for the next graph
+    enum ggml_threadpool_wait {
+        GGML_THREADPOOL_WAIT_POLL     = 0, // poll for the rounds set by ggml_threadpool_params.poll, then sleep
+        GGML_THREADPOOL_WAIT_ADAPTIVE = 1, // poll while the graphs come back-to-back (e.g. decoding), sleep when idle
+    };
+
+    #define GGML_THREADPOOL_WAKE_HIST 16
+
+    // time from the start of a graph until the workers start computing it
+    // hist[i] counts the wake-ups in [2^(i+7), 2^(i+8)) ns, the first and the last buckets are open-ended
+    struct ggml_threadpool_wake_stats {
+        uint64_t n_poll;  // wake-ups of workers that were polling
+        uint64_t n_sleep; // wake-ups of workers that were sleeping
+        uint64_t hist[GGML_THREADPOOL_WAKE_HIST];
+    };
+
     GGML_BACKEND_API struct ggml_threadpool *      ggml_threadpool_new           (struct ggml_threadpool_params  * params);
     GGML_BACKEND_API void                          ggml_threadpool_free          (struct ggml_threadpool * threadpool);
     GGML_BACKEND_API int                           ggml_threadpool_get_n_threads (struct ggml_threadpool * threadpool);
     GGML_BACKEND_API void                          ggml_threadpool_pause         (struct ggml_threadpool * threadpool);
     GGML_BACKEND_API void                          ggml_threadpool_resume        (struct ggml_threadpool * threadpool);
 
+    // the wait policy and the wake-up stats are not available with OpenMP, call them between the graphs
+    GGML_BACKEND_API void                          ggml_threadpool_set_wait        (struct ggml_threadpool * threadpool, enum ggml_threadpool_wait wait);
+    GGML_BACKEND_API void                          ggml_threadpool_get_wake_stats  (struct ggml_threadpool * threadpool, struct ggml_threadpool_wake_stats * stats);
+    GGML_BACKEND_API void                          ggml_threadpool_reset_wake_stats(struct ggml_threadpool * threadpool);
+
     // ggml_graph_plan() has to be called before ggml_graph_compute()
     // when plan.work_size > 0, caller must allocate memory for plan.work_data
     GGML_BACKEND_API struct ggml_cplan ggml_graph_plan(
@@ -88,6 +138,7 @@ extern "C" {
     GGML_BACKEND_API int ggml_cpu_has_avx512_vnni(void);
     GGML_BACKEND_API int ggml_cpu_has_avx512_bf16(void);
     GGML_BACKEND_API int ggml_cpu_has_amx_int8   (void);
+    GGML_BACKEND_API int ggml_cpu_has_amx_bf16   (void);
     // ARM
     GGML_BACKEND_API int ggml_cpu_has_neon       (void);
     GGML_BACKEND_API int ggml_cpu_has_arm_fma    (void);
@@ -132,8 +183,19 @@ extern "C" {
     GGML_BACKEND_API void ggml_backend_cpu_set_threadpool    (ggml_backend_t backend_cpu, ggml_threadpool_t threadpool);
     GGML_BACKEND_API void ggml_backend_cpu_set_abort_callback(ggml_backend_t backend_cpu, ggml_abort_callback abort_callback, void * abort_callback_data);
 
+    // called after every graph computed by the backend with the per-node timings of the graph (NULL to disable)
+    typedef void (*ggml_backend_cpu_timing_callback)(const struct ggml_cgraph * cgraph, const struct ggml_cpu_node_timing * timing, void * user_data);
+    GGML_BACKEND_API void ggml_backend_cpu_set_timing_callback(ggml_backend_t backend_cpu, ggml_backend_cpu_timing_callback timing_callback, void * timing_callback_data);
+
     GGML_BACKEND_API ggml_backend_reg_t ggml_backend_cpu_reg(void);
 
+    // CPU_REPACK buffer over memory that already holds repacked tensors, e.g. a mapped cache of the weights
+    // repacked by a previous run - the memory is not owned by the buffer
+    GGML_BACKEND_API ggml_backend_buffer_t ggml_backend_cpu_repack_buffer_from_ptr(void * ptr, size_t size);
+
+    // name of the interleaved layout of a tensor allocated in a CPU_REPACK buffer, NULL if it is not repacked
+    GGML_BACKEND_API const char * ggml_backend_cpu_repack_tensor_layout(const struct ggml_tensor * tensor);
+
     GGML_BACKEND_API void ggml_cpu_fp32_to_fp32(const float *,       float *, int64_t);
     GGML_BACKEND_API void ggml_cpu_fp32_to_fp16(const float *, ggml_fp16_t *, int64_t);
     GGML_BACKEND_API void ggml_cpu_fp16_to_fp32(const ggml_fp16_t *, float *, int64_t);
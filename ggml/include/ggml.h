@@ -2096,6 +2096,28 @@ extern "C" {
             float                 max_bias,
             float                 logit_softcap);
 
+    // paged variant: the rows of K and V are read through a block table
+    //
+    // q:      [n_embd_k, n_batch,      n_head,    ne3 ]
+    // k:      [n_embd_k, n_rows,       n_head_kv, 1   ] pool of rows shared by all the sequences
+    // v:      [n_embd_v, n_rows,       n_head_kv, 1   ] !! not transposed !!
+    // blocks: [n_kv/block_size, ne3] I32, physical block of each logical block of block_size rows, -1 = unused
+    // mask:   [n_kv,     n_batch_pad,  ne32,      ne33]
+    //
+    // the logical KV row i of the batch i3 is the row blocks[i/block_size, i3]*block_size + i%block_size of k and v
+    //
+    GGML_API struct ggml_tensor * ggml_flash_attn_ext_paged(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * q,
+            struct ggml_tensor  * k,
+            struct ggml_tensor  * v,
+            struct ggml_tensor  * mask,
+            struct ggml_tensor  * blocks,
+            int                   block_size,
+            float                 scale,
+            float                 max_bias,
+            float                 logit_softcap);
+
     GGML_API void ggml_flash_attn_ext_set_prec(
             struct ggml_tensor * a,
             enum ggml_prec       prec);
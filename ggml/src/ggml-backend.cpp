@@ -478,6 +478,10 @@ ggml_backend_buffer_t ggml_backend_dev_buffer_from_host_ptr(ggml_backend_dev_t d
 }
 
 bool ggml_backend_dev_supports_op(ggml_backend_dev_t device, const struct ggml_tensor * op) {
+    // the block table of the paged flash attention (ggml_flash_attn_ext_paged) is only read by the CPU backend
+    if (op->op == GGML_OP_FLASH_ATTN_EXT && op->src[5] && device->iface.get_type(device) != GGML_BACKEND_DEVICE_TYPE_CPU) {
+        return false;
+    }
     return device->iface.supports_op(device, op);
 }
 
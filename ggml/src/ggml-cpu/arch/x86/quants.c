@@ -3818,3 +3818,94 @@ void ggml_vec_dot_iq4_xs_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const v
 #endif
 }
 
+
+// multiply-add of a quantized row, y += v*x
+
+#if defined(__AVX2__)
+// y[0:32] += d*q for the 32 signed bytes of q
+static inline void ggml_vec_mad_i8_32(float * GGML_RESTRICT y, const __m256i q, const float d) {
+    const __m128i q0 = _mm256_castsi256_si128(q);
+    const __m128i q1 = _mm256_extracti128_si256(q, 1);
+#if defined(__AVX512F__)
+    const __m512 vd = _mm512_set1_ps(d);
+
+    _mm512_storeu_ps(y +  0, _mm512_fmadd_ps(vd, _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(q0)), _mm512_loadu_ps(y +  0)));
+    _mm512_storeu_ps(y + 16, _mm512_fmadd_ps(vd, _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(q1)), _mm512_loadu_ps(y + 16)));
+#else
+    const __m256 vd = _mm256_set1_ps(d);
+
+    _mm256_storeu_ps(y +  0, _mm256_fmadd_ps(vd, _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(q0)),                    _mm256_loadu_ps(y +  0)));
+    _mm256_storeu_ps(y +  8, _mm256_fmadd_ps(vd, _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(q0, 8))), _mm256_loadu_ps(y +  8)));
+    _mm256_storeu_ps(y + 16, _mm256_fmadd_ps(vd, _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(q1)),                    _mm256_loadu_ps(y + 16)));
+    _mm256_storeu_ps(y + 24, _mm256_fmadd_ps(vd, _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(q1, 8))), _mm256_loadu_ps(y + 24)));
+#endif
+}
+#endif
+
+void ggml_vec_mad_q4_0(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v) {
+#if defined(__AVX2__)
+    const int qk = QK4_0;
+    const int nb = n / qk;
+
+    assert(n % qk == 0);
+
+    const block_q4_0 * GGML_RESTRICT x = vx;
+
+    const __m256i off = _mm256_set1_epi8(8);
+
+    for (int ib = 0; ib < nb; ++ib) {
+        const float d = GGML_CPU_FP16_TO_FP32(x[ib].d)*v;
+
+        // the low nibbles are the first 16 values, the high nibbles the last 16
+        const __m256i q = _mm256_sub_epi8(bytes_from_nibbles_32(x[ib].qs), off);
+
+        ggml_vec_mad_i8_32(y + ib*qk, q, d);
+    }
+#else
+    ggml_vec_mad_q4_0_generic(n, y, vx, v);
+#endif
+}
+
+void ggml_vec_mad_q5_0(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v) {
+#if defined(__AVX2__)
+    const int qk = QK5_0;
+    const int nb = n / qk;
+
+    assert(n % qk == 0);
+
+    const block_q5_0 * GGML_RESTRICT x = vx;
+
+    for (int ib = 0; ib < nb; ++ib) {
+        const float d = GGML_CPU_FP16_TO_FP32(x[ib].d)*v;
+
+        // (q | h << 4) - 16: the bytes without their high bit get 0xF0
+        __m256i q = bytes_from_nibbles_32(x[ib].qs);
+        __m256i h = bytes_from_bits_32(x[ib].qh);
+        h = _mm256_andnot_si256(h, _mm256_set1_epi8((char)0xF0));
+        q = _mm256_or_si256(q, h);
+
+        ggml_vec_mad_i8_32(y + ib*qk, q, d);
+    }
+#else
+    ggml_vec_mad_q5_0_generic(n, y, vx, v);
+#endif
+}
+
+void ggml_vec_mad_q8_0(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v) {
+#if defined(__AVX2__)
+    const int qk = QK8_0;
+    const int nb = n / qk;
+
+    assert(n % qk == 0);
+
+    const block_q8_0 * GGML_RESTRICT x = vx;
+
+    for (int ib = 0; ib < nb; ++ib) {
+        const float d = GGML_CPU_FP16_TO_FP32(x[ib].d)*v;
+
+        ggml_vec_mad_i8_32(y + ib*qk, _mm256_loadu_si256((const __m256i *) x[ib].qs), d);
+    }
+#else
+    ggml_vec_mad_q8_0_generic(n, y, vx, v);
+#endif
+}
@@ -1373,6 +1373,340 @@ static void gemm_q4_b32_8x8_q8_0_lut_avx(int n, float * GGML_RESTRICT s, size_t
 
 #endif // defined(__AVX2__) || defined(__AVX512F__)
 
+#if defined(__AVX2__)
+// Q3_K, Q5_K and Q6_K: each interleaved block is unpacked to a block_kx8_unpacked tile (see repack.h) and
+// the tile is multiplied with the q8_K activations using maddubs on the unsigned quants
+
+// the 6-bit scales of the Q3_K and Q5_K interleaved blocks, as v[j*8 + r]
+static inline void unpack_scales_kx8_avx2(const uint8_t * GGML_RESTRICT scales, uint8_t * GGML_RESTRICT v) {
+    const __m256i m4  = _mm256_set1_epi8(0x0F);
+    const __m256i m30 = _mm256_set1_epi8(0x30);
+
+    const __m256i lo_0 = _mm256_loadu_si256((const __m256i *) (scales +  0)); // j = 0..3 and 8..11
+    const __m256i lo_1 = _mm256_loadu_si256((const __m256i *) (scales + 32)); // j = 4..7 and 12..15
+    const __m256i hi   = _mm256_loadu_si256((const __m256i *) (scales + 64));
+
+    _mm256_storeu_si256((__m256i *) (v +  0), _mm256_or_si256(_mm256_and_si256(lo_0, m4), _mm256_and_si256(_mm256_slli_epi16(hi, 4), m30)));
+    _mm256_storeu_si256((__m256i *) (v + 32), _mm256_or_si256(_mm256_and_si256(lo_1, m4), _mm256_and_si256(_mm256_slli_epi16(hi, 2), m30)));
+    _mm256_storeu_si256((__m256i *) (v + 64), _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(lo_0, 4), m4), _mm256_and_si256(hi, m30)));
+    _mm256_storeu_si256((__m256i *) (v + 96), _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(lo_1, 4), m4), _mm256_and_si256(_mm256_srli_epi16(hi, 2), m30)));
+}
+
+// scales[j] from the 8 int8 scales of sub-block j, each repeated 4 times
+static inline void set_scale_kx8_avx2(int16_t * GGML_RESTRICT dst, const __m128i sc) {
+    const __m128i rep_0 = _mm_set_epi8(3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0);
+    const __m128i rep_1 = _mm_set_epi8(7, 7, 7, 7, 6, 6, 6, 6, 5, 5, 5, 5, 4, 4, 4, 4);
+
+    _mm256_storeu_si256((__m256i *) (dst +  0), _mm256_cvtepi8_epi16(_mm_shuffle_epi8(sc, rep_0)));
+    _mm256_storeu_si256((__m256i *) (dst + 16), _mm256_cvtepi8_epi16(_mm_shuffle_epi8(sc, rep_1)));
+}
+
+// scales and mins of the Q3_K and Q6_K blocks, sc holds the int8 scales as [j][r] and the min of a
+// sub-block is its scale << shift
+static inline void set_scales_signed_kx8_avx2(block_kx8_unpacked & t, const int8_t * GGML_RESTRICT sc, int shift) {
+    for (int j = 0; j < QK_K / 16; j++) {
+        set_scale_kx8_avx2(t.scales[j], _mm_loadl_epi64((const __m128i *) (sc + j * 8)));
+    }
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    for (int p = 0; p < QK_K / 32; p++) {
+        const __m128i sc_0 = _mm_loadl_epi64((const __m128i *) (sc + (2 * p + 0) * 8));
+        const __m128i sc_1 = _mm_loadl_epi64((const __m128i *) (sc + (2 * p + 1) * 8));
+        _mm256_storeu_si256((__m256i *) t.mins[p], _mm256_sll_epi16(_mm256_cvtepi8_epi16(_mm_unpacklo_epi8(sc_0, sc_1)), count));
+    }
+}
+
+static void unpack_q3_Kx8_avx2(const block_q3_Kx8 & b, block_kx8_unpacked & t) {
+    alignas(32) int8_t sc[128];
+    unpack_scales_kx8_avx2(b.scales, (uint8_t *) sc);
+    for (int i = 0; i < 128; i += 32) {
+        const __m256i v = _mm256_load_si256((const __m256i *) (sc + i));
+        _mm256_store_si256((__m256i *) (sc + i), _mm256_sub_epi8(v, _mm256_set1_epi8(32)));
+    }
+    set_scales_signed_kx8_avx2(t, sc, 2);
+
+    const __m256 d = GGML_F32Cx8_LOAD(b.d);
+    _mm256_storeu_ps(t.d,    d);
+    _mm256_storeu_ps(t.dmin, d);
+
+    // chunk q + 4*i: 2 bits at 2*(i / 2) of qs[q + 4*(i % 2)], high bit at i of hmask[q]
+    const __m256i m3 = _mm256_set1_epi8(0x03);
+    const __m256i m4 = _mm256_set1_epi8(0x04);
+    for (int h = 0; h < 64; h += 32) {
+        for (int q = 0; q < 4; q++) {
+            const __m256i q2_0 = _mm256_loadu_si256((const __m256i *) (b.qs + (q + 0) * 64 + h));
+            const __m256i q2_1 = _mm256_loadu_si256((const __m256i *) (b.qs + (q + 4) * 64 + h));
+            const __m256i hb   = _mm256_loadu_si256((const __m256i *) (b.hmask + q * 64 + h));
+            for (int i = 0; i < 8; i++) {
+                const __m256i lo = _mm256_and_si256(_mm256_srli_epi16(i % 2 ? q2_1 : q2_0, 2 * (i / 2)), m3);
+                const __m256i hi = _mm256_and_si256(i <= 2 ? _mm256_slli_epi16(hb, 2 - i) : _mm256_srli_epi16(hb, i - 2), m4);
+                _mm256_storeu_si256((__m256i *) (t.qs[q + 4 * i] + h), _mm256_or_si256(lo, hi));
+            }
+        }
+    }
+}
+
+static void unpack_q5_Kx8_avx2(const block_q5_Kx8 & b, block_kx8_unpacked & t) {
+    alignas(32) uint8_t v[128];
+    unpack_scales_kx8_avx2(b.scales, v);
+
+    // the scale and the min of a 32-element sub-block apply to its two 16-element halves
+    for (int p = 0; p < QK_K / 32; p++) {
+        const __m128i sc = _mm_loadl_epi64((const __m128i *) (v + p * 8));
+        const __m128i mn = _mm_loadl_epi64((const __m128i *) (v + (8 + p) * 8));
+        set_scale_kx8_avx2(t.scales[2 * p + 0], sc);
+        set_scale_kx8_avx2(t.scales[2 * p + 1], sc);
+        _mm256_storeu_si256((__m256i *) t.mins[p], _mm256_cvtepi8_epi16(_mm_unpacklo_epi8(mn, mn)));
+    }
+
+    _mm256_storeu_ps(t.d,    GGML_F32Cx8_LOAD(b.d));
+    _mm256_storeu_ps(t.dmin, GGML_F32Cx8_LOAD(b.dmin));
+
+    // chunk q + 4*i: nibble i / 4 of qs[q + 4*(i % 4)], high bit at i of qh[q]
+    const __m256i m4  = _mm256_set1_epi8(0x0F);
+    const __m256i m10 = _mm256_set1_epi8(0x10);
+    for (int h = 0; h < 64; h += 32) {
+        for (int q = 0; q < 4; q++) {
+            __m256i q4[4];
+            for (int i = 0; i < 4; i++) {
+                q4[i] = _mm256_loadu_si256((const __m256i *) (b.qs + (q + 4 * i) * 64 + h));
+            }
+            const __m256i hb = _mm256_loadu_si256((const __m256i *) (b.qh + q * 64 + h));
+            for (int i = 0; i < 8; i++) {
+                const __m256i lo = _mm256_and_si256(i < 4 ? q4[i] : _mm256_srli_epi16(q4[i - 4], 4), m4);
+                const __m256i hi = _mm256_and_si256(i <= 4 ? _mm256_slli_epi16(hb, 4 - i) : _mm256_srli_epi16(hb, i - 4), m10);
+                _mm256_storeu_si256((__m256i *) (t.qs[q + 4 * i] + h), _mm256_or_si256(lo, hi));
+            }
+        }
+    }
+}
+
+static void unpack_q6_Kx8_avx2(const block_q6_Kx8 & b, block_kx8_unpacked & t) {
+    set_scales_signed_kx8_avx2(t, b.scales, 5);
+
+    const __m256 d = GGML_F32Cx8_LOAD(b.d);
+    _mm256_storeu_ps(t.d,    d);
+    _mm256_storeu_ps(t.dmin, d);
+
+    // chunks k, k + 8, k + 16 and k + 24: nibbles of ql[k] and ql[k + 8], 2 bits each of qh[k]
+    const __m256i m4  = _mm256_set1_epi8(0x0F);
+    const __m256i m30 = _mm256_set1_epi8(0x30);
+    for (int h = 0; h < 64; h += 32) {
+        for (int k = 0; k < 8; k++) {
+            const __m256i l_0 = _mm256_loadu_si256((const __m256i *) (b.ql + (k + 0) * 64 + h));
+            const __m256i l_1 = _mm256_loadu_si256((const __m256i *) (b.ql + (k + 8) * 64 + h));
+            const __m256i hb  = _mm256_loadu_si256((const __m256i *) (b.qh + k * 64 + h));
+
+            _mm256_storeu_si256((__m256i *) (t.qs[k +  0] + h), _mm256_or_si256(_mm256_and_si256(l_0, m4), _mm256_and_si256(_mm256_slli_epi16(hb, 4), m30)));
+            _mm256_storeu_si256((__m256i *) (t.qs[k +  8] + h), _mm256_or_si256(_mm256_and_si256(l_1, m4), _mm256_and_si256(_mm256_slli_epi16(hb, 2), m30)));
+            _mm256_storeu_si256((__m256i *) (t.qs[k + 16] + h), _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(l_0, 4), m4), _mm256_and_si256(hb, m30)));
+            _mm256_storeu_si256((__m256i *) (t.qs[k + 24] + h), _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(l_1, 4), m4), _mm256_and_si256(_mm256_srli_epi16(hb, 2), m30)));
+        }
+    }
+}
+
+static inline __m256i load_q8_chunk_avx2(const int8_t * GGML_RESTRICT x) {
+    int64_t v;
+    memcpy(&v, x, sizeof(v));
+    return _mm256_set1_epi64x(v);
+}
+
+// res[m] = dot products of the 8 rows of the tile with activation row m of NROWS interleaved q8_K rows
+// (a block_q8_Kx4 for NROWS == 4, a block_q8_K for NROWS == 1)
+template <int NROWS>
+static inline void dot_kx8_unpacked_avx(const block_kx8_unpacked & t, const int8_t * GGML_RESTRICT qs, const int16_t * GGML_RESTRICT bsums,
+                                        const float * GGML_RESTRICT d, __m256 * GGML_RESTRICT res) {
+    __m256i isum[NROWS];
+
+#if defined(__AVX512BW__)
+    __m512i iacc[NROWS];
+    for (int m = 0; m < NROWS; m++) {
+        iacc[m] = _mm512_setzero_si512();
+    }
+    for (int j = 0; j < QK_K / 16; j++) {
+        const __m512i w_0 = _mm512_loadu_si512((const __m512i *) t.qs[2 * j + 0]);
+        const __m512i w_1 = _mm512_loadu_si512((const __m512i *) t.qs[2 * j + 1]);
+        const __m512i sc  = _mm512_loadu_si512((const __m512i *) t.scales[j]);
+        for (int m = 0; m < NROWS; m++) {
+            int64_t a_0;
+            int64_t a_1;
+            memcpy(&a_0, qs + (2 * j + 0) * NROWS * 8 + m * 8, sizeof(a_0));
+            memcpy(&a_1, qs + (2 * j + 1) * NROWS * 8 + m * 8, sizeof(a_1));
+            const __m512i p = _mm512_add_epi16(_mm512_maddubs_epi16(w_0, _mm512_set1_epi64(a_0)),
+                                               _mm512_maddubs_epi16(w_1, _mm512_set1_epi64(a_1)));
+            iacc[m] = _mm512_add_epi32(iacc[m], _mm512_madd_epi16(p, sc));
+        }
+    }
+    // the two int32 of each row are in a 64-bit lane
+    for (int m = 0; m < NROWS; m++) {
+        isum[m] = _mm512_cvtepi64_epi32(_mm512_add_epi32(iacc[m], _mm512_srli_epi64(iacc[m], 32)));
+    }
+#else
+    __m256i iacc_0[NROWS]; // rows 0..3
+    __m256i iacc_1[NROWS]; // rows 4..7
+    for (int m = 0; m < NROWS; m++) {
+        iacc_0[m] = _mm256_setzero_si256();
+        iacc_1[m] = _mm256_setzero_si256();
+    }
+    for (int j = 0; j < QK_K / 16; j++) {
+        const __m256i w_00 = _mm256_loadu_si256((const __m256i *) (t.qs[2 * j + 0] +  0));
+        const __m256i w_01 = _mm256_loadu_si256((const __m256i *) (t.qs[2 * j + 0] + 32));
+        const __m256i w_10 = _mm256_loadu_si256((const __m256i *) (t.qs[2 * j + 1] +  0));
+        const __m256i w_11 = _mm256_loadu_si256((const __m256i *) (t.qs[2 * j + 1] + 32));
+        const __m256i sc_0 = _mm256_loadu_si256((const __m256i *) (t.scales[j] +  0));
+        const __m256i sc_1 = _mm256_loadu_si256((const __m256i *) (t.scales[j] + 16));
+        for (int m = 0; m < NROWS; m++) {
+            const __m256i a_0 = load_q8_chunk_avx2(qs + (2 * j + 0) * NROWS * 8 + m * 8);
+            const __m256i a_1 = load_q8_chunk_avx2(qs + (2 * j + 1) * NROWS * 8 + m * 8);
+            const __m256i p_0 = _mm256_add_epi16(_mm256_maddubs_epi16(w_00, a_0), _mm256_maddubs_epi16(w_10, a_1));
+            const __m256i p_1 = _mm256_add_epi16(_mm256_maddubs_epi16(w_01, a_0), _mm256_maddubs_epi16(w_11, a_1));
+            iacc_0[m] = _mm256_add_epi32(iacc_0[m], _mm256_madd_epi16(p_0, sc_0));
+            iacc_1[m] = _mm256_add_epi32(iacc_1[m], _mm256_madd_epi16(p_1, sc_1));
+        }
+    }
+    const __m256i perm = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+    for (int m = 0; m < NROWS; m++) {
+        isum[m] = _mm256_permutevar8x32_epi32(_mm256_hadd_epi32(iacc_0[m], iacc_1[m]), perm);
+    }
+#endif
+
+    // the mins, with the sums of the 16-element sub-blocks 2*p and 2*p + 1 of the activations
+    const __m256 dw   = _mm256_loadu_ps(t.d);
+    const __m256 dmin = _mm256_loadu_ps(t.dmin);
+    for (int m = 0; m < NROWS; m++) {
+        __m256i imin = _mm256_setzero_si256();
+        for (int p = 0; p < QK_K / 32; p++) {
+            int32_t bs;
+            memcpy(&bs, bsums + (p / 2) * NROWS * 4 + m * 4 + (p % 2) * 2, sizeof(bs));
+            imin = _mm256_add_epi32(imin, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *) t.mins[p]), _mm256_set1_epi32(bs)));
+        }
+        const __m256 r = _mm256_fmsub_ps(dw, _mm256_cvtepi32_ps(isum[m]), _mm256_mul_ps(dmin, _mm256_cvtepi32_ps(imin)));
+        res[m] = _mm256_mul_ps(r, _mm256_set1_ps(d[m]));
+    }
+}
+
+template <typename BLOC_TYPE, void (*UNPACK)(const BLOC_TYPE &, block_kx8_unpacked &)>
+static void gemv_kx8_q8_K_avx(int n, float * GGML_RESTRICT s, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nc) {
+    const int nb = n / QK_K;
+
+    block_kx8_unpacked t;
+
+    const block_q8_K * a_ptr = (const block_q8_K *) vy;
+    for (int x = 0; x < nc / 8; x++) {
+        const BLOC_TYPE * b_ptr = (const BLOC_TYPE *) vx + (x * nb);
+
+        __m256 acc = _mm256_setzero_ps();
+        for (int l = 0; l < nb; l++) {
+            UNPACK(b_ptr[l], t);
+
+            __m256 res;
+            dot_kx8_unpacked_avx<1>(t, a_ptr[l].qs, a_ptr[l].bsums, &a_ptr[l].d, &res);
+            acc = _mm256_add_ps(acc, res);
+        }
+        _mm256_storeu_ps(s + x * 8, acc);
+    }
+}
+
+// each block of 8 rows is unpacked once for all the activation rows
+template <typename BLOC_TYPE, void (*UNPACK)(const BLOC_TYPE &, block_kx8_unpacked &)>
+static void gemm_kx8_q8_K_avx(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int nb = n / QK_K;
+
+    block_kx8_unpacked t;
+
+    for (int x = 0; x < nc / 8; x++) {
+        const BLOC_TYPE * b_ptr = (const BLOC_TYPE *) vx + (x * nb);
+        for (int l = 0; l < nb; l++) {
+            UNPACK(b_ptr[l], t);
+
+            for (int y = 0; y < nr / 4; y++) {
+                const block_q8_Kx4 * a_ptr = (const block_q8_Kx4 *) vy + (y * nb) + l;
+
+                __m256 res[4];
+                dot_kx8_unpacked_avx<4>(t, a_ptr->qs, a_ptr->bsums, a_ptr->d, res);
+
+                for (int m = 0; m < 4; m++) {
+                    float * dst = s + (y * 4 + m) * bs + x * 8;
+                    _mm256_storeu_ps(dst, l == 0 ? res[m] : _mm256_add_ps(_mm256_loadu_ps(dst), res[m]));
+                }
+            }
+        }
+    }
+}
+
+// Q8_0: dot products of a block_q8_0x8 with NROWS interleaved q8_0 rows (a block_q8_0x4 for NROWS == 4,
+// a block_q8_0 for NROWS == 1). The int32 sums of each weight row are in 2 lanes of the accumulators, they
+// are reduced once all the blocks are done.
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+template <int NROWS>
+static inline void dot_q8_0x8_avx(const block_q8_0x8 & b, const int8_t * GGML_RESTRICT qs, const ggml_half * GGML_RESTRICT d, __m512 * GGML_RESTRICT acc) {
+    __m512i iacc[NROWS];
+    for (int m = 0; m < NROWS; m++) {
+        iacc[m] = _mm512_setzero_si512();
+    }
+    for (int k = 0; k < QK8_0 / 8; k++) {
+        const __m512i w = _mm512_loadu_si512((const __m512i *) (b.qs + k * 64));
+        for (int m = 0; m < NROWS; m++) {
+            int64_t a;
+            memcpy(&a, qs + k * NROWS * 8 + m * 8, sizeof(a));
+            iacc[m] = mul_sum_i8_pairs_acc_int32x16(iacc[m], w, _mm512_set1_epi64(a));
+        }
+    }
+    const __m512 dw = _mm512_permutexvar_ps(_mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7),
+                                            _mm512_castps256_ps512(GGML_F32Cx8_LOAD(b.d)));
+    for (int m = 0; m < NROWS; m++) {
+        acc[m] = _mm512_fmadd_ps(_mm512_cvtepi32_ps(iacc[m]), _mm512_mul_ps(dw, _mm512_set1_ps(GGML_CPU_FP16_TO_FP32(d[m]))), acc[m]);
+    }
+}
+
+static inline __m256 reduce_q8_0x8_avx(__m512 acc) {
+    const __m512 sum = _mm512_add_ps(acc, _mm512_castsi512_ps(_mm512_srli_epi64(_mm512_castps_si512(acc), 32)));
+    return _mm512_castps512_ps256(_mm512_permutexvar_ps(_mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 0, 2, 4, 6, 8, 10, 12, 14), sum));
+}
+
+#define Q8_0X8_ACC_T     __m512
+#define Q8_0X8_ACC_ZERO  _mm512_setzero_ps()
+#else
+struct q8_0x8_acc {
+    __m256 acc_0; // rows 0..3
+    __m256 acc_1; // rows 4..7
+};
+
+template <int NROWS>
+static inline void dot_q8_0x8_avx(const block_q8_0x8 & b, const int8_t * GGML_RESTRICT qs, const ggml_half * GGML_RESTRICT d, q8_0x8_acc * GGML_RESTRICT acc) {
+    __m256i iacc_0[NROWS];
+    __m256i iacc_1[NROWS];
+    for (int m = 0; m < NROWS; m++) {
+        iacc_0[m] = _mm256_setzero_si256();
+        iacc_1[m] = _mm256_setzero_si256();
+    }
+    for (int k = 0; k < QK8_0 / 8; k++) {
+        const __m256i w_0 = _mm256_loadu_si256((const __m256i *) (b.qs + k * 64 +  0));
+        const __m256i w_1 = _mm256_loadu_si256((const __m256i *) (b.qs + k * 64 + 32));
+        for (int m = 0; m < NROWS; m++) {
+            const __m256i a = load_q8_chunk_avx2(qs + k * NROWS * 8 + m * 8);
+            iacc_0[m] = mul_sum_i8_pairs_acc_int32x8(iacc_0[m], w_0, a);
+            iacc_1[m] = mul_sum_i8_pairs_acc_int32x8(iacc_1[m], w_1, a);
+        }
+    }
+    const __m256 dw   = GGML_F32Cx8_LOAD(b.d);
+    const __m256 dw_0 = _mm256_permutevar8x32_ps(dw, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
+    const __m256 dw_1 = _mm256_permutevar8x32_ps(dw, _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7));
+    for (int m = 0; m < NROWS; m++) {
+        const __m256 da = _mm256_set1_ps(GGML_CPU_FP16_TO_FP32(d[m]));
+        acc[m].acc_0 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_0[m]), _mm256_mul_ps(dw_0, da), acc[m].acc_0);
+        acc[m].acc_1 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_1[m]), _mm256_mul_ps(dw_1, da), acc[m].acc_1);
+    }
+}
+
+static inline __m256 reduce_q8_0x8_avx(q8_0x8_acc acc) {
+    return _mm256_permutevar8x32_ps(_mm256_hadd_ps(acc.acc_0, acc.acc_1), _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+}
+
+#define Q8_0X8_ACC_T     q8_0x8_acc
+#define Q8_0X8_ACC_ZERO  q8_0x8_acc { _mm256_setzero_ps(), _mm256_setzero_ps() }
+#endif
+#endif // defined(__AVX2__)
+
 void ggml_gemv_q4_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
 #if defined(__AVX2__) || defined(__AVX512F__)
     {
@@ -1938,6 +2272,69 @@ void ggml_gemv_q2_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const vo
 #endif
 }
 
+void ggml_gemv_q3_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    assert(n % QK_K == 0);
+    assert(nc % 8 == 0);
+    UNUSED(bs);
+    UNUSED(nr);
+
+    gemv_kx8_q8_K_avx<block_q3_Kx8, unpack_q3_Kx8_avx2>(n, s, vx, vy, nc);
+#else
+    ggml_gemv_q3_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+#endif
+}
+
+void ggml_gemv_q5_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    assert(n % QK_K == 0);
+    assert(nc % 8 == 0);
+    UNUSED(bs);
+    UNUSED(nr);
+
+    gemv_kx8_q8_K_avx<block_q5_Kx8, unpack_q5_Kx8_avx2>(n, s, vx, vy, nc);
+#else
+    ggml_gemv_q5_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+#endif
+}
+
+void ggml_gemv_q6_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    assert(n % QK_K == 0);
+    assert(nc % 8 == 0);
+    UNUSED(bs);
+    UNUSED(nr);
+
+    gemv_kx8_q8_K_avx<block_q6_Kx8, unpack_q6_Kx8_avx2>(n, s, vx, vy, nc);
+#else
+    ggml_gemv_q6_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+#endif
+}
+
+void ggml_gemv_q8_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    const int nb = n / QK8_0;
+
+    assert(n % QK8_0 == 0);
+    assert(nc % 8 == 0);
+    UNUSED(bs);
+    UNUSED(nr);
+
+    const block_q8_0 * a_ptr = (const block_q8_0 *) vy;
+    for (int x = 0; x < nc / 8; x++) {
+        const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+
+        Q8_0X8_ACC_T acc = Q8_0X8_ACC_ZERO;
+        for (int l = 0; l < nb; l++) {
+            dot_q8_0x8_avx<1>(b_ptr[l], a_ptr[l].qs, &a_ptr[l].d, &acc);
+        }
+        _mm256_storeu_ps(s + x * 8, reduce_q8_0x8_avx(acc));
+    }
+#else
+    ggml_gemv_q8_0_8x8_q8_0_generic(n, s, bs, vx, vy, nr, nc);
+#endif
+}
+
 void ggml_gemm_q4_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
 #if defined(__AVX2__) || defined(__AVX512F__)
     {
@@ -6305,3 +6702,66 @@ void ggml_gemm_q2_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const vo
 
 #endif
 }
+
+void ggml_gemm_q3_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    assert(n % QK_K == 0);
+    assert(nr % 4 == 0);
+    assert(nc % 8 == 0);
+
+    gemm_kx8_q8_K_avx<block_q3_Kx8, unpack_q3_Kx8_avx2>(n, s, bs, vx, vy, nr, nc);
+#else
+    ggml_gemm_q3_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+#endif
+}
+
+void ggml_gemm_q5_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    assert(n % QK_K == 0);
+    assert(nr % 4 == 0);
+    assert(nc % 8 == 0);
+
+    gemm_kx8_q8_K_avx<block_q5_Kx8, unpack_q5_Kx8_avx2>(n, s, bs, vx, vy, nr, nc);
+#else
+    ggml_gemm_q5_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+#endif
+}
+
+void ggml_gemm_q6_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    assert(n % QK_K == 0);
+    assert(nr % 4 == 0);
+    assert(nc % 8 == 0);
+
+    gemm_kx8_q8_K_avx<block_q6_Kx8, unpack_q6_Kx8_avx2>(n, s, bs, vx, vy, nr, nc);
+#else
+    ggml_gemm_q6_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+#endif
+}
+
+void ggml_gemm_q8_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+#if defined(__AVX2__)
+    const int nb = n / QK8_0;
+
+    assert(n % QK8_0 == 0);
+    assert(nr % 4 == 0);
+    assert(nc % 8 == 0);
+
+    for (int y = 0; y < nr / 4; y++) {
+        const block_q8_0x4 * a_ptr = (const block_q8_0x4 *) vy + (y * nb);
+        for (int x = 0; x < nc / 8; x++) {
+            const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+
+            Q8_0X8_ACC_T acc[4] = { Q8_0X8_ACC_ZERO, Q8_0X8_ACC_ZERO, Q8_0X8_ACC_ZERO, Q8_0X8_ACC_ZERO };
+            for (int l = 0; l < nb; l++) {
+                dot_q8_0x8_avx<4>(b_ptr[l], a_ptr[l].qs, a_ptr[l].d, acc);
+            }
+            for (int m = 0; m < 4; m++) {
+                _mm256_storeu_ps(s + (y * 4 + m) * bs + x * 8, reduce_q8_0x8_avx(acc[m]));
+            }
+        }
+    }
+#else
+    ggml_gemm_q8_0_8x8_q8_0_generic(n, s, bs, vx, vy, nr, nc);
+#endif
+}
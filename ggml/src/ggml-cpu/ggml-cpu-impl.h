@@ -24,8 +24,34 @@ struct ggml_compute_params {
     void * wdata;
 
     struct ggml_threadpool * threadpool;
+
+    // nodes that follow dst in the graph and are computed as a part of it, see ggml_graph_compute_node_plan
+    struct ggml_tensor * const * fused;
+    int n_fused;
+
+    // cumulative row share of each thread in units of 1/GGML_ROW_SPLIT_ONE, [nth + 1] entries
+    // set on hybrid CPUs so that faster cores get more rows, NULL = equal split
+    const uint32_t * row_split;
 };
 
+#define GGML_ROW_SPLIT_SHIFT 16
+#define GGML_ROW_SPLIT_ONE   (1u << GGML_ROW_SPLIT_SHIFT)
+
+// range of rows [ir0, ir1) of nr rows processed by the current thread
+static inline void ggml_thread_rows(const struct ggml_compute_params * params, int64_t nr, int64_t * ir0, int64_t * ir1) {
+    if (params->row_split == NULL) {
+        // rows per thread
+        const int64_t dr = (nr + params->nth - 1)/params->nth;
+
+        *ir0 = MIN(dr*params->ith, nr);
+        *ir1 = MIN(*ir0 + dr, nr);
+        return;
+    }
+
+    *ir0 = (nr*(int64_t) params->row_split[params->ith    ]) >> GGML_ROW_SPLIT_SHIFT;
+    *ir1 = (nr*(int64_t) params->row_split[params->ith + 1]) >> GGML_ROW_SPLIT_SHIFT;
+}
+
 
 #if defined(_MSC_VER)
 
@@ -509,8 +535,11 @@ static __m256 __lasx_xvreplfr2vr_s(const float val) {
 // TODO: move to ggml-threading
 void ggml_barrier(struct ggml_threadpool * tp);
 
-void ggml_threadpool_chunk_set(struct ggml_threadpool * tp, int value);
-int  ggml_threadpool_chunk_add(struct ggml_threadpool * tp, int value);
+// work-stealing distribution of the chunks of an op: each thread starts with a contiguous range of the chunks and
+// steals from the ranges of the other threads when its own range is done
+// reset is called by a single thread before a barrier, next returns -1 when all the chunks are taken
+void ggml_threadpool_chunks_reset(struct ggml_threadpool * tp, int nth, int n_chunks);
+int  ggml_threadpool_chunks_next (struct ggml_threadpool * tp, int ith, int nth);
 
 #ifdef __cplusplus
 }
@@ -437,6 +437,20 @@ typedef pthread_mutex_t    ggml_mutex_t;
 
 #endif
 
+// per-thread range of the chunks of the current op: the owner takes the chunks from the start of its range and the
+// threads that are done with their own range steal from it
+struct ggml_chunk_range {
+    atomic_int GGML_CACHE_ALIGN next;
+    int end;
+    int victim; // owner only: first range to steal from
+};
+
+// how ggml_graph_compute() runs a node of the graph, see ggml_graph_compute_node_plan
+struct ggml_cpu_node_plan {
+    bool    sync;    // the threads wait for each other before starting the node
+    uint8_t n_fused; // number of following nodes computed together with the node
+};
+
 // Threadpool def
 struct ggml_threadpool {
     ggml_mutex_t mutex;       // mutex for cond.var
@@ -449,7 +463,8 @@ struct ggml_threadpool {
     atomic_int n_graph;       // incremented when there is work to be done (i.e each graph)
     atomic_int GGML_CACHE_ALIGN n_barrier;
     atomic_int GGML_CACHE_ALIGN n_barrier_passed;
-    atomic_int GGML_CACHE_ALIGN current_chunk; // currently processing chunk during Mat_Mul, shared between all the threads.
+
+    struct ggml_chunk_range * chunks; // [n_threads_max] chunks of the current op, see ggml_threadpool_chunks_next
 
     // these are atomic as an annotation for thread-sanitizer
     atomic_bool stop;         // Used for stopping the threadpool altogether
@@ -463,9 +478,34 @@ struct ggml_threadpool {
     int32_t      prio;        // Scheduling priority
     uint32_t     poll;        // Polling level (0 - no polling)
 
+    atomic_int   wait;        // enum ggml_threadpool_wait
+    atomic_int   spin_us;     // adaptive wait: how long the workers poll for the next graph
+    atomic_int   n_sleeping;  // workers waiting on the cond.var for the next graph
+    uint64_t     t_kickoff;   // cycle counter at the start of the current graph
+    int64_t      t_done;      // end of the previous graph (us)
+    int64_t      gap_avg;     // moving average of the time between the graphs (us)
+    double       ns_per_cycle; // 0 when the wake-ups are not measured
+
+    bool         hybrid;      // the CPUs have different capacities, the rows are split in proportion to them
+    int        * capacity;    // [n_threads_max] capacity of the CPU of each thread in the current graph
+
     enum ggml_status ec;
+
+    // only set while measuring a graph (cplan->node_timing != NULL):
+    // [n_threads][n_nodes] busy cycles per thread, followed by [n_nodes + 1] start stamps of thread 0
+    uint64_t * node_cycles;
+    uint64_t * node_cycles_buf;  // kept across graphs, grown to the largest measured graph
+    size_t     node_cycles_size;
+
+    // [n_nodes] plan of the current graph
+    struct ggml_cpu_node_plan * node_plan;
+    int                         node_plan_size;
 };
 
+// adaptive wait (GGML_THREADPOOL_WAIT_ADAPTIVE): bounds of the time the workers poll for the next graph
+#define GGML_THREADPOOL_SPIN_MIN_US   50
+#define GGML_THREADPOOL_SPIN_MAX_US 5000
+
 // Per-thread state
 struct ggml_compute_state {
 #ifndef GGML_USE_OPENMP
@@ -473,6 +513,8 @@ struct ggml_compute_state {
     bool cpumask[GGML_MAX_N_THREADS];
     int  last_graph;
     bool pending;
+    bool slept; // waited on the cond.var for the pending graph
+    struct ggml_threadpool_wake_stats wake;
 #endif
     struct ggml_threadpool * threadpool;
     int ith;
@@ -491,6 +533,62 @@ static inline void ggml_thread_cpu_relax(void) {
 static inline void ggml_thread_cpu_relax(void) {;}
 #endif
 
+// Cycle counter for the per-node timing (see ggml_graph_compute_timing)
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+static inline uint64_t ggml_cpu_cycles(void) {
+    return __rdtsc();
+}
+#elif defined(__aarch64__) && ( defined(__clang__) || defined(__GNUC__) )
+static inline uint64_t ggml_cpu_cycles(void) {
+    uint64_t v;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+}
+#else
+static inline uint64_t ggml_cpu_cycles(void) {
+    return (uint64_t) ggml_time_us()*1000;
+}
+#endif
+
+static double ggml_cpu_ns_per_cycle = 0.0;
+
+// calibrate the cycle counter against the wall clock the first time it is used, no fixed frequency is assumed
+// the 2 ms measurement runs outside of the critical section, concurrent first calls keep the first result
+static double ggml_cpu_cycles_ns(void) {
+    ggml_critical_section_start();
+    double res = ggml_cpu_ns_per_cycle;
+    ggml_critical_section_end();
+
+    if (res != 0.0) {
+        return res;
+    }
+
+    const int64_t  t0 = ggml_time_us();
+    const uint64_t c0 = ggml_cpu_cycles();
+
+    int64_t t1 = t0;
+    while (t1 - t0 < 2000) {
+        ggml_thread_cpu_relax();
+        t1 = ggml_time_us();
+    }
+
+    const uint64_t c1 = ggml_cpu_cycles();
+
+    ggml_critical_section_start();
+    if (ggml_cpu_ns_per_cycle == 0.0) {
+        ggml_cpu_ns_per_cycle = c1 > c0 ? 1000.0*(t1 - t0)/(c1 - c0) : 1.0;
+    }
+    res = ggml_cpu_ns_per_cycle;
+    ggml_critical_section_end();
+
+    return res;
+}
+
 //
 // NUMA support
 //
@@ -516,12 +614,38 @@ struct ggml_numa_nodes {
 #endif
 };
 
+#if defined(__gnu_linux__)
+// bytes of the weights read by mul_mat by the threads of the node, one cache line per node so that only the threads
+// of a node share it
+struct ggml_numa_traffic_node {
+    atomic_uint_fast64_t GGML_CACHE_ALIGN bytes_local;
+    atomic_uint_fast64_t bytes_remote;
+};
+#endif
+
+//
+// hybrid CPUs (P-cores + E-cores, big.LITTLE)
+//
+
+#define GGML_CPU_CAPACITY_SCALE 1024
+
+// the cores are treated as one class when the slowest one has at least this share of the capacity of the fastest one
+#define GGML_CPU_CAPACITY_SAME  (GGML_CPU_CAPACITY_SCALE*85/100)
+
 //
 // ggml state
 //
 
 struct ggml_state {
     struct ggml_numa_nodes numa;
+#if defined(__gnu_linux__)
+    struct ggml_numa_traffic_node numa_traffic[GGML_NUMA_MAX_NODES];
+#endif
+    bool disable_fusion; // GGML_CPU_DISABLE_FUSION
+
+    // relative performance of each CPU, GGML_CPU_CAPACITY_SCALE for the fastest ones, 0 = unknown
+    uint16_t cpu_capacity[GGML_NUMA_MAX_CPUS];
+    bool     cpu_hybrid; // the CPUs belong to different classes, unless GGML_CPU_DISABLE_HYBRID is set
 };
 
 static struct ggml_state g_state = {0};
@@ -564,12 +688,42 @@ void ggml_barrier(struct ggml_threadpool * tp) {
 #endif
 }
 
-void ggml_threadpool_chunk_set(struct ggml_threadpool * tp, int value) {
-    atomic_store_explicit(&tp->current_chunk, value, memory_order_relaxed);
+void ggml_threadpool_chunks_reset(struct ggml_threadpool * tp, int nth, int n_chunks) {
+    for (int i = 0; i < nth; ++i) {
+        struct ggml_chunk_range * range = &tp->chunks[i];
+        atomic_store_explicit(&range->next, (int) (((int64_t) i*n_chunks)/nth), memory_order_relaxed);
+        range->end    = (int) (((int64_t) (i + 1)*n_chunks)/nth);
+        range->victim = (i + 1) % nth;
+    }
 }
 
-int ggml_threadpool_chunk_add(struct ggml_threadpool * tp, int value) {
-    return atomic_fetch_add_explicit(&tp->current_chunk, value, memory_order_relaxed);
+int ggml_threadpool_chunks_next(struct ggml_threadpool * tp, int ith, int nth) {
+    struct ggml_chunk_range * own = &tp->chunks[ith];
+
+    if (atomic_load_explicit(&own->next, memory_order_relaxed) < own->end) {
+        const int chunk = atomic_fetch_add_explicit(&own->next, 1, memory_order_relaxed);
+        if (chunk < own->end) {
+            return chunk;
+        }
+    }
+
+    // steal from the other ranges, starting with the last one that still had chunks
+    for (int i = 0; i < nth; ++i) {
+        const int victim = (own->victim + i) % nth;
+
+        struct ggml_chunk_range * range = &tp->chunks[victim];
+        if (victim == ith || atomic_load_explicit(&range->next, memory_order_relaxed) >= range->end) {
+            continue;
+        }
+
+        const int chunk = atomic_fetch_add_explicit(&range->next, 1, memory_order_relaxed);
+        if (chunk < range->end) {
+            own->victim = victim;
+            return chunk;
+        }
+    }
+
+    return -1;
 }
 
 #if defined(__gnu_linux__)
@@ -679,6 +833,284 @@ bool ggml_is_numa(void) {
     return g_state.numa.n_nodes > 1;
 }
 
+static bool ggml_numa_is_split(void) {
+    return ggml_is_numa() && g_state.numa.numa_strategy == GGML_NUMA_STRATEGY_SPLIT;
+}
+
+// node of the thread ith out of nth, the threads are assigned to the nodes in contiguous groups
+static int ggml_numa_thread_node(int ith, int nth) {
+    return (int) (((int64_t) ith*g_state.numa.n_nodes)/nth);
+}
+
+// first thread of the group of the node
+static int ggml_numa_node_first_thread(int node, int nth) {
+    return (int) (((int64_t) node*nth + g_state.numa.n_nodes - 1)/g_state.numa.n_nodes);
+}
+
+// rows [r0, r1) of a matrix of nrows rows held by the node
+static void ggml_numa_node_rows(int node, int64_t nrows, int64_t * r0, int64_t * r1) {
+    *r0 = (node    )*nrows/g_state.numa.n_nodes;
+    *r1 = (node + 1)*nrows/g_state.numa.n_nodes;
+}
+
+// the weights are split when they are large enough to give at least one row to each node
+static bool ggml_numa_is_split_weight(const struct ggml_tensor * tensor) {
+    return tensor->buffer && ggml_backend_buffer_get_usage(tensor->buffer) == GGML_BACKEND_BUFFER_USAGE_WEIGHTS &&
+           tensor->ne[1] >= (int64_t) g_state.numa.n_nodes;
+}
+
+#if defined(__gnu_linux__) && defined(SYS_move_pages)
+#define GGML_NUMA_PLACEMENT_MAX 2048
+
+// where the pages of the row slices of a split weight are, queried with move_pages(2) until all of them are resident
+struct ggml_numa_placement {
+    const void * data;     // NULL for a free entry
+    bool         resident; // all the pages were resident at the last query
+    uint64_t     bytes[GGML_NUMA_MAX_NODES][GGML_NUMA_MAX_NODES]; // [slice][node] bytes of the rows of a slice on a node
+};
+
+// open addressing on the data pointer, only accessed in the critical section
+static struct ggml_numa_placement * g_numa_placement = NULL;
+
+static struct ggml_numa_placement * ggml_numa_find_placement(const void * data, bool insert) {
+    if (g_numa_placement == NULL) {
+        if (!insert) {
+            return NULL;
+        }
+        g_numa_placement = calloc(GGML_NUMA_PLACEMENT_MAX, sizeof(struct ggml_numa_placement));
+        if (g_numa_placement == NULL) {
+            return NULL;
+        }
+    }
+
+    const size_t h = (size_t) (((uintptr_t) data >> 12) % GGML_NUMA_PLACEMENT_MAX);
+    for (size_t i = 0; i < GGML_NUMA_PLACEMENT_MAX; ++i) {
+        struct ggml_numa_placement * p = &g_numa_placement[(h + i) % GGML_NUMA_PLACEMENT_MAX];
+        if (p->data == data) {
+            return p;
+        }
+        if (p->data == NULL) {
+            if (!insert) {
+                return NULL;
+            }
+            p->data     = data;
+            p->resident = false;
+            return p;
+        }
+    }
+
+    // full, the weight is not accounted
+    return NULL;
+}
+
+// count the bytes of the pages of [start, end) on each node, false if some pages are not resident
+static bool ggml_numa_count_pages(uintptr_t start, uintptr_t end, uint64_t * bytes) {
+    const uintptr_t page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+
+    void * pages[256];
+    int    status[256];
+
+    bool resident = true;
+
+    uintptr_t page = start & ~(page_size - 1);
+    while (page < end) {
+        unsigned long n = 0;
+        for (; n < 256 && page + n*page_size < end; ++n) {
+            pages[n] = (void *) (page + n*page_size);
+        }
+
+        // without target nodes, move_pages only reports the node of each page
+        if (syscall(SYS_move_pages, 0, n, pages, NULL, status, 0) != 0) {
+            return false;
+        }
+
+        for (unsigned long i = 0; i < n; ++i) {
+            const uintptr_t p0 = MAX((uintptr_t) pages[i], start);
+            const uintptr_t p1 = MIN((uintptr_t) pages[i] + page_size, end);
+            if (status[i] >= 0 && status[i] < GGML_NUMA_MAX_NODES) {
+                bytes[status[i]] += p1 - p0;
+            } else {
+                resident = false;
+            }
+        }
+
+        page += n*page_size;
+    }
+
+    return resident;
+}
+
+static void ggml_numa_query_placement(const struct ggml_tensor * tensor, struct ggml_numa_placement * p) {
+    memset(p->bytes, 0, sizeof(p->bytes));
+    p->resident = true;
+
+    for (int64_t i3 = 0; i3 < tensor->ne[3]; ++i3) {
+        for (int64_t i2 = 0; i2 < tensor->ne[2]; ++i2) {
+            const uintptr_t base = (uintptr_t) tensor->data + i2*tensor->nb[2] + i3*tensor->nb[3];
+
+            for (uint32_t slice = 0; slice < g_state.numa.n_nodes; ++slice) {
+                int64_t r0, r1;
+                ggml_numa_node_rows(slice, tensor->ne[1], &r0, &r1);
+
+                if (!ggml_numa_count_pages(base + r0*tensor->nb[1], base + r1*tensor->nb[1], p->bytes[slice])) {
+                    p->resident = false;
+                }
+            }
+        }
+    }
+}
+
+static void ggml_numa_forget_placement(const struct ggml_tensor * tensor) {
+    ggml_critical_section_start();
+    struct ggml_numa_placement * p = ggml_numa_find_placement(tensor->data, false);
+    if (p) {
+        p->resident = false;
+    }
+    ggml_critical_section_end();
+}
+#else
+static void ggml_numa_forget_placement(const struct ggml_tensor * tensor) {
+    UNUSED(tensor);
+}
+#endif
+
+#if defined(__gnu_linux__) && defined(SYS_mbind)
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)
+#endif
+
+// bind the pages of [addr, addr + size) to the node and migrate the ones that are already resident
+static bool ggml_numa_bind(void * addr, size_t size, int node) {
+    unsigned long nodemask = 1ul << node;
+    return syscall(SYS_mbind, addr, size, MPOL_BIND, &nodemask, (unsigned long) GGML_NUMA_MAX_NODES + 1, MPOL_MF_MOVE) == 0;
+}
+
+void ggml_numa_place_tensor(const struct ggml_tensor * tensor) {
+    if (!ggml_numa_is_split() || tensor->data == NULL || !ggml_numa_is_split_weight(tensor)) {
+        return;
+    }
+
+    const uintptr_t page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+
+    const int64_t nrows = tensor->ne[1];
+
+    // the pages move, the traffic accounting queries their nodes again
+    ggml_numa_forget_placement(tensor);
+
+    for (int64_t i3 = 0; i3 < tensor->ne[3]; ++i3) {
+        for (int64_t i2 = 0; i2 < tensor->ne[2]; ++i2) {
+            const uintptr_t base = (uintptr_t) tensor->data + i2*tensor->nb[2] + i3*tensor->nb[3];
+
+            // a page shared by two slices goes to the node of the first one
+            for (uint32_t node = 0; node < g_state.numa.n_nodes; ++node) {
+                int64_t r0, r1;
+                ggml_numa_node_rows(node, nrows, &r0, &r1);
+
+                const uintptr_t start = node == 0 ? base & ~(page_size - 1) : GGML_PAD(base + r0*tensor->nb[1], page_size);
+                const uintptr_t end   = GGML_PAD(base + r1*tensor->nb[1], page_size);
+
+                if (end > start && !ggml_numa_bind((void *) start, end - start, node)) {
+                    GGML_LOG_WARN("%s: mbind failed for %s: %s\n", __func__, tensor->name, strerror(errno));
+                    return;
+                }
+            }
+        }
+    }
+}
+#else
+void ggml_numa_place_tensor(const struct ggml_tensor * tensor) {
+    UNUSED(tensor);
+}
+#endif
+
+#if defined(__gnu_linux__)
+void ggml_numa_get_traffic(struct ggml_numa_traffic * traffic) {
+    traffic->bytes_local  = 0;
+    traffic->bytes_remote = 0;
+    for (int node = 0; node < GGML_NUMA_MAX_NODES; ++node) {
+        traffic->bytes_local  += atomic_load_explicit(&g_state.numa_traffic[node].bytes_local,  memory_order_relaxed);
+        traffic->bytes_remote += atomic_load_explicit(&g_state.numa_traffic[node].bytes_remote, memory_order_relaxed);
+    }
+}
+
+void ggml_numa_reset_traffic(void) {
+    for (int node = 0; node < GGML_NUMA_MAX_NODES; ++node) {
+        atomic_store_explicit(&g_state.numa_traffic[node].bytes_local,  0, memory_order_relaxed);
+        atomic_store_explicit(&g_state.numa_traffic[node].bytes_remote, 0, memory_order_relaxed);
+    }
+}
+
+// account the rows [ir0_start, ir0_end) of each matrix of the weight src0 read by a thread of the node, local or
+// remote depending on the node the pages of the rows are actually on
+static void ggml_numa_add_traffic(const struct ggml_tensor * src0, int node, int64_t ir0_start, int64_t ir0_end) {
+#if defined(SYS_move_pages)
+    const int64_t nmat = src0->ne[2]*src0->ne[3];
+
+    uint64_t bytes_local  = 0;
+    uint64_t bytes_remote = 0;
+
+    ggml_critical_section_start();
+
+    struct ggml_numa_placement * p = ggml_numa_find_placement(src0->data, true);
+    if (p && !p->resident) {
+        ggml_numa_query_placement(src0, p);
+    }
+
+    for (uint32_t n = 0; p && n < g_state.numa.n_nodes; ++n) {
+        int64_t r0, r1;
+        ggml_numa_node_rows(n, src0->ne[1], &r0, &r1);
+
+        r0 = MAX(r0, ir0_start);
+        r1 = MIN(r1, ir0_end);
+        if (r1 <= r0) {
+            continue;
+        }
+
+        uint64_t slice_bytes = 0;
+        for (int k = 0; k < GGML_NUMA_MAX_NODES; ++k) {
+            slice_bytes += p->bytes[n][k];
+        }
+        if (slice_bytes == 0) {
+            continue; // not resident yet
+        }
+
+        // the rows read are assumed to be spread over the nodes like the resident pages of their slice
+        const double   share = (double) p->bytes[n][node]/slice_bytes;
+        const uint64_t bytes = (uint64_t) (r1 - r0)*src0->nb[1]*nmat;
+
+        bytes_local  += (uint64_t) (bytes*share);
+        bytes_remote += bytes - (uint64_t) (bytes*share);
+    }
+
+    ggml_critical_section_end();
+
+    if (bytes_local) {
+        atomic_fetch_add_explicit(&g_state.numa_traffic[node].bytes_local,  bytes_local,  memory_order_relaxed);
+    }
+    if (bytes_remote) {
+        atomic_fetch_add_explicit(&g_state.numa_traffic[node].bytes_remote, bytes_remote, memory_order_relaxed);
+    }
+#else
+    UNUSED(src0); UNUSED(node); UNUSED(ir0_start); UNUSED(ir0_end);
+#endif
+}
+#else
+void ggml_numa_get_traffic(struct ggml_numa_traffic * traffic) {
+    traffic->bytes_local  = 0;
+    traffic->bytes_remote = 0;
+}
+
+void ggml_numa_reset_traffic(void) {
+}
+
+static void ggml_numa_add_traffic(const struct ggml_tensor * src0, int node, int64_t ir0_start, int64_t ir0_end) {
+    UNUSED(src0); UNUSED(node); UNUSED(ir0_start); UNUSED(ir0_end);
+}
+#endif
+
 #if defined(__ARM_ARCH)
 
 #if defined(__linux__) && defined(__aarch64__)
@@ -1199,6 +1631,101 @@ static void ggml_compute_forward_mul_mat_one_chunk(
     }
 }
 
+// computes the nodes fused after a MUL_MAT (params->fused) on the rows [ir0_start, ir0_end) of the columns
+// [ir1_start, ir1_end) of its result, writing them to the last fused node
+static void ggml_compute_forward_mul_mat_epilogue(
+    const struct ggml_compute_params * params,
+    const struct ggml_tensor * dst,
+    const int64_t ir0_start,
+    const int64_t ir0_end,
+    const int64_t ir1_start,
+    const int64_t ir1_end) {
+
+    if (params->n_fused == 0 || ir0_start >= ir0_end) {
+        return;
+    }
+
+    const struct ggml_tensor * out = params->fused[params->n_fused - 1];
+
+    GGML_TENSOR_LOCALS(int64_t, ne, dst, ne)
+    GGML_TENSOR_LOCALS(size_t,  nb, dst, nb)
+
+    const int n = (int) (ir0_end - ir0_start);
+
+    for (int64_t ir1 = ir1_start; ir1 < ir1_end; ++ir1) {
+        const int64_t i3 = (ir1 / (ne2 * ne1));
+        const int64_t i2 = (ir1 - i3 * ne2 * ne1) / ne1;
+        const int64_t i1 = (ir1 - i3 * ne2 * ne1 - i2 * ne1);
+
+        const float * x = (const float *) ((const char *) dst->data + i1*nb1 + i2*nb2 + i3*nb3) + ir0_start;
+              float * y = (float *) ((char *) out->data + i1*out->nb[1] + i2*out->nb[2] + i3*out->nb[3]) + ir0_start;
+
+        for (int k = 0; k < params->n_fused; ++k) {
+            const struct ggml_tensor * node  = params->fused[k];
+            const struct ggml_tensor * prev  = k == 0 ? dst : params->fused[k - 1];
+            const struct ggml_tensor * other = node->src[0] == prev ? node->src[1] : node->src[0];
+
+            // row of the other operand, broadcast like in the binary ops
+            const float * b = other ? (const float *) ((const char *) other->data +
+                    (i1 % other->ne[1])*other->nb[1] + (i2 % other->ne[2])*other->nb[2] + (i3 % other->ne[3])*other->nb[3]) + ir0_start : NULL;
+
+            switch (node->op) {
+                case GGML_OP_ADD:
+                    ggml_vec_add_f32(n, y, x, b);
+                    break;
+                case GGML_OP_MUL:
+                    ggml_vec_mul_f32(n, y, x, b);
+                    break;
+                case GGML_OP_UNARY:
+                    switch (ggml_get_unary_op(node)) {
+                        case GGML_UNARY_OP_SILU: ggml_vec_silu_f32(n, y, x); break;
+                        case GGML_UNARY_OP_GELU: ggml_vec_gelu_f32(n, y, x); break;
+                        case GGML_UNARY_OP_RELU: ggml_vec_relu_f32(n, y, x); break;
+                        default: GGML_ABORT("fatal error");
+                    }
+                    break;
+                case GGML_OP_GLU:
+                    switch (ggml_get_glu_op(node)) {
+                        case GGML_GLU_OP_SWIGLU: ggml_vec_swiglu_f32(n, y, x, b); break;
+                        case GGML_GLU_OP_GEGLU:  ggml_vec_geglu_f32 (n, y, x, b); break;
+                        default: GGML_ABORT("fatal error");
+                    }
+                    break;
+                default:
+                    GGML_ABORT("fatal error");
+            }
+
+            x = y;
+        }
+    }
+}
+
+// epilogue after a MUL_MAT computed by llamafile_sgemm, which does not split the result like the chunks below
+static void ggml_compute_forward_mul_mat_epilogue_all(
+    const struct ggml_compute_params * params,
+    const struct ggml_tensor * dst) {
+
+    if (params->n_fused == 0) {
+        return;
+    }
+
+    const int64_t nr0 = dst->ne[0];
+    const int64_t nr1 = dst->ne[1]*dst->ne[2]*dst->ne[3];
+
+    ggml_barrier(params->threadpool);
+
+    int64_t ir0;
+    int64_t ir1;
+
+    if (nr1 >= params->nth) {
+        ggml_thread_rows(params, nr1, &ir0, &ir1);
+        ggml_compute_forward_mul_mat_epilogue(params, dst, 0, nr0, ir0, ir1);
+    } else {
+        ggml_thread_rows(params, nr0, &ir0, &ir1);
+        ggml_compute_forward_mul_mat_epilogue(params, dst, ir0, ir1, 0, nr1);
+    }
+}
+
 void ggml_compute_forward_mul_mat(
         const struct ggml_compute_params * params,
               struct ggml_tensor * dst) {
@@ -1256,6 +1783,7 @@ void ggml_compute_forward_mul_mat(
                                      src1->type,
                                      dst->type))
                     goto UseGgmlGemm1;
+        ggml_compute_forward_mul_mat_epilogue_all(params, dst);
         return;
     }
 UseGgmlGemm1:;
@@ -1298,37 +1826,6 @@ UseGgmlGemm1:;
     #endif
     }
 
-    if (ith == 0) {
-        // Every thread starts at ith, so the first unprocessed chunk is nth.  This save a bit of coordination right at the start.
-        atomic_store_explicit(&params->threadpool->current_chunk, nth, memory_order_relaxed);
-    }
-
-    ggml_barrier(params->threadpool);
-
-#if GGML_USE_LLAMAFILE
-    if (src1->type != vec_dot_type) {
-        const void* wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
-        const size_t row_size = ggml_row_size(vec_dot_type, ne10);
-
-        for (int64_t i13 = 0; i13 < ne13; i13++)
-            for (int64_t i12 = 0; i12 < ne12; i12++)
-                if (!llamafile_sgemm(params,
-                                     ne01, ne11, ne00/ggml_blck_size(src0->type),
-                                     (const char *)src0->data + i12/r2*nb02 + i13/r3*nb03,
-                                     nb01/ggml_type_size(src0->type),
-                                     (const char *)wdata + (i12*ne11 + i13*ne12*ne11)*row_size,
-                                     row_size/ggml_type_size(vec_dot_type),
-                                     (char *)dst->data + i12*nb2 + i13*nb3,
-                                     nb1/ggml_type_size(dst->type),
-                                     src0->type,
-                                     vec_dot_type,
-                                     dst->type))
-                    goto UseGgmlGemm2;
-        return;
-    }
-UseGgmlGemm2:;
-#endif
-
     // This is the size of the first dimension of the result, so we can iterate that way. (see the ASSERT above, these are the same numbers)
     const int64_t nr0 = ne0;
 
@@ -1362,12 +1859,76 @@ UseGgmlGemm2:;
     const int64_t dr0 = (nr0 + nchunk0 - 1) / nchunk0;
     const int64_t dr1 = (nr1 + nchunk1 - 1) / nchunk1;
 
-    // The first chunk comes from our thread_id, the rest will get auto-assigned.
-    int current_chunk = ith;
+    if (ith == 0) {
+        // Each thread starts with a contiguous range of chunks
+        ggml_threadpool_chunks_reset(params->threadpool, nth, (int) (nchunk0 * nchunk1));
+    }
 
-    while (current_chunk < nchunk0 * nchunk1) {
-        const int64_t ith0 = current_chunk % nchunk0;
-        const int64_t ith1 = current_chunk / nchunk0;
+    ggml_barrier(params->threadpool);
+
+#if GGML_USE_LLAMAFILE
+    if (src1->type != vec_dot_type) {
+        const void* wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
+        const size_t row_size = ggml_row_size(vec_dot_type, ne10);
+
+        for (int64_t i13 = 0; i13 < ne13; i13++)
+            for (int64_t i12 = 0; i12 < ne12; i12++)
+                if (!llamafile_sgemm(params,
+                                     ne01, ne11, ne00/ggml_blck_size(src0->type),
+                                     (const char *)src0->data + i12/r2*nb02 + i13/r3*nb03,
+                                     nb01/ggml_type_size(src0->type),
+                                     (const char *)wdata + (i12*ne11 + i13*ne12*ne11)*row_size,
+                                     row_size/ggml_type_size(vec_dot_type),
+                                     (char *)dst->data + i12*nb2 + i13*nb3,
+                                     nb1/ggml_type_size(dst->type),
+                                     src0->type,
+                                     vec_dot_type,
+                                     dst->type))
+                    goto UseGgmlGemm2;
+        ggml_compute_forward_mul_mat_epilogue_all(params, dst);
+        return;
+    }
+UseGgmlGemm2:;
+#endif
+
+    // The weights split across the NUMA nodes are computed by the threads of the node holding the rows, without stealing
+    // chunks from the other nodes
+    const bool numa_split = ggml_numa_is_split() && ggml_numa_is_split_weight(src0);
+
+    if (numa_split && nth >= (int) g_state.numa.n_nodes) {
+        const int node = ggml_numa_thread_node(ith, nth);
+
+        const int ith0 = ggml_numa_node_first_thread(node,     nth);
+        const int nth0 = ggml_numa_node_first_thread(node + 1, nth) - ith0;
+
+        int64_t node_r0, node_r1;
+        ggml_numa_node_rows(node, nr0, &node_r0, &node_r1);
+
+        // keep an even number of rows per thread for the mmla kernels
+        const int64_t dr0_node = GGML_PAD((node_r1 - node_r0 + nth0 - 1) / nth0, 2);
+
+        const int64_t ir0_start = MIN(node_r0 + dr0_node * (ith - ith0), node_r1);
+        const int64_t ir0_end   = MIN(ir0_start + dr0_node, node_r1);
+
+        if (ir0_end > ir0_start) {
+            int64_t num_rows_per_vec_dot = vec_dot_num_rows;
+            if ((nr0 % 2 != 0) || (ne11 % 2 != 0) || ((ir0_end - ir0_start) % 2 != 0) || (nr1 % 2 != 0)) {
+                num_rows_per_vec_dot = 1;
+            }
+            ggml_compute_forward_mul_mat_one_chunk(params, dst, src0->type, num_rows_per_vec_dot, ir0_start, ir0_end, 0, nr1);
+            ggml_compute_forward_mul_mat_epilogue(params, dst, ir0_start, ir0_end, 0, nr1);
+
+            ggml_numa_add_traffic(src0, node, ir0_start, ir0_end);
+        }
+        return;
+    }
+
+    // The first chunks come from the range of our thread_id, the rest are stolen from the other threads.
+    int current_chunk = ggml_threadpool_chunks_next(params->threadpool, ith, nth);
+
+    while (current_chunk >= 0) {
+        const int64_t ith0 = current_chunk % nchunk0;
+        const int64_t ith1 = current_chunk / nchunk0;
 
         const int64_t ir0_start = dr0 * ith0;
         const int64_t ir0_end = MIN(ir0_start + dr0, nr0);
@@ -1384,12 +1945,17 @@ UseGgmlGemm2:;
             num_rows_per_vec_dot = 1;
         }
         ggml_compute_forward_mul_mat_one_chunk(params, dst, src0->type, num_rows_per_vec_dot, ir0_start, ir0_end, ir1_start, ir1_end);
+        ggml_compute_forward_mul_mat_epilogue(params, dst, ir0_start, ir0_end, ir1_start, ir1_end);
+
+        if (numa_split) {
+            ggml_numa_add_traffic(src0, ggml_numa_thread_node(ith, nth), ir0_start, ir0_end);
+        }
 
         if (nth >= nchunk0 * nchunk1) {
             break;
         }
 
-        current_chunk = atomic_fetch_add_explicit(&params->threadpool->current_chunk, 1, memory_order_relaxed);
+        current_chunk = ggml_threadpool_chunks_next(params->threadpool, ith, nth);
     }
 }
 
@@ -1465,6 +2031,30 @@ static void ggml_compute_forward_mul_mat_id_one_chunk(
     }
 }
 
+// chunks of the rows of one expert
+static void ggml_mul_mat_id_chunks(int64_t nr0, int64_t nr1, int nth, int64_t * nchunk0, int64_t * nchunk1) {
+    int chunk_size = 16;
+    if (nr0 == 1 || nr1 == 1) {
+        chunk_size = 64;
+    }
+
+#if defined(__aarch64__)
+    // disable for ARM
+    const bool disable_chunking = true;
+#else
+    // disable for NUMA
+    const bool disable_chunking = ggml_is_numa();
+#endif // defined(__aarch64__)
+
+    *nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
+    *nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
+
+    if (*nchunk0 * *nchunk1 < nth * 4 || disable_chunking) {
+        *nchunk0 = nr0 > nr1 ? nth : 1;
+        *nchunk1 = nr0 > nr1 ? 1 : nth;
+    }
+}
+
 static void * incr_ptr_aligned(void ** p, size_t size, size_t align) {
 
     void * ptr = *p;
@@ -1519,8 +2109,8 @@ static void ggml_compute_forward_mul_mat_id(
     struct mmid_row_mapping * matrix_rows = // [n_as][ids->ne[0]*ids->ne[1]]
         incr_ptr_aligned(&wdata_cur, n_as*ids->ne[0]*ids->ne[1]*sizeof(struct mmid_row_mapping), sizeof(int64_t));
 
-    char (*atomic_current_chunk)[CACHE_LINE_SIZE] = // [n_as]
-        incr_ptr_aligned(&wdata_cur, CACHE_LINE_SIZE * n_as, CACHE_LINE_SIZE);
+    int64_t * expert_chunks = // [n_as + 1] first chunk of each expert in the chunks of all the experts
+        incr_ptr_aligned(&wdata_cur, (n_as + 1)*sizeof(int64_t), sizeof(int64_t));
 
     GGML_ASSERT(params->wsize >= (size_t)((char *) wdata_cur - (char *) params->wdata));
 
@@ -1576,80 +2166,67 @@ static void ggml_compute_forward_mul_mat_id(
                 matrix_row_counts[i02] += 1;
             }
         }
-    }
 
-    // reset current_chunk
-    for (int cur_a = ith; cur_a < n_as; cur_a += nth) {
-        atomic_int * current_chunk_ctr = (atomic_int *)(atomic_current_chunk + cur_a);
-        *current_chunk_ctr = nth;
+        // the chunks of all the experts are distributed together, so that the threads done with the small experts
+        // steal from the large ones
+        expert_chunks[0] = 0;
+        for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+            int64_t nchunk0 = 0;
+            int64_t nchunk1 = 0;
+            if (matrix_row_counts[cur_a] > 0) {
+                ggml_mul_mat_id_chunks(ne01, matrix_row_counts[cur_a], nth, &nchunk0, &nchunk1);
+            }
+            expert_chunks[cur_a + 1] = expert_chunks[cur_a] + nchunk0*nchunk1;
+        }
+
+        ggml_threadpool_chunks_reset(params->threadpool, nth, (int) expert_chunks[n_as]);
     }
 
     ggml_barrier(params->threadpool);
 
-    for (int cur_a = 0; cur_a < n_as; ++cur_a) {
-        const int64_t cne1 = matrix_row_counts[cur_a];
+    const void * wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
+    const size_t row_size = ggml_row_size(vec_dot_type, ne10);
 
-        if (cne1 == 0) {
-            continue;
+    int cur_a = 0;
+
+    for (int chunk = ggml_threadpool_chunks_next(params->threadpool, ith, nth); chunk >= 0;
+             chunk = ggml_threadpool_chunks_next(params->threadpool, ith, nth)) {
+        // expert of the chunk, the chunks of a range are consecutive so the search is short except after a steal
+        while (chunk < expert_chunks[cur_a]) {
+            --cur_a;
+        }
+        while (chunk >= expert_chunks[cur_a + 1]) {
+            ++cur_a;
         }
 
         const char * src0_cur = (const char *) src0->data + cur_a * nb02;
-        const void * wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
-        const size_t row_size = ggml_row_size(vec_dot_type, ne10);
 
         const int64_t nr0 = ne01;
-        const int64_t nr1 = cne1;
-
-        int chunk_size = 16;
-        if (nr0 == 1 || nr1 == 1) {
-            chunk_size = 64;
-        }
+        const int64_t nr1 = matrix_row_counts[cur_a];
 
-#if defined(__aarch64__)
-        // disable for ARM
-        const bool disable_chunking = true;
-#else
-        // disable for NUMA
-        const bool disable_chunking = ggml_is_numa();
-#endif // defined(__aarch64__)
-
-        int64_t nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
-        int64_t nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
-
-        if (nchunk0 * nchunk1 < nth * 4 || disable_chunking) {
-            nchunk0 = nr0 > nr1 ? nth : 1;
-            nchunk1 = nr0 > nr1 ? 1 : nth;
-        }
+        int64_t nchunk0;
+        int64_t nchunk1;
+        ggml_mul_mat_id_chunks(nr0, nr1, nth, &nchunk0, &nchunk1);
 
         const int64_t dr0 = (nr0 + nchunk0 - 1) / nchunk0;
         const int64_t dr1 = (nr1 + nchunk1 - 1) / nchunk1;
 
-        int current_chunk = ith;
+        const int64_t current_chunk = chunk - expert_chunks[cur_a];
 
-        atomic_int * current_chunk_ctr = (atomic_int *)(atomic_current_chunk + cur_a);
-
-        while (current_chunk < nchunk0 * nchunk1) {
-            const int64_t ith0 = current_chunk % nchunk0;
-            const int64_t ith1 = current_chunk / nchunk0;
-
-            const int64_t ir0_start = dr0 * ith0;
-            const int64_t ir0_end = MIN(ir0_start + dr0, nr0);
-
-            const int64_t ir1_start = dr1 * ith1;
-            const int64_t ir1_end = MIN(ir1_start + dr1, nr1);
+        const int64_t ith0 = current_chunk % nchunk0;
+        const int64_t ith1 = current_chunk / nchunk0;
 
-            ggml_compute_forward_mul_mat_id_one_chunk(
-                dst, src0, src1, ids, cur_a,
-                ir0_start, ir0_end, ir1_start, ir1_end,
-                src0_cur, matrix_rows, row_size, src1_cont, wdata
-            );
+        const int64_t ir0_start = dr0 * ith0;
+        const int64_t ir0_end = MIN(ir0_start + dr0, nr0);
 
-            if (nth >= nchunk0 * nchunk1) {
-                break;
-            }
+        const int64_t ir1_start = dr1 * ith1;
+        const int64_t ir1_end = MIN(ir1_start + dr1, nr1);
 
-            current_chunk = atomic_fetch_add_explicit(current_chunk_ctr, 1, memory_order_relaxed);
-        }
+        ggml_compute_forward_mul_mat_id_one_chunk(
+            dst, src0, src1, ids, cur_a,
+            ir0_start, ir0_end, ir1_start, ir1_end,
+            src0_cur, matrix_rows, row_size, src1_cont, wdata
+        );
     }
 }
 
@@ -2040,7 +2617,7 @@ static void ggml_compute_forward(struct ggml_compute_params * params, struct ggm
 
 // Android's libc implementation "bionic" does not support setting affinity
 #if defined(__gnu_linux__)
-static void set_numa_thread_affinity(int thread_n) {
+static void set_numa_thread_affinity(int thread_n, int n_threads) {
     if (!ggml_is_numa()) {
         return;
     }
@@ -2054,6 +2631,10 @@ static void set_numa_thread_affinity(int thread_n) {
             // run thread on node_num thread_n / (threads per node)
             node_num = thread_n % g_state.numa.n_nodes;
             break;
+        case GGML_NUMA_STRATEGY_SPLIT:
+            // run thread on the node whose slice of the weights it computes
+            node_num = ggml_numa_thread_node(thread_n, n_threads);
+            break;
         case GGML_NUMA_STRATEGY_ISOLATE:
             // run thread on current_node
             node_num = g_state.numa.current_node;
@@ -2108,10 +2689,116 @@ static void clear_numa_thread_affinity(void) {
 #else
 // TODO: Windows etc.
 // (the linux implementation may also work on BSD, someone should test)
-static void set_numa_thread_affinity(int thread_n) { UNUSED(thread_n);  }
+static void set_numa_thread_affinity(int thread_n, int n_threads) { UNUSED(thread_n); UNUSED(n_threads); }
 static void clear_numa_thread_affinity(void) {}
 #endif
 
+#if defined(__gnu_linux__)
+static uint64_t ggml_cpu_read_sysfs(int cpu, const char * name) {
+    char path[256];
+    int rv = snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", cpu, name);
+    GGML_ASSERT(rv > 0 && (unsigned)rv < sizeof(path));
+
+    FILE * fptr = fopen(path, "r");
+    if (fptr == NULL) {
+        return 0;
+    }
+
+    unsigned long long value = 0;
+    if (fscanf(fptr, "%llu", &value) != 1) {
+        value = 0;
+    }
+    fclose(fptr);
+
+    return value;
+}
+
+// relative performance of the CPUs from the scheduler capacity (Arm, recent x86 kernels) or from the maximum frequency
+static void ggml_cpu_capacity_init(void) {
+    uint64_t value[GGML_NUMA_MAX_CPUS] = {0};
+
+    int n_cpus = 0;
+    for (; n_cpus < GGML_NUMA_MAX_CPUS; ++n_cpus) {
+        struct stat st;
+        char path[256];
+        int rv = snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", n_cpus);
+        GGML_ASSERT(rv > 0 && (unsigned)rv < sizeof(path));
+        if (stat(path, &st) != 0) {
+            break;
+        }
+    }
+
+    // use the same source for all the CPUs, the two are on different scales
+    const char * sources[] = { "cpu_capacity", "cpufreq/cpuinfo_max_freq" };
+
+    for (size_t i = 0; i < sizeof(sources)/sizeof(sources[0]); ++i) {
+        bool complete = n_cpus > 0;
+        for (int c = 0; c < n_cpus && complete; ++c) {
+            value[c] = ggml_cpu_read_sysfs(c, sources[i]);
+            complete = value[c] > 0;
+        }
+        if (complete) {
+            break;
+        }
+        memset(value, 0, sizeof(value));
+    }
+
+    uint64_t max = 0;
+    for (int c = 0; c < n_cpus; ++c) {
+        max = MAX(max, value[c]);
+    }
+
+    bool hybrid = false;
+    for (int c = 0; c < n_cpus && max > 0; ++c) {
+        g_state.cpu_capacity[c] = (uint16_t) MAX(1, value[c]*GGML_CPU_CAPACITY_SCALE/max);
+        hybrid = hybrid || g_state.cpu_capacity[c] < GGML_CPU_CAPACITY_SAME;
+    }
+
+    g_state.cpu_hybrid = hybrid && getenv("GGML_CPU_DISABLE_HYBRID") == NULL;
+
+    GGML_PRINT_DEBUG("%s: %d CPUs, hybrid = %d\n", __func__, n_cpus, g_state.cpu_hybrid);
+}
+
+// capacity of the CPU the calling thread runs on, 0 = unknown
+static int ggml_cpu_capacity_current(void) {
+    const int cpu = sched_getcpu();
+    return cpu >= 0 && cpu < GGML_NUMA_MAX_CPUS ? g_state.cpu_capacity[cpu] : 0;
+}
+#else
+// TODO: hybrid CPUs on Windows (GetSystemCpuSetInformation, EfficiencyClass) and Apple (hw.perflevel)
+static void ggml_cpu_capacity_init(void) {}
+static int ggml_cpu_capacity_current(void) { return 0; }
+#endif
+
+// split the rows between the threads in proportion to the capacity of their CPUs, see ggml_thread_rows
+// returns false if the split would be equal or a capacity is unknown
+static bool ggml_cpu_row_split(const int * capacity, int n_threads, uint32_t * row_split) {
+    int64_t sum = 0;
+    bool same = true;
+
+    for (int i = 0; i < n_threads; ++i) {
+        if (capacity[i] <= 0) {
+            return false;
+        }
+        sum += capacity[i];
+        same = same && capacity[i] == capacity[0];
+    }
+
+    if (same) {
+        return false;
+    }
+
+    int64_t acc = 0;
+
+    row_split[0] = 0;
+    for (int i = 0; i < n_threads; ++i) {
+        acc += capacity[i];
+        row_split[i + 1] = (uint32_t) ((acc*GGML_ROW_SPLIT_ONE)/sum);
+    }
+
+    return true;
+}
+
 static int ggml_get_n_tasks(struct ggml_tensor * node, int n_threads) {
     int n_tasks = 0;
 
@@ -2607,6 +3294,10 @@ void ggml_threadpool_free(struct ggml_threadpool* threadpool) {
 
     const size_t workers_size = sizeof(struct ggml_compute_state) * n_threads;
     ggml_aligned_free(threadpool->workers, workers_size);
+    ggml_aligned_free(threadpool->chunks, sizeof(struct ggml_chunk_range) * n_threads);
+    free(threadpool->node_plan);
+    free(threadpool->node_cycles_buf);
+    free(threadpool->capacity);
     ggml_aligned_free(threadpool, sizeof(struct ggml_threadpool));
 }
 
@@ -2649,6 +3340,36 @@ void ggml_threadpool_resume(struct ggml_threadpool * threadpool) {
 #endif
 }
 
+void ggml_threadpool_set_wait(struct ggml_threadpool * threadpool, enum ggml_threadpool_wait wait) {
+    atomic_store_explicit(&threadpool->wait, (int) wait, memory_order_relaxed);
+}
+
+void ggml_threadpool_get_wake_stats(struct ggml_threadpool * threadpool, struct ggml_threadpool_wake_stats * stats) {
+    memset(stats, 0, sizeof(*stats));
+#ifndef GGML_USE_OPENMP
+    for (int j = 1; j < threadpool->n_threads_max; j++) {
+        const struct ggml_threadpool_wake_stats * wake = &threadpool->workers[j].wake;
+        stats->n_poll  += wake->n_poll;
+        stats->n_sleep += wake->n_sleep;
+        for (int i = 0; i < GGML_THREADPOOL_WAKE_HIST; i++) {
+            stats->hist[i] += wake->hist[i];
+        }
+    }
+#else
+    UNUSED(threadpool);
+#endif
+}
+
+void ggml_threadpool_reset_wake_stats(struct ggml_threadpool * threadpool) {
+#ifndef GGML_USE_OPENMP
+    for (int j = 1; j < threadpool->n_threads_max; j++) {
+        memset(&threadpool->workers[j].wake, 0, sizeof(struct ggml_threadpool_wake_stats));
+    }
+#else
+    UNUSED(threadpool);
+#endif
+}
+
 struct ggml_cplan ggml_graph_plan(
           const struct ggml_cgraph * cgraph,
                                int   n_threads,
@@ -2732,8 +3453,8 @@ struct ggml_cplan ggml_graph_plan(
                         cur += n_as * sizeof(int64_t) + sizeof(int64_t);
                         // matrix_rows
                         cur += n_as*ids->ne[0]*ids->ne[1]*sizeof(struct mmid_row_mapping) + sizeof(int64_t);
-                        // atomic_current_chunk
-                        cur += CACHE_LINE_SIZE*n_as + CACHE_LINE_SIZE;
+                        // expert_chunks
+                        cur += (n_as + 1)*sizeof(int64_t) + sizeof(int64_t);
                     } break;
                 case GGML_OP_OUT_PROD:
                     {
@@ -2796,6 +3517,10 @@ struct ggml_cplan ggml_graph_plan(
                         const int64_t ne20 = node->src[2]->ne[0]; // DV
 
                         cur = sizeof(float)*(1*ne10 + 2*ne20)*n_tasks; // 1x head size K + 2x head size V (per thread)
+
+                        if (node->src[0]->ne[1] >= GGML_FA_TILE_Q_MIN) {
+                            cur = MAX(cur, sizeof(float)*GGML_FA_TILED_WORK_SIZE(ne10, ne20)*n_tasks);
+                        }
                     } break;
                 case GGML_OP_FLASH_ATTN_BACK:
                     {
@@ -2842,6 +3567,256 @@ struct ggml_cplan ggml_graph_plan(
     return cplan;
 }
 
+// Barrier elision
+
+// max nodes computed between two barriers
+#define GGML_SYNC_WINDOW 8
+
+static bool ggml_graph_node_is_nop(const struct ggml_tensor * node) {
+    switch (node->op) {
+        case GGML_OP_NONE:
+        case GGML_OP_VIEW:
+        case GGML_OP_RESHAPE:
+        case GGML_OP_PERMUTE:
+        case GGML_OP_TRANSPOSE:
+            return true;
+        default:
+            return ggml_is_empty(node);
+    }
+}
+
+// ops that split their rows statically across the threads and use neither the work buffer nor the chunks of the
+// threadpool, so that the threads can start them while the other threads are still computing the previous nodes
+static bool ggml_graph_node_is_static(const struct ggml_tensor * node) {
+    if (node->src[0] && node->src[0]->extra) {
+        // may be computed by an extra buffer type
+        return false;
+    }
+
+    switch (node->op) {
+        case GGML_OP_ADD:
+        case GGML_OP_SUB:
+        case GGML_OP_MUL:
+        case GGML_OP_DIV:
+            return !ggml_is_quantized(node->src[0]->type) && !ggml_is_quantized(node->src[1]->type) && !ggml_is_quantized(node->type);
+        case GGML_OP_DUP:
+        case GGML_OP_CPY:
+        case GGML_OP_CONT:
+            return !ggml_is_quantized(node->src[0]->type) && !ggml_is_quantized(node->type);
+        case GGML_OP_SCALE:
+        case GGML_OP_NORM:
+        case GGML_OP_RMS_NORM:
+        case GGML_OP_GET_ROWS:
+        case GGML_OP_SET_ROWS:
+        case GGML_OP_UNARY:
+        case GGML_OP_GLU:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool ggml_tensor_data_overlap(const struct ggml_tensor * a, const struct ggml_tensor * b) {
+    if (a == NULL || b == NULL || a->data == NULL || b->data == NULL) {
+        return false;
+    }
+
+    const char * a0 = (const char *) a->data;
+    const char * b0 = (const char *) b->data;
+
+    return a0 < b0 + ggml_nbytes(b) && b0 < a0 + ggml_nbytes(a);
+}
+
+// true if node reads what prev writes, writes what prev reads or writes the same memory
+static bool ggml_graph_node_depends(const struct ggml_tensor * node, const struct ggml_tensor * prev) {
+    if (ggml_tensor_data_overlap(node, prev)) {
+        return true;
+    }
+    for (int i = 0; i < GGML_MAX_SRC; ++i) {
+        if (ggml_tensor_data_overlap(node->src[i], prev) || ggml_tensor_data_overlap(node, prev->src[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Fusion
+
+// max nodes computed in the epilogue of a MUL_MAT
+#define GGML_MAX_FUSED 4
+
+static bool ggml_tensor_same_or_disjoint(const struct ggml_tensor * a, const struct ggml_tensor * b) {
+    return !ggml_tensor_data_overlap(a, b) || (a->data == b->data && ggml_are_same_layout(a, b));
+}
+
+// nodes[i + k] with k > 0 as the last node of the epilogue of the MUL_MAT nodes[i]: its result is computed from the
+// rows of the MUL_MAT and of the other operands only, without the intermediate nodes
+static bool ggml_graph_node_can_fuse_mul_mat(const struct ggml_cgraph * cgraph, int i, int k) {
+    const struct ggml_tensor * mm   = cgraph->nodes[i];
+    const struct ggml_tensor * node = cgraph->nodes[i + k];
+    const struct ggml_tensor * prev = cgraph->nodes[i + k - 1];
+
+    if (node->type != GGML_TYPE_F32) {
+        return false;
+    }
+
+    switch (node->op) {
+        case GGML_OP_ADD:
+        case GGML_OP_MUL:
+            break;
+        case GGML_OP_UNARY:
+            switch (ggml_get_unary_op(node)) {
+                case GGML_UNARY_OP_SILU:
+                case GGML_UNARY_OP_GELU:
+                case GGML_UNARY_OP_RELU:
+                    break;
+                default:
+                    return false;
+            }
+            break;
+        case GGML_OP_GLU:
+            switch (ggml_get_glu_op(node)) {
+                case GGML_GLU_OP_SWIGLU:
+                case GGML_GLU_OP_GEGLU:
+                    // only the split form, with the MUL_MAT as the activated half
+                    if (node->src[0] != prev || node->src[1] == NULL) {
+                        return false;
+                    }
+                    break;
+                default:
+                    return false;
+            }
+            break;
+        default:
+            return false;
+    }
+
+    const struct ggml_tensor * other = node->src[0] == prev ? node->src[1] : node->src[0];
+    if (other) {
+        if (other->type != GGML_TYPE_F32 || other->nb[0] != sizeof(float) || other->ne[0] != node->ne[0] ||
+            !ggml_can_repeat(other, node) || ggml_tensor_data_overlap(other, mm)) {
+            return false;
+        }
+    }
+
+    if (!ggml_is_contiguous(node) || ggml_tensor_data_overlap(node, mm->src[0]) || ggml_tensor_data_overlap(node, mm->src[1]) ||
+        !ggml_tensor_same_or_disjoint(node, mm)) {
+        return false;
+    }
+
+    // the other operands are read after the result of the previous nodes is written, only the first one can share it
+    for (int j = 1; j <= k; ++j) {
+        const struct ggml_tensor * n = cgraph->nodes[i + j];
+        const struct ggml_tensor * o = n->src[0] == cgraph->nodes[i + j - 1] ? n->src[1] : n->src[0];
+        if (o && ggml_tensor_data_overlap(o, node) && (j > 1 || !ggml_tensor_same_or_disjoint(o, node))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// number of nodes following nodes[i] that are computed together with it
+static int ggml_graph_node_n_fused(const struct ggml_cgraph * cgraph, int i) {
+    const struct ggml_tensor * node = cgraph->nodes[i];
+
+    if (g_state.disable_fusion || (node->src[0] && node->src[0]->extra)) {
+        return 0;
+    }
+
+    switch (node->op) {
+        case GGML_OP_MUL_MAT:
+            {
+                if (node->type != GGML_TYPE_F32 || !ggml_is_contiguous(node)) {
+                    return 0;
+                }
+
+                enum ggml_op ops[GGML_MAX_FUSED + 1] = { GGML_OP_MUL_MAT };
+
+                int n_fused = 0;
+                for (int k = 1; k <= GGML_MAX_FUSED && i + k < cgraph->n_nodes; ++k) {
+                    ops[k] = cgraph->nodes[i + k]->op;
+                    if (!ggml_can_fuse(cgraph, i, ops, k + 1) || !ggml_graph_node_can_fuse_mul_mat(cgraph, i, k)) {
+                        break;
+                    }
+                    n_fused = k;
+                }
+                return n_fused;
+            }
+        case GGML_OP_RMS_NORM:
+            {
+                const enum ggml_op ops[2] = { GGML_OP_RMS_NORM, GGML_OP_MUL };
+                if (!ggml_can_fuse(cgraph, i, ops, 2)) {
+                    return 0;
+                }
+
+                const struct ggml_tensor * mul = cgraph->nodes[i + 1];
+                const struct ggml_tensor * w   = mul->src[0] == node ? mul->src[1] : mul->src[0];
+
+                // the weights are read after the result is scaled in place
+                if (node->src[0]->type != GGML_TYPE_F32 || node->type != GGML_TYPE_F32 || mul->type != GGML_TYPE_F32 ||
+                    w->type != GGML_TYPE_F32 || w->nb[0] != sizeof(float) || mul->nb[0] != sizeof(float) ||
+                    w->ne[0] != mul->ne[0] || !ggml_can_repeat(w, mul) ||
+                    ggml_tensor_data_overlap(w, mul) || !ggml_tensor_same_or_disjoint(mul, node->src[0])) {
+                    return 0;
+                }
+                return 1;
+            }
+        default:
+            return 0;
+    }
+}
+
+// plan[i].sync is false when node i can be started before all the threads are done with the nodes since the last
+// barrier: it is a static op that does not touch the memory of these nodes. The nodes that are not static always
+// start after a barrier since they share the work buffer and the chunks. A fused group of nodes is planned as one node
+static void ggml_graph_compute_node_plan(const struct ggml_cgraph * cgraph, struct ggml_cpu_node_plan * plan, bool elide_barriers) {
+    const struct ggml_tensor * window[GGML_SYNC_WINDOW];
+    int n_window = 0;
+
+    for (int i = 0; i < cgraph->n_nodes; ++i) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+
+        const int n_fused = ggml_graph_node_n_fused(cgraph, i);
+
+        plan[i].n_fused = (uint8_t) n_fused;
+        for (int k = 1; k <= n_fused; ++k) {
+            plan[i + k].sync    = false;
+            plan[i + k].n_fused = 0;
+        }
+
+        if (!elide_barriers) {
+            plan[i].sync = true;
+            i += n_fused;
+            continue;
+        }
+
+        if (n_fused == 0 && ggml_graph_node_is_nop(node)) {
+            plan[i].sync = false;
+            continue;
+        }
+
+        bool sync = n_window + n_fused + 1 > GGML_SYNC_WINDOW;
+        for (int k = 0; k <= n_fused && !sync; ++k) {
+            sync = !ggml_graph_node_is_static(cgraph->nodes[i + k]);
+            for (int j = 0; j < n_window && !sync; ++j) {
+                sync = ggml_graph_node_depends(cgraph->nodes[i + k], window[j]);
+            }
+        }
+
+        if (sync) {
+            n_window = 0;
+        }
+
+        plan[i].sync = sync;
+        for (int k = 0; k <= n_fused; ++k) {
+            window[n_window++] = cgraph->nodes[i + k];
+        }
+
+        i += n_fused;
+    }
+}
+
 static thread_ret_t ggml_graph_compute_thread(void * data) {
     struct ggml_compute_state * state = (struct ggml_compute_state *) data;
     struct ggml_threadpool    * tp    = state->threadpool;
@@ -2849,7 +3824,7 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
     const struct ggml_cgraph * cgraph = tp->cgraph;
     const struct ggml_cplan  * cplan  = tp->cplan;
 
-    set_numa_thread_affinity(state->ith);
+    set_numa_thread_affinity(state->ith, atomic_load_explicit(&tp->n_threads_cur, memory_order_relaxed));
 
     struct ggml_compute_params params = {
         /*.ith       =*/ state->ith,
@@ -2857,12 +3832,53 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
         /*.wsize     =*/ cplan->work_size,
         /*.wdata     =*/ cplan->work_data,
         /*.threadpool=*/ tp,
+        /*.fused     =*/ NULL,
+        /*.n_fused   =*/ 0,
+        /*.row_split =*/ NULL,
     };
 
+    // hybrid CPU: the threads may migrate between the graphs, the split is computed from the CPUs they start on
+    uint32_t row_split[GGML_MAX_N_THREADS + 1];
+
+    if (tp->hybrid && params.nth > 1) {
+        tp->capacity[state->ith] = ggml_cpu_capacity_current();
+        ggml_barrier(tp);
+        if (ggml_cpu_row_split(tp->capacity, params.nth, row_split)) {
+            params.row_split = row_split;
+        }
+    }
+
+    uint64_t busy = 0;
+
+    uint64_t * node_cycles = tp->node_cycles ? tp->node_cycles + (size_t) state->ith*cgraph->n_nodes : NULL;
+    uint64_t * node_stamps = tp->node_cycles && state->ith == 0 ? tp->node_cycles + (size_t) cplan->n_threads*cgraph->n_nodes : NULL;
+
     for (int node_n = 0; node_n < cgraph->n_nodes && atomic_load_explicit(&tp->abort, memory_order_relaxed) != node_n; node_n++) {
         struct ggml_tensor * node = cgraph->nodes[node_n];
 
-        ggml_compute_forward(&params, node);
+        params.n_fused = tp->node_plan[node_n].n_fused;
+        params.fused   = params.n_fused > 0 ? cgraph->nodes + node_n + 1 : NULL;
+
+        if (node_cycles) {
+            const uint64_t t0 = ggml_cpu_cycles();
+
+            ggml_compute_forward(&params, node);
+
+            node_cycles[node_n] = ggml_cpu_cycles() - t0;
+            if (node_stamps) {
+                node_stamps[node_n] = t0;
+            }
+        } else if (cplan->thread_busy_ns) {
+            const uint64_t t0 = ggml_cpu_cycles();
+
+            ggml_compute_forward(&params, node);
+
+            busy += ggml_cpu_cycles() - t0;
+        } else {
+            ggml_compute_forward(&params, node);
+        }
+
+        node_n += params.n_fused;
 
         if (state->ith == 0 && cplan->abort_callback &&
                 cplan->abort_callback(cplan->abort_callback_data)) {
@@ -2870,13 +3886,27 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
             tp->ec    = GGML_STATUS_ABORTED;
         }
 
-        if (node_n + 1 < cgraph->n_nodes) {
+        if (node_n + 1 < cgraph->n_nodes && tp->node_plan[node_n + 1].sync) {
             ggml_barrier(state->threadpool);
         }
     }
 
+    // before the barrier, the caller reads the times as soon as thread 0 returns
+    if (cplan->thread_busy_ns) {
+        if (node_cycles) {
+            for (int i = 0; i < cgraph->n_nodes; i++) {
+                busy += node_cycles[i];
+            }
+        }
+        cplan->thread_busy_ns[state->ith] = (int64_t) (busy*ggml_cpu_cycles_ns());
+    }
+
     ggml_barrier(state->threadpool);
 
+    if (node_stamps) {
+        node_stamps[cgraph->n_nodes] = ggml_cpu_cycles();
+    }
+
     return 0;
 }
 
@@ -2924,6 +3954,19 @@ static inline bool ggml_graph_compute_poll_for_work(struct ggml_compute_state *
         return state->pending;
     }
 
+    if (atomic_load_explicit(&threadpool->wait, memory_order_relaxed) == GGML_THREADPOOL_WAIT_ADAPTIVE) {
+        const int64_t t_end = ggml_time_us() + atomic_load_explicit(&threadpool->spin_us, memory_order_relaxed);
+
+        for (uint32_t i = 1; !ggml_graph_compute_thread_ready(state); i++) {
+            ggml_thread_cpu_relax();
+            if (i % 64 == 0 && ggml_time_us() >= t_end) {
+                break;
+            }
+        }
+
+        return state->pending;
+    }
+
     // This seems to make 0 ... 100 a decent range for polling level across modern processors.
     // Perhaps, we can adjust it dynamically based on load and things.
     const uint64_t n_rounds = 1024UL * 128 * threadpool->poll;
@@ -2945,16 +3988,42 @@ static inline bool ggml_graph_compute_check_for_work(struct ggml_compute_state *
     }
 
     ggml_mutex_lock_shared(&threadpool->mutex);
+    // the main thread checks n_sleeping after publishing the graph, see ggml_graph_compute_kickoff
+    atomic_fetch_add_explicit(&threadpool->n_sleeping, 1, memory_order_seq_cst);
+    ggml_graph_compute_thread_sync(state);
     while (!ggml_graph_compute_thread_ready(state)) {
         // No new work. Wait for the signal.
         GGML_PRINT_DEBUG("thread #%d waiting for work (sleeping)\n", state->ith);
+        state->slept = true;
         ggml_cond_wait(&threadpool->cond, &threadpool->mutex);
     }
+    atomic_fetch_add_explicit(&threadpool->n_sleeping, -1, memory_order_relaxed);
     ggml_mutex_unlock_shared(&threadpool->mutex);
 
     return state->pending;
 }
 
+// wake-up latency of a worker, from the start of the graph by the main thread
+static void ggml_threadpool_wake_record(struct ggml_compute_state * state) {
+    const struct ggml_threadpool * threadpool = state->threadpool;
+
+    const uint64_t t_now = ggml_cpu_cycles();
+    const uint64_t ns    = t_now > threadpool->t_kickoff ? (uint64_t) ((t_now - threadpool->t_kickoff)*threadpool->ns_per_cycle) : 0;
+
+    int i = 0;
+    while (i < GGML_THREADPOOL_WAKE_HIST - 1 && ns >= (256ull << i)) {
+        i++;
+    }
+
+    state->wake.hist[i]++;
+    if (state->slept) {
+        state->wake.n_sleep++;
+    } else {
+        state->wake.n_poll++;
+    }
+    state->slept = false;
+}
+
 static thread_ret_t ggml_graph_compute_secondary_thread(void* data) {
     struct ggml_compute_state * state = (struct ggml_compute_state *) data;
     struct ggml_threadpool * threadpool = state->threadpool;
@@ -2986,6 +4055,10 @@ static thread_ret_t ggml_graph_compute_secondary_thread(void* data) {
         if (state->pending) {
             state->pending = false;
 
+            if (threadpool->ns_per_cycle > 0.0) {
+                ggml_threadpool_wake_record(state);
+            }
+
             ggml_graph_compute_thread(state);
         }
     }
@@ -2993,14 +4066,54 @@ static thread_ret_t ggml_graph_compute_secondary_thread(void* data) {
     return (thread_ret_t) 0;
 }
 
+// adaptive wait: while the graphs come back-to-back the workers poll for twice the average time between them,
+// otherwise they go to sleep after a short poll
+static void ggml_threadpool_update_spin(struct ggml_threadpool * threadpool) {
+    if (threadpool->t_done > 0) {
+        const int64_t gap = ggml_time_us() - threadpool->t_done;
+        threadpool->gap_avg = threadpool->gap_avg > 0 ? (3*threadpool->gap_avg + gap)/4 : gap;
+    }
+
+    int64_t spin_us = GGML_THREADPOOL_SPIN_MIN_US;
+    if (threadpool->gap_avg <= GGML_THREADPOOL_SPIN_MAX_US) {
+        spin_us = MIN(MAX(2*threadpool->gap_avg, GGML_THREADPOOL_SPIN_MIN_US), GGML_THREADPOOL_SPIN_MAX_US);
+    }
+
+    atomic_store_explicit(&threadpool->spin_us, (int) spin_us, memory_order_relaxed);
+}
+
 // Start processing new graph
 static void ggml_graph_compute_kickoff(struct ggml_threadpool * threadpool, int n_threads)
 {
-    // Always take the mutex here because the worker threads are doing hybrid poll/wait
+    GGML_PRINT_DEBUG("threadpool: n_threads_cur %d n_threads %d\n", threadpool->n_threads_cur, n_threads);
 
-    ggml_mutex_lock(&threadpool->mutex);
+    if (atomic_load_explicit(&threadpool->wait, memory_order_relaxed) == GGML_THREADPOOL_WAIT_ADAPTIVE) {
+        ggml_threadpool_update_spin(threadpool);
+    }
 
-    GGML_PRINT_DEBUG("threadpool: n_threads_cur %d n_threads %d\n", threadpool->n_threads_cur, n_threads);
+    threadpool->t_kickoff = ggml_cpu_cycles();
+
+    if (threadpool->pause) {
+        ggml_mutex_lock(&threadpool->mutex);
+
+        // Update the number of active threads
+        atomic_store_explicit(&threadpool->n_threads_cur, n_threads, memory_order_relaxed);
+
+        // Indicate the graph is ready to be processed
+        atomic_fetch_add_explicit(&threadpool->n_graph, 1, memory_order_seq_cst);
+
+        // Update main thread prio and affinity to match the threadpool settings
+        ggml_thread_apply_priority(threadpool->prio);
+        if (ggml_thread_cpumask_is_valid(threadpool->workers[0].cpumask)) {
+            ggml_thread_apply_affinity(threadpool->workers[0].cpumask);
+        }
+
+        // resume does cond broadcast
+        ggml_threadpool_resume_locked(threadpool);
+
+        ggml_mutex_unlock(&threadpool->mutex);
+        return;
+    }
 
     // Update the number of active threads
     atomic_store_explicit(&threadpool->n_threads_cur, n_threads, memory_order_relaxed);
@@ -3009,20 +4122,14 @@ static void ggml_graph_compute_kickoff(struct ggml_threadpool * threadpool, int
     // We need the full seq-cst fence here because of the polling threads (used in thread_sync)
     atomic_fetch_add_explicit(&threadpool->n_graph, 1, memory_order_seq_cst);
 
-    if (threadpool->pause) {
-       // Update main thread prio and affinity to match the threadpool settings
-       ggml_thread_apply_priority(threadpool->prio);
-       if (ggml_thread_cpumask_is_valid(threadpool->workers[0].cpumask)) {
-           ggml_thread_apply_affinity(threadpool->workers[0].cpumask);
-       }
-
-       // resume does cond broadcast
-       ggml_threadpool_resume_locked(threadpool);
-    } else {
-       ggml_cond_broadcast(&threadpool->cond);
+    // The polling workers pick up the graph by themselves, the mutex is only needed to wake up the sleeping ones.
+    // A worker that is about to sleep increments n_sleeping before checking n_graph, so that either it sees the
+    // new graph or we see it
+    if (atomic_load_explicit(&threadpool->n_sleeping, memory_order_seq_cst) > 0) {
+        ggml_mutex_lock(&threadpool->mutex);
+        ggml_cond_broadcast(&threadpool->cond);
+        ggml_mutex_unlock(&threadpool->mutex);
     }
-
-    ggml_mutex_unlock(&threadpool->mutex);
 }
 
 #endif // GGML_USE_OPENMP
@@ -3040,7 +4147,7 @@ static struct ggml_threadpool * ggml_threadpool_new_impl(
         threadpool->n_graph          = 0;
         threadpool->n_barrier        = 0;
         threadpool->n_barrier_passed = 0;
-        threadpool->current_chunk    = 0;
+        threadpool->chunks           = NULL;
         threadpool->stop             = false;
         threadpool->pause            = tpp->paused;
         threadpool->abort            = -1;
@@ -3049,7 +4156,28 @@ static struct ggml_threadpool * ggml_threadpool_new_impl(
         threadpool->n_threads_cur    = tpp->n_threads;
         threadpool->poll             = tpp->poll;
         threadpool->prio             = tpp->prio;
+        threadpool->wait             = GGML_THREADPOOL_WAIT_POLL;
+        threadpool->spin_us          = GGML_THREADPOOL_SPIN_MIN_US;
+        threadpool->n_sleeping       = 0;
+        threadpool->t_kickoff        = 0;
+        threadpool->t_done           = 0;
+        threadpool->gap_avg          = 0;
+        threadpool->ns_per_cycle     = 0.0;
+        threadpool->hybrid           = g_state.cpu_hybrid;
+        threadpool->capacity         = NULL;
         threadpool->ec               = GGML_STATUS_SUCCESS;
+        threadpool->node_cycles      = NULL;
+        threadpool->node_cycles_buf  = NULL;
+        threadpool->node_cycles_size = 0;
+        threadpool->node_plan        = NULL;
+        threadpool->node_plan_size   = 0;
+    }
+
+    threadpool->chunks = ggml_aligned_malloc(sizeof(struct ggml_chunk_range) * tpp->n_threads);
+    memset(threadpool->chunks, 0, sizeof(struct ggml_chunk_range) * tpp->n_threads);
+
+    if (threadpool->hybrid) {
+        threadpool->capacity = calloc(tpp->n_threads, sizeof(int));
     }
 
     // Allocate and init workers state
@@ -3095,7 +4223,98 @@ static struct ggml_threadpool * ggml_threadpool_new_impl(
 }
 
 struct ggml_threadpool * ggml_threadpool_new(struct ggml_threadpool_params * tpp) {
-    return ggml_threadpool_new_impl(tpp, NULL, NULL);
+    // detects the core classes
+    ggml_cpu_init();
+
+    struct ggml_threadpool * threadpool = ggml_threadpool_new_impl(tpp, NULL, NULL);
+
+    // only the persistent threadpools measure the wake-ups, the calibration is done once per process
+    threadpool->ns_per_cycle = ggml_cpu_cycles_ns();
+
+    return threadpool;
+}
+
+static bool ggml_op_is_noop(enum ggml_op op) {
+    switch (op) {
+        case GGML_OP_NONE:
+        case GGML_OP_RESHAPE:
+        case GGML_OP_TRANSPOSE:
+        case GGML_OP_VIEW:
+        case GGML_OP_PERMUTE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// reduce the per-thread cycle counts to per-node times
+// the cycles of a fused group of nodes are counted on its first node, the time of the group is shared by its nodes in
+// proportion to their bytes
+static void ggml_graph_compute_timing(
+        const struct ggml_cgraph        * cgraph,
+               struct ggml_cplan        * cplan,
+        const struct ggml_cpu_node_plan * plan,
+                  const uint64_t        * node_cycles,
+                             int          n_done) {
+    const int n_nodes   = cgraph->n_nodes;
+    const int n_threads = cplan->n_threads;
+
+    const uint64_t * node_stamps = node_cycles + (size_t) n_threads*n_nodes;
+
+    const double ns_per_cycle = ggml_cpu_cycles_ns();
+
+    for (int i = 0; i < n_nodes; i++) {
+        struct ggml_cpu_node_timing * timing = &cplan->node_timing[i];
+        const struct ggml_tensor    * node   = cgraph->nodes[i];
+
+        timing->t_wall_ns = 0;
+        timing->t_busy_ns = 0;
+        timing->nbytes    = 0;
+
+        if (!ggml_op_is_noop(node->op)) {
+            timing->nbytes = ggml_nbytes(node);
+            for (int j = 0; j < GGML_MAX_SRC; j++) {
+                if (node->src[j]) {
+                    timing->nbytes += ggml_nbytes(node->src[j]);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < n_done && i < n_nodes; i += 1 + plan[i].n_fused) {
+        const int n_group = 1 + plan[i].n_fused;
+
+        // the group ends when thread 0 starts the next node
+        const uint64_t t_end = i + n_group < n_done ? node_stamps[i + n_group] : node_stamps[n_nodes];
+
+        uint64_t busy = 0;
+        for (int j = 0; j < n_threads; j++) {
+            busy += node_cycles[(size_t) j*n_nodes + i];
+        }
+
+        const int64_t t_wall_ns = (int64_t) ((t_end - node_stamps[i])*ns_per_cycle);
+        const int64_t t_busy_ns = (int64_t) (busy*ns_per_cycle);
+
+        if (n_group == 1) {
+            cplan->node_timing[i].t_wall_ns = t_wall_ns;
+            cplan->node_timing[i].t_busy_ns = t_busy_ns;
+            continue;
+        }
+
+        size_t nbytes = 0;
+        for (int k = 0; k < n_group; k++) {
+            nbytes += cplan->node_timing[i + k].nbytes;
+        }
+
+        for (int k = 0; k < n_group; k++) {
+            struct ggml_cpu_node_timing * timing = &cplan->node_timing[i + k];
+
+            const double share = nbytes > 0 ? (double) timing->nbytes/nbytes : 1.0/n_group;
+
+            timing->t_wall_ns = (int64_t) (t_wall_ns*share);
+            timing->t_busy_ns = (int64_t) (t_busy_ns*share);
+        }
+    }
 }
 
 enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cplan * cplan) {
@@ -3121,11 +4340,37 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
         // No worker threads should be accessing the parameters below at this stage
         threadpool->cgraph           = cgraph;
         threadpool->cplan            = cplan;
-        threadpool->current_chunk    = 0;
         threadpool->abort            = -1;
         threadpool->ec               = GGML_STATUS_SUCCESS;
     }
 
+    if (threadpool->node_plan_size < cgraph->n_nodes) {
+        free(threadpool->node_plan);
+        threadpool->node_plan      = malloc(cgraph->n_nodes*sizeof(struct ggml_cpu_node_plan));
+        threadpool->node_plan_size = cgraph->n_nodes;
+    }
+
+    // the abort callback is checked by thread 0 after each node, the other threads must not run ahead of it
+    const bool elide_barriers = n_threads > 1 && cplan->abort_callback == NULL;
+    ggml_graph_compute_node_plan(cgraph, threadpool->node_plan, elide_barriers);
+
+    // threads that are not started for this graph are not busy
+    if (cplan->thread_busy_ns) {
+        memset(cplan->thread_busy_ns, 0, n_threads*sizeof(int64_t));
+    }
+
+    // per-node timing: threads that are not started for this graph leave their counts at zero
+    if (cplan->node_timing) {
+        const size_t n_cycles = (size_t) n_threads*cgraph->n_nodes + cgraph->n_nodes + 1;
+        if (threadpool->node_cycles_size < n_cycles) {
+            free(threadpool->node_cycles_buf);
+            threadpool->node_cycles_buf  = malloc(n_cycles*sizeof(uint64_t));
+            threadpool->node_cycles_size = n_cycles;
+        }
+        memset(threadpool->node_cycles_buf, 0, n_cycles*sizeof(uint64_t));
+        threadpool->node_cycles = threadpool->node_cycles_buf;
+    }
+
 #ifdef GGML_USE_OPENMP
     if (n_threads > 1) {
         #pragma omp parallel num_threads(n_threads)
@@ -3154,6 +4399,8 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
 
     // This is a work thread too
     ggml_graph_compute_thread(&threadpool->workers[0]);
+
+    threadpool->t_done = ggml_time_us();
 #endif
 
     // don't leave affinity set on the main thread
@@ -3161,6 +4408,15 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
 
     enum ggml_status ret = threadpool->ec;
 
+    if (threadpool->node_cycles) {
+        const int n_abort = atomic_load_explicit(&threadpool->abort, memory_order_relaxed);
+        const int n_done  = n_abort >= 0 ? n_abort : cgraph->n_nodes;
+
+        ggml_graph_compute_timing(cgraph, cplan, threadpool->node_plan, threadpool->node_cycles, n_done);
+
+        threadpool->node_cycles = NULL;
+    }
+
     if (disposable_threadpool) {
         ggml_threadpool_free(threadpool);
     }
@@ -3363,6 +4619,14 @@ int ggml_cpu_has_amx_int8(void) {
 #endif
 }
 
+int ggml_cpu_has_amx_bf16(void) {
+#if defined(__AMX_BF16__) && defined(__AVX512BF16__)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
 int ggml_cpu_has_bmi2(void) {
 #if defined(__BMI2__)
     return 1;
@@ -3565,6 +4829,10 @@ void ggml_cpu_init(void) {
         ggml_init_arm_arch_features();
 #endif
 
+        g_state.disable_fusion = getenv("GGML_CPU_DISABLE_FUSION") != NULL;
+
+        ggml_cpu_capacity_init();
+
         is_first_call = false;
     }
 
@@ -95,6 +95,10 @@ struct ggml_backend_cpu_context {
 
     ggml_abort_callback abort_callback;
     void *              abort_callback_data;
+
+    ggml_backend_cpu_timing_callback timing_callback;
+    void *                           timing_callback_data;
+    std::vector<ggml_cpu_node_timing> timing;
 };
 
 static const char * ggml_backend_cpu_get_name(ggml_backend_t backend) {
@@ -173,7 +177,19 @@ static enum ggml_status ggml_backend_cpu_graph_compute(ggml_backend_t backend, s
     cplan.abort_callback      = cpu_ctx->abort_callback;
     cplan.abort_callback_data = cpu_ctx->abort_callback_data;
 
-    return ggml_graph_compute(cgraph, &cplan);
+    if (cpu_ctx->timing_callback == NULL) {
+        return ggml_graph_compute(cgraph, &cplan);
+    }
+
+    cpu_ctx->timing.resize(cgraph->n_nodes);
+    cplan.node_timing = cpu_ctx->timing.data();
+
+    enum ggml_status status = ggml_graph_compute(cgraph, &cplan);
+    if (status == GGML_STATUS_SUCCESS) {
+        cpu_ctx->timing_callback(cgraph, cplan.node_timing, cpu_ctx->timing_callback_data);
+    }
+
+    return status;
 }
 
 static const struct ggml_backend_i ggml_backend_cpu_i = {
@@ -212,6 +228,8 @@ ggml_backend_t ggml_backend_cpu_init(void) {
     ctx->work_size           = 0;
     ctx->abort_callback      = NULL;
     ctx->abort_callback_data = NULL;
+    ctx->timing_callback      = NULL;
+    ctx->timing_callback_data = NULL;
 
     ggml_backend_t cpu_backend = new ggml_backend {
         /* .guid    = */ ggml_backend_cpu_guid(),
@@ -259,6 +277,14 @@ void ggml_backend_cpu_set_abort_callback(ggml_backend_t backend_cpu, ggml_abort_
     ctx->abort_callback_data = abort_callback_data;
 }
 
+void ggml_backend_cpu_set_timing_callback(ggml_backend_t backend_cpu, ggml_backend_cpu_timing_callback timing_callback, void * timing_callback_data) {
+    GGML_ASSERT(ggml_backend_is_cpu(backend_cpu));
+
+    struct ggml_backend_cpu_context * ctx = (struct ggml_backend_cpu_context *)backend_cpu->context;
+    ctx->timing_callback      = timing_callback;
+    ctx->timing_callback_data = timing_callback_data;
+}
+
 // CPU backend - device
 
 struct ggml_backend_cpu_device_context {
@@ -542,6 +568,9 @@ static ggml_backend_feature * ggml_backend_cpu_get_features(ggml_backend_reg_t r
         if (ggml_cpu_has_amx_int8()) {
             features.push_back({ "AMX_INT8", "1" });
         }
+        if (ggml_cpu_has_amx_bf16()) {
+            features.push_back({ "AMX_BF16", "1" });
+        }
         if (ggml_cpu_has_neon()) {
             features.push_back({ "NEON", "1" });
         }
@@ -626,12 +655,29 @@ static void * ggml_backend_cpu_get_proc_address(ggml_backend_reg_t reg, const ch
     if (strcmp(name, "ggml_backend_set_abort_callback") == 0) {
         return (void *)ggml_backend_cpu_set_abort_callback;
     }
+    if (strcmp(name, "ggml_backend_cpu_set_timing_callback") == 0) {
+        return (void *)ggml_backend_cpu_set_timing_callback;
+    }
     if (strcmp(name, "ggml_backend_cpu_numa_init") == 0) {
         return (void *)ggml_numa_init;
     }
     if (strcmp(name, "ggml_backend_cpu_is_numa") == 0) {
         return (void *)ggml_is_numa;
     }
+    if (strcmp(name, "ggml_backend_cpu_numa_place_tensor") == 0) {
+        return (void *)ggml_numa_place_tensor;
+    }
+    if (strcmp(name, "ggml_backend_cpu_numa_get_traffic") == 0) {
+        return (void *)ggml_numa_get_traffic;
+    }
+#ifdef GGML_USE_CPU_REPACK
+    if (strcmp(name, "ggml_backend_cpu_repack_buffer_from_ptr") == 0) {
+        return (void *)ggml_backend_cpu_repack_buffer_from_ptr;
+    }
+    if (strcmp(name, "ggml_backend_cpu_repack_tensor_layout") == 0) {
+        return (void *)ggml_backend_cpu_repack_tensor_layout;
+    }
+#endif
 
     // threadpool - TODO:  move to ggml-base
     if (strcmp(name, "ggml_threadpool_new") == 0) {
@@ -640,6 +686,15 @@ static void * ggml_backend_cpu_get_proc_address(ggml_backend_reg_t reg, const ch
     if (strcmp(name, "ggml_threadpool_free") == 0) {
         return (void *)ggml_threadpool_free;
     }
+    if (strcmp(name, "ggml_threadpool_set_wait") == 0) {
+        return (void *)ggml_threadpool_set_wait;
+    }
+    if (strcmp(name, "ggml_threadpool_get_wake_stats") == 0) {
+        return (void *)ggml_threadpool_get_wake_stats;
+    }
+    if (strcmp(name, "ggml_threadpool_reset_wake_stats") == 0) {
+        return (void *)ggml_threadpool_reset_wake_stats;
+    }
     if (strcmp(name, "ggml_backend_cpu_set_threadpool") == 0) {
         return (void *)ggml_backend_cpu_set_threadpool;
     }
@@ -56,6 +56,12 @@
 
 #include <array>
 #include <type_traits>
+#include <vector>
+
+#if defined(__AMX_BF16__) && defined(__gnu_linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #ifdef _MSC_VER
 #define NOINLINE __declspec(noinline)
@@ -440,16 +446,7 @@ class tinyBLAS {
         const int64_t jj_BN = (NB_BN - (NB_BN * SIZE_BN - xtiles));
         const int64_t nb_job = ytiles * NB_BN;
 
-        if (params->ith == 0) {
-            GGML_ASSERT( jj_BN * SIZE_BN + (NB_BN - jj_BN) * (SIZE_BN - 1) == xtiles);
-            // Every thread starts at ith, so the first unprocessed chunk is nth.  This save a bit of coordination right at the start.
-            ggml_threadpool_chunk_set(params->threadpool, params->nth);
-        }
-
-        ggml_barrier(params->threadpool);
-
-        int64_t job = params->ith;
-        while (job < nb_job) {
+        auto run_job = [&](int64_t job) {
             const int64_t ii = (job % ytiles) * RM * BM;
             const int64_t jb =  job / ytiles;
             const int64_t jr0 = BLOC_POS(jb  , jj_BN, SIZE_BN);
@@ -471,8 +468,28 @@ class tinyBLAS {
                 }
                 GGML_ASSERT(jj == jj2);
             }
+        };
+
+        if (params->nth == 1) {
+            // a single thread computing a block of a larger op (e.g. a tile of flash attention) while the
+            // other threads of the pool work on other blocks: no chunk counter, no barrier
+            for (int64_t job = 0; job < nb_job; ++job) {
+                run_job(job);
+            }
+            return;
+        }
+
+        if (params->ith == 0) {
+            GGML_ASSERT( jj_BN * SIZE_BN + (NB_BN - jj_BN) * (SIZE_BN - 1) == xtiles);
+            // Every thread starts with a contiguous range of jobs and steals from the other threads when it is done
+            ggml_threadpool_chunks_reset(params->threadpool, params->nth, (int) nb_job);
+        }
 
-            job = ggml_threadpool_chunk_add(params->threadpool, 1);
+        ggml_barrier(params->threadpool);
+
+        for (int64_t job = ggml_threadpool_chunks_next(params->threadpool, params->ith, params->nth); job >= 0;
+                     job = ggml_threadpool_chunks_next(params->threadpool, params->ith, params->nth)) {
+            run_job(job);
         }
 
         ggml_barrier(params->threadpool);
@@ -489,6 +506,217 @@ class tinyBLAS {
     const int64_t ldc;
 };
 
+#if defined(__AMX_BF16__) && defined(__AVX512BF16__)
+//////////////////////////////////////////////////////////////////////////////////////////
+// AMX BF16 MATRIX MULTIPLICATION
+
+// All the tiles have the same shape, 16 rows of 64 bytes:
+//
+//    A: 16 rows of A x 32 bf16 of k, loaded straight from A
+//    B: 16 pairs of k x 16 rows of B x 2 bf16 (VNNI layout), packed from B
+//    C: 16 rows of A x 16 rows of B, f32
+//
+// TMM0-TMM3 hold the 2x2 blocks of C, TMM4-TMM5 the rows of A and TMM6-TMM7 the rows of B:
+//
+//            B TMM6  B TMM7
+//    A TMM4  C TMM0  C TMM1
+//    A TMM5  C TMM2  C TMM3
+//
+// B is packed by blocks of 32 rows, the missing rows are zero, so only m and k have to be multiples
+// of the tile sizes.
+
+#ifndef ARCH_REQ_XCOMP_PERM
+#define ARCH_REQ_XCOMP_PERM     0x1023
+#endif
+#ifndef XFEATURE_XTILEDATA
+#define XFEATURE_XTILEDATA      18
+#endif
+
+#define AMX_TILE_M 16 // rows of A and of B in a tile
+#define AMX_TILE_K 32 // bf16 of k in a tile
+
+struct amx_tile_config {
+    uint8_t  palette_id;
+    uint8_t  start_row;
+    uint8_t  reserved_0[14];
+    uint16_t colsb[16];
+    uint8_t  rows[16];
+};
+
+// the process has to ask the kernel for the permission to use the tiles once
+static bool amx_tile_init() {
+#if defined(__gnu_linux__)
+    static const bool ok = syscall(SYS_arch_prctl, ARCH_REQ_XCOMP_PERM, XFEATURE_XTILEDATA) == 0;
+    return ok;
+#else
+    return true;
+#endif
+}
+
+class tinyBLAS_AMX_BF16 {
+  public:
+    tinyBLAS_AMX_BF16(const ggml_compute_params * params, int64_t k,
+                      const ggml_bf16_t *A, int64_t lda,
+                      const ggml_bf16_t *B, int64_t ldb,
+                      float *C, int64_t ldc)
+        : params(params), A(A), B(B), C(C), k(k), lda(lda), ldb(ldb), ldc(ldc) {
+    }
+
+    bool matmul(int64_t m, int64_t n) {
+        // with fewer rows of B the tiles are mostly padding, tinyBLAS with vdpbf16ps is faster
+        if (m % AMX_TILE_M != 0 || k % AMX_TILE_K != 0 || n < AMX_TILE_M || !amx_tile_init()) {
+            return false;
+        }
+
+        // the rows of A are split in blocks small enough to give a few jobs to every thread
+        const int64_t xtiles = (n + BN - 1)/BN;
+        const int64_t BM     = std::max<int64_t>(2*AMX_TILE_M, std::min<int64_t>(256, m*xtiles/(4*params->nth)) & ~(int64_t) (2*AMX_TILE_M - 1));
+        const int64_t ytiles = (m + BM - 1)/BM;
+        const int64_t nb_job = ytiles*xtiles;
+
+        // the jobs of a block of B are consecutive, so that a thread packs it once for its range of jobs
+        auto run_job = [&](int64_t job) {
+            const int64_t jb = job/ytiles;
+            const int64_t i0 = (job%ytiles)*BM;
+            const int64_t i1 = std::min(i0 + BM, m);
+
+            if (jb != packed_jb) {
+                pack(jb*BN, std::min(BN, n - jb*BN));
+                packed_jb = jb;
+            }
+
+            for (int64_t ii = i0; ii < i1; ii += 2*AMX_TILE_M) {
+                if (ii + 2*AMX_TILE_M <= i1) {
+                    gemm_bloc<2>(ii, jb*BN, std::min(BN, n - jb*BN));
+                } else {
+                    gemm_bloc<1>(ii, jb*BN, std::min(BN, n - jb*BN));
+                }
+            }
+        };
+
+        // the tile configuration is per thread, keep the one of the other AMX kernels (see ggml_tile_config_init)
+        amx_tile_config saved;
+        _tile_storeconfig(&saved);
+
+        amx_tile_config tc = {};
+        tc.palette_id = 1;
+        for (int t = 0; t < 8; ++t) {
+            tc.rows[t]  = AMX_TILE_M;
+            tc.colsb[t] = AMX_TILE_K*sizeof(ggml_bf16_t);
+        }
+        _tile_loadconfig(&tc);
+
+        if (params->nth == 1) {
+            for (int64_t job = 0; job < nb_job; ++job) {
+                run_job(job);
+            }
+        } else {
+            if (params->ith == 0) {
+                ggml_threadpool_chunks_reset(params->threadpool, params->nth, (int) nb_job);
+            }
+
+            ggml_barrier(params->threadpool);
+
+            for (int64_t job = ggml_threadpool_chunks_next(params->threadpool, params->ith, params->nth); job >= 0;
+                         job = ggml_threadpool_chunks_next(params->threadpool, params->ith, params->nth)) {
+                run_job(job);
+            }
+
+            ggml_barrier(params->threadpool);
+        }
+
+        if (saved.palette_id != 0) {
+            _tile_loadconfig(&saved);
+        } else {
+            _tile_release();
+        }
+
+        return true;
+    }
+
+  private:
+    static constexpr int64_t BN = 2*AMX_TILE_M; // rows of B in a packed block
+
+    // rows [jj, jj + nj) of B to the VNNI layout of the B tiles: [k/AMX_TILE_K][2][AMX_TILE_K/2][AMX_TILE_M][2]
+    void pack(int64_t jj, int64_t nj) {
+        packed.resize(k*BN);
+
+        uint32_t * dst = (uint32_t *) packed.data();
+
+        for (int64_t j = 0; j < BN; ++j) {
+            const uint32_t * src = j < nj ? (const uint32_t *) (B + ldb*(jj + j)) : nullptr;
+            for (int64_t l = 0; l < k/2; ++l) {
+                const int64_t kb = l/(AMX_TILE_K/2);
+                const int64_t kk = l%(AMX_TILE_K/2);
+                dst[((kb*2 + j/AMX_TILE_M)*(AMX_TILE_K/2) + kk)*AMX_TILE_M + j%AMX_TILE_M] = src ? src[l] : 0;
+            }
+        }
+    }
+
+    template <int RM>
+    void gemm_bloc(int64_t ii, int64_t jj, int64_t nj) {
+        const size_t tile_size = AMX_TILE_K*AMX_TILE_M; // bf16 in a packed tile of B
+
+        _tile_zero(0);
+        _tile_zero(1);
+        if constexpr (RM == 2) {
+            _tile_zero(2);
+            _tile_zero(3);
+        }
+
+        for (int64_t l = 0; l < k; l += AMX_TILE_K) {
+            const ggml_bf16_t * Bp = packed.data() + (l/AMX_TILE_K)*2*tile_size;
+
+            _tile_loadd(6, Bp,             AMX_TILE_K*sizeof(ggml_bf16_t));
+            _tile_loadd(7, Bp + tile_size, AMX_TILE_K*sizeof(ggml_bf16_t));
+
+            _tile_loadd(4, A + lda*ii + l, lda*sizeof(ggml_bf16_t));
+            _tile_dpbf16ps(0, 4, 6);
+            _tile_dpbf16ps(1, 4, 7);
+
+            if constexpr (RM == 2) {
+                _tile_loadd(5, A + lda*(ii + AMX_TILE_M) + l, lda*sizeof(ggml_bf16_t));
+                _tile_dpbf16ps(2, 5, 6);
+                _tile_dpbf16ps(3, 5, 7);
+            }
+        }
+
+        // C is [rows of B][rows of A], the tiles are [rows of A][rows of B]
+        float Ct[2][2][AMX_TILE_M][AMX_TILE_M];
+
+        _tile_stored(0, Ct[0][0], AMX_TILE_M*sizeof(float));
+        _tile_stored(1, Ct[0][1], AMX_TILE_M*sizeof(float));
+        if constexpr (RM == 2) {
+            _tile_stored(2, Ct[1][0], AMX_TILE_M*sizeof(float));
+            _tile_stored(3, Ct[1][1], AMX_TILE_M*sizeof(float));
+        }
+
+        for (int64_t j = 0; j < nj; ++j) {
+            for (int r = 0; r < RM; ++r) {
+                for (int64_t i = 0; i < AMX_TILE_M; ++i) {
+                    C[ldc*(jj + j) + ii + r*AMX_TILE_M + i] = Ct[r][j/AMX_TILE_M][i][j%AMX_TILE_M];
+                }
+            }
+        }
+    }
+
+    const ggml_compute_params * params;
+    const ggml_bf16_t *const A;
+    const ggml_bf16_t *const B;
+    float *const C;
+    const int64_t k;
+    const int64_t lda;
+    const int64_t ldb;
+    const int64_t ldc;
+
+    // packed block of B, per thread so that the threads pack only the blocks of their jobs
+    int64_t packed_jb = -1;
+    static thread_local std::vector<ggml_bf16_t> packed;
+};
+
+thread_local std::vector<ggml_bf16_t> tinyBLAS_AMX_BF16::packed;
+#endif // __AMX_BF16__ && __AVX512BF16__
+
 //////////////////////////////////////////////////////////////////////////////////////////
 // QUANT ZERO MATRIX MULTIPLICATION
 
@@ -2630,6 +2858,15 @@ bool llamafile_sgemm(const struct ggml_compute_params * params, int64_t m, int64
     case GGML_TYPE_BF16: {
 #if defined(__AVX512BF16__)
         if (Btype == GGML_TYPE_BF16) {
+#if defined(__AMX_BF16__)
+            tinyBLAS_AMX_BF16 tba{ params, k,
+                (const ggml_bf16_t *)A, lda,
+                (const ggml_bf16_t *)B, ldb,
+                (float *)C, ldc};
+            if (tba.matmul(m, n)) {
+                return true;
+            }
+#endif
             tinyBLAS<32, __m512, __m512bh, ggml_bf16_t, ggml_bf16_t, float> tb{ params, k,
                 (const ggml_bf16_t *)A, lda,
                 (const ggml_bf16_t *)B, ldb,
@@ -6,6 +6,15 @@
 #include "ggml.h"
 #include "unary-ops.h"
 #include "vec.h"
+#include "quants.h"
+
+#if defined(__ARM_FEATURE_SVE) || defined(__ARM_FEATURE_MATMUL_INT8)
+#undef GGML_USE_LLAMAFILE
+#endif
+
+#ifdef GGML_USE_LLAMAFILE
+#include "llamafile/sgemm.h"
+#endif
 
 #include <float.h>
 #include <algorithm>
@@ -52,15 +61,11 @@ static void ggml_compute_forward_dup_f16(
     GGML_TENSOR_UNARY_OP_LOCALS
 
     const int ith = params->ith; // thread index
-    const int nth = params->nth; // number of threads
 
     // parallelize by rows
     const int nr = ne01;
-    // number of rows per thread
-    const int dr = (nr + nth - 1) / nth;
     // row range for this thread
-    const int ir0 = dr * ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     if (src0->type == dst->type &&
         ne00 == ne0 &&
@@ -316,15 +321,11 @@ static void ggml_compute_forward_dup_bf16(
     GGML_TENSOR_UNARY_OP_LOCALS
 
     const int ith = params->ith; // thread index
-    const int nth = params->nth; // number of threads
 
     // parallelize by rows
     const int nr = ne01;
-    // number of rows per thread
-    const int dr = (nr + nth - 1) / nth;
     // row range for this thread
-    const int ir0 = dr * ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     if (src0->type == dst->type &&
         ne00 == ne0 &&
@@ -666,16 +667,10 @@ static void ggml_compute_forward_dup_f32(
 
     GGML_TENSOR_UNARY_OP_LOCALS
 
-    const int ith = params->ith; // thread index
-    const int nth = params->nth; // number of threads
-
     // parallelize by rows
     const int nr = ne01;
-    // number of rows per thread
-    const int dr = (nr + nth - 1) / nth;
     // row range for this thread
-    const int ir0 = dr * ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     if (src0->type == dst->type &&
         ne00 == ne0 &&
@@ -970,16 +965,10 @@ static void ggml_compute_forward_dup_bytes(
 
     const size_t type_size = ggml_type_size(src0->type);
 
-    const int ith = params->ith; // thread index
-    const int nth = params->nth; // number of threads
-
     // parallelize by rows
     const int nr = ne01;
-    // number of rows per thread
-    const int dr = (nr + nth - 1) / nth;
     // row range for this thread
-    const int ir0 = dr * ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     if (src0->type == dst->type &&
         ggml_are_same_shape(src0, dst) &&
@@ -1122,14 +1111,8 @@ static void ggml_compute_forward_dup_q(
     // must either have first dimension large enough to hold a row, or fully contiguous
     GGML_ASSERT((ne10 % qk) == 0 || ggml_is_contiguous(dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int64_t ir = ir0; ir < ir1; ++ir) {
 
@@ -1204,7 +1187,6 @@ static void ggml_compute_forward_add_q_f32(
     GGML_TENSOR_BINARY_OP_LOCALS
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const ggml_type type = src0->type;
     const ggml_type dtype = dst->type;
@@ -1223,12 +1205,8 @@ static void ggml_compute_forward_add_q_f32(
     GGML_ASSERT(ggml_is_quantized(src0->type));
     GGML_ASSERT(src1->type == GGML_TYPE_F32);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     float * wdata = (float *) params->wdata + (ne00 + CACHE_LINE_SIZE_F32) * ith;
 
@@ -1329,9 +1307,6 @@ static void ggml_compute_forward_add_id_f32(
     GGML_ASSERT(src0->nb[0] == sizeof(float));
     GGML_ASSERT(src1->nb[0] == sizeof(float));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nr  = ggml_nrows(src0);
 
     GGML_TENSOR_TERNARY_OP_LOCALS
@@ -1339,12 +1314,8 @@ static void ggml_compute_forward_add_id_f32(
     GGML_ASSERT( nb0 == sizeof(float));
     GGML_ASSERT(nb10 == sizeof(float));
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int ir = ir0; ir < ir1; ++ir) {
         // src0 indices
@@ -1394,9 +1365,6 @@ static void ggml_compute_forward_add1_f32(
     GGML_ASSERT(ggml_are_same_shape(src0, dst));
     GGML_ASSERT(ggml_is_scalar(src1));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nr  = ggml_nrows(src0);
 
     GGML_TENSOR_UNARY_OP_LOCALS
@@ -1404,12 +1372,8 @@ static void ggml_compute_forward_add1_f32(
     GGML_ASSERT( nb0 == sizeof(float));
     GGML_ASSERT(nb00 == sizeof(float));
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int ir = ir0; ir < ir1; ++ir) {
         // src0 and dst are same shape => same indices
@@ -1447,9 +1411,6 @@ static void ggml_compute_forward_add1_f16_f32(
     // scalar to add
     const float v = *(float *) src1->data;
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nr  = ggml_nrows(src0);
 
     GGML_TENSOR_UNARY_OP_LOCALS
@@ -1461,12 +1422,8 @@ static void ggml_compute_forward_add1_f16_f32(
     GGML_ASSERT( nb0 == sizeof(ggml_fp16_t));
     GGML_ASSERT(nb00 == sizeof(ggml_fp16_t));
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int ir = ir0; ir < ir1; ++ir) {
         // src0 and dst are same shape => same indices
@@ -1495,9 +1452,6 @@ static void ggml_compute_forward_add1_f16_f16(
     // scalar to add
     const float v = GGML_CPU_FP16_TO_FP32(*(ggml_fp16_t *) src1->data);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nr  = ggml_nrows(src0);
 
     GGML_TENSOR_UNARY_OP_LOCALS
@@ -1509,12 +1463,8 @@ static void ggml_compute_forward_add1_f16_f16(
     GGML_ASSERT( nb0 == sizeof(ggml_fp16_t));
     GGML_ASSERT(nb00 == sizeof(ggml_fp16_t));
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int ir = ir0; ir < ir1; ++ir) {
         // src0 and dst are same shape => same indices
@@ -1544,7 +1494,6 @@ static void ggml_compute_forward_add1_q_f32(
     const float v = *(float *) src1->data;
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const int nr  = ggml_nrows(src0);
 
@@ -1566,12 +1515,8 @@ static void ggml_compute_forward_add1_q_f32(
     GGML_ASSERT(dst->type == src0->type);
     GGML_ASSERT(src1->type == GGML_TYPE_F32);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     float * wdata = (float *) params->wdata + (ne0 + CACHE_LINE_SIZE_F32) * ith;
 
@@ -1608,9 +1553,6 @@ static void ggml_compute_forward_add1_bf16_f32(
     // scalar to add
     const float v = *(float *) src1->data;
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nr  = ggml_nrows(src0);
 
     GGML_TENSOR_UNARY_OP_LOCALS
@@ -1622,12 +1564,8 @@ static void ggml_compute_forward_add1_bf16_f32(
     GGML_ASSERT( nb0 == sizeof(ggml_bf16_t));
     GGML_ASSERT(nb00 == sizeof(ggml_bf16_t));
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int ir = ir0; ir < ir1; ++ir) {
         // src0 and dst are same shape => same indices
@@ -1656,9 +1594,6 @@ static void ggml_compute_forward_add1_bf16_bf16(
     // scalar to add
     const float v = GGML_BF16_TO_FP32(*(ggml_bf16_t *) src1->data);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nr  = ggml_nrows(src0);
 
     GGML_TENSOR_UNARY_OP_LOCALS
@@ -1670,12 +1605,8 @@ static void ggml_compute_forward_add1_bf16_bf16(
     GGML_ASSERT( nb0 == sizeof(ggml_bf16_t));
     GGML_ASSERT(nb00 == sizeof(ggml_bf16_t));
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int ir = ir0; ir < ir1; ++ir) {
         // src0 and dst are same shape => same indices
@@ -1792,9 +1723,6 @@ static void ggml_compute_forward_acc_f32(
         ggml_barrier(params->threadpool);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nr = ggml_nrows(src1);
     const int nc = src1->ne[0];
 
@@ -1814,12 +1742,8 @@ static void ggml_compute_forward_acc_f32(
 
     GGML_ASSERT(nb10 == sizeof(float));
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int ir = ir0; ir < ir1; ++ir) {
         // src0 and dst are viewed with shape of src1 and offset
@@ -2194,12 +2118,8 @@ static void ggml_compute_forward_count_equal_i32(
     int64_t * sums = (int64_t *) params->wdata;
     int64_t sum_thread = 0;
 
-    // rows per thread
-    const int64_t dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int64_t ir0 = dr*ith;
-    const int64_t ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int64_t ir = ir0; ir < ir1; ++ir) {
         const int64_t i03 =  ir                        / (ne02*ne01);
@@ -2666,18 +2586,11 @@ static void ggml_compute_forward_gelu_f32(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_vec_gelu_f32(nc,
@@ -2705,18 +2618,11 @@ static void ggml_compute_forward_gelu_f16(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_vec_gelu_f16(nc,
@@ -2769,18 +2675,11 @@ static void ggml_compute_forward_gelu_erf_f32(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_vec_gelu_erf_f32(nc,
@@ -2808,18 +2707,11 @@ static void ggml_compute_forward_gelu_erf_f16(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_vec_gelu_erf_f16(nc,
@@ -2872,18 +2764,11 @@ static void ggml_compute_forward_gelu_quick_f32(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_vec_gelu_quick_f32(nc,
@@ -2911,18 +2796,11 @@ static void ggml_compute_forward_gelu_quick_f16(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_vec_gelu_quick_f16(nc,
@@ -2975,18 +2853,11 @@ static void ggml_compute_forward_silu_f32(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_vec_silu_f32(nc,
@@ -3014,18 +2885,11 @@ static void ggml_compute_forward_silu_f16(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_vec_silu_f16(nc,
@@ -3164,18 +3028,11 @@ static void ggml_compute_forward_silu_back_f32(
     assert(ggml_are_same_shape(src1, dst));
     assert(ggml_are_same_shape(src1, grad));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1->ne[0];
     const int nr = ggml_nrows(src1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_vec_silu_backward_f32(nc,
@@ -3207,18 +3064,11 @@ static void ggml_compute_forward_silu_back_f16(
     assert(ggml_are_same_shape(src1, dst));
     assert(ggml_are_same_shape(src1, grad));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1->ne[0];
     const int nr = ggml_nrows(src1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_vec_silu_backward_f16(nc,
@@ -3281,9 +3131,6 @@ static void ggml_compute_forward_reglu_f32(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3292,12 +3139,8 @@ static void ggml_compute_forward_reglu_f32(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         float * src0_p = (float *) (src0_d + i1*src0_o);
@@ -3340,9 +3183,6 @@ static void ggml_compute_forward_reglu_f16(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3351,12 +3191,8 @@ static void ggml_compute_forward_reglu_f16(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
@@ -3424,9 +3260,6 @@ static void ggml_compute_forward_geglu_f32(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3435,12 +3268,8 @@ static void ggml_compute_forward_geglu_f32(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         float * src0_p = (float *) (src0_d + i1*src0_o);
@@ -3483,9 +3312,6 @@ static void ggml_compute_forward_geglu_f16(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3494,12 +3320,8 @@ static void ggml_compute_forward_geglu_f16(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
@@ -3567,9 +3389,6 @@ static void ggml_compute_forward_swiglu_f32(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3578,12 +3397,8 @@ static void ggml_compute_forward_swiglu_f32(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         float * src0_p = (float *) (src0_d + i1*src0_o);
@@ -3626,9 +3441,6 @@ static void ggml_compute_forward_swiglu_f16(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3637,12 +3449,8 @@ static void ggml_compute_forward_swiglu_f16(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
@@ -3710,9 +3518,6 @@ static void ggml_compute_forward_swiglu_oai_f32(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3723,12 +3528,8 @@ static void ggml_compute_forward_swiglu_oai_f32(
     const float alpha = ggml_get_op_params_f32(dst, 2);
     const float limit = ggml_get_op_params_f32(dst, 3);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         float * src0_p = (float *) (src0_d + i1*src0_o);
@@ -3797,9 +3598,6 @@ static void ggml_compute_forward_geglu_erf_f32(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3808,12 +3606,8 @@ static void ggml_compute_forward_geglu_erf_f32(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         float * src0_p = (float *) (src0_d + i1*src0_o);
@@ -3856,9 +3650,6 @@ static void ggml_compute_forward_geglu_erf_f16(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3867,12 +3658,8 @@ static void ggml_compute_forward_geglu_erf_f16(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
@@ -3940,9 +3727,6 @@ static void ggml_compute_forward_geglu_quick_f32(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3951,12 +3735,8 @@ static void ggml_compute_forward_geglu_quick_f32(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         float * src0_p = (float *) (src0_d + i1*src0_o);
@@ -3999,9 +3779,6 @@ static void ggml_compute_forward_geglu_quick_f16(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -4010,12 +3787,8 @@ static void ggml_compute_forward_geglu_quick_f16(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
@@ -4074,44 +3847,43 @@ static void ggml_compute_forward_norm_f32(
 
     GGML_ASSERT(src0->nb[0] == sizeof(float));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     GGML_TENSOR_UNARY_OP_LOCALS
 
+    const auto [ir0, ir1] = get_thread_range(params, src0);
+
     float eps;
     memcpy(&eps, dst->op_params, sizeof(float));
 
     GGML_ASSERT(eps >= 0.0f);
 
     // TODO: optimize
-    for (int64_t i03 = 0; i03 < ne03; i03++) {
-        for (int64_t i02 = 0; i02 < ne02; i02++) {
-            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
-                const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
-
-                ggml_float sum = 0.0;
-                for (int64_t i00 = 0; i00 < ne00; i00++) {
-                    sum += (ggml_float)x[i00];
-                }
+    for (int64_t ir = ir0; ir < ir1; ++ir) {
+        const int64_t i03 = ir/(ne02*ne01);
+        const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+        const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
 
-                float mean = sum/ne00;
+        const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
 
-                float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
+        ggml_float sum = 0.0;
+        for (int64_t i00 = 0; i00 < ne00; i00++) {
+            sum += (ggml_float)x[i00];
+        }
 
-                ggml_float sum2 = 0.0;
-                for (int64_t i00 = 0; i00 < ne00; i00++) {
-                    float v = x[i00] - mean;
-                    y[i00] = v;
-                    sum2 += (ggml_float)(v*v);
-                }
+        float mean = sum/ne00;
 
-                float variance = sum2/ne00;
-                const float scale = 1.0f/sqrtf(variance + eps);
+        float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
 
-                ggml_vec_scale_f32(ne00, y, scale);
-            }
+        ggml_float sum2 = 0.0;
+        for (int64_t i00 = 0; i00 < ne00; i00++) {
+            float v = x[i00] - mean;
+            y[i00] = v;
+            sum2 += (ggml_float)(v*v);
         }
+
+        float variance = sum2/ne00;
+        const float scale = 1.0f/sqrtf(variance + eps);
+
+        ggml_vec_scale_f32(ne00, y, scale);
     }
 }
 
@@ -4145,44 +3917,95 @@ static void ggml_compute_forward_rms_norm_f32(
 
     GGML_ASSERT(src0->nb[0] == sizeof(float));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     GGML_TENSOR_UNARY_OP_LOCALS
 
+    const auto [ir0, ir1] = get_thread_range(params, src0);
+
     float eps;
     memcpy(&eps, dst->op_params, sizeof(float));
 
     GGML_ASSERT(eps >= 0.0f);
 
     // TODO: optimize
-    for (int64_t i03 = 0; i03 < ne03; i03++) {
-        for (int64_t i02 = 0; i02 < ne02; i02++) {
-            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
-                const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+    for (int64_t ir = ir0; ir < ir1; ++ir) {
+        const int64_t i03 = ir/(ne02*ne01);
+        const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+        const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
 
-                ggml_float sum = 0.0;
-                for (int64_t i00 = 0; i00 < ne00; i00++) {
-                    sum += (ggml_float)(x[i00] * x[i00]);
-                }
+        const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
 
-                const float mean = sum/ne00;
+        ggml_float sum = 0.0;
+        for (int64_t i00 = 0; i00 < ne00; i00++) {
+            sum += (ggml_float)(x[i00] * x[i00]);
+        }
 
-                float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
+        const float mean = sum/ne00;
 
-                memcpy(y, x, ne00 * sizeof(float));
-                // for (int i00 = 0; i00 < ne00; i00++) {
-                //     y[i00] = x[i00];
-                // }
+        float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
 
-                const float scale = 1.0f/sqrtf(mean + eps);
+        memcpy(y, x, ne00 * sizeof(float));
+        // for (int i00 = 0; i00 < ne00; i00++) {
+        //     y[i00] = x[i00];
+        // }
 
-                // if you hit this, likely you got an inf somewhere earlier
-                assert(scale > 0.0f);
+        const float scale = 1.0f/sqrtf(mean + eps);
 
-                ggml_vec_scale_f32(ne00, y, scale);
-            }
+        // if you hit this, likely you got an inf somewhere earlier
+        assert(scale > 0.0f);
+
+        ggml_vec_scale_f32(ne00, y, scale);
+    }
+}
+
+// RMS_NORM followed by a MUL with the weights (params->fused[0]), the normalized rows are not stored
+static void ggml_compute_forward_rms_norm_mul_f32(
+        const ggml_compute_params * params,
+        const ggml_tensor * norm,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * src0 = norm->src[0];
+    const ggml_tensor * w    = dst->src[0] == norm ? dst->src[1] : dst->src[0];
+
+    GGML_ASSERT(ggml_are_same_shape(src0, dst));
+    GGML_ASSERT(src0->nb[0] == sizeof(float));
+    GGML_ASSERT(w->nb[0] == sizeof(float) && w->ne[0] == dst->ne[0]);
+
+    GGML_TENSOR_UNARY_OP_LOCALS
+
+    const auto [ir0, ir1] = get_thread_range(params, src0);
+
+    float eps;
+    memcpy(&eps, norm->op_params, sizeof(float));
+
+    GGML_ASSERT(eps >= 0.0f);
+
+    for (int64_t ir = ir0; ir < ir1; ++ir) {
+        const int64_t i03 = ir/(ne02*ne01);
+        const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+        const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
+
+        const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+
+        ggml_float sum = 0.0;
+        for (int64_t i00 = 0; i00 < ne00; i00++) {
+            sum += (ggml_float)(x[i00] * x[i00]);
         }
+
+        const float mean = sum/ne00;
+
+        float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
+
+        const float * wr = (float *) ((char *) w->data + (i01 % w->ne[1])*w->nb[1] + (i02 % w->ne[2])*w->nb[2] + (i03 % w->ne[3])*w->nb[3]);
+
+        memcpy(y, x, ne00 * sizeof(float));
+
+        const float scale = 1.0f/sqrtf(mean + eps);
+
+        // if you hit this, likely you got an inf somewhere earlier
+        assert(scale > 0.0f);
+
+        ggml_vec_scale_f32(ne00, y, scale);
+        ggml_vec_mul_f32(ne00, y, y, wr);
     }
 }
 
@@ -4192,6 +4015,12 @@ void ggml_compute_forward_rms_norm(
 
     const ggml_tensor * src0 = dst->src[0];
 
+    if (params->n_fused > 0) {
+        GGML_ASSERT(src0->type == GGML_TYPE_F32);
+        ggml_compute_forward_rms_norm_mul_f32(params, dst, params->fused[0]);
+        return;
+    }
+
     switch (src0->type) {
         case GGML_TYPE_F32:
             {
@@ -4486,36 +4315,35 @@ static void ggml_compute_forward_l2_norm_f32(
 
     GGML_ASSERT(src0->nb[0] == sizeof(float));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     GGML_TENSOR_UNARY_OP_LOCALS
 
+    const auto [ir0, ir1] = get_thread_range(params, src0);
+
     float eps;
     memcpy(&eps, dst->op_params, sizeof(float));
 
     GGML_ASSERT(eps >= 0.0f);
 
     // TODO: optimize
-    for (int64_t i03 = 0; i03 < ne03; i03++) {
-        for (int64_t i02 = 0; i02 < ne02; i02++) {
-            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
-                const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+    for (int64_t ir = ir0; ir < ir1; ++ir) {
+        const int64_t i03 = ir/(ne02*ne01);
+        const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+        const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
 
-                ggml_float sum = 0.0;
-                for (int64_t i00 = 0; i00 < ne00; i00++) {
-                    sum += (ggml_float)(x[i00] * x[i00]);
-                }
+        const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
 
-                float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
+        ggml_float sum = 0.0;
+        for (int64_t i00 = 0; i00 < ne00; i00++) {
+            sum += (ggml_float)(x[i00] * x[i00]);
+        }
 
-                memcpy(y, x, ne00 * sizeof(float));
+        float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
 
-                const float scale = 1.0f/fmaxf(sqrtf(sum), eps);
+        memcpy(y, x, ne00 * sizeof(float));
 
-                ggml_vec_scale_f32(ne00, y, scale);
-            }
-        }
+        const float scale = 1.0f/fmaxf(sqrtf(sum), eps);
+
+        ggml_vec_scale_f32(ne00, y, scale);
     }
 }
 
@@ -4553,7 +4381,6 @@ static void ggml_compute_forward_out_prod_f32(
     GGML_ASSERT(src1->type == GGML_TYPE_F32);
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     GGML_ASSERT(ne0 == ne00);
     GGML_ASSERT(ne1 == ne10);
@@ -4592,12 +4419,8 @@ static void ggml_compute_forward_out_prod_f32(
     // total rows in dst
     const int64_t nr = ne1*ne2*ne3;
 
-    // rows per thread
-    const int64_t dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int64_t ir0 = dr*ith;
-    const int64_t ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     // block-tiling attempt
     const int64_t blck_0 = MAX(GGML_VEC_MAD_UNROLL, 32);
@@ -4670,7 +4493,6 @@ static void ggml_compute_forward_out_prod_q_f32(
     GGML_TENSOR_BINARY_OP_LOCALS;
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const ggml_type type = src0->type;
     ggml_to_float_t const dequantize_row_q = ggml_get_type_traits(type)->to_float;
@@ -4707,12 +4529,8 @@ static void ggml_compute_forward_out_prod_q_f32(
     // total rows in dst
     const int64_t nr = ne1*ne2*ne3;
 
-    // rows per thread
-    const int64_t dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int64_t ir0 = dr*ith;
-    const int64_t ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     // dst[:,:,:,:] = 0
     // for i2,i3:
@@ -4815,18 +4633,11 @@ static void ggml_compute_forward_scale_f32(
     memcpy(&s, (float *) dst->op_params + 0, sizeof(float));
     memcpy(&b, (float *) dst->op_params + 1, sizeof(float));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     const size_t nb01 = src0->nb[1];
 
@@ -4901,9 +4712,6 @@ static void ggml_compute_forward_set_f32(
         ggml_barrier(params->threadpool);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nr = ggml_nrows(src1);
     const int nc = src1->ne[0];
 
@@ -4922,12 +4730,8 @@ static void ggml_compute_forward_set_f32(
 
     GGML_ASSERT(nb10 == sizeof(float));
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int ir = ir0; ir < ir1; ++ir) {
         // src0 and dst are viewed with shape of src1 and offset
@@ -4972,9 +4776,6 @@ static void ggml_compute_forward_set_i32(
         ggml_barrier(params->threadpool);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nr = ggml_nrows(src1);
     const int nc = src1->ne[0];
 
@@ -4993,12 +4794,8 @@ static void ggml_compute_forward_set_i32(
 
     GGML_ASSERT(nb10 == sizeof(int32_t));
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int ir = ir0; ir < ir1; ++ir) {
         // src0 and dst are viewed with shape of src1 and offset
@@ -5138,15 +4935,8 @@ static void ggml_compute_forward_get_rows_q(
     assert(nb00 == ggml_type_size(type));
     assert(ggml_nrows(dst) == nr);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int64_t i = ir0; i < ir1; ++i) {
         const int64_t i12 = i/(ne11*ne10);
@@ -5179,15 +4969,8 @@ static void ggml_compute_forward_get_rows_f16(
     assert(nb00 == sizeof(ggml_fp16_t));
     assert(ggml_nrows(dst) == nr);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int64_t i = ir0; i < ir1; ++i) {
         const int64_t i12 = i/(ne11*ne10);
@@ -5220,15 +5003,8 @@ static void ggml_compute_forward_get_rows_bf16(
     assert(nb00 == sizeof(ggml_bf16_t));
     assert(ggml_nrows(dst) == nr);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int64_t i = ir0; i < ir1; ++i) {
         const int64_t i12 = i/(ne11*ne10);
@@ -5261,15 +5037,8 @@ static void ggml_compute_forward_get_rows_f32(
     assert(nb00 == sizeof(float));
     assert(ggml_nrows(dst) == nr);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int64_t i = ir0; i < ir1; ++i) {
         const int64_t i12 = i/(ne11*ne10);
@@ -5375,15 +5144,8 @@ static void ggml_compute_forward_set_rows_f32(
     assert(ne02 % ne11 == 0);
     assert(ne03 % ne12 == 0);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int64_t dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int64_t ir0 = dr*ith;
-    const int64_t ir1 = std::min(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     ggml_from_float_t const from_float = ggml_get_type_traits_cpu(dst->type)->from_float;
 
@@ -5700,10 +5462,11 @@ static void ggml_compute_forward_soft_max_f32(
     memcpy(&max_bias, (float *) dst->op_params + 1, sizeof(float));
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     GGML_TENSOR_UNARY_OP_LOCALS
 
+    const auto [ir0, ir1] = get_thread_range(params, src0);
+
     const int64_t nb11 = src1 ? src1->nb[1] : 1;
     const int64_t nb12 = src1 ? src1->nb[2] : 1;
     const int64_t nb13 = src1 ? src1->nb[3] : 1;
@@ -5726,71 +5489,71 @@ static void ggml_compute_forward_soft_max_f32(
     // sinks
     const float * sk = src2 ? (float *)((char *) src2->data) : nullptr;
 
-    for (int64_t i03 = 0; i03 < ne03; i03++) {
-        for (int64_t i02 = 0; i02 < ne02; i02++) {
-            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
-                const int64_t i11 = i01;
-                const int64_t i12 = i02%ne12;
-                const int64_t i13 = i03%ne13;
-
-                // ALiBi
-                const uint32_t h = i02; // head
-                const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
-
-                float * sp = (float *)((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
-                float * dp = (float *)((char *)  dst->data + i01*nb1  + i02*nb2  + i03*nb3);
-
-                // broadcast the mask across rows
-                ggml_fp16_t * mp_f16 = src1 ? (ggml_fp16_t *)((char *) src1->data + i11*nb11 + i12*nb12 + i13*nb13) : NULL;
-                float       * mp_f32 = src1 ? (float       *)((char *) src1->data + i11*nb11 + i12*nb12 + i13*nb13) : NULL;
-
-                ggml_vec_cpy_f32  (ne00, wp, sp);
-                ggml_vec_scale_f32(ne00, wp, scale);
-                if (mp_f32) {
-                    if (use_f16) {
-                        for (int i = 0; i < ne00; ++i) {
-                            wp[i] += slope*GGML_CPU_FP16_TO_FP32(mp_f16[i]);
-                        }
-                    } else {
-                        for (int i = 0; i < ne00; ++i) {
-                            wp[i] += slope*mp_f32[i];
-                        }
-                    }
-                }
+    for (int64_t ir = ir0; ir < ir1; ++ir) {
+        const int64_t i03 = ir/(ne02*ne01);
+        const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+        const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
 
-#ifndef NDEBUG
+        const int64_t i11 = i01;
+        const int64_t i12 = i02%ne12;
+        const int64_t i13 = i03%ne13;
+
+        // ALiBi
+        const uint32_t h = i02; // head
+        const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
+
+        float * sp = (float *)((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+        float * dp = (float *)((char *)  dst->data + i01*nb1  + i02*nb2  + i03*nb3);
+
+        // broadcast the mask across rows
+        ggml_fp16_t * mp_f16 = src1 ? (ggml_fp16_t *)((char *) src1->data + i11*nb11 + i12*nb12 + i13*nb13) : NULL;
+        float       * mp_f32 = src1 ? (float       *)((char *) src1->data + i11*nb11 + i12*nb12 + i13*nb13) : NULL;
+
+        ggml_vec_cpy_f32  (ne00, wp, sp);
+        ggml_vec_scale_f32(ne00, wp, scale);
+        if (mp_f32) {
+            if (use_f16) {
+                for (int i = 0; i < ne00; ++i) {
+                    wp[i] += slope*GGML_CPU_FP16_TO_FP32(mp_f16[i]);
+                }
+            } else {
                 for (int i = 0; i < ne00; ++i) {
-                    //printf("p[%d] = %f\n", i, p[i]);
-                    assert(!isnan(wp[i]));
+                    wp[i] += slope*mp_f32[i];
                 }
+            }
+        }
+
+#ifndef NDEBUG
+        for (int i = 0; i < ne00; ++i) {
+            //printf("p[%d] = %f\n", i, p[i]);
+            assert(!isnan(wp[i]));
+        }
 #endif
 
-                float max = -INFINITY;
-                ggml_vec_max_f32(ne00, &max, wp);
+        float max = -INFINITY;
+        ggml_vec_max_f32(ne00, &max, wp);
 
-                // if we have sinks, make a correction as if they were included in the softmax
-                if (sk) {
-                    max = MAX(max, sk[i02]);
-                }
+        // if we have sinks, make a correction as if they were included in the softmax
+        if (sk) {
+            max = MAX(max, sk[i02]);
+        }
 
-                ggml_float sum = ggml_vec_soft_max_f32(ne00, dp, wp, max);
-                assert(sum > 0.0);
+        ggml_float sum = ggml_vec_soft_max_f32(ne00, dp, wp, max);
+        assert(sum > 0.0);
 
-                if (sk) {
-                    sum += (ggml_float) expf(sk[i02] - max);
-                }
+        if (sk) {
+            sum += (ggml_float) expf(sk[i02] - max);
+        }
 
-                sum = 1.0/sum;
-                ggml_vec_scale_f32(ne00, dp, sum);
+        sum = 1.0/sum;
+        ggml_vec_scale_f32(ne00, dp, sum);
 
 #ifndef NDEBUG
-                for (int i = 0; i < ne00; ++i) {
-                    assert(!isnan(dp[i]));
-                    assert(!isinf(dp[i]));
-                }
-#endif
-            }
+        for (int i = 0; i < ne00; ++i) {
+            assert(!isnan(dp[i]));
+            assert(!isinf(dp[i]));
         }
+#endif
     }
 }
 
@@ -5838,18 +5601,11 @@ static void ggml_compute_forward_soft_max_ext_back_f32(
 
     // TODO: handle transposed/permuted matrices
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int i1 = ir0; i1 < ir1; i1++) {
         float *dy = (float *)((char *) src0->data + i1*src0->nb[1]);
@@ -6178,19 +5934,14 @@ static void ggml_compute_forward_rope_f32(
     GGML_ASSERT(nb00 == sizeof(float));
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const int nr = ggml_nrows(dst);
 
     GGML_ASSERT(n_dims <= ne0);
     GGML_ASSERT(n_dims % 2 == 0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     // row index used to determine which thread to use
     int ir = 0;
@@ -6364,19 +6115,14 @@ static void ggml_compute_forward_rope_f16(
     GGML_ASSERT(nb0 == sizeof(ggml_fp16_t));
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const int nr = ggml_nrows(dst);
 
     GGML_ASSERT(n_dims <= ne0);
     GGML_ASSERT(n_dims % 2 == 0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     // row index used to determine which thread to use
     int ir = 0;
@@ -6576,7 +6322,6 @@ static void ggml_compute_forward_conv_transpose_1d_f16_f32(
     GGML_TENSOR_BINARY_OP_LOCALS
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const int nk = ne00*ne01*ne02;
 
@@ -6624,12 +6369,8 @@ static void ggml_compute_forward_conv_transpose_1d_f16_f32(
     // total rows in dst
     const int nr = ne1;
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     ggml_fp16_t * const wdata     = (ggml_fp16_t *) params->wdata + 0;
     ggml_fp16_t * const wdata_src = wdata + nk;
@@ -6664,7 +6405,6 @@ static void ggml_compute_forward_conv_transpose_1d_f32(
     GGML_TENSOR_BINARY_OP_LOCALS
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const int nk = ne00*ne01*ne02;
 
@@ -6712,12 +6452,8 @@ static void ggml_compute_forward_conv_transpose_1d_f32(
     // total rows in dst
     const int nr = ne1;
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     float * const wdata     = (float *) params->wdata + 0;
     float * const wdata_src = wdata + nk;
@@ -8166,6 +7902,18 @@ void ggml_compute_forward_argsort(
 
 // ggml_compute_forward_flash_attn_ext
 
+typedef void (*ggml_fa_vec_mad_t)(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT x, float v);
+
+// multiply-add of the V rows of the quantized types that have a fused kernel, nullptr for the others
+static ggml_fa_vec_mad_t ggml_fa_get_v_mad(ggml_type type) {
+    switch (type) {
+        case GGML_TYPE_Q4_0: return ggml_vec_mad_q4_0;
+        case GGML_TYPE_Q5_0: return ggml_vec_mad_q5_0;
+        case GGML_TYPE_Q8_0: return ggml_vec_mad_q8_0;
+        default:             return nullptr;
+    }
+}
+
 static void ggml_compute_forward_flash_attn_ext_f16(
         const ggml_compute_params * params,
         ggml_tensor * dst) {
@@ -8175,6 +7923,7 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     const ggml_tensor * v     = dst->src[2];
     const ggml_tensor * mask  = dst->src[3];
     const ggml_tensor * sinks = dst->src[4];
+    const ggml_tensor * blocks = dst->src[5];
 
     GGML_TENSOR_LOCALS(int64_t, neq, q,   ne)
     GGML_TENSOR_LOCALS(size_t,  nbq, q,   nb)
@@ -8186,7 +7935,6 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const int64_t DK = nek0;
     const int64_t DV = nev0;
@@ -8219,17 +7967,17 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     const int64_t rv2 = neq2/nev2;
     const int64_t rv3 = neq3/nev3;
 
+    // paged K/V: the logical rows are gathered through the block table
+    const int64_t bs  = blocks ? ggml_get_op_params_i32(dst, 4) : 1;
+    const int64_t n_kv = blocks ? blocks->ne[0]*bs : nek1;
+
     // parallelize by q rows using ggml_vec_dot_f32
 
     // total rows in q
     const int nr = neq1*neq2*neq3;
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     float scale         = 1.0f;
     float max_bias      = 0.0f;
@@ -8253,6 +8001,7 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     ggml_from_float_t const q_to_vec_dot   = ggml_get_type_traits_cpu(k_vec_dot_type)->from_float;
     ggml_vec_dot_t    const kq_vec_dot     = ggml_get_type_traits_cpu(k->type)->vec_dot;
     ggml_to_float_t   const v_to_float     = ggml_get_type_traits(v->type)->to_float;
+    ggml_fa_vec_mad_t const v_mad          = ggml_fa_get_v_mad(v->type);
 
     GGML_ASSERT((                            q_to_vec_dot) && "fattn: unsupported K-type");
     GGML_ASSERT((v->type == GGML_TYPE_F32 || v_to_float  ) && "fattn: unsupported V-type");
@@ -8291,21 +8040,33 @@ static void ggml_compute_forward_flash_attn_ext_f16(
         const int iv3 = iq3 / rv3;
         const int iv2 = iq2 / rv2;
 
+        const int32_t * bt = blocks ? (const int32_t *) ((const char *) blocks->data + iq3*blocks->nb[1]) : NULL;
+
         const float * pq = (const float *) ((char *) q->data + (iq1*nbq1 + iq2*nbq2 + iq3*nbq3));
         q_to_vec_dot(pq, Q_q, DK);
 
         // online softmax / attention
         // loop over n_kv and n_head_kv
         // ref: https://arxiv.org/pdf/2112.05682.pdf
-        for (int64_t ic = 0; ic < nek1; ++ic) {
+        for (int64_t ic = 0; ic < n_kv; ++ic) {
             const float mv = mp ? slope*GGML_CPU_FP16_TO_FP32(mp[ic]) : 0.0f;
             if (mv == -INFINITY) {
                 continue;
             }
 
+            // row of K/V
+            int64_t ik1 = ic;
+            if (bt) {
+                const int32_t ib = bt[ic/bs];
+                if (ib < 0) {
+                    continue;
+                }
+                ik1 = ib*bs + ic%bs;
+            }
+
             float s; // KQ value
 
-            const char * k_data = (const char *) k->data + ( ic*nbk1 + ik2*nbk2 + ik3*nbk3);
+            const char * k_data = (const char *) k->data + (ik1*nbk1 + ik2*nbk2 + ik3*nbk3);
             kq_vec_dot(DK, &s, 0, k_data, 0, Q_q, 0, 1);
 
             s = s*scale; // scale KQ value
@@ -8321,7 +8082,7 @@ static void ggml_compute_forward_flash_attn_ext_f16(
             float ms = 1.0f; // upon new higher max val, scale VKQ and KQ sum with this value
             float vs = 1.0f; // post-softmax KQ value, expf(s - M)
 
-            const char * v_data = ((const char *) v->data + (ic*nbv1 + iv2*nbv2 + iv3*nbv3));
+            const char * v_data = ((const char *) v->data + (ik1*nbv1 + iv2*nbv2 + iv3*nbv3));
 
             if (v->type == GGML_TYPE_F16) {
                 if (s > M) {
@@ -8352,7 +8113,9 @@ static void ggml_compute_forward_flash_attn_ext_f16(
                 }
 
                 // V += v*expf(s - M)
-                if (v_to_float) {
+                if (v_mad) {
+                    v_mad(DV, VKQ32, v_data, vs);
+                } else if (v_to_float) {
                     v_to_float(v_data, V32, DV);
                     ggml_vec_mad_f32(DV, VKQ32, V32, vs);
                 } else {
@@ -8404,6 +8167,330 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     }
 }
 
+// VKQ[iq] += sum_j P[iq][j]*V[j] for nq queries, with the accumulators of 4 queries and 2 vectors of the V
+// columns kept in registers while the nkv rows of V are streamed
+template <int NQ>
+static void ggml_fa_tile_pv_rows(int64_t nkv, int64_t DV, const float * P, const float * V, float * VKQ) {
+    for (int64_t d = 0; d < DV; d += 2*GGML_F32_EPR) {
+        GGML_F32_VEC acc[NQ][2];
+        for (int r = 0; r < NQ; ++r) {
+            acc[r][0] = GGML_F32_VEC_LOAD(VKQ + r*DV + d);
+            acc[r][1] = GGML_F32_VEC_LOAD(VKQ + r*DV + d + GGML_F32_EPR);
+        }
+        for (int64_t j = 0; j < nkv; ++j) {
+            const GGML_F32_VEC v0 = GGML_F32_VEC_LOAD(V + j*DV + d);
+            const GGML_F32_VEC v1 = GGML_F32_VEC_LOAD(V + j*DV + d + GGML_F32_EPR);
+            for (int r = 0; r < NQ; ++r) {
+                const GGML_F32_VEC p = GGML_F32_VEC_SET1(P[r*GGML_FA_TILE_KV + j]);
+                acc[r][0] = GGML_F32_VEC_FMA(acc[r][0], v0, p);
+                acc[r][1] = GGML_F32_VEC_FMA(acc[r][1], v1, p);
+            }
+        }
+        for (int r = 0; r < NQ; ++r) {
+            GGML_F32_VEC_STORE(VKQ + r*DV + d,                acc[r][0]);
+            GGML_F32_VEC_STORE(VKQ + r*DV + d + GGML_F32_EPR, acc[r][1]);
+        }
+    }
+}
+
+static void ggml_fa_tile_pv(int64_t nq, int64_t nkv, int64_t DV, const float * P, const float * V, float * VKQ) {
+    int64_t iq = 0;
+#if defined(GGML_SIMD) && !defined(__ARM_FEATURE_SVE) && !defined(__riscv_v_intrinsic)
+    if (DV % (2*GGML_F32_EPR) == 0) {
+        for (; iq + 4 <= nq; iq += 4) {
+            ggml_fa_tile_pv_rows<4>(nkv, DV, P + iq*GGML_FA_TILE_KV, V, VKQ + iq*DV);
+        }
+        for (; iq < nq; ++iq) {
+            ggml_fa_tile_pv_rows<1>(nkv, DV, P + iq*GGML_FA_TILE_KV, V, VKQ + iq*DV);
+        }
+    }
+#endif
+    for (; iq < nq; ++iq) {
+        for (int64_t j = 0; j < nkv; ++j) {
+            ggml_vec_mad_f32(DV, VKQ + iq*DV, V + j*DV, P[iq*GGML_FA_TILE_KV + j]);
+        }
+    }
+}
+
+// tiled variant for prompt processing: a tile of GGML_FA_TILE_Q queries of the same head is processed against
+// tiles of GGML_FA_TILE_KV keys/values, so that each K/V row is read once per tile of queries instead of once
+// per query. The queries of the tile are converted once to the vec dot type of K, so KQ uses the integer dot
+// products for quantized K, with llamafile_sgemm when possible. The V tile is converted to F32 once for all the
+// queries of the tile and softmax(KQ)*V is accumulated row by row of V so that it does not need to be transposed
+static void ggml_compute_forward_flash_attn_ext_tiled(
+        const ggml_compute_params * params,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * q     = dst->src[0];
+    const ggml_tensor * k     = dst->src[1];
+    const ggml_tensor * v     = dst->src[2];
+    const ggml_tensor * mask  = dst->src[3];
+    const ggml_tensor * sinks = dst->src[4];
+    const ggml_tensor * blocks = dst->src[5];
+
+    GGML_TENSOR_LOCALS(int64_t, neq, q,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbq, q,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nek, k,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbk, k,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nev, v,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbv, v,   nb)
+    GGML_TENSOR_LOCALS(int64_t, ne,  dst, ne)
+    GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int64_t DK = nek0;
+    const int64_t DV = nev0;
+
+    GGML_ASSERT(ne0 == DV);
+    GGML_ASSERT(ne2 == neq1);
+
+    GGML_ASSERT(nbq0 == ggml_type_size(q->type));
+    GGML_ASSERT(nbk0 == ggml_type_size(k->type));
+    GGML_ASSERT(nbv0 == ggml_type_size(v->type));
+
+    GGML_ASSERT(nb0 == sizeof(float));
+
+    const int64_t rk2 = neq2/nek2;
+    const int64_t rk3 = neq3/nek3;
+
+    const int64_t rv2 = neq2/nev2;
+    const int64_t rv3 = neq3/nev3;
+
+    // paged K/V: the tiles do not cross the blocks, so that their rows are contiguous
+    const int64_t bs  = blocks ? ggml_get_op_params_i32(dst, 4) : nek1;
+    const int64_t n_kv = blocks ? blocks->ne[0]*bs : nek1;
+
+    float scale         = 1.0f;
+    float max_bias      = 0.0f;
+    float logit_softcap = 0.0f;
+
+    memcpy(&scale,         (float *) dst->op_params + 0, sizeof(float));
+    memcpy(&max_bias,      (float *) dst->op_params + 1, sizeof(float));
+    memcpy(&logit_softcap, (float *) dst->op_params + 2, sizeof(float));
+
+    if (logit_softcap != 0) {
+        scale /= logit_softcap;
+    }
+
+    const uint32_t n_head      = neq2;
+    const uint32_t n_head_log2 = 1u << (uint32_t) floor(log2(n_head));
+
+    const float m0 = powf(2.0f, -(max_bias       ) / n_head_log2);
+    const float m1 = powf(2.0f, -(max_bias / 2.0f) / n_head_log2);
+
+    ggml_type         const k_vec_dot_type = ggml_get_type_traits_cpu(k->type)->vec_dot_type;
+    ggml_from_float_t const q_to_vec_dot   = ggml_get_type_traits_cpu(k_vec_dot_type)->from_float;
+    ggml_vec_dot_t    const kq_vec_dot     = ggml_get_type_traits_cpu(k->type)->vec_dot;
+    ggml_to_float_t   const v_to_float     = ggml_get_type_traits(v->type)->to_float;
+
+    GGML_ASSERT((                            q_to_vec_dot) && "fattn: unsupported K-type");
+    GGML_ASSERT((v->type == GGML_TYPE_F32 || v_to_float) && "fattn: unsupported V-type");
+
+    const size_t q_row_size = ggml_row_size(k_vec_dot_type, DK);
+    GGML_ASSERT(q_row_size <= DK*sizeof(float));
+
+    // per-thread buffers
+    float * wdata    = (float *) params->wdata + ith*(GGML_FA_TILED_WORK_SIZE(DK, DV) + CACHE_LINE_SIZE_F32);
+    char  * Q_q      = (char *) wdata;                          // [GGML_FA_TILE_Q][DK] Q in the vec dot type of K
+    float * KQ       = wdata + GGML_FA_TILE_Q*DK;               // [GGML_FA_TILE_Q][GGML_FA_TILE_KV] KQ, then softmax(KQ)
+    float * V32      = KQ + GGML_FA_TILE_Q*GGML_FA_TILE_KV;     // [GGML_FA_TILE_KV][DV] V tile converted to F32
+    float * VKQ      = V32 + GGML_FA_TILE_KV*DV;                // [GGML_FA_TILE_Q][DV] accumulators
+    float * M        = VKQ + GGML_FA_TILE_Q*DV;                 // [GGML_FA_TILE_Q] maximum KQ value
+    float * S        = M + GGML_FA_TILE_Q;                      // [GGML_FA_TILE_Q] sum
+    float * MK       = S + GGML_FA_TILE_Q;                      // [GGML_FA_TILE_Q][GGML_FA_TILE_KV] mask tile converted to F32
+
+#ifdef GGML_USE_LLAMAFILE
+    // each thread computes its own tiles, the products must not be split across the threads
+    ggml_compute_params params_tile = *params;
+    params_tile.ith = 0;
+    params_tile.nth = 1;
+    params_tile.row_split = NULL;
+#endif
+
+    const int64_t n_tile_q = (neq1 + GGML_FA_TILE_Q - 1)/GGML_FA_TILE_Q;
+
+    // total tiles of queries, the threads take them in turn to balance causal masks
+    const int64_t nr = n_tile_q*neq2*neq3;
+
+    for (int64_t ir = ith; ir < nr; ir += nth) {
+        const int64_t iq3 = ir/(neq2*n_tile_q);
+        const int64_t iq2 = (ir - iq3*neq2*n_tile_q)/n_tile_q;
+        const int64_t iq1 = (ir - iq3*neq2*n_tile_q - iq2*n_tile_q)*GGML_FA_TILE_Q; // first query of the tile
+
+        const int64_t nq = MIN(GGML_FA_TILE_Q, neq1 - iq1);
+
+        const uint32_t h = iq2; // head index
+        const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
+
+        // k indices
+        const int64_t ik3 = iq3 / rk3;
+        const int64_t ik2 = iq2 / rk2;
+
+        // v indices
+        const int64_t iv3 = iq3 / rv3;
+        const int64_t iv2 = iq2 / rv2;
+
+        const int32_t * bt = blocks ? (const int32_t *) ((const char *) blocks->data + iq3*blocks->nb[1]) : NULL;
+
+        const ggml_fp16_t * mp[GGML_FA_TILE_Q];
+
+        for (int64_t iq = 0; iq < nq; ++iq) {
+            const float * pq = (const float *) ((char *) q->data + ((iq1 + iq)*nbq1 + iq2*nbq2 + iq3*nbq3));
+            q_to_vec_dot(pq, Q_q + iq*q_row_size, DK);
+
+            mp[iq] = mask ? (ggml_fp16_t *)((char *) mask->data + (iq1 + iq)*mask->nb[1] + (iq2%mask->ne[2])*mask->nb[2] + (iq3%mask->ne[3])*mask->nb[3]) : NULL;
+
+            M[iq] = -INFINITY;
+            S[iq] = 0.0f;
+        }
+        memset(VKQ, 0, nq*DV*sizeof(float));
+
+        for (int64_t ic = 0, nkv = 0; ic < n_kv; ic += nkv) {
+            nkv = MIN(MIN(GGML_FA_TILE_KV, n_kv - ic), bs - ic%bs);
+
+            // first row of the tile in K/V
+            int64_t ik1 = ic;
+            if (bt) {
+                const int32_t ib = bt[ic/bs];
+                if (ib < 0) {
+                    continue;
+                }
+                ik1 = ib*bs + ic%bs;
+            }
+
+            // skip the tiles masked for all the queries, e.g. the future of the tile in causal attention
+            if (mask) {
+                bool masked = true;
+                for (int64_t iq = 0; iq < nq; ++iq) {
+                    float * mk = MK + iq*GGML_FA_TILE_KV;
+                    ggml_cpu_fp16_to_fp32(mp[iq] + ic, mk, nkv);
+                    for (int64_t j = 0; j < nkv && masked; ++j) {
+                        masked = mk[j] == -INFINITY;
+                    }
+                }
+                if (masked) {
+                    continue;
+                }
+            }
+
+            const char * k_data = (const char *) k->data + (ik1*nbk1 + ik2*nbk2 + ik3*nbk3);
+
+            // KQ = K*Q^T
+            bool done = false;
+#ifdef GGML_USE_LLAMAFILE
+            done = llamafile_sgemm(&params_tile, nkv, nq, DK/ggml_blck_size(k->type),
+                                   k_data, nbk1/ggml_type_size(k->type),
+                                   Q_q, q_row_size/ggml_type_size(k_vec_dot_type),
+                                   KQ, GGML_FA_TILE_KV,
+                                   k->type, k_vec_dot_type, GGML_TYPE_F32);
+#endif
+            if (!done) {
+                for (int64_t iq = 0; iq < nq; ++iq) {
+                    for (int64_t j = 0; j < nkv; ++j) {
+                        kq_vec_dot(DK, KQ + iq*GGML_FA_TILE_KV + j, 0, k_data + j*nbk1, 0, Q_q + iq*q_row_size, 0, 1);
+                    }
+                }
+            }
+
+            // online softmax, the rows of KQ become the weights of the V rows of the tile
+            for (int64_t iq = 0; iq < nq; ++iq) {
+                float * kq = KQ + iq*GGML_FA_TILE_KV;
+
+                ggml_vec_scale_f32(nkv, kq, scale);
+
+                if (logit_softcap != 0.0f) {
+                    for (int64_t j = 0; j < nkv; ++j) {
+                        kq[j] = logit_softcap*tanhf(kq[j]);
+                    }
+                }
+
+                if (mask) {
+                    ggml_vec_mad_f32(nkv, kq, MK + iq*GGML_FA_TILE_KV, slope);
+                }
+
+                float Mnew = -INFINITY;
+                ggml_vec_max_f32(nkv, &Mnew, kq);
+                Mnew = MAX(Mnew, M[iq]);
+
+                if (Mnew == -INFINITY) {
+                    // everything masked so far for this query
+                    memset(kq, 0, nkv*sizeof(float));
+                    continue;
+                }
+
+                // VKQ = VKQ*expf(Mold - M)
+                const float ms = expf(M[iq] - Mnew);
+                if (ms != 1.0f) {
+                    ggml_vec_scale_f32(DV, VKQ + iq*DV, ms);
+                }
+
+                S[iq] = S[iq]*ms + (float) ggml_vec_soft_max_f32(nkv, kq, kq, Mnew);
+                M[iq] = Mnew;
+            }
+
+            // V tile in F32
+            const char * v_data = (const char *) v->data + (ik1*nbv1 + iv2*nbv2 + iv3*nbv3);
+
+            const float * v32 = (const float *) v_data;
+            if (v->type != GGML_TYPE_F32 || nbv1 != DV*sizeof(float)) {
+                // whole tile at once when the rows are contiguous
+                const bool    cont = nbv1 == ggml_row_size(v->type, DV);
+                const int64_t nr   = cont ? 1 : nkv;
+                const int64_t n    = cont ? nkv*DV : DV;
+
+                for (int64_t j = 0; j < nr; ++j) {
+                    const char * vj = v_data + j*nbv1;
+                    switch (v->type) {
+                        case GGML_TYPE_F32:  memcpy(V32 + j*DV, vj, n*sizeof(float)); break;
+                        case GGML_TYPE_F16:  ggml_cpu_fp16_to_fp32((const ggml_fp16_t *) vj, V32 + j*DV, n); break;
+                        case GGML_TYPE_BF16: ggml_cpu_bf16_to_fp32((const ggml_bf16_t *) vj, V32 + j*DV, n); break;
+                        default:             v_to_float(vj, V32 + j*DV, n); break;
+                    }
+                }
+                v32 = V32;
+            }
+
+            // VKQ += softmax(KQ)*V
+            ggml_fa_tile_pv(nq, nkv, DV, KQ, v32, VKQ);
+        }
+
+        for (int64_t iq = 0; iq < nq; ++iq) {
+            float * vkq = VKQ + iq*DV;
+
+            // sinks
+            if (sinks) {
+                const float s = ((float *)((char *) sinks->data))[h];
+
+                float ms = 1.0f;
+                float vs = 1.0f;
+
+                if (s > M[iq]) {
+                    ms = expf(M[iq] - s);
+                    ggml_vec_scale_f32(DV, vkq, ms);
+                } else {
+                    vs = expf(s - M[iq]);
+                }
+
+                S[iq] = S[iq]*ms + vs;
+            }
+
+            // V /= S
+            const float S_inv = 1.0f/S[iq];
+            ggml_vec_scale_f32(DV, vkq, S_inv);
+
+            // dst indices
+            const int64_t i1 = iq1 + iq;
+            const int64_t i2 = iq2;
+            const int64_t i3 = iq3;
+
+            // permute(0, 2, 1, 3)
+            memcpy((char *) dst->data + (i3*ne2*ne1 + i2 + i1*ne1)*nb1, vkq, nb1);
+        }
+    }
+}
+
 void ggml_compute_forward_flash_attn_ext(
         const ggml_compute_params * params,
         ggml_tensor * dst) {
@@ -8412,7 +8499,11 @@ void ggml_compute_forward_flash_attn_ext(
         case GGML_PREC_F32:
             {
                 // uses F32 accumulators
-                ggml_compute_forward_flash_attn_ext_f16(params, dst);
+                if (dst->src[0]->ne[1] >= GGML_FA_TILE_Q_MIN) {
+                    ggml_compute_forward_flash_attn_ext_tiled(params, dst);
+                } else {
+                    ggml_compute_forward_flash_attn_ext_f16(params, dst);
+                }
             } break;
         default:
             {
@@ -8445,7 +8536,6 @@ static void ggml_compute_forward_flash_attn_back_f32(
     GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const int64_t D = neq0;
     const int64_t N = neq1;
@@ -8516,12 +8606,8 @@ static void ggml_compute_forward_flash_attn_back_f32(
     // total rows in k
     const int nr = nek2*nek3;
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     const float scale = 1.0f/sqrtf(D);
 
@@ -8765,9 +8851,6 @@ static void ggml_compute_forward_ssm_conv_f32(
     const ggml_tensor * src0 = dst->src[0]; // conv_x
     const ggml_tensor * src1 = dst->src[1]; // conv1d.weight
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc  = src1->ne[0]; // d_conv
     const int ncs = src0->ne[0]; // d_conv - 1 + n_t
     const int nr  = src0->ne[1]; // d_inner
@@ -8779,12 +8862,8 @@ static void ggml_compute_forward_ssm_conv_f32(
     GGML_ASSERT(src1->nb[0] == sizeof(float));
     GGML_ASSERT(src0->nb[1] == src0->ne[0]*sizeof(float));
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
     const int ir  = ir1 - ir0;
 
     for (int i3 = 0; i3 < n_s; ++i3) {
@@ -10150,12 +10229,8 @@ static void ggml_compute_forward_cross_entropy_loss_f32(
 
     GGML_ASSERT(params->wsize >= sizeof(float) * (nth + nth * nc));
 
-    // rows per thread
-    const int64_t dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int64_t ir0 = dr*ith;
-    const int64_t ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     for (int64_t i1 = ir0; i1 < ir1; ++i1) {
         const float * s0 = (const float *)((const char *) src0->data + i1*src0->nb[1]);
@@ -10232,19 +10307,12 @@ static void ggml_compute_forward_cross_entropy_loss_back_f32(
     GGML_ASSERT(ggml_is_contiguous(grad));
     GGML_ASSERT(ggml_are_same_shape(src0f, src1f) && ggml_are_same_shape(src0f, dst));
 
-    const int64_t ith = params->ith;
-    const int64_t nth = params->nth;
-
     // TODO: handle transposed/permuted matrices
     const int64_t nc = src0f->ne[0];
     const int64_t nr = ggml_nrows(src0f);
 
-    // rows per thread
-    const int64_t dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int64_t ir0 = dr*ith;
-    const int64_t ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     const float d_by_nr = ((const float *) grad->data)[0] / (float) nr;
 
@@ -10314,20 +10382,13 @@ static void ggml_compute_forward_opt_step_adamw_f32(
     GGML_ASSERT(ggml_are_same_shape(src0, src0_grad_v));
     GGML_ASSERT(ggml_nelements(adamw_params) == 7);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nr  = ggml_nrows(src0);
 
     GGML_TENSOR_UNARY_OP_LOCALS
     GGML_ASSERT(nb00 == sizeof(float));
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
     // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     const float * adamw_params_ptr = ggml_get_data_f32(adamw_params);
 
@@ -10392,20 +10453,13 @@ static void ggml_compute_forward_opt_step_sgd_f32(const ggml_compute_params * pa
     GGML_ASSERT(ggml_are_same_shape(src0, src0_grad));
     GGML_ASSERT(ggml_nelements(sgd_params) == 2);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nr = ggml_nrows(src0);
 
     GGML_TENSOR_UNARY_OP_LOCALS
     GGML_ASSERT(nb00 == sizeof(float));
 
-    // rows per thread
-    const int dr = (nr + nth - 1) / nth;
-
     // row range for this thread
-    const int ir0 = dr * ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    const auto [ir0, ir1] = get_thread_range(params, nr);
 
     // using adamw param subset we care about - alpha, wd - could have a separate struct
     const float * sgd_params_ptr   = ggml_get_data_f32(sgd_params);
@@ -23,6 +23,16 @@ static const size_t CACHE_LINE_SIZE_F32 = CACHE_LINE_SIZE/sizeof(float);
 // Work buffer size for im2col operations in CONV2D
 #define GGML_IM2COL_WORK_SIZE (16 * 1024 * 1024)
 
+// flash attention with at least GGML_FA_TILE_Q_MIN queries processes tiles of GGML_FA_TILE_Q queries against
+// tiles of GGML_FA_TILE_KV keys/values
+#define GGML_FA_TILE_Q     32
+#define GGML_FA_TILE_KV    64
+#define GGML_FA_TILE_Q_MIN 8
+
+// work buffer of the tiled flash attention per thread, in floats: Q, KQ, V tile, VKQ, softmax state, mask
+#define GGML_FA_TILED_WORK_SIZE(DK, DV) \
+    (GGML_FA_TILE_Q*(DK) + GGML_FA_TILE_Q*GGML_FA_TILE_KV + GGML_FA_TILE_KV*(DV) + GGML_FA_TILE_Q*(DV) + 2*GGML_FA_TILE_Q + GGML_FA_TILE_Q*GGML_FA_TILE_KV)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -1180,6 +1180,76 @@ void ggml_vec_dot_iq4_xs_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs,
     *s = sumf;
 }
 
+// ============================ multiply-add
+
+// the single-query flash attention accumulates the quantized V rows with these instead of converting them
+// to F32 first (the tiled kernel converts a V tile once for all its queries)
+
+void ggml_vec_mad_q4_0_generic(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v) {
+    const int qk = QK4_0;
+    const int nb = n / qk;
+
+    assert(n % qk == 0);
+
+    const block_q4_0 * GGML_RESTRICT x = vx;
+
+    for (int ib = 0; ib < nb; ++ib) {
+        const float d = GGML_CPU_FP16_TO_FP32(x[ib].d)*v;
+
+        float * GGML_RESTRICT yb = y + ib*qk;
+
+        for (int j = 0; j < qk/2; ++j) {
+            yb[j]        += d*((x[ib].qs[j] & 0x0F) - 8);
+            yb[j + qk/2] += d*((x[ib].qs[j] >>   4) - 8);
+        }
+    }
+}
+
+void ggml_vec_mad_q5_0_generic(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v) {
+    const int qk = QK5_0;
+    const int nb = n / qk;
+
+    assert(n % qk == 0);
+
+    const block_q5_0 * GGML_RESTRICT x = vx;
+
+    for (int ib = 0; ib < nb; ++ib) {
+        const float d = GGML_CPU_FP16_TO_FP32(x[ib].d)*v;
+
+        uint32_t qh;
+        memcpy(&qh, x[ib].qh, sizeof(qh));
+
+        float * GGML_RESTRICT yb = y + ib*qk;
+
+        for (int j = 0; j < qk/2; ++j) {
+            const uint8_t xh_0 = ((qh >> (j +  0)) << 4) & 0x10;
+            const uint8_t xh_1 = ((qh >> (j + 12))     ) & 0x10;
+
+            yb[j]        += d*(((x[ib].qs[j] & 0x0F) | xh_0) - 16);
+            yb[j + qk/2] += d*(((x[ib].qs[j] >>   4) | xh_1) - 16);
+        }
+    }
+}
+
+void ggml_vec_mad_q8_0_generic(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+
+    assert(n % qk == 0);
+
+    const block_q8_0 * GGML_RESTRICT x = vx;
+
+    for (int ib = 0; ib < nb; ++ib) {
+        const float d = GGML_CPU_FP16_TO_FP32(x[ib].d)*v;
+
+        float * GGML_RESTRICT yb = y + ib*qk;
+
+        for (int j = 0; j < qk; ++j) {
+            yb[j] += d*x[ib].qs[j];
+        }
+    }
+}
+
 // ============================ 4-bit non-linear quants
 
 void quantize_row_iq4_nl(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
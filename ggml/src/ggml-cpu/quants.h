@@ -62,6 +62,11 @@ void ggml_vec_dot_iq4_nl_q8_0 (int n, float * GGML_RESTRICT s, size_t bs, const
 void ggml_vec_dot_iq4_xs_q8_K (int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc);
 void ggml_vec_dot_iq3_s_q8_K  (int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc);
 
+// Multiply-add of a quantized row: y += v*x, x is dequantized on the fly
+void ggml_vec_mad_q4_0(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v);
+void ggml_vec_mad_q5_0(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v);
+void ggml_vec_mad_q8_0(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v);
+
 // Generic implementation
 void quantize_row_q8_0_generic(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, int64_t k);
 void quantize_row_q8_1_generic(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, int64_t k);
@@ -92,6 +97,10 @@ void ggml_vec_dot_iq1_m_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs,
 void ggml_vec_dot_iq4_nl_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc);
 void ggml_vec_dot_iq4_xs_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc);
 
+void ggml_vec_mad_q4_0_generic(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v);
+void ggml_vec_mad_q5_0_generic(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v);
+void ggml_vec_mad_q8_0_generic(int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT vx, float v);
+
 #ifdef __cplusplus
 }
 #endif
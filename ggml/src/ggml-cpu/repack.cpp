@@ -198,6 +198,192 @@ template <> void ggml_quantize_mat_t<8, GGML_TYPE_Q8_K>(const float * GGML_RESTR
     ggml_quantize_mat_q8_K_4x8(x, vy, n_per_row);
 }
 
+// Q3_K, Q5_K and Q6_K interleaved blocks: the reference unpack to block_kx8_unpacked and dot product
+
+static void unpack_scales_kx8(const uint8_t * GGML_RESTRICT scales, int * GGML_RESTRICT v) {
+    for (int j = 0; j < 16; j++) {
+        for (int r = 0; r < 8; r++) {
+            const int lo = (scales[(j % 8) * 8 + r] >> (4 * (j / 8))) & 0xF;
+            const int hi = (scales[64 + (j % 4) * 8 + r] >> (2 * (j / 4))) & 3;
+            v[j * 8 + r] = lo | (hi << 4);
+        }
+    }
+}
+
+// sc and mn are the scale and the min of each 16-element sub-block, as [sub-block][row]
+static void set_scales_kx8(block_kx8_unpacked & t, const int * sc, const int * mn) {
+    for (int j = 0; j < QK_K / 16; j++) {
+        for (int r = 0; r < 8; r++) {
+            for (int l = 0; l < 4; l++) {
+                t.scales[j][r * 4 + l] = sc[j * 8 + r];
+            }
+        }
+    }
+    for (int p = 0; p < QK_K / 32; p++) {
+        for (int r = 0; r < 8; r++) {
+            t.mins[p][r * 2 + 0] = mn[(2 * p + 0) * 8 + r];
+            t.mins[p][r * 2 + 1] = mn[(2 * p + 1) * 8 + r];
+        }
+    }
+}
+
+static void unpack_q3_Kx8_generic(const block_q3_Kx8 & b, block_kx8_unpacked & t) {
+    int v[128];
+    int sc[128];
+    int mn[128];
+
+    unpack_scales_kx8(b.scales, v);
+    for (int i = 0; i < 128; i++) {
+        sc[i] = v[i] - 32;
+        mn[i] = 4 * sc[i];
+    }
+    set_scales_kx8(t, sc, mn);
+
+    for (int r = 0; r < 8; r++) {
+        t.d[r]    = GGML_CPU_FP16_TO_FP32(b.d[r]);
+        t.dmin[r] = t.d[r];
+    }
+
+    for (int k = 0; k < QK_K / 8; k++) {
+        for (int i = 0; i < 64; i++) {
+            const int q2 = (b.qs[(k % 8) * 64 + i] >> (2 * (k / 8))) & 3;
+            const int h  = (b.hmask[(k % 4) * 64 + i] >> (k / 4)) & 1;
+            t.qs[k][i] = q2 | (h << 2);
+        }
+    }
+}
+
+static void unpack_q5_Kx8_generic(const block_q5_Kx8 & b, block_kx8_unpacked & t) {
+    int v[128];
+    int sc[128];
+    int mn[128];
+
+    unpack_scales_kx8(b.scales, v);
+    for (int j = 0; j < QK_K / 16; j++) {
+        for (int r = 0; r < 8; r++) {
+            sc[j * 8 + r] = v[(j / 2) * 8 + r];
+            mn[j * 8 + r] = v[(8 + j / 2) * 8 + r];
+        }
+    }
+    set_scales_kx8(t, sc, mn);
+
+    for (int r = 0; r < 8; r++) {
+        t.d[r]    = GGML_CPU_FP16_TO_FP32(b.d[r]);
+        t.dmin[r] = GGML_CPU_FP16_TO_FP32(b.dmin[r]);
+    }
+
+    for (int k = 0; k < QK_K / 8; k++) {
+        for (int i = 0; i < 64; i++) {
+            const int q4 = (b.qs[(k % 16) * 64 + i] >> (4 * (k / 16))) & 0xF;
+            const int h  = (b.qh[(k % 4) * 64 + i] >> (k / 4)) & 1;
+            t.qs[k][i] = q4 | (h << 4);
+        }
+    }
+}
+
+static void unpack_q6_Kx8_generic(const block_q6_Kx8 & b, block_kx8_unpacked & t) {
+    int sc[128];
+    int mn[128];
+
+    for (int i = 0; i < 128; i++) {
+        sc[i] = b.scales[i];
+        mn[i] = 32 * sc[i];
+    }
+    set_scales_kx8(t, sc, mn);
+
+    for (int r = 0; r < 8; r++) {
+        t.d[r]    = GGML_CPU_FP16_TO_FP32(b.d[r]);
+        t.dmin[r] = t.d[r];
+    }
+
+    for (int k = 0; k < QK_K / 8; k++) {
+        for (int i = 0; i < 64; i++) {
+            const int q4 = (b.ql[(k % 16) * 64 + i] >> (4 * (k / 16))) & 0xF;
+            const int h  = (b.qh[(k % 8) * 64 + i] >> (2 * (k / 8))) & 3;
+            t.qs[k][i] = q4 | (h << 4);
+        }
+    }
+}
+
+// dot products of the 8 rows of the tile with a q8_K row: the 8-element chunks of the row are a_stride
+// bytes apart and bsums are the sums of its 16-element sub-blocks
+static void dot_kx8_unpacked_generic(const block_kx8_unpacked & t, const int8_t * a, int a_stride, const int16_t * bsums, float d, float * s) {
+    for (int r = 0; r < 8; r++) {
+        int sumi = 0;
+        for (int j = 0; j < QK_K / 16; j++) {
+            int sumj = 0;
+            for (int k = 2 * j; k < 2 * j + 2; k++) {
+                for (int i = 0; i < 8; i++) {
+                    sumj += t.qs[k][r * 8 + i] * a[k * a_stride + i];
+                }
+            }
+            sumi += sumj * t.scales[j][r * 4];
+        }
+        int summ = 0;
+        for (int p = 0; p < QK_K / 32; p++) {
+            summ += t.mins[p][r * 2 + 0] * bsums[2 * p + 0] + t.mins[p][r * 2 + 1] * bsums[2 * p + 1];
+        }
+        s[r] = d * (t.d[r] * sumi - t.dmin[r] * summ);
+    }
+}
+
+template <typename BLOC_TYPE, void (*UNPACK)(const BLOC_TYPE &, block_kx8_unpacked &)>
+static void gemv_kx8_q8_K_generic(int n, float * GGML_RESTRICT s, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nc) {
+    const int nb = n / QK_K;
+
+    assert(n % QK_K == 0);
+    assert(nc % 8 == 0);
+
+    block_kx8_unpacked t;
+    float sumf[8];
+    float tmp[8];
+
+    const block_q8_K * a_ptr = (const block_q8_K *) vy;
+    for (int x = 0; x < nc / 8; x++) {
+        const BLOC_TYPE * b_ptr = (const BLOC_TYPE *) vx + (x * nb);
+        for (int j = 0; j < 8; j++) sumf[j] = 0.0f;
+        for (int l = 0; l < nb; l++) {
+            UNPACK(b_ptr[l], t);
+            dot_kx8_unpacked_generic(t, a_ptr[l].qs, 8, a_ptr[l].bsums, a_ptr[l].d, tmp);
+            for (int j = 0; j < 8; j++) sumf[j] += tmp[j];
+        }
+        for (int j = 0; j < 8; j++) s[x * 8 + j] = sumf[j];
+    }
+}
+
+// each block of 8 rows is unpacked once for all the activation rows
+template <typename BLOC_TYPE, void (*UNPACK)(const BLOC_TYPE &, block_kx8_unpacked &)>
+static void gemm_kx8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int nb = n / QK_K;
+
+    assert(n % QK_K == 0);
+    assert(nr % 4 == 0);
+    assert(nc % 8 == 0);
+
+    block_kx8_unpacked t;
+    int16_t bsums[QK_K / 16];
+    float tmp[8];
+
+    for (int x = 0; x < nc / 8; x++) {
+        const BLOC_TYPE * b_ptr = (const BLOC_TYPE *) vx + (x * nb);
+        for (int l = 0; l < nb; l++) {
+            UNPACK(b_ptr[l], t);
+            for (int y = 0; y < nr / 4; y++) {
+                const block_q8_Kx4 * a_ptr = (const block_q8_Kx4 *) vy + (y * nb) + l;
+                for (int m = 0; m < 4; m++) {
+                    for (int g = 0; g < 4; g++) {
+                        memcpy(bsums + g * 4, a_ptr->bsums + g * 16 + m * 4, 4 * sizeof(int16_t));
+                    }
+                    dot_kx8_unpacked_generic(t, a_ptr->qs + m * 8, 32, bsums, a_ptr->d[m], tmp);
+
+                    float * dst = s + (y * 4 + m) * bs + x * 8;
+                    for (int j = 0; j < 8; j++) dst[j] = l == 0 ? tmp[j] : dst[j] + tmp[j];
+                }
+            }
+        }
+    }
+}
+
 extern "C" {
 
 void ggml_gemv_q4_0_4x4_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
@@ -487,6 +673,66 @@ void ggml_gemv_q2_K_8x8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs,
     }
 }
 
+void ggml_gemv_q3_K_8x8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    assert(nr == 1);
+    UNUSED(bs);
+    UNUSED(nr);
+
+    gemv_kx8_q8_K_generic<block_q3_Kx8, unpack_q3_Kx8_generic>(n, s, vx, vy, nc);
+}
+
+void ggml_gemv_q5_K_8x8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    assert(nr == 1);
+    UNUSED(bs);
+    UNUSED(nr);
+
+    gemv_kx8_q8_K_generic<block_q5_Kx8, unpack_q5_Kx8_generic>(n, s, vx, vy, nc);
+}
+
+void ggml_gemv_q6_K_8x8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    assert(nr == 1);
+    UNUSED(bs);
+    UNUSED(nr);
+
+    gemv_kx8_q8_K_generic<block_q6_Kx8, unpack_q6_Kx8_generic>(n, s, vx, vy, nc);
+}
+
+void ggml_gemv_q8_0_8x8_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert(nr == 1);
+    assert(n % qk == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    UNUSED(bs);
+    UNUSED(nr);
+
+    float sumf[8];
+    int sumi;
+
+    const block_q8_0 * a_ptr = (const block_q8_0 *) vy;
+    for (int x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+
+        for (int j = 0; j < ncols_interleaved; j++) sumf[j] = 0.0;
+        for (int l = 0; l < nb; l++) {
+            for (int j = 0; j < ncols_interleaved; j++) {
+                sumi = 0;
+                for (int k = 0; k < (qk / blocklen); k++) {
+                    for (int i = 0; i < blocklen; ++i) {
+                        sumi += b_ptr[l].qs[k * ncols_interleaved * blocklen + j * blocklen + i] * a_ptr[l].qs[k * blocklen + i];
+                    }
+                }
+                sumf[j] += sumi * GGML_CPU_FP16_TO_FP32(b_ptr[l].d[j]) * GGML_CPU_FP16_TO_FP32(a_ptr[l].d);
+            }
+        }
+        for (int j = 0; j < ncols_interleaved; j++) s[x * ncols_interleaved + j] = sumf[j];
+    }
+}
+
 void ggml_gemv_iq4_nl_4x4_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
     const int qk = QK8_0;
     const int nb = n / qk;
@@ -907,6 +1153,60 @@ void ggml_gemm_q2_K_8x8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs,
 }
 
 
+void ggml_gemm_q3_K_8x8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    gemm_kx8_q8_K_generic<block_q3_Kx8, unpack_q3_Kx8_generic>(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemm_q5_K_8x8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    gemm_kx8_q8_K_generic<block_q5_Kx8, unpack_q5_Kx8_generic>(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemm_q6_K_8x8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    gemm_kx8_q8_K_generic<block_q6_Kx8, unpack_q6_Kx8_generic>(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemm_q8_0_8x8_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert(n % qk == 0);
+    assert(nr % 4 == 0);
+    assert(nc % ncols_interleaved == 0);
+
+    float sumf[4][8];
+    int sumi;
+
+    for (int y = 0; y < nr / 4; y++) {
+        const block_q8_0x4 * a_ptr = (const block_q8_0x4 *) vy + (y * nb);
+        for (int x = 0; x < nc / ncols_interleaved; x++) {
+            const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++) sumf[m][j] = 0.0;
+            }
+            for (int l = 0; l < nb; l++) {
+                for (int m = 0; m < 4; m++) {
+                    for (int j = 0; j < ncols_interleaved; j++) {
+                        sumi = 0;
+                        for (int k = 0; k < (qk / blocklen); k++) {
+                            for (int i = 0; i < blocklen; ++i) {
+                                sumi += b_ptr[l].qs[k * ncols_interleaved * blocklen + j * blocklen + i] *
+                                        a_ptr[l].qs[k * 4 * blocklen + m * blocklen + i];
+                            }
+                        }
+                        sumf[m][j] += sumi * GGML_CPU_FP16_TO_FP32(b_ptr[l].d[j]) * GGML_CPU_FP16_TO_FP32(a_ptr[l].d[m]);
+                    }
+                }
+            }
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++)
+                    s[(y * 4 + m) * bs + x * ncols_interleaved + j] = sumf[m][j];
+            }
+        }
+    }
+}
+
 void ggml_gemm_iq4_nl_4x4_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
     const int qk = QK8_0;
     const int nb = n / qk;
@@ -1446,6 +1746,247 @@ static int repack_iq4_nl_to_iq4_nl_8_bl(struct ggml_tensor * t, int interleave_b
     GGML_UNUSED(data_size);
 }
 
+// pack the 6-bit scales v[j*8 + r] of the Q3_K and Q5_K interleaved blocks
+static void pack_scales_kx8(const int * v, uint8_t * scales) {
+    memset(scales, 0, 96);
+    for (int j = 0; j < 16; j++) {
+        for (int r = 0; r < 8; r++) {
+            scales[(j % 8) * 8 + r]      |= (v[j * 8 + r] & 0xF) << (4 * (j / 8));
+            scales[64 + (j % 4) * 8 + r] |= (v[j * 8 + r] >> 4)  << (2 * (j / 4));
+        }
+    }
+}
+
+static block_q3_Kx8 make_block_q3_Kx8(block_q3_K * in) {
+    block_q3_Kx8 out;
+
+    memset(out.hmask, 0, sizeof(out.hmask));
+    memset(out.qs,    0, sizeof(out.qs));
+
+    static const uint32_t kmask1 = 0x03030303;
+    static const uint32_t kmask2 = 0x0f0f0f0f;
+
+    int v[128];
+
+    for (int r = 0; r < 8; r++) {
+        out.d[r] = in[r].d;
+
+        // the 16 scales of the Q3_K block, with the offset of 32
+        uint32_t aux[4];
+        memcpy(aux, in[r].scales, 12);
+        const uint32_t tmp = aux[2];
+        aux[2] = ((aux[0] >> 4) & kmask2) | (((tmp >> 4) & kmask1) << 4);
+        aux[3] = ((aux[1] >> 4) & kmask2) | (((tmp >> 6) & kmask1) << 4);
+        aux[0] = (aux[0] & kmask2) | (((tmp >> 0) & kmask1) << 4);
+        aux[1] = (aux[1] & kmask2) | (((tmp >> 2) & kmask1) << 4);
+
+        const uint8_t * sc = (const uint8_t *) aux;
+        for (int j = 0; j < 16; j++) {
+            v[j * 8 + r] = sc[j];
+        }
+
+        // element e: 2 bits at shift 2*t of qs[32*n + l] and bit 4*n + t of hmask[l],
+        // with n = e / 128, t = (e % 128) / 32, l = e % 32
+        for (int e = 0; e < QK_K; e++) {
+            const int n = e / 128;
+            const int t = (e % 128) / 32;
+            const int l = e % 32;
+
+            const int q2 = (in[r].qs[32 * n + l] >> (2 * t)) & 3;
+            const int h  = (in[r].hmask[l] >> (4 * n + t)) & 1;
+
+            const int k = e / 8;
+            const int i = r * 8 + e % 8;
+            out.qs[(k % 8) * 64 + i]    |= q2 << (2 * (k / 8));
+            out.hmask[(k % 4) * 64 + i] |= h  << (k / 4);
+        }
+    }
+
+    pack_scales_kx8(v, out.scales);
+
+    return out;
+}
+
+static block_q5_Kx8 make_block_q5_Kx8(block_q5_K * in) {
+    block_q5_Kx8 out;
+
+    memset(out.qh, 0, sizeof(out.qh));
+    memset(out.qs, 0, sizeof(out.qs));
+
+    int v[128];
+
+    for (int r = 0; r < 8; r++) {
+        out.d[r]    = in[r].GGML_COMMON_AGGR_U.GGML_COMMON_AGGR_S.d;
+        out.dmin[r] = in[r].GGML_COMMON_AGGR_U.GGML_COMMON_AGGR_S.dmin;
+
+        // scales and mins of the 32-element sub-blocks, 6 bits each in 12 bytes
+        const uint8_t * q = in[r].scales;
+        for (int j = 0; j < 8; j++) {
+            int sc;
+            int m;
+            if (j < 4) {
+                sc = q[j] & 63;
+                m  = q[j + 4] & 63;
+            } else {
+                sc = (q[j + 4] & 0xF) | ((q[j - 4] >> 6) << 4);
+                m  = (q[j + 4] >>  4) | ((q[j - 0] >> 6) << 4);
+            }
+            v[j * 8 + r]       = sc;
+            v[(8 + j) * 8 + r] = m;
+        }
+
+        // element e: nibble h of qs[32*g + l] and bit 2*g + h of qh[l],
+        // with g = e / 64, h = (e % 64) / 32, l = e % 32
+        for (int e = 0; e < QK_K; e++) {
+            const int g = e / 64;
+            const int h = (e % 64) / 32;
+            const int l = e % 32;
+
+            const int q4 = (in[r].qs[32 * g + l] >> (4 * h)) & 0xF;
+            const int q1 = (in[r].qh[l] >> (2 * g + h)) & 1;
+
+            const int k = e / 8;
+            const int i = r * 8 + e % 8;
+            out.qs[(k % 16) * 64 + i] |= q4 << (4 * (k / 16));
+            out.qh[(k % 4) * 64 + i]  |= q1 << (k / 4);
+        }
+    }
+
+    pack_scales_kx8(v, out.scales);
+
+    return out;
+}
+
+static block_q6_Kx8 make_block_q6_Kx8(block_q6_K * in) {
+    block_q6_Kx8 out;
+
+    memset(out.ql, 0, sizeof(out.ql));
+    memset(out.qh, 0, sizeof(out.qh));
+
+    for (int r = 0; r < 8; r++) {
+        out.d[r] = in[r].d;
+
+        for (int j = 0; j < QK_K / 16; j++) {
+            out.scales[j * 8 + r] = in[r].scales[j];
+        }
+
+        // element e: nibble t / 2 of ql[64*n + 32*(t % 2) + l] and 2 bits at shift 2*t of qh[32*n + l],
+        // with n = e / 128, t = (e % 128) / 32, l = e % 32
+        for (int e = 0; e < QK_K; e++) {
+            const int n = e / 128;
+            const int t = (e % 128) / 32;
+            const int l = e % 32;
+
+            const int q4 = (in[r].ql[64 * n + 32 * (t % 2) + l] >> (4 * (t / 2))) & 0xF;
+            const int q2 = (in[r].qh[32 * n + l] >> (2 * t)) & 3;
+
+            const int k = e / 8;
+            const int i = r * 8 + e % 8;
+            out.ql[(k % 16) * 64 + i] |= q4 << (4 * (k / 16));
+            out.qh[(k % 8) * 64 + i]  |= q2 << (2 * (k / 8));
+        }
+    }
+
+    return out;
+}
+
+static block_q8_0x8 make_block_q8_0x8(block_q8_0 * in, unsigned int blck_size_interleave) {
+    block_q8_0x8 out;
+
+    for (int i = 0; i < 8; i++) {
+        out.d[i] = in[i].d;
+    }
+
+    // interleave the quants of the 8 blocks, blck_size_interleave bytes at a time
+    const int end = QK8_0 * 8 / blck_size_interleave;
+    for (int i = 0; i < end; ++i) {
+        int src_id = i % 8;
+        int src_offset = (i / 8) * blck_size_interleave;
+        int dst_offset = i * blck_size_interleave;
+
+        memcpy(&out.qs[dst_offset], &in[src_id].qs[src_offset], blck_size_interleave);
+    }
+
+    return out;
+}
+
+template <typename SRC_TYPE, typename DST_TYPE, DST_TYPE (*MAKE_BLOCK)(SRC_TYPE *)>
+static int repack_k_to_kx8_bl(struct ggml_tensor * t, int interleave_block, const void * GGML_RESTRICT data, size_t data_size) {
+    GGML_ASSERT(interleave_block == 8);
+    constexpr int nrows_interleaved = 8;
+
+    DST_TYPE * dst = (DST_TYPE *)t->data;
+    const SRC_TYPE * src = (const SRC_TYPE *) data;
+    SRC_TYPE dst_tmp[8];
+    int nrow = ggml_nrows(t);
+    int nblocks = t->ne[0] / QK_K;
+
+    GGML_ASSERT(data_size == nrow * nblocks * sizeof(SRC_TYPE));
+
+    if (t->ne[1] % nrows_interleaved != 0 || t->ne[0] % QK_K != 0) {
+        return -1;
+    }
+
+    for (int b = 0; b < nrow; b += nrows_interleaved) {
+        for (int64_t x = 0; x < nblocks; x++) {
+            for (int i  = 0; i < nrows_interleaved; i++ ) {
+                dst_tmp[i] = src[x + i * nblocks];
+            }
+            *dst++ = MAKE_BLOCK(dst_tmp);
+        }
+        src += nrows_interleaved * nblocks;
+    }
+    return 0;
+
+    GGML_UNUSED(data_size);
+}
+
+static int repack_q3_K_to_q3_K_8_bl(struct ggml_tensor * t, int interleave_block, const void * GGML_RESTRICT data, size_t data_size) {
+    GGML_ASSERT(t->type == GGML_TYPE_Q3_K);
+    return repack_k_to_kx8_bl<block_q3_K, block_q3_Kx8, make_block_q3_Kx8>(t, interleave_block, data, data_size);
+}
+
+static int repack_q5_K_to_q5_K_8_bl(struct ggml_tensor * t, int interleave_block, const void * GGML_RESTRICT data, size_t data_size) {
+    GGML_ASSERT(t->type == GGML_TYPE_Q5_K);
+    return repack_k_to_kx8_bl<block_q5_K, block_q5_Kx8, make_block_q5_Kx8>(t, interleave_block, data, data_size);
+}
+
+static int repack_q6_K_to_q6_K_8_bl(struct ggml_tensor * t, int interleave_block, const void * GGML_RESTRICT data, size_t data_size) {
+    GGML_ASSERT(t->type == GGML_TYPE_Q6_K);
+    return repack_k_to_kx8_bl<block_q6_K, block_q6_Kx8, make_block_q6_Kx8>(t, interleave_block, data, data_size);
+}
+
+static int repack_q8_0_to_q8_0_8_bl(struct ggml_tensor * t, int interleave_block, const void * GGML_RESTRICT data, size_t data_size) {
+    GGML_ASSERT(t->type == GGML_TYPE_Q8_0);
+    GGML_ASSERT(interleave_block == 8);
+    constexpr int nrows_interleaved = 8;
+
+    block_q8_0x8 * dst = (block_q8_0x8*)t->data;
+    const block_q8_0 * src = (const block_q8_0*) data;
+    block_q8_0 dst_tmp[8];
+    int nrow = ggml_nrows(t);
+    int nblocks = t->ne[0] / QK8_0;
+
+    GGML_ASSERT(data_size == nrow * nblocks * sizeof(block_q8_0));
+
+    if (t->ne[1] % nrows_interleaved != 0 || t->ne[0] % 8 != 0) {
+        return -1;
+    }
+
+    for (int b = 0; b < nrow; b += nrows_interleaved) {
+        for (int64_t x = 0; x < nblocks; x++) {
+            for (int i  = 0; i < nrows_interleaved; i++ ) {
+                dst_tmp[i] = src[x + i * nblocks];
+            }
+            *dst++ = make_block_q8_0x8(dst_tmp, interleave_block);
+        }
+        src += nrows_interleaved * nblocks;
+    }
+    return 0;
+
+    GGML_UNUSED(data_size);
+}
+
 namespace ggml::cpu::repack {
 // repack
 template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS>
@@ -1472,6 +2013,22 @@ template <> int repack<block_q2_K, 8, 8>(struct ggml_tensor * t, const void * da
     return repack_q2_K_to_q2_K_8_bl(t, 8, data, data_size);
 }
 
+template <> int repack<block_q3_K, 8, 8>(struct ggml_tensor * t, const void * data, size_t data_size) {
+    return repack_q3_K_to_q3_K_8_bl(t, 8, data, data_size);
+}
+
+template <> int repack<block_q5_K, 8, 8>(struct ggml_tensor * t, const void * data, size_t data_size) {
+    return repack_q5_K_to_q5_K_8_bl(t, 8, data, data_size);
+}
+
+template <> int repack<block_q6_K, 8, 8>(struct ggml_tensor * t, const void * data, size_t data_size) {
+    return repack_q6_K_to_q6_K_8_bl(t, 8, data, data_size);
+}
+
+template <> int repack<block_q8_0, 8, 8>(struct ggml_tensor * t, const void * data, size_t data_size) {
+    return repack_q8_0_to_q8_0_8_bl(t, 8, data, data_size);
+}
+
 template <> int repack<block_iq4_nl, 4, 4>(struct ggml_tensor * t, const void * data, size_t data_size) {
     return repack_iq4_nl_to_iq4_nl_4_bl(t, 4, data, data_size);
 }
@@ -1509,6 +2066,22 @@ template <> void gemv<block_q2_K, 8, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t
     ggml_gemv_q2_K_8x8_q8_K(n, s, bs, vx, vy, nr, nc);
 }
 
+template <> void gemv<block_q3_K, 8, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemv_q3_K_8x8_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemv<block_q5_K, 8, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemv_q5_K_8x8_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemv<block_q6_K, 8, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemv_q6_K_8x8_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemv<block_q8_0, 8, 8, GGML_TYPE_Q8_0>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemv_q8_0_8x8_q8_0(n, s, bs, vx, vy, nr, nc);
+}
+
 template <> void gemv<block_iq4_nl, 4, 4, GGML_TYPE_Q8_0>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
     ggml_gemv_iq4_nl_4x4_q8_0(n, s, bs, vx, vy, nr, nc);
 }
@@ -1541,6 +2114,22 @@ template <> void gemm<block_q2_K, 8, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t
     ggml_gemm_q2_K_8x8_q8_K(n, s, bs, vx, vy, nr, nc);
 }
 
+template <> void gemm<block_q3_K, 8, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemm_q3_K_8x8_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemm<block_q5_K, 8, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemm_q5_K_8x8_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemm<block_q6_K, 8, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemm_q6_K_8x8_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemm<block_q8_0, 8, 8, GGML_TYPE_Q8_0>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemm_q8_0_8x8_q8_0(n, s, bs, vx, vy, nr, nc);
+}
+
 template <> void gemm<block_iq4_nl, 4, 4, GGML_TYPE_Q8_0>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
     ggml_gemm_iq4_nl_4x4_q8_0(n, s, bs, vx, vy, nr, nc);
 }
@@ -1552,9 +2141,22 @@ template <> void gemm<block_iq4_nl, 8, 8, GGML_TYPE_Q8_0>(int n, float * s, size
 class tensor_traits_base : public ggml::cpu::tensor_traits {
   public:
     virtual int repack(struct ggml_tensor * t, const void * data, size_t data_size) = 0;
+
+    // name of the interleaved layout, e.g. q4_0_8x8_q8_0
+    virtual const char * layout() const = 0;
 };
 
 template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PARAM_TYPE> class tensor_traits : public tensor_traits_base {
+    const char * layout_;
+
+  public:
+    explicit tensor_traits(const char * layout) : layout_(layout) {}
+
+    const char * layout() const override {
+        return layout_;
+    }
+
+  private:
 
     bool work_size(int /* n_threads */, const struct ggml_tensor * op, size_t & size) override {
         // not realy a GGML_TYPE_Q8_0 but same size.
@@ -1813,17 +2415,23 @@ template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PAR
 static const ggml::cpu::tensor_traits * ggml_repack_get_optimal_repack_type(const struct ggml_tensor * cur) {
 
     // instance for Q4
-    static const ggml::cpu::repack::tensor_traits<block_q4_0, 4, 4, GGML_TYPE_Q8_0> q4_0_4x4_q8_0;
-    static const ggml::cpu::repack::tensor_traits<block_q4_0, 8, 4, GGML_TYPE_Q8_0> q4_0_4x8_q8_0;
-    static const ggml::cpu::repack::tensor_traits<block_q4_0, 8, 8, GGML_TYPE_Q8_0> q4_0_8x8_q8_0;
-    static const ggml::cpu::repack::tensor_traits<block_q4_K, 8, 8, GGML_TYPE_Q8_K> q4_K_8x8_q8_K;
+    static const ggml::cpu::repack::tensor_traits<block_q4_0, 4, 4, GGML_TYPE_Q8_0> q4_0_4x4_q8_0("q4_0_4x4_q8_0");
+    static const ggml::cpu::repack::tensor_traits<block_q4_0, 8, 4, GGML_TYPE_Q8_0> q4_0_4x8_q8_0("q4_0_4x8_q8_0");
+    static const ggml::cpu::repack::tensor_traits<block_q4_0, 8, 8, GGML_TYPE_Q8_0> q4_0_8x8_q8_0("q4_0_8x8_q8_0");
+    static const ggml::cpu::repack::tensor_traits<block_q4_K, 8, 8, GGML_TYPE_Q8_K> q4_K_8x8_q8_K("q4_K_8x8_q8_K");
 
     // instance for Q2
-    static const ggml::cpu::repack::tensor_traits<block_q2_K, 8, 8, GGML_TYPE_Q8_K> q2_K_8x8_q8_K;
+    static const ggml::cpu::repack::tensor_traits<block_q2_K, 8, 8, GGML_TYPE_Q8_K> q2_K_8x8_q8_K("q2_K_8x8_q8_K");
+
+    // instances for Q3, Q5, Q6 and Q8
+    static const ggml::cpu::repack::tensor_traits<block_q3_K, 8, 8, GGML_TYPE_Q8_K> q3_K_8x8_q8_K("q3_K_8x8_q8_K");
+    static const ggml::cpu::repack::tensor_traits<block_q5_K, 8, 8, GGML_TYPE_Q8_K> q5_K_8x8_q8_K("q5_K_8x8_q8_K");
+    static const ggml::cpu::repack::tensor_traits<block_q6_K, 8, 8, GGML_TYPE_Q8_K> q6_K_8x8_q8_K("q6_K_8x8_q8_K");
+    static const ggml::cpu::repack::tensor_traits<block_q8_0, 8, 8, GGML_TYPE_Q8_0> q8_0_8x8_q8_0("q8_0_8x8_q8_0");
 
     // instance for IQ4
-    static const ggml::cpu::repack::tensor_traits<block_iq4_nl, 4, 4, GGML_TYPE_Q8_0> iq4_nl_4x4_q8_0;
-    static const ggml::cpu::repack::tensor_traits<block_iq4_nl, 8, 8, GGML_TYPE_Q8_0> iq4_nl_8x8_q8_0;
+    static const ggml::cpu::repack::tensor_traits<block_iq4_nl, 4, 4, GGML_TYPE_Q8_0> iq4_nl_4x4_q8_0("iq4_nl_4x4_q8_0");
+    static const ggml::cpu::repack::tensor_traits<block_iq4_nl, 8, 8, GGML_TYPE_Q8_0> iq4_nl_8x8_q8_0("iq4_nl_8x8_q8_0");
 
     if (cur->type == GGML_TYPE_Q4_0) {
         if (ggml_cpu_has_avx2() || (ggml_cpu_has_sve() && ggml_cpu_has_matmul_int8() && ggml_cpu_get_sve_cnt() == QK8_0)) {
@@ -1853,6 +2461,30 @@ static const ggml::cpu::tensor_traits * ggml_repack_get_optimal_repack_type(cons
                 return &q2_K_8x8_q8_K;
             }
         }
+    } else if (cur->type == GGML_TYPE_Q3_K) {
+        if (ggml_cpu_has_avx2()) {
+            if (cur->ne[1] % 8 == 0) {
+                return &q3_K_8x8_q8_K;
+            }
+        }
+    } else if (cur->type == GGML_TYPE_Q5_K) {
+        if (ggml_cpu_has_avx2()) {
+            if (cur->ne[1] % 8 == 0) {
+                return &q5_K_8x8_q8_K;
+            }
+        }
+    } else if (cur->type == GGML_TYPE_Q6_K) {
+        if (ggml_cpu_has_avx2()) {
+            if (cur->ne[1] % 8 == 0) {
+                return &q6_K_8x8_q8_K;
+            }
+        }
+    } else if (cur->type == GGML_TYPE_Q8_0) {
+        if (ggml_cpu_has_avx2()) {
+            if (cur->ne[1] % 8 == 0) {
+                return &q8_0_8x8_q8_0;
+            }
+        }
     } else if (cur->type == GGML_TYPE_IQ4_NL) {
         if (ggml_cpu_has_avx2()) {
             if (cur->ne[1] % 8 == 0) {
@@ -1980,3 +2612,24 @@ ggml_backend_buffer_type_t ggml_backend_cpu_repack_buffer_type(void) {
 
     return &ggml_backend_cpu_buffer_type_repack;
 }
+
+ggml_backend_buffer_t ggml_backend_cpu_repack_buffer_from_ptr(void * ptr, size_t size) {
+    ggml_backend_buffer_t buffer = ggml_backend_cpu_buffer_from_ptr(ptr, size);
+
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+
+    // the memory already holds the repacked data, it may be read-only (e.g. a mapped file)
+    buffer->buft              = ggml_backend_cpu_repack_buffer_type();
+    buffer->iface.init_tensor = ggml_backend_cpu_repack_buffer_init_tensor;
+    buffer->iface.set_tensor  = ggml_backend_cpu_repack_buffer_set_tensor;
+    buffer->iface.get_tensor  = nullptr;
+    buffer->iface.cpy_tensor  = nullptr;
+    return buffer;
+}
+
+const char * ggml_backend_cpu_repack_tensor_layout(const struct ggml_tensor * tensor) {
+    auto * tensor_traits = (const ggml::cpu::repack::tensor_traits_base *) ggml_repack_get_optimal_repack_type(tensor);
+    return tensor_traits ? tensor_traits->layout() : nullptr;
+}
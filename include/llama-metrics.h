@@ -0,0 +1,120 @@
+#pragma once
+
+#ifndef __cplusplus
+#error "This header is for C++ only"
+#endif
+
+#include "llama.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//
+// llama_metrics - process-wide counters, gauges and histograms in the Prometheus text format
+//
+// Updates are lock-free: counters and histograms keep LLAMA_METRICS_N_SHARDS cache-line aligned copies
+// of their values and each thread only writes to its own shard with relaxed atomics. Shards are summed when
+// the metrics are rendered, so the hot paths (decode, per-token, per-node timing) never contend on
+// a shared cache line or a mutex. Registration takes a mutex and returns a pointer that stays valid
+// for the lifetime of the process - look the metric up once and keep the pointer.
+//
+
+#define LLAMA_METRICS_N_SHARDS 16
+
+// index of the shard the calling thread writes to
+LLAMA_API int llama_metrics_shard_id();
+
+struct alignas(64) llama_metric_shard {
+    std::atomic<double> value{0.0};
+};
+
+class LLAMA_API llama_metric_counter {
+public:
+    void add(double v = 1.0);
+
+    double value() const;
+
+private:
+    llama_metric_shard shards_[LLAMA_METRICS_N_SHARDS];
+};
+
+class LLAMA_API llama_metric_gauge {
+public:
+    void set(double v);
+    void add(double v);
+
+    double value() const;
+
+private:
+    std::atomic<double> value_{0.0};
+};
+
+class LLAMA_API llama_metric_histogram {
+public:
+    // bounds are the upper bounds of the buckets, in increasing order; the +Inf bucket is implicit
+    explicit llama_metric_histogram(std::vector<double> bounds);
+
+    void observe(double v);
+
+    // cumulative bucket counts (bounds().size() + 1 entries, the last one is +Inf), sum and count
+    void collect(std::vector<uint64_t> & buckets, double & sum, uint64_t & count) const;
+
+    const std::vector<double> & bounds() const { return bounds_; }
+
+private:
+    struct alignas(64) shard {
+        std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+        std::atomic<double>   sum{0.0};
+        std::atomic<uint64_t> count{0};
+    };
+
+    std::vector<double> bounds_;
+
+    shard shards_[LLAMA_METRICS_N_SHARDS];
+};
+
+enum class llama_metric_type {
+    COUNTER,
+    GAUGE,
+    HISTOGRAM,
+};
+
+class LLAMA_API llama_metrics_registry {
+public:
+    // labels are given pre-formatted, e.g. "component=\"attention\""; the same name and labels
+    // always return the same metric
+    llama_metric_counter   * counter  (const std::string & name, const std::string & help, const std::string & labels = "");
+    llama_metric_gauge     * gauge    (const std::string & name, const std::string & help, const std::string & labels = "");
+    llama_metric_histogram * histogram(const std::string & name, const std::string & help, const std::vector<double> & bounds,
+                                       const std::string & labels = "");
+
+    // all registered metrics in the Prometheus text exposition format (version 0.0.4)
+    std::string render() const;
+
+private:
+    struct family {
+        llama_metric_type type;
+        std::string       help;
+
+        std::map<std::string, std::unique_ptr<llama_metric_counter>>   counters;
+        std::map<std::string, std::unique_ptr<llama_metric_gauge>>     gauges;
+        std::map<std::string, std::unique_ptr<llama_metric_histogram>> histograms;
+    };
+
+    family & get_family(const std::string & name, const std::string & help, llama_metric_type type);
+
+    mutable std::mutex mutex_;
+
+    std::map<std::string, family> families_;
+};
+
+// the process-wide registry, shared by libllama, llama-server and llama-monitoring-server
+LLAMA_API llama_metrics_registry & llama_metrics();
+
+// bucket bounds: start, start*factor, ... (n bounds)
+LLAMA_API std::vector<double> llama_metrics_exponential_buckets(double start, double factor, int n);
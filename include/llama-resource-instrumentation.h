@@ -25,6 +25,9 @@ enum class llama_resource_level {
 
 // Forward declarations
 class llama_resource_instrumentation;
+struct ggml_cpu_node_timing;
+class llama_instr_sink;
+enum class llama_instr_overflow;
 
 // Resource identification and metadata
 struct llama_resource_id {
@@ -47,7 +50,6 @@ struct llama_memory_resource {
     std::vector<int64_t> tensor_shape;
     ggml_type precision;
     std::string memory_type;         // "vram", "ram", "cache"
-    double estimated_bandwidth_gbps;
     double compression_ratio;
     void* memory_address;
     std::chrono::high_resolution_clock::time_point alloc_time;
@@ -61,10 +63,10 @@ struct llama_compute_resource {
     std::string component_type;      // "attention_qkv", "attention_scores", "mlp_gate", etc.
     std::vector<std::string> input_tensor_names;
     std::vector<int64_t> output_shape;
-    double compute_intensity_gflops;
-    uint64_t estimated_duration_us;
+    double compute_intensity_gflops; // floating point work of the output node, from its shape
+    uint64_t measured_duration_us;   // average measured wall time of this op type so far (0 if not measured yet)
     int parallelism_factor;
-    double memory_throughput_gbps;
+    double memory_throughput_gbps;   // measured for this op type, see llama_op_timing
     double sm_utilization_percent;
     std::string to_json() const;
 };
@@ -109,13 +111,32 @@ struct llama_mlp_resource {
     std::string to_json() const;
 };
 
+// Measured execution statistics of graph nodes, aggregated per op type or per layer
+// collected from the CPU backend with ggml_backend_cpu_set_timing_callback()
+struct llama_op_timing {
+    uint64_t n_nodes   = 0;     // number of executed nodes
+    int64_t  t_wall_ns = 0;     // wall time, including the wait for the slowest thread
+    int64_t  t_busy_ns = 0;     // compute time summed over all threads
+    uint64_t nbytes    = 0;     // bytes touched (sources + destination)
+    double   flops     = 0.0;   // floating point operations
+    
+    void add(const llama_op_timing& other);
+    
+    // roofline coordinates
+    double gbps() const;                  // achieved memory bandwidth (GB/s)
+    double gflops_per_s() const;          // achieved compute throughput (GFLOP/s)
+    double arithmetic_intensity() const;  // FLOP per byte
+    
+    std::string to_json() const;
+};
+
 // Main resource instrumentation class
 class llama_resource_instrumentation {
 private:
     // Configuration
     llama_resource_level level_;
     std::string log_file_path_;
-    std::unique_ptr<std::ofstream> log_file_;
+    std::unique_ptr<llama_instr_sink> sink_;
     bool enabled_;
     std::string session_id_;
     
@@ -135,8 +156,14 @@ private:
     std::map<std::string, double> component_memory_peaks_;
     std::map<std::string, double> component_compute_totals_;
     
+    // Measured node timings: per op type and per layer -> component ("attention", "feed_forward", "other")
+    bool timing_enabled_;
+    std::map<std::string, llama_op_timing> op_timings_;
+    std::map<int, std::map<std::string, llama_op_timing>> layer_timings_;
+    
     // Thread safety
     std::mutex resources_mutex_;
+    std::mutex timing_mutex_;
 
 public:
     // Constructor/Destructor
@@ -149,6 +176,11 @@ public:
     void flush();
     void set_level(llama_resource_level level);
     
+    // Asynchronous writer control and statistics
+    void set_overflow_policy(llama_instr_overflow overflow);
+    uint64_t n_entries_written() const;
+    uint64_t n_entries_dropped() const;
+    
     // Session management
     void begin_session(const std::string& session_id);
     void end_session();
@@ -173,14 +205,21 @@ public:
     void log_mlp_operation(const std::string& mlp_op, const ggml_tensor* weights, 
                           const ggml_tensor* activations);
     
+    // Measured per-node timing of the CPU backend
+    void set_timing(bool enabled);
+    bool collects_timing() const { return enabled_ && timing_enabled_; }
+    static void timing_callback(const ggml_cgraph* cgraph, const ggml_cpu_node_timing* timing, void* user_data);
+    void record_graph_timing(const ggml_cgraph* cgraph, const ggml_cpu_node_timing* timing);
+    std::map<std::string, llama_op_timing> get_op_timings();
+    std::map<int, std::map<std::string, llama_op_timing>> get_layer_timings();
+    void reset_timings();
+    void log_timing_summary();
+    
 private:
     // Internal helper methods
     llama_resource_id generate_resource_id(const std::string& resource_type, 
                                          const std::string& component);
-    double estimate_memory_bandwidth(const ggml_tensor* tensor, const std::string& operation);
-    double estimate_compute_gflops(const std::string& operation, const ggml_tensor* a, 
-                                  const ggml_tensor* b = nullptr);
-    uint64_t estimate_operation_duration(const std::string& operation, double gflops);
+    static double node_flops(const ggml_tensor* node);
     int estimate_parallelism_factor(const ggml_tensor* tensor);
     double get_compression_ratio(const ggml_tensor* tensor);
     
@@ -284,6 +284,10 @@ extern "C" {
         // override key-value pairs of the model meta data
         const struct llama_model_kv_override * kv_overrides;
 
+        // path of the on-disk cache of the weights repacked for the CPU, NULL to disable
+        // the cache is written on the first load and mapped instead of repacking the weights on the next ones
+        const char * repack_cache;
+
         // Keep the booleans together to avoid misalignment during copy-by-value.
         bool vocab_only;      // only load the vocabulary, no weights
         bool use_mmap;        // use mmap if possible
@@ -292,6 +296,11 @@ extern "C" {
         bool use_extra_bufts; // use extra buffer types (used for weight repacking)
     };
 
+    struct llama_kv_cache_type_override {
+        const char *   pattern; // matched against the names of the KV cache tensors: cache_k_l<il>, cache_v_l<il>
+        enum ggml_type type;
+    };
+
     // NOTE: changing the default values of parameters marked as [EXPERIMENTAL] may cause crashes or incorrect results in certain configurations
     //       https://github.com/ggml-org/llama.cpp/pull/7544
     struct llama_context_params {
@@ -315,12 +324,19 @@ extern "C" {
         float    yarn_beta_slow;   // YaRN high correction dim
         uint32_t yarn_orig_ctx;    // YaRN original context size
         float    defrag_thold;     // defragment the KV cache if holes/size > thold, <= 0 disabled (default)
+        uint32_t defrag_max_cells; // max KV cells moved per decode step, the defrag is spread over several steps, 0 = all at once (default)
+        uint32_t kv_block_size;    // cells per block of the paged KV cache, 0 = not paged (default) [EXPERIMENTAL]
+        uint32_t kv_spill_mib;     // MiB of host memory (or file) for the sequences spilled out of a full KV cache, 0 = disabled (default) [EXPERIMENTAL]
+        uint32_t kv_evict_sink;    // KV eviction: cells kept at the start of each sequence (attention sinks)
+        uint32_t kv_evict_recent;  // KV eviction: most recent cells kept, 0 = eviction disabled (default) [EXPERIMENTAL]
+        uint32_t kv_evict_heavy;   // KV eviction: cells with the highest accumulated attention kept, requires flash_attn = false
 
         ggml_backend_sched_eval_callback cb_eval;
         void * cb_eval_user_data;
 
         enum ggml_type type_k; // data type for K cache [EXPERIMENTAL]
         enum ggml_type type_v; // data type for V cache [EXPERIMENTAL]
+        enum ggml_type type_kv_spill; // data type of the spilled K/V rows, GGML_TYPE_COUNT = same as the cache [EXPERIMENTAL]
 
         // Abort callback
         // if it returns true, execution of llama_decode() will be aborted
@@ -328,6 +344,14 @@ extern "C" {
         ggml_abort_callback abort_callback;
         void *              abort_callback_data;
 
+        // spill the sequences to a new file in this directory instead of host memory, NULL = host memory
+        // every context creates its own file and removes it when it is freed
+        const char * kv_spill_path;
+
+        // NULL-terminated list of data types to use for the KV cache tensors that match a pattern, the first match wins
+        // the other tensors use type_k/type_v [EXPERIMENTAL]
+        const struct llama_kv_cache_type_override * kv_type_overrides;
+
         // Keep the booleans together and at the end of the struct to avoid misalignment during copy-by-value.
         bool embeddings;  // if true, extract embeddings (together with logits)
         bool offload_kqv; // offload the KQV ops (including the KV cache) to GPU
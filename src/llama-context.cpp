@@ -7,12 +7,94 @@
 #include "llama-mmap.h"
 #include "llama-model.h"
 #include "llama-instrumentation.h"
+#include "llama-resource-instrumentation.h"
+#include "llama-metrics.h"
+#include "llama-kv-cache-unified.h"
+#include "llama-kv-cache-unified-iswa.h"
 
 #include <cinttypes>
 #include <cstring>
 #include <limits>
 #include <stdexcept>
 
+#ifdef LLAMA_INSTRUMENTATION
+// process-wide decode metrics, rendered by the /metrics endpoints of the servers
+struct llama_decode_metrics {
+    llama_metric_histogram * decode_seconds;
+    llama_metric_histogram * ubatch_tokens;
+    llama_metric_counter   * tokens;
+    llama_metric_counter   * decode_errors;
+    llama_metric_counter   * decode_traced;
+    llama_metric_gauge     * kv_cells_used;
+    llama_metric_gauge     * kv_cells_total;
+    llama_metric_gauge     * kv_fragmentation;
+    llama_metric_histogram * kv_update_seconds;
+    llama_metric_histogram * kv_defrag_cells;
+    llama_metric_counter   * kv_evicted_cells;
+
+    llama_decode_metrics() {
+        auto & reg = llama_metrics();
+
+        decode_seconds = reg.histogram("llamacpp:decode_seconds", "Latency of llama_decode calls.",
+                llama_metrics_exponential_buckets(0.0005, 2.0, 16));
+        ubatch_tokens  = reg.histogram("llamacpp:ubatch_tokens", "Number of tokens per micro-batch.",
+                llama_metrics_exponential_buckets(1.0, 2.0, 14));
+        tokens         = reg.counter("llamacpp:decode_tokens_total", "Number of tokens submitted to llama_decode.");
+        decode_errors  = reg.counter("llamacpp:decode_errors_total", "Number of llama_decode calls that returned an error, no KV slot or were aborted.");
+        decode_traced  = reg.counter("llamacpp:decode_traced_total", "Number of llama_decode calls traced by the instrumentation.");
+        kv_cells_used  = reg.gauge("llamacpp:kv_cells_used", "Number of used KV cells after the last decode.");
+        kv_cells_total = reg.gauge("llamacpp:kv_cells_total", "Number of KV cells of the last decoding context.");
+        kv_fragmentation  = reg.gauge("llamacpp:kv_fragmentation", "Fraction of empty KV cells below the last used cell, after the last decode.");
+        kv_update_seconds = reg.histogram("llamacpp:kv_update_seconds", "Latency of the KV cache updates (K-shift, defragmentation) run before a decode.",
+                llama_metrics_exponential_buckets(0.0001, 2.0, 16));
+        kv_defrag_cells   = reg.histogram("llamacpp:kv_defrag_cells", "Number of KV cells moved per defragmentation step.",
+                llama_metrics_exponential_buckets(1.0, 2.0, 18));
+        kv_evicted_cells  = reg.counter("llamacpp:kv_evicted_cells_total", "Number of KV cells dropped by the eviction policy (sinks, recent window, heavy hitters).");
+    }
+};
+
+static llama_decode_metrics & decode_metrics() {
+    static llama_decode_metrics metrics;
+    return metrics;
+}
+
+static const llama_kv_cache_unified * get_kv_unified(const llama_memory_i * memory) {
+    const llama_kv_cache_unified * kv = dynamic_cast<const llama_kv_cache_unified *>(memory);
+    if (!kv) {
+        const auto * kv_iswa = dynamic_cast<const llama_kv_cache_unified_iswa *>(memory);
+        if (kv_iswa) {
+            kv = kv_iswa->get_base();
+        }
+    }
+
+    return kv;
+}
+
+static void update_kv_metrics(const llama_memory_i * memory) {
+    const auto * kv = get_kv_unified(memory);
+
+    if (kv) {
+        decode_metrics().kv_cells_used   ->set(kv->get_used());
+        decode_metrics().kv_cells_total  ->set((double) kv->get_size()*kv->get_n_stream());
+        decode_metrics().kv_fragmentation->set(kv->get_fragmentation());
+
+        if (kv->get_evict_n_cells() > 0) {
+            decode_metrics().kv_evicted_cells->add(kv->get_evict_n_cells());
+        }
+    }
+}
+
+static void update_kv_update_metrics(const llama_memory_i * memory, int64_t t_update_us) {
+    decode_metrics().kv_update_seconds->observe(1e-6*(ggml_time_us() - t_update_us));
+
+    const auto * kv = get_kv_unified(memory);
+
+    if (kv && kv->get_defrag_n_moved() > 0) {
+        decode_metrics().kv_defrag_cells->observe(kv->get_defrag_n_moved());
+    }
+}
+#endif
+
 //
 // llama_context
 //
@@ -41,6 +123,7 @@ llama_context::llama_context(
     cparams.yarn_beta_fast   = params.yarn_beta_fast;
     cparams.yarn_beta_slow   = params.yarn_beta_slow;
     cparams.defrag_thold     = params.defrag_thold;
+    cparams.defrag_max_cells = params.defrag_max_cells;
     cparams.embeddings       = params.embeddings;
     cparams.offload_kqv      = params.offload_kqv;
     cparams.flash_attn       = params.flash_attn;
@@ -114,6 +197,29 @@ llama_context::llama_context(
         }
     }
 
+    cparams.kv_block_size = params.kv_block_size;
+
+    if (cparams.kv_block_size > 0) {
+        // the paged KV cache pools the cells of the streams of a non-unified cache and is read by the flash attention
+        if (cparams.kv_unified || cparams.n_seq_max == 1 || !cparams.flash_attn) {
+            LLAMA_LOG_WARN("%s: paged KV cache requires n_seq_max > 1, a non-unified KV cache and flash attention - disabling\n", __func__);
+            cparams.kv_block_size = 0;
+        } else if ((cparams.kv_block_size & (cparams.kv_block_size - 1)) != 0 ||
+                    cparams.kv_block_size > llama_kv_cache_unified::get_padding(cparams)) {
+            throw std::runtime_error("kv_block_size must be a power of 2 <= " + std::to_string(llama_kv_cache_unified::get_padding(cparams)));
+        }
+    }
+
+    cparams.kv_evict_sink   = params.kv_evict_sink;
+    cparams.kv_evict_recent = params.kv_evict_recent;
+    cparams.kv_evict_heavy  = params.kv_evict_recent > 0 ? params.kv_evict_heavy : 0;
+
+    if (cparams.kv_evict_heavy > 0 && cparams.flash_attn) {
+        // the flash attention does not expose the attention scores
+        LLAMA_LOG_WARN("%s: the heavy hitters of the KV eviction require flash_attn = false - keeping only the sinks and the recent window\n", __func__);
+        cparams.kv_evict_heavy = 0;
+    }
+
     {
         const char * LLAMA_GRAPH_REUSE_DISABLE = getenv("LLAMA_GRAPH_REUSE_DISABLE");
         graph_reuse_disable = LLAMA_GRAPH_REUSE_DISABLE ? (atoi(LLAMA_GRAPH_REUSE_DISABLE) != 0) : graph_reuse_disable;
@@ -123,7 +229,7 @@ llama_context::llama_context(
         }
     }
 
-    const uint32_t n_ctx_per_seq = cparams.n_ctx / cparams.n_seq_max;
+    const uint32_t n_ctx_per_seq = this->n_ctx_per_seq();
 
     LLAMA_LOG_INFO("%s: n_seq_max     = %u\n",   __func__, cparams.n_seq_max);
     LLAMA_LOG_INFO("%s: n_ctx         = %u\n",   __func__, cparams.n_ctx);
@@ -133,6 +239,10 @@ llama_context::llama_context(
     LLAMA_LOG_INFO("%s: causal_attn   = %d\n",   __func__, cparams.causal_attn);
     LLAMA_LOG_INFO("%s: flash_attn    = %d\n",   __func__, cparams.flash_attn);
     LLAMA_LOG_INFO("%s: kv_unified    = %s\n",   __func__, cparams.kv_unified ? "true" : "false");
+    LLAMA_LOG_INFO("%s: kv_block_size = %u\n",   __func__, cparams.kv_block_size);
+    if (cparams.kv_evict_recent > 0) {
+        LLAMA_LOG_INFO("%s: kv_evict      = sink %u, recent %u, heavy %u\n", __func__, cparams.kv_evict_sink, cparams.kv_evict_recent, cparams.kv_evict_heavy);
+    }
     LLAMA_LOG_INFO("%s: freq_base     = %.1f\n", __func__, cparams.rope_freq_base);
     LLAMA_LOG_INFO("%s: freq_scale    = %g\n",   __func__, cparams.rope_freq_scale);
 
@@ -210,9 +320,14 @@ llama_context::llama_context(
     // init the memory module
     if (!hparams.vocab_only) {
         llama_memory_params params_mem = {
-            /*.type_k   =*/ params.type_k,
-            /*.type_v   =*/ params.type_v,
-            /*.swa_full =*/ params.swa_full,
+            /*.type_k         =*/ params.type_k,
+            /*.type_v         =*/ params.type_v,
+            /*.type_overrides =*/ params.kv_type_overrides,
+            /*.swa_full       =*/ params.swa_full,
+
+            /*.spill_size     =*/ (size_t) params.kv_spill_mib*1024*1024,
+            /*.spill_type     =*/ params.type_kv_spill,
+            /*.spill_path     =*/ params.kv_spill_path ? params.kv_spill_path : "",
         };
 
         memory.reset(model.create_memory(params_mem, cparams));
@@ -418,7 +533,8 @@ uint32_t llama_context::n_ctx() const {
 }
 
 uint32_t llama_context::n_ctx_per_seq() const {
-    return cparams.n_ctx / cparams.n_seq_max;
+    // with the paged KV cache, any sequence can use all the cells
+    return cparams.kv_block_size > 0 ? cparams.n_ctx : cparams.n_ctx / cparams.n_seq_max;
 }
 
 uint32_t llama_context::n_batch() const {
@@ -489,9 +605,17 @@ bool llama_context::kv_self_update(bool optimize) {
         //       reset the graph result only if the memory module did reset the scheduler
         gf_res_prev->reset();
 
+#ifdef LLAMA_INSTRUMENTATION
+        const int64_t t_update_us = ggml_time_us();
+#endif
+
         if (!mctx->apply()) {
             LLAMA_LOG_ERROR("%s: failed to apply memory update\n", __func__);
         }
+
+#ifdef LLAMA_INSTRUMENTATION
+        update_kv_update_metrics(memory.get(), t_update_us);
+#endif
     }
 
     // if the memory module did any computation, we have to reserve a new worst-case graph
@@ -970,7 +1094,7 @@ int llama_context::decode(const llama_batch & batch_inp) {
     const int64_t n_embd  = hparams.n_embd;
 
     // Log input tokens if available
-    if (batch_inp.token && g_llama_instr) {
+    if (batch_inp.token) {
         INSTR_LOG_TOKENS_IN(batch_inp.token, batch_inp.n_tokens, &vocab);
     }
 
@@ -1077,6 +1201,10 @@ int llama_context::decode(const llama_batch & batch_inp) {
         INSTR_BEGIN_STEP("process_ubatch", -1);
         INSTR_LOG_PERF("ubatch_tokens", ubatch.n_tokens, "tokens");
 
+#ifdef LLAMA_INSTRUMENTATION
+        decode_metrics().ubatch_tokens->observe(ubatch.n_tokens);
+#endif
+
         // count the outputs in this ubatch
         {
             int32_t n_outputs_new = 0;
@@ -1223,6 +1351,16 @@ int llama_context::decode(const llama_batch & batch_inp) {
             }
         }
 
+        // KV eviction: accumulate the attention received by the KV cells, it ranks the heavy hitters
+        if (res->get_attn_mass()) {
+            const auto * kv_ctx = dynamic_cast<const llama_kv_cache_unified_context *>(mctx.get());
+            if (kv_ctx) {
+                ggml_backend_sched_synchronize(sched.get());
+
+                kv_ctx->add_attn_mass(res->get_attn_mass());
+            }
+        }
+
         n_outputs_prev += n_outputs;
     } while (mctx->next());
 
@@ -1287,6 +1425,10 @@ int llama_context::decode(const llama_batch & batch_inp) {
         ggml_backend_sched_reset(sched.get());
     }
 
+#ifdef LLAMA_INSTRUMENTATION
+    update_kv_metrics(memory.get());
+#endif
+
     INSTR_END_STEP("Decode completed successfully");
     return 0;
 }
@@ -1477,6 +1619,18 @@ ggml_status llama_context::graph_compute(
         auto * reg = ggml_backend_dev_backend_reg(ggml_backend_get_device(backend_cpu));
         auto * set_threadpool_fn = (decltype(ggml_backend_cpu_set_threadpool) *) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_set_threadpool");
         set_threadpool_fn(backend_cpu, tp);
+
+#ifdef LLAMA_INSTRUMENTATION
+        // measured per-node timing for the resource instrumentation
+        auto * set_timing_fn = (decltype(ggml_backend_cpu_set_timing_callback) *) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_set_timing_callback");
+        if (set_timing_fn) {
+            if (g_resource_instr && g_resource_instr->collects_timing()) {
+                set_timing_fn(backend_cpu, llama_resource_instrumentation::timing_callback, g_resource_instr.get());
+            } else {
+                set_timing_fn(backend_cpu, nullptr, nullptr);
+            }
+        }
+#endif
     }
 
     // set the number of threads for all the backends
@@ -1484,6 +1638,18 @@ ggml_status llama_context::graph_compute(
         set_n_threads_fn.second(set_n_threads_fn.first, n_threads);
     }
 
+#ifdef LLAMA_INSTRUMENTATION
+    // observe tensors at execution time for the instrumentation, unless the user installed an eval callback
+    // this has to be re-evaluated before every compute since the graph may be reused across instrumentation changes
+    if (!cparams.cb_eval) {
+        if (g_llama_instr && g_llama_instr->observes_tensors()) {
+            ggml_backend_sched_set_eval_callback(sched.get(), llama_instrumentation::eval_callback, g_llama_instr.get());
+        } else {
+            ggml_backend_sched_set_eval_callback(sched.get(), nullptr, nullptr);
+        }
+    }
+#endif
+
     auto status = ggml_backend_sched_graph_compute_async(sched.get(), gf);
     if (status != GGML_STATUS_SUCCESS) {
         LLAMA_LOG_ERROR("%s: ggml_backend_sched_graph_compute_async failed with error %d\n", __func__, status);
@@ -2294,12 +2460,21 @@ llama_context_params llama_context_default_params() {
         /*.yarn_beta_slow              =*/ 1.0f,
         /*.yarn_orig_ctx               =*/ 0,
         /*.defrag_thold                =*/ -1.0f,
+        /*.defrag_max_cells            =*/ 0,
+        /*.kv_block_size               =*/ 0,
+        /*.kv_spill_mib                =*/ 0,
+        /*.kv_evict_sink               =*/ 4,
+        /*.kv_evict_recent             =*/ 0,
+        /*.kv_evict_heavy              =*/ 0,
         /*.cb_eval                     =*/ nullptr,
         /*.cb_eval_user_data           =*/ nullptr,
         /*.type_k                      =*/ GGML_TYPE_F16,
         /*.type_v                      =*/ GGML_TYPE_F16,
+        /*.type_kv_spill               =*/ GGML_TYPE_COUNT,
         /*.abort_callback              =*/ nullptr,
         /*.abort_callback_data         =*/ nullptr,
+        /*.kv_spill_path               =*/ nullptr,
+        /*.kv_type_overrides           =*/ nullptr,
         /*.embeddings                  =*/ false,
         /*.offload_kqv                 =*/ true,
         /*.flash_attn                  =*/ false,
@@ -2904,11 +3079,21 @@ int32_t llama_encode(
 int32_t llama_decode(
         llama_context * ctx,
           llama_batch   batch) {
+#ifdef LLAMA_INSTRUMENTATION
+    // in the statistical mode the INSTR_* calls of the decodes that are not sampled are skipped
+    if (g_llama_instr && g_llama_instr->begin_decode()) {
+        decode_metrics().decode_traced->add();
+    }
+
+    const int64_t t_start_us = ggml_time_us();
+#endif
+
     // Log the main decode entry point
     INSTR_BEGIN_STEP("llama_decode_api", -1);
     INSTR_LOG_PERF("api_batch_size", batch.n_tokens, "tokens");
-    
+
     const int ret = ctx->decode(batch);
+
     if (ret != 0 && ret != 1) {
         LLAMA_LOG_ERROR("%s: failed to decode, ret = %d\n", __func__, ret);
         INSTR_END_STEP("API decode failed with error code: " + std::to_string(ret));
@@ -2916,6 +3101,21 @@ int32_t llama_decode(
         INSTR_END_STEP("API decode completed successfully");
     }
 
+#ifdef LLAMA_INSTRUMENTATION
+    const int64_t t_decode_us = ggml_time_us() - t_start_us;
+
+    decode_metrics().decode_seconds->observe(1e-6*t_decode_us);
+    if (ret == 0) {
+        decode_metrics().tokens->add(batch.n_tokens);
+    } else {
+        decode_metrics().decode_errors->add();
+    }
+
+    if (g_llama_instr) {
+        g_llama_instr->end_decode(t_decode_us);
+    }
+#endif
+
     return ret;
 }
 
@@ -2947,6 +3147,22 @@ void llama_perf_context_print(const llama_context * ctx) {
             __func__, data.t_eval_ms, data.n_eval, data.t_eval_ms / data.n_eval, 1e3 / data.t_eval_ms * data.n_eval);
     LLAMA_LOG_INFO("%s:       total time = %10.2f ms / %5d tokens\n", __func__, (t_end_ms - data.t_start_ms), (data.n_p_eval + data.n_eval));
     LLAMA_LOG_INFO("%s:    graphs reused = %10d\n", __func__, data.n_reused);
+
+    // cross-node reads of the weights with --numa split
+    if (auto * dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU)) {
+        auto * reg        = ggml_backend_dev_backend_reg(dev);
+        auto * traffic_fn = (decltype(ggml_numa_get_traffic) *) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_numa_get_traffic");
+        if (traffic_fn) {
+            ggml_numa_traffic traffic;
+            traffic_fn(&traffic);
+
+            const uint64_t total = traffic.bytes_local + traffic.bytes_remote;
+            if (total > 0) {
+                LLAMA_LOG_INFO("%s:     numa traffic = %10.2f MiB local, %10.2f MiB remote (%5.2f%% cross-node)\n", __func__,
+                        traffic.bytes_local/1024.0/1024.0, traffic.bytes_remote/1024.0/1024.0, 100.0*traffic.bytes_remote/total);
+            }
+        }
+    }
 }
 
 void llama_perf_context_reset(llama_context * ctx) {
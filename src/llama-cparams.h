@@ -26,6 +26,14 @@ struct llama_cparams {
     float yarn_beta_slow;
     float defrag_thold;
 
+    uint32_t defrag_max_cells; // max KV cells moved per decode step, 0 = defrag all at once
+    uint32_t kv_block_size; // cells per block of the paged KV cache, 0 = not paged
+
+    // KV eviction: keep the sinks, the recent window and the heavy hitters of each sequence, kv_evict_recent == 0 = disabled
+    uint32_t kv_evict_sink;
+    uint32_t kv_evict_recent;
+    uint32_t kv_evict_heavy;
+
     bool embeddings;
     bool causal_attn;
     bool offload_kqv;
@@ -1,5 +1,4 @@
 #include "llama-graph.h"
-#include "llama-instrumentation.h"
 
 #include "llama-impl.h"
 #include "llama-batch.h"
@@ -10,6 +9,7 @@
 #include "llama-memory-hybrid.h"
 #include "llama-memory-recurrent.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstring>
@@ -300,6 +300,17 @@ void llm_graph_input_attn_kv_unified::set_input(const llama_ubatch * ubatch) {
     mctx->set_input_v_idxs(self_v_idxs, ubatch);
 
     mctx->set_input_kq_mask(self_kq_mask, ubatch, cparams.causal_attn);
+
+    if (self_kv_blocks) {
+        mctx->set_input_kv_blocks(self_kv_blocks);
+    }
+
+    if (self_kq_ones) {
+        GGML_ASSERT(ggml_backend_buffer_is_host(self_kq_ones->buffer));
+
+        float * data = (float *) self_kq_ones->data;
+        std::fill(data, data + ggml_nelements(self_kq_ones), 1.0f);
+    }
 }
 
 bool llm_graph_input_attn_kv_unified::can_reuse(const llm_graph_params & params) {
@@ -417,6 +428,7 @@ void llm_graph_result::reset() {
     t_logits      = nullptr;
     t_embd        = nullptr;
     t_embd_pooled = nullptr;
+    t_attn_mass   = nullptr;
 
     params = {};
 
@@ -530,11 +542,8 @@ llm_graph_context::llm_graph_context(const llm_graph_params & params) :
     }
 
 void llm_graph_context::cb(ggml_tensor * cur, const char * name, int il) const {
-    // Add instrumentation logging for all tensor operations
-    if (cur && name) {
-        INSTR_LOG_TENSOR(cur, std::string(name), "intermediate");
-    }
-    
+    // note: tensor instrumentation happens at execution time through the scheduler eval callback
+    //       (see llama_context::graph_compute) - nothing has been computed yet at this point
     if (cb_func) {
         cb_func(ubatch, cur, name, il);
     }
@@ -1231,11 +1240,14 @@ ggml_tensor * llm_graph_context::build_attn_mha(
          ggml_tensor * kq_mask,
          ggml_tensor * v_mla,
          ggml_tensor * sinks,
-             float     kq_scale) const {
+             float     kq_scale,
+         ggml_tensor * kv_blocks,
+         ggml_tensor * kq_ones) const {
     const bool v_trans = v->nb[1] > v->nb[2];
 
     // split the batch into streams if needed
-    const auto n_stream = k->ne[3];
+    // paged: k and v hold the whole pool, the streams are given by the block tables
+    const auto n_stream = kv_blocks ? kv_blocks->ne[1] : k->ne[3];
 
     q = ggml_reshape_4d(ctx0, q, q->ne[0], q->ne[1], q->ne[2]/n_stream, n_stream);
 
@@ -1243,10 +1255,12 @@ ggml_tensor * llm_graph_context::build_attn_mha(
     k = ggml_permute(ctx0, k, 0, 2, 1, 3);
     v = ggml_permute(ctx0, v, 0, 2, 1, 3);
 
-    const auto n_kv = k->ne[1];
+    const auto n_kv = kv_blocks ? kq_mask->ne[0] : k->ne[1];
 
     ggml_tensor * cur;
 
+    GGML_ASSERT((kv_blocks == nullptr || (cparams.flash_attn && n_kv % 256 == 0 && kq_b == nullptr)) && "paged KV cache requires flash attention");
+
     // TODO: replace hardcoded padding with ggml-provided padding
     if (cparams.flash_attn && (n_kv % 256 == 0) && kq_b == nullptr) {
         GGML_ASSERT(kq_b == nullptr && "Flash attention does not support KQ bias yet");
@@ -1264,8 +1278,13 @@ ggml_tensor * llm_graph_context::build_attn_mha(
             v = ggml_cast(ctx0, v, GGML_TYPE_F16);
         }
 
-        cur = ggml_flash_attn_ext(ctx0, q, k, v, kq_mask, kq_scale, hparams.f_max_alibi_bias,
-                                  hparams.attn_soft_cap ? hparams.f_attn_logit_softcapping : 0.0f);
+        if (kv_blocks) {
+            cur = ggml_flash_attn_ext_paged(ctx0, q, k, v, kq_mask, kv_blocks, n_kv/kv_blocks->ne[0], kq_scale, hparams.f_max_alibi_bias,
+                                            hparams.attn_soft_cap ? hparams.f_attn_logit_softcapping : 0.0f);
+        } else {
+            cur = ggml_flash_attn_ext(ctx0, q, k, v, kq_mask, kq_scale, hparams.f_max_alibi_bias,
+                                      hparams.attn_soft_cap ? hparams.f_attn_logit_softcapping : 0.0f);
+        }
 
         ggml_flash_attn_ext_add_sinks(cur, sinks);
         ggml_flash_attn_ext_set_prec (cur, GGML_PREC_F32);
@@ -1318,6 +1337,29 @@ ggml_tensor * llm_graph_context::build_attn_mha(
         kq = ggml_soft_max_ext(ctx0, kq, kq_mask, kq_scale, hparams.f_max_alibi_bias);
         ggml_soft_max_add_sinks(kq, sinks);
 
+        if (kq_ones) {
+            // attention mass of the KV cells: sum kq [n_kv, n_tokens, n_head, n_stream] over the tokens, then over the heads
+            const int64_t n_tokens_s = kq->ne[1];
+            const int64_t n_head_s   = kq->ne[2];
+            const int64_t n_stream_s = kq->ne[3];
+
+            const size_t nbf = ggml_element_size(kq_ones);
+
+            ggml_tensor * mass = ggml_out_prod(ctx0, kq,
+                    ggml_view_4d(ctx0, kq_ones, 1, n_tokens_s, n_head_s, n_stream_s, nbf, nbf*n_tokens_s, nbf*n_tokens_s*n_head_s, 0));
+
+            mass = ggml_reshape_4d(ctx0, mass, mass->ne[0], n_head_s, 1, n_stream_s);
+            mass = ggml_out_prod(ctx0, mass,
+                    ggml_view_4d(ctx0, kq_ones, 1, n_head_s, 1, n_stream_s, nbf, nbf*n_head_s, nbf*n_head_s, 0));
+
+            mass = ggml_reshape_2d(ctx0, mass, mass->ne[0], n_stream_s);
+
+            res->t_attn_mass = res->t_attn_mass ? ggml_add(ctx0, res->t_attn_mass, mass) : mass;
+
+            ggml_set_output(res->t_attn_mass);
+            ggml_build_forward_expand(gf, res->t_attn_mass);
+        }
+
         if (!v_trans) {
             // note: avoid this branch
             v = ggml_cont(ctx0, ggml_transpose(ctx0, v));
@@ -1428,6 +1470,18 @@ static std::unique_ptr<llm_graph_input_attn_kv_unified> build_attn_inp_kv_unifie
         ggml_set_input(inp->self_kq_mask);
 
         inp->self_kq_mask_cnv = cparams.flash_attn ? ggml_cast(ctx0, inp->self_kq_mask, GGML_TYPE_F16) : inp->self_kq_mask;
+
+        inp->self_kv_blocks = mctx_cur->build_input_kv_blocks(ctx0, ubatch);
+
+        if (cparams.kv_evict_heavy > 0) {
+            uint32_t n_head_max = 0;
+            for (uint32_t il = 0; il < hparams.n_layer; ++il) {
+                n_head_max = std::max(n_head_max, hparams.n_head(il));
+            }
+
+            inp->self_kq_ones = ggml_new_tensor_1d(ctx0, GGML_TYPE_F32, (int64_t) n_tokens*n_head_max);
+            ggml_set_input(inp->self_kq_ones);
+        }
     }
 
     return inp;
@@ -1475,7 +1529,7 @@ ggml_tensor * llm_graph_context::build_attn(
     ggml_tensor * k = mctx_cur->get_k(ctx0, il);
     ggml_tensor * v = mctx_cur->get_v(ctx0, il);
 
-    ggml_tensor * cur = build_attn_mha(q, k, v, kq_b, kq_mask, v_mla, nullptr, kq_scale);
+    ggml_tensor * cur = build_attn_mha(q, k, v, kq_b, kq_mask, v_mla, nullptr, kq_scale, inp->get_kv_blocks(), inp->get_kq_ones());
     cb(cur, "kqv_out", il);
 
     if (wo) {
@@ -278,12 +278,20 @@ public:
 
     ggml_tensor * get_kq_mask() const { return self_kq_mask_cnv; }
 
+    ggml_tensor * get_kv_blocks() const { return self_kv_blocks; }
+
+    ggml_tensor * get_kq_ones() const { return self_kq_ones; }
+
     ggml_tensor * self_k_idxs = nullptr; // I64 [n_batch]
     ggml_tensor * self_v_idxs = nullptr; // I64 [n_batch] or [n_batch*n_embd_v_gqa]
 
     ggml_tensor * self_kq_mask     = nullptr; // F32 [n_kv, n_batch/n_stream, 1, n_stream]
     ggml_tensor * self_kq_mask_cnv = nullptr; //     [n_kv, n_batch/n_stream, 1, n_stream]
 
+    ggml_tensor * self_kv_blocks = nullptr; // I32 [n_kv/n_block, n_stream] (paged KV cache only)
+
+    ggml_tensor * self_kq_ones = nullptr; // F32 [n_batch*n_head] (KV eviction with heavy hitters only)
+
     // note: these have to be copies because in order to be able to reuse a graph, its inputs
     //       need to carry these parameters with them. otherwise, they can point to freed
     //       llm_graph_params from a previous batch, causing stack-use-after-return
@@ -464,6 +472,7 @@ public:
     ggml_tensor * get_logits()      const { return t_logits; }
     ggml_tensor * get_embd()        const { return t_embd; }
     ggml_tensor * get_embd_pooled() const { return t_embd_pooled; }
+    ggml_tensor * get_attn_mass()   const { return t_attn_mass; }
 
     ggml_cgraph  * get_gf()  const { return gf; }
     ggml_context * get_ctx() const { return ctx_compute.get(); }
@@ -490,6 +499,7 @@ public:
     ggml_tensor * t_logits      = nullptr;
     ggml_tensor * t_embd        = nullptr;
     ggml_tensor * t_embd_pooled = nullptr;
+    ggml_tensor * t_attn_mass   = nullptr; // F32 [n_kv, n_stream] attention received by the KV cells, summed over the layers
 
     std::vector<llm_graph_input_ptr> inputs;
 
@@ -687,7 +697,9 @@ struct llm_graph_context {
              ggml_tensor * kq_mask,
              ggml_tensor * sinks,
              ggml_tensor * v_mla,   // [n_embd_head_v_mla, n_embd_head_v, n_head_v]
-                   float   kq_scale) const;
+                   float   kq_scale,
+             ggml_tensor * kv_blocks = nullptr,  // paged KV cache: k and v are the whole pool
+             ggml_tensor * kq_ones   = nullptr) const; // accumulate the attention mass of the KV cells in t_attn_mass
 
     llm_graph_input_attn_no_cache * build_attn_inp_no_cache() const;
 
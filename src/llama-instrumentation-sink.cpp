@@ -0,0 +1,331 @@
+#include "llama-instrumentation-sink.h"
+
+#include "llama-impl.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+
+#ifndef _WIN32
+    #include <sys/uio.h>
+    #include <unistd.h>
+    #include <limits.h>
+#endif
+
+// max number of entries handed to a single writev() call
+#if defined(IOV_MAX) && IOV_MAX < 256
+    #define LLAMA_INSTR_SINK_BATCH IOV_MAX
+#else
+    #define LLAMA_INSTR_SINK_BATCH 256
+#endif
+
+static size_t round_up_pow2(size_t n) {
+    size_t res = 2;
+    while (res < n) {
+        res <<= 1;
+    }
+    return res;
+}
+
+//
+// llama_instr_line_index
+//
+
+size_t llama_instr_line_index::n_lines() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return starts_.size() - 1;
+}
+
+bool llama_instr_line_index::range(size_t from, size_t & to, uint64_t & begin, uint64_t & end) const {
+    std::lock_guard<std::mutex> lock(mtx_);
+
+    const size_t n = starts_.size() - 1;
+    if (from > n) {
+        return false;
+    }
+
+    to    = std::min(to, n);
+    to    = std::max(to, from);
+    begin = starts_[from];
+    end   = starts_[to];
+
+    return true;
+}
+
+size_t llama_instr_line_index::wait(size_t n, int timeout_ms) const {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&]() {
+        return closed_ || starts_.size() - 1 > n;
+    });
+    return starts_.size() - 1;
+}
+
+bool llama_instr_line_index::closed() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return closed_;
+}
+
+void llama_instr_line_index::set_base(uint64_t offset) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    starts_.assign(1, offset);
+    end_ = offset;
+}
+
+void llama_instr_line_index::append(const char * data, size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+
+        const char * p   = data;
+        const char * end = data + size;
+        while (p < end) {
+            const char * nl = (const char *) memchr(p, '\n', end - p);
+            if (!nl) {
+                break;
+            }
+            p = nl + 1;
+            starts_.push_back(end_ + (p - data));
+        }
+        end_ += size;
+    }
+    cv_.notify_all();
+}
+
+void llama_instr_line_index::close() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        closed_ = true;
+    }
+    cv_.notify_all();
+}
+
+//
+// llama_instr_sink
+//
+
+llama_instr_sink::llama_instr_sink(const std::string & path, size_t capacity, llama_instr_overflow overflow,
+                                   std::shared_ptr<llama_instr_line_index> index, bool append)
+    : index_(std::move(index))
+    , slots_(round_up_pow2(capacity))
+    , mask_(slots_.size() - 1)
+    , overflow_(overflow)
+{
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    file_ = fopen(path.c_str(), append ? "ab" : "wb");
+    if (!file_) {
+        LLAMA_LOG_ERROR("%s: failed to open '%s'\n", __func__, path.c_str());
+        if (index_) {
+            index_->close();
+        }
+        return;
+    }
+
+    if (index_) {
+        fseek(file_, 0, SEEK_END);
+        index_->set_base((uint64_t) ftell(file_));
+    }
+
+    thrd_ = std::thread([this]() { worker(); });
+}
+
+llama_instr_sink::~llama_instr_sink() {
+    if (thrd_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        cv_work_.notify_one();
+        thrd_.join();
+    }
+
+    if (file_) {
+        fclose(file_);
+    }
+
+    if (index_) {
+        index_->close();
+    }
+}
+
+// bounded MPSC queue, ref: https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+bool llama_instr_sink::try_push(std::string & entry) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+
+    slot * s;
+    while (true) {
+        s = &slots_[pos & mask_];
+
+        const size_t   seq  = s->seq.load(std::memory_order_acquire);
+        const intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // full
+            return false;
+        } else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+
+    s->data = std::move(entry);
+    s->seq.store(pos + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool llama_instr_sink::push(std::string entry, bool newline) {
+    if (!file_) {
+        return false;
+    }
+
+    if (newline && (entry.empty() || entry.back() != '\n')) {
+        entry.push_back('\n');
+    }
+
+    while (!try_push(entry)) {
+        if (get_overflow() == llama_instr_overflow::DROP) {
+            n_dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // BLOCK: make sure the writer is awake and give it a chance to drain
+        cv_work_.notify_one();
+        std::this_thread::yield();
+    }
+
+    n_pushed_.fetch_add(1, std::memory_order_relaxed);
+
+    if (sleeping_.load()) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        cv_work_.notify_one();
+    }
+
+    return true;
+}
+
+void llama_instr_sink::flush() {
+    if (!thrd_.joinable()) {
+        return;
+    }
+
+    const size_t target = head_.load();
+
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_work_.notify_one();
+    cv_done_.wait(lock, [&]() { return completed_.load() >= target; });
+}
+
+size_t llama_instr_sink::pop_batch(std::vector<std::string> & out, size_t n_max) {
+    out.clear();
+
+    while (out.size() < n_max) {
+        slot & s = slots_[tail_ & mask_];
+
+        if (s.seq.load(std::memory_order_acquire) != tail_ + 1) {
+            // empty, or the next slot is claimed but not yet published
+            break;
+        }
+
+        out.push_back(std::move(s.data));
+        s.data.clear();
+        s.seq.store(tail_ + slots_.size(), std::memory_order_release);
+
+        tail_++;
+    }
+
+    return out.size();
+}
+
+void llama_instr_sink::write_batch(std::vector<std::string> & batch) {
+    size_t n_bytes = 0;
+
+#ifdef _WIN32
+    for (const auto & entry : batch) {
+        n_bytes += fwrite(entry.data(), 1, entry.size(), file_);
+    }
+    fflush(file_);
+#else
+    struct iovec iov[LLAMA_INSTR_SINK_BATCH];
+
+    const int n_iov = (int) batch.size();
+    for (int i = 0; i < n_iov; ++i) {
+        iov[i].iov_base = (void *) batch[i].data();
+        iov[i].iov_len  = batch[i].size();
+    }
+
+    const int fd = fileno(file_);
+
+    int i0 = 0;
+    while (i0 < n_iov) {
+        const ssize_t n = writev(fd, iov + i0, n_iov - i0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LLAMA_LOG_ERROR("%s: writev failed: %s\n", __func__, strerror(errno));
+            break;
+        }
+
+        n_bytes += n;
+
+        // skip over the fully written entries and adjust the partially written one
+        size_t rem = n;
+        while (i0 < n_iov && rem >= iov[i0].iov_len) {
+            rem -= iov[i0].iov_len;
+            i0++;
+        }
+        if (i0 < n_iov) {
+            iov[i0].iov_base = (char *) iov[i0].iov_base + rem;
+            iov[i0].iov_len -= rem;
+        }
+    }
+#endif
+
+    if (index_) {
+        // only index what actually made it to the file
+        size_t rem = n_bytes;
+        for (size_t i = 0; i < batch.size() && rem > 0; ++i) {
+            const size_t n = std::min(rem, batch[i].size());
+            index_->append(batch[i].data(), n);
+            rem -= n;
+        }
+    }
+
+    n_bytes_.fetch_add(n_bytes, std::memory_order_relaxed);
+    n_written_.fetch_add(batch.size(), std::memory_order_relaxed);
+}
+
+void llama_instr_sink::worker() {
+    std::vector<std::string> batch;
+    batch.reserve(LLAMA_INSTR_SINK_BATCH);
+
+    while (true) {
+        const size_t n = pop_batch(batch, LLAMA_INSTR_SINK_BATCH);
+        if (n > 0) {
+            write_batch(batch);
+
+            std::lock_guard<std::mutex> lock(mtx_);
+            completed_.fetch_add(n);
+            cv_done_.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mtx_);
+
+        if (stop_ && completed_.load() == head_.load()) {
+            break;
+        }
+
+        sleeping_.store(true);
+        cv_work_.wait_for(lock, std::chrono::milliseconds(10), [&]() {
+            return stop_ || head_.load() != tail_;
+        });
+        sleeping_.store(false);
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What to do when a producer finds the ring buffer full
+enum class llama_instr_overflow {
+    BLOCK,  // wait for the writer thread to free a slot (no entries are lost)
+    DROP,   // discard the entry and count it in n_dropped()
+};
+
+// Byte offsets of the lines written by a sink, shared with readers that follow the log
+// (e.g. a server streaming it to clients) so they can seek to any line without rescanning the file
+// line 0 is the first line written by the sink, offsets are absolute positions in the file
+class llama_instr_line_index {
+public:
+    size_t n_lines() const;
+
+    // byte range [begin, end) of the lines [from, to), to is clamped to n_lines()
+    // returns false if from is past the last complete line
+    bool range(size_t from, size_t & to, uint64_t & begin, uint64_t & end) const;
+
+    // block until more than n lines are complete, the index is closed or the timeout expires
+    // returns n_lines()
+    size_t wait(size_t n, int timeout_ms) const;
+
+    // true once the sink has been destroyed - no more lines will be added
+    bool closed() const;
+
+    // called by the sink after data has been written
+    void set_base(uint64_t offset);
+    void append(const char * data, size_t size);
+    void close();
+
+private:
+    mutable std::mutex              mtx_;
+    mutable std::condition_variable cv_;
+
+    std::vector<uint64_t> starts_ = { 0 };  // start of each line, the last entry is the start of the incomplete tail
+    uint64_t              end_    = 0;
+    bool                  closed_ = false;
+};
+
+// Asynchronous sink for instrumentation log entries
+//
+// Producers (decode thread, sampling loop, ...) push complete entries into a bounded
+// lock-free MPSC ring buffer. A background writer thread drains the ring in batches and
+// writes them with a single writev() call, so file I/O never happens on the hot path.
+class llama_instr_sink {
+public:
+    // if index is set, every line written to the file is recorded in it
+    // append == false truncates an existing file (e.g. a binary trace, which starts with its own header)
+    llama_instr_sink(const std::string & path,
+                     size_t capacity = 4096,
+                     llama_instr_overflow overflow = llama_instr_overflow::BLOCK,
+                     std::shared_ptr<llama_instr_line_index> index = nullptr,
+                     bool append = true);
+    ~llama_instr_sink();
+
+    llama_instr_sink(const llama_instr_sink &) = delete;
+    llama_instr_sink & operator=(const llama_instr_sink &) = delete;
+
+    bool is_open() const { return file_ != nullptr; }
+
+    // queue one entry; a trailing newline is appended if missing, unless newline is false (binary data)
+    // returns false if the entry was dropped
+    bool push(std::string entry, bool newline = true);
+
+    // block until every entry pushed before this call has been written to the file
+    void flush();
+
+    void set_overflow(llama_instr_overflow overflow) { overflow_.store(overflow, std::memory_order_relaxed); }
+    llama_instr_overflow get_overflow() const { return overflow_.load(std::memory_order_relaxed); }
+
+    uint64_t n_pushed()  const { return n_pushed_.load(std::memory_order_relaxed); }
+    uint64_t n_written() const { return n_written_.load(std::memory_order_relaxed); }
+    uint64_t n_dropped() const { return n_dropped_.load(std::memory_order_relaxed); }
+    uint64_t n_bytes()   const { return n_bytes_.load(std::memory_order_relaxed); }
+
+private:
+    struct slot {
+        std::atomic<size_t> seq;
+        std::string         data;
+    };
+
+    bool try_push(std::string & entry);
+    size_t pop_batch(std::vector<std::string> & out, size_t n_max);
+    void write_batch(std::vector<std::string> & batch);
+    void worker();
+
+    FILE * file_ = nullptr;
+
+    std::shared_ptr<llama_instr_line_index> index_;
+
+    std::vector<slot> slots_;
+    size_t            mask_;
+
+    // producers claim slots by advancing head_, the single consumer advances tail_
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) size_t              tail_ = 0;
+
+    std::atomic<llama_instr_overflow> overflow_;
+
+    std::atomic<uint64_t> n_pushed_{0};
+    std::atomic<uint64_t> n_written_{0};
+    std::atomic<uint64_t> n_dropped_{0};
+    std::atomic<uint64_t> n_bytes_{0};
+
+    // only used to park the writer thread and to wait for drains - never taken by push()
+    // unless the writer is asleep
+    std::mutex              mtx_;
+    std::condition_variable cv_work_;
+    std::condition_variable cv_done_;
+    std::atomic<bool>       sleeping_{false};
+    std::atomic<size_t>     completed_{0};
+    bool                    stop_ = false;
+
+    std::thread thrd_;
+};
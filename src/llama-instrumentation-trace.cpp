@@ -0,0 +1,338 @@
+#include "llama-instrumentation-trace.h"
+
+#include <chrono>
+#include <limits>
+
+static int64_t trace_time_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+template <typename T>
+static void trace_append(std::string & buf, const T & x) {
+    buf.append((const char *) &x, sizeof(T));
+}
+
+template <typename T>
+static void trace_append_col(std::string & buf, const std::vector<T> & col) {
+    buf.append((const char *) col.data(), col.size()*sizeof(T));
+}
+
+//
+// llama_trace_writer
+//
+
+llama_trace_writer::llama_trace_writer(emit_fn emit, size_t block_size)
+    : emit_(std::move(emit))
+    , block_size_(block_size)
+{
+    string_ids_[""] = 0;
+
+    std::string header;
+    trace_append<uint32_t>(header, LLAMA_TRACE_MAGIC);
+    trace_append<uint32_t>(header, LLAMA_TRACE_VERSION);
+    emit_(std::move(header));
+
+    col_type_ .reserve(block_size_);
+    col_flags_.reserve(block_size_);
+    col_layer_.reserve(block_size_);
+    col_name_ .reserve(block_size_);
+    col_dt_   .reserve(block_size_);
+    for (auto & col : col_v_) {
+        col.reserve(block_size_);
+    }
+}
+
+llama_trace_writer::~llama_trace_writer() {
+    flush();
+}
+
+uint32_t llama_trace_writer::intern(const std::string & str) {
+    auto it = string_ids_.find(str);
+    if (it != string_ids_.end()) {
+        return it->second;
+    }
+
+    if (string_ids_.size() >= LLAMA_TRACE_MAX_STRINGS) {
+        return local(str);
+    }
+
+    const uint32_t id = (uint32_t) string_ids_.size();
+    string_ids_.emplace(str, id);
+    strings_new_.push_back(str);
+
+    return id;
+}
+
+uint32_t llama_trace_writer::local(const std::string & str) {
+    if (str.empty()) {
+        return 0;
+    }
+
+    auto it = local_ids_.find(str);
+    if (it != local_ids_.end()) {
+        return it->second;
+    }
+
+    const uint32_t id = LLAMA_TRACE_STR_LOCAL | ((local_base_ + (uint32_t) strings_local_.size()) & ~LLAMA_TRACE_STR_LOCAL);
+    local_ids_.emplace(str, id);
+    strings_local_.push_back(str);
+
+    return id;
+}
+
+void llama_trace_writer::add(llama_trace_event ev) {
+    if (ev.t_us == 0) {
+        ev.t_us = trace_time_us();
+    }
+
+    if (!col_type_.empty()) {
+        const int64_t dt = ev.t_us - t_prev_;
+        if (dt < 0 || dt > std::numeric_limits<uint32_t>::max()) {
+            // cannot be delta-encoded - start a new block
+            flush();
+        }
+    }
+
+    if (col_type_.empty()) {
+        t_base_ = ev.t_us;
+        t_prev_ = ev.t_us;
+    }
+
+    col_type_ .push_back(ev.type);
+    col_flags_.push_back(ev.flags);
+    col_layer_.push_back(ev.layer);
+    col_name_ .push_back(ev.name);
+    col_dt_   .push_back((uint32_t) (ev.t_us - t_prev_));
+    for (int i = 0; i < 4; ++i) {
+        col_v_[i].push_back(ev.v[i]);
+    }
+
+    t_prev_ = ev.t_us;
+
+    if (col_type_.size() >= block_size_) {
+        flush();
+    }
+}
+
+void llama_trace_writer::flush() {
+    if (col_type_.empty()) {
+        return;
+    }
+
+    const uint32_t n_events = (uint32_t) col_type_.size();
+
+    size_t size = 5*sizeof(uint32_t) + sizeof(int64_t) + n_events*(1 + 2 + 4 + 4 + 4 + 4*8);
+    for (const auto & str : strings_new_) {
+        size += sizeof(uint32_t) + str.size();
+    }
+    for (const auto & str : strings_local_) {
+        size += sizeof(uint32_t) + str.size();
+    }
+
+    std::string buf;
+    buf.reserve(size);
+
+    trace_append<uint32_t>(buf, LLAMA_TRACE_BLOCK_MAGIC);
+    trace_append<uint32_t>(buf, n_events);
+    trace_append<uint32_t>(buf, (uint32_t) strings_new_.size());
+    trace_append<uint32_t>(buf, (uint32_t) strings_local_.size());
+    trace_append<int64_t> (buf, t_base_);
+
+    for (const auto & str : strings_new_) {
+        trace_append<uint32_t>(buf, (uint32_t) str.size());
+        buf.append(str);
+    }
+    for (const auto & str : strings_local_) {
+        trace_append<uint32_t>(buf, (uint32_t) str.size());
+        buf.append(str);
+    }
+
+    trace_append_col(buf, col_type_);
+    trace_append_col(buf, col_flags_);
+    trace_append_col(buf, col_layer_);
+    trace_append_col(buf, col_name_);
+    trace_append_col(buf, col_dt_);
+    for (const auto & col : col_v_) {
+        trace_append_col(buf, col);
+    }
+
+    emit_(std::move(buf));
+
+    strings_new_.clear();
+
+    local_base_ += (uint32_t) strings_local_.size();
+    local_ids_.clear();
+    strings_local_.clear();
+
+    col_type_ .clear();
+    col_flags_.clear();
+    col_layer_.clear();
+    col_name_ .clear();
+    col_dt_   .clear();
+    for (auto & col : col_v_) {
+        col.clear();
+    }
+}
+
+//
+// llama_trace_reader
+//
+
+llama_trace_reader::~llama_trace_reader() {
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+template <typename T>
+static bool trace_read(FILE * file, T & x) {
+    return fread(&x, sizeof(T), 1, file) == 1;
+}
+
+template <typename T>
+static bool trace_read_col(FILE * file, std::vector<T> & col, size_t n) {
+    col.resize(n);
+    return fread(col.data(), sizeof(T), n, file) == n;
+}
+
+bool llama_trace_reader::open(const std::string & path) {
+    file_ = fopen(path.c_str(), "rb");
+    if (!file_) {
+        return false;
+    }
+
+    uint32_t magic   = 0;
+    uint32_t version = 0;
+    if (!trace_read(file_, magic) || !trace_read(file_, version)) {
+        return false;
+    }
+
+    if (magic != LLAMA_TRACE_MAGIC || version != LLAMA_TRACE_VERSION) {
+        return false;
+    }
+
+    strings_.clear();
+    strings_.push_back("");
+
+    for (int i = 0; i < 2; ++i) {
+        local_[i].clear();
+        local_base_[i] = 0;
+    }
+
+    return true;
+}
+
+bool llama_trace_reader::read_block() {
+    uint32_t magic     = 0;
+    uint32_t n_events  = 0;
+    uint32_t n_strings = 0;
+    uint32_t n_local   = 0;
+    int64_t  t_base    = 0;
+
+    if (!trace_read(file_, magic) || magic != LLAMA_TRACE_BLOCK_MAGIC) {
+        return false;
+    }
+    if (!trace_read(file_, n_events) || !trace_read(file_, n_strings) || !trace_read(file_, n_local) || !trace_read(file_, t_base)) {
+        return false;
+    }
+
+    const auto read_str = [this](std::string & str) {
+        uint32_t len = 0;
+        if (!trace_read(file_, len)) {
+            return false;
+        }
+        str.assign(len, '\0');
+        return len == 0 || fread(&str[0], 1, len, file_) == len;
+    };
+
+    for (uint32_t i = 0; i < n_strings; ++i) {
+        std::string str;
+        if (!read_str(str)) {
+            return false;
+        }
+        strings_.push_back(std::move(str));
+    }
+
+    // the strings of the previous block stay valid for the events of a group that continues in this block
+    local_base_[0] = local_base_[1];
+    local_base_[1] = local_base_[1] + (uint32_t) local_[1].size();
+    local_[0] = std::move(local_[1]);
+    local_[1].resize(n_local);
+
+    for (auto & str : local_[1]) {
+        if (!read_str(str)) {
+            return false;
+        }
+    }
+
+    std::vector<uint8_t>  col_type;
+    std::vector<uint16_t> col_flags;
+    std::vector<int32_t>  col_layer;
+    std::vector<uint32_t> col_name;
+    std::vector<uint32_t> col_dt;
+    std::vector<uint64_t> col_v[4];
+
+    bool ok = true;
+    ok = ok && trace_read_col(file_, col_type,  n_events);
+    ok = ok && trace_read_col(file_, col_flags, n_events);
+    ok = ok && trace_read_col(file_, col_layer, n_events);
+    ok = ok && trace_read_col(file_, col_name,  n_events);
+    ok = ok && trace_read_col(file_, col_dt,    n_events);
+    for (auto & col : col_v) {
+        ok = ok && trace_read_col(file_, col, n_events);
+    }
+    if (!ok) {
+        return false;
+    }
+
+    events_.resize(n_events);
+    pos_ = 0;
+
+    int64_t t = t_base;
+    for (uint32_t i = 0; i < n_events; ++i) {
+        auto & ev = events_[i];
+
+        t += col_dt[i];
+
+        ev.type  = col_type[i];
+        ev.flags = col_flags[i];
+        ev.layer = col_layer[i];
+        ev.name  = col_name[i];
+        ev.t_us  = t;
+        for (int j = 0; j < 4; ++j) {
+            ev.v[j] = col_v[j][i];
+        }
+    }
+
+    return true;
+}
+
+bool llama_trace_reader::next(llama_trace_event & ev) {
+    while (pos_ >= events_.size()) {
+        if (!file_ || !read_block()) {
+            return false;
+        }
+    }
+
+    ev = events_[pos_++];
+
+    return true;
+}
+
+const std::string & llama_trace_reader::str(uint32_t id) const {
+    static const std::string empty;
+
+    if (id & LLAMA_TRACE_STR_LOCAL) {
+        const uint32_t idx = id & ~LLAMA_TRACE_STR_LOCAL;
+        for (int i = 1; i >= 0; --i) {
+            const uint32_t off = (idx - local_base_[i]) & ~LLAMA_TRACE_STR_LOCAL;
+            if (off < local_[i].size()) {
+                return local_[i][off];
+            }
+        }
+        return empty;
+    }
+
+    return id < strings_.size() ? strings_[id] : empty;
+}
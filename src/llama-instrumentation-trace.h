@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compact binary trace format for the instrumentation
+//
+// file   : header, then any number of blocks
+// header : u32 magic "LLTR", u32 version
+// block  : u32 magic "LTBK", u32 n_events, u32 n_strings, u32 n_local, i64 t_base_us
+//          n_strings x (u32 len, char[len])  - new entries of the string table, ids are assigned in order
+//          n_local   x (u32 len, char[len])  - strings of the events of this block only
+//          columns, each n_events long:
+//              u8  type, u16 flags, i32 layer, u32 name, u32 dt_us, u64 v0, u64 v1, u64 v2, u64 v3
+//
+// Every event is a fixed-size record stored column-wise. The fixed names (tensors, operations, keys, ...)
+// are interned once per file and referenced by id, up to LLAMA_TRACE_MAX_STRINGS of them. The strings that
+// change with every event (step names, notes, prompts, session ids, ...) are stored in the block of the
+// event, their ids have the LLAMA_TRACE_STR_LOCAL bit set and keep counting across the blocks, so that a
+// group of events split over two blocks still resolves them. Timestamps are delta-encoded against the previous
+// event of the block, the first event of a block is relative to t_base_us (microseconds since epoch).
+// All values are little-endian, the v0..v3 payload holds either int64 or double depending on the event.
+//
+// use tools/instr-trace (llama-instr-trace) to convert a trace back to JSONL
+
+#define LLAMA_TRACE_MAGIC       0x52544c4c // "LLTR"
+#define LLAMA_TRACE_BLOCK_MAGIC 0x4b42544c // "LTBK"
+#define LLAMA_TRACE_VERSION     2
+
+#define LLAMA_TRACE_STR_LOCAL   0x80000000u // id of a string stored in the block of the event
+#define LLAMA_TRACE_MAX_STRINGS 65536       // size limit of the string table, the other strings are stored per block
+
+enum llama_trace_event_type : uint8_t {
+    LLAMA_TRACE_EVENT_NONE = 0,
+
+    LLAMA_TRACE_EVENT_SESSION_START,  // name: session id,     v0: prompt (str)
+    LLAMA_TRACE_EVENT_SESSION_END,    // name: session id,     v0: duration ms, v1: steps, v2: n input tokens, v3: n output tokens
+    LLAMA_TRACE_EVENT_STEP_BEGIN,     // name: step name,      v0: step id
+    LLAMA_TRACE_EVENT_STEP_END,       // name: step name,      v0: step id, v1: duration us, v2: notes (str)
+    LLAMA_TRACE_EVENT_INPUT_TOKENS,   //                       v0: n tokens, followed by v0 TOKEN events
+    LLAMA_TRACE_EVENT_OUTPUT_TOKEN,   //                       v0: token, v1: probability (f64), v2: position
+    LLAMA_TRACE_EVENT_TOKEN,          //                       v0: token, v1: position, v2: timestamp us
+    LLAMA_TRACE_EVENT_TENSOR,         // name: tensor name,    v0..v3: min, max, mean, std (f64), flags: ggml_type | has_stats << 8
+                                      //                       followed by TENSOR_SHAPE and TENSOR_CTX
+    LLAMA_TRACE_EVENT_TENSOR_SHAPE,   // flags: n_dims,        v0..v3: ne
+    LLAMA_TRACE_EVENT_TENSOR_CTX,     // name: operation,      v0: role (str), v1: step name (str), v2: nbytes, v3: n elements
+    LLAMA_TRACE_EVENT_SAMPLING,       // name: method,         v0: selected token, v1: selected prob (f64), v2: n candidates, v3: n layers
+                                      //                       flags: n params, followed by the candidates, params and layers
+    LLAMA_TRACE_EVENT_CANDIDATE,      // name: token text,     v0: token, v1: prob (f64), v2: logit (f64)
+    LLAMA_TRACE_EVENT_LAYER,          // name: layer type,     v0: execution time us, v1: operation (str), flags: n metrics followed by PARAMs
+    LLAMA_TRACE_EVENT_PARAM,          // name: key,            v0: value (f64)
+    LLAMA_TRACE_EVENT_KV_UPDATE,      // name: operation,      v0: seq id, v1: pos start, v2: pos end
+    LLAMA_TRACE_EVENT_PERF,           // name: metric name,    v0: value (f64), v1: unit (str)
+    LLAMA_TRACE_EVENT_MODEL_METRICS,  //                       flags: n params, followed by PARAMs with "group.key" names
+
+    LLAMA_TRACE_EVENT_COUNT,
+};
+
+struct llama_trace_event {
+    uint8_t  type  = LLAMA_TRACE_EVENT_NONE;
+    uint16_t flags = 0;
+    int32_t  layer = -1;
+    uint32_t name  = 0;
+    int64_t  t_us  = 0;  // absolute, microseconds since epoch
+    uint64_t v[4]  = { 0, 0, 0, 0 };
+};
+
+static inline uint64_t llama_trace_i64(int64_t x) {
+    return (uint64_t) x;
+}
+
+static inline uint64_t llama_trace_f64(double x) {
+    uint64_t res;
+    memcpy(&res, &x, sizeof(res));
+    return res;
+}
+
+static inline int64_t llama_trace_as_i64(uint64_t x) {
+    return (int64_t) x;
+}
+
+static inline double llama_trace_as_f64(uint64_t x) {
+    double res;
+    memcpy(&res, &x, sizeof(res));
+    return res;
+}
+
+// Accumulates events into column blocks and hands each serialized block to emit()
+// not thread-safe - one writer per instrumentation stream
+class llama_trace_writer {
+public:
+    using emit_fn = std::function<void(std::string && data)>;
+
+    llama_trace_writer(emit_fn emit, size_t block_size = 1024);
+    ~llama_trace_writer();
+
+    // id 0 is always the empty string
+    // a fixed name, added to the string table of the file (stored per block once the table is full)
+    uint32_t intern(const std::string & str);
+
+    // a per-event string, stored in the current block only (once per block)
+    uint32_t local(const std::string & str);
+
+    // stamps the event with the current time if t_us == 0
+    void add(llama_trace_event ev);
+
+    // serialize and emit the pending block, if any
+    void flush();
+
+private:
+    emit_fn emit_;
+    size_t  block_size_;
+
+    std::unordered_map<std::string, uint32_t> string_ids_;
+    std::vector<std::string>                  strings_new_;
+
+    std::unordered_map<std::string, uint32_t> local_ids_;
+    std::vector<std::string>                  strings_local_;
+    uint32_t                                  local_base_ = 0; // id of strings_local_[0], without LLAMA_TRACE_STR_LOCAL
+
+    int64_t t_base_ = 0;
+    int64_t t_prev_ = 0;
+
+    std::vector<uint8_t>  col_type_;
+    std::vector<uint16_t> col_flags_;
+    std::vector<int32_t>  col_layer_;
+    std::vector<uint32_t> col_name_;
+    std::vector<uint32_t> col_dt_;
+    std::vector<uint64_t> col_v_[4];
+};
+
+// Sequential reader, used by the offline converter
+class llama_trace_reader {
+public:
+    ~llama_trace_reader();
+
+    bool open(const std::string & path);
+
+    // returns false at the end of the trace or on a malformed block
+    bool next(llama_trace_event & ev);
+
+    const std::string & str(uint32_t id) const;
+    const std::string & str(uint64_t v) const { return str((uint32_t) v); }
+
+private:
+    bool read_block();
+
+    FILE * file_ = nullptr;
+
+    std::vector<std::string> strings_;
+
+    // per-block strings of the current and of the previous block
+    std::vector<std::string> local_[2];
+    uint32_t                 local_base_[2] = { 0, 0 };
+
+    std::vector<llama_trace_event> events_;
+    size_t                         pos_ = 0;
+};
@@ -2,9 +2,13 @@
 #include "llama-vocab.h"
 #include "llama-impl.h"
 
+#include "ggml-backend.h"
+
 #include <algorithm>
 #include <numeric>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <random>
 #include <stdexcept>
 
@@ -31,6 +35,7 @@ std::string llama_tensor_metadata::to_json() const {
     ss << "\"mean_val\":" << mean_val << ",";
     ss << "\"std_val\":" << std_val << ",";
     ss << "\"memory_bytes\":" << memory_bytes << ",";
+    ss << "\"has_stats\":" << (has_stats ? "true" : "false") << ",";
     ss << "\"timestamp\":\"" << std::chrono::duration_cast<std::chrono::microseconds>(
         timestamp.time_since_epoch()).count() << "\"";
     ss << "}";
@@ -177,7 +182,8 @@ std::string llama_sampling_state::to_json() const {
 }
 
 // Constructor
-llama_instrumentation::llama_instrumentation(llama_instr_level level, const std::string& log_path)
+llama_instrumentation::llama_instrumentation(llama_instr_level level, const std::string& log_path,
+                                             llama_instr_format format)
     : level_(level)
     , log_file_path_(log_path)
     , current_step_id_(0)
@@ -186,22 +192,56 @@ llama_instrumentation::llama_instrumentation(llama_instr_level level, const std:
     , enabled_(true)
     , current_layer_idx_(-1)
     , current_step_name_("")
+    , in_step_(false)
+    , sample_every_(1)
+    , time_budget_(0.0)
+    , n_decode_(0)
+    , n_decode_traced_(0)
+    , t_decode_us_(0)
+    , t_decode_traced_us_(0)
 {
-    log_file_ = std::make_unique<std::ofstream>(log_file_path_, std::ios::app);
-    if (!log_file_->is_open()) {
+    // the line index is only meaningful for JSONL
+    if (format == llama_instr_format::JSONL) {
+        line_index_ = std::make_shared<llama_instr_line_index>();
+    }
+    
+    // a binary trace cannot be appended to, it starts with its own header and string table
+    sink_ = std::make_unique<llama_instr_sink>(log_file_path_, 4096, llama_instr_overflow::BLOCK, line_index_,
+                                               format != llama_instr_format::BINARY);
+    if (!sink_->is_open()) {
         LLAMA_LOG_ERROR("Failed to open instrumentation log file: %s\n", log_file_path_.c_str());
         enabled_ = false;
     } else {
         LLAMA_LOG_INFO("Instrumentation logging to: %s\n", log_file_path_.c_str());
     }
+    
+    if (enabled_ && format == llama_instr_format::BINARY) {
+        llama_instr_sink * sink = sink_.get();
+        trace_ = std::make_unique<llama_trace_writer>([sink](std::string && data) {
+            sink->push(std::move(data), false);
+        });
+    }
+    
+    if (const char * filter = getenv("LLAMA_INSTR_TENSOR_FILTER")) {
+        set_tensor_filter(filter);
+    }
+    
+    // e.g. LLAMA_INSTR_SAMPLE_EVERY=100 LLAMA_INSTR_TIME_BUDGET=0.01 to keep the profiling on in production
+    const char * sample_every = getenv("LLAMA_INSTR_SAMPLE_EVERY");
+    const char * time_budget  = getenv("LLAMA_INSTR_TIME_BUDGET");
+    if (sample_every || time_budget) {
+        set_sampling(sample_every ? (uint32_t) std::max(1, atoi(sample_every)) : 1, time_budget ? atof(time_budget) : 0.0);
+    }
 }
 
 // Destructor
 llama_instrumentation::~llama_instrumentation() {
-    if (log_file_ && log_file_->is_open()) {
-        flush();
-        log_file_->close();
+    if (sink_ && sink_->n_dropped() > 0) {
+        LLAMA_LOG_WARN(INSTR_LOG_PREFIX "%llu log entries were dropped\n", (unsigned long long) sink_->n_dropped());
     }
+    // emit the pending trace block, then let the sink drain all queued entries before closing the file
+    trace_.reset();
+    sink_.reset();
 }
 
 void llama_instrumentation::enable() {
@@ -219,12 +259,75 @@ void llama_instrumentation::set_level(llama_instr_level level) {
     LLAMA_LOG_INFO(INSTR_LOG_PREFIX "Instrumentation level set to: %d\n", static_cast<int>(level));
 }
 
+void llama_instrumentation::set_sampling(uint32_t every_n, double time_budget) {
+    sample_every_.store(std::max<uint32_t>(1, every_n), std::memory_order_relaxed);
+    time_budget_.store(std::max(0.0, time_budget), std::memory_order_relaxed);
+    LLAMA_LOG_INFO(INSTR_LOG_PREFIX "Tracing 1 in %u decodes, time budget %.3f\n", sample_every(), this->time_budget());
+}
+
+// the instrumentation whose decode on this thread is not traced, llama_decode runs on the calling thread
+static thread_local const llama_instrumentation * g_instr_skip_decode = nullptr;
+
+bool llama_instrumentation::skips_decode() const {
+    return g_instr_skip_decode == this;
+}
+
+bool llama_instrumentation::begin_decode() {
+    const uint32_t every_n     = sample_every();
+    const double   time_budget = this->time_budget();
+    
+    const uint64_t n_decode = n_decode_.fetch_add(1, std::memory_order_relaxed);
+    
+    bool traced = every_n <= 1 || n_decode % every_n == 0;
+    if (traced && time_budget > 0.0 &&
+            t_decode_traced_us_.load(std::memory_order_relaxed) > time_budget * t_decode_us_.load(std::memory_order_relaxed)) {
+        traced = false;
+    }
+    
+    if (traced) {
+        n_decode_traced_.fetch_add(1, std::memory_order_relaxed);
+    }
+    g_instr_skip_decode = traced ? nullptr : this;
+    
+    return traced && enabled_;
+}
+
+void llama_instrumentation::end_decode(int64_t t_decode_us) {
+    t_decode_us_.fetch_add(t_decode_us, std::memory_order_relaxed);
+    if (!skips_decode()) {
+        t_decode_traced_us_.fetch_add(t_decode_us, std::memory_order_relaxed);
+    }
+    g_instr_skip_decode = nullptr;
+}
+
 void llama_instrumentation::flush() {
-    if (log_file_) {
-        log_file_->flush();
+    if (trace_) {
+        trace_->flush();
+    }
+    if (sink_) {
+        sink_->flush();
     }
 }
 
+void llama_instrumentation::set_overflow_policy(llama_instr_overflow overflow) {
+    if (trace_ && overflow == llama_instr_overflow::DROP) {
+        // a dropped block would lose its part of the string table and corrupt the rest of the trace
+        LLAMA_LOG_WARN(INSTR_LOG_PREFIX "the binary trace format does not support dropping entries\n");
+        return;
+    }
+    if (sink_) {
+        sink_->set_overflow(overflow);
+    }
+}
+
+uint64_t llama_instrumentation::n_entries_written() const {
+    return sink_ ? sink_->n_written() : 0;
+}
+
+uint64_t llama_instrumentation::n_entries_dropped() const {
+    return sink_ ? sink_->n_dropped() : 0;
+}
+
 void llama_instrumentation::begin_session(const std::string& prompt, const struct llama_model* model) {
     if (!enabled_) return;
     
@@ -255,10 +358,21 @@ void llama_instrumentation::begin_step(const std::string& step_name, int layer_i
     
     current_step_name_ = step_name;
     current_layer_idx_ = layer_id;
+    in_step_ = true;
     step_start_time_ = std::chrono::high_resolution_clock::now();
     
     // Only log step_begin in VERBOSE mode to reduce noise
     if (level_ >= llama_instr_level::VERBOSE) {
+        if (trace_) {
+            llama_trace_event ev;
+            ev.type  = LLAMA_TRACE_EVENT_STEP_BEGIN;
+            ev.name  = trace_->local(step_name);
+            ev.layer = layer_id;
+            ev.v[0]  = llama_trace_i64(current_step_id_);
+            trace_->add(ev);
+            return;
+        }
+        
         std::stringstream entry;
         entry << "{\"event\":\"step_begin\",\"timestamp\":\"" << get_current_timestamp() 
               << "\",\"step_id\":" << current_step_id_ 
@@ -270,13 +384,22 @@ void llama_instrumentation::begin_step(const std::string& step_name, int layer_i
 }
 
 void llama_instrumentation::end_step(const std::string& notes) {
-    if (!enabled_ || current_step_name_.empty()) return;
+    if (!enabled_ || !in_step_) return;
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - step_start_time_);
     
     // Only log step_end in VERBOSE mode to reduce noise
-    if (level_ >= llama_instr_level::VERBOSE) {
+    if (level_ >= llama_instr_level::VERBOSE && trace_) {
+        llama_trace_event ev;
+        ev.type  = LLAMA_TRACE_EVENT_STEP_END;
+        ev.name  = trace_->local(current_step_name_);
+        ev.layer = current_layer_idx_;
+        ev.v[0]  = llama_trace_i64(current_step_id_);
+        ev.v[1]  = llama_trace_i64(duration.count());
+        ev.v[2]  = trace_->local(notes);
+        trace_->add(ev);
+    } else if (level_ >= llama_instr_level::VERBOSE) {
         llama_step_metrics metrics;
         metrics.step_name = current_step_name_;
         metrics.step_id = current_step_id_;
@@ -294,6 +417,7 @@ void llama_instrumentation::end_step(const std::string& notes) {
     
     current_step_id_++;
     current_step_name_.clear();
+    in_step_ = false;
 }
 
 void llama_instrumentation::log_input_tokens(const llama_token* tokens, int n_tokens, 
@@ -301,6 +425,34 @@ void llama_instrumentation::log_input_tokens(const llama_token* tokens, int n_to
     if (!enabled_ || level_ < llama_instr_level::MINIMAL) return;
     
     input_tokens_.clear();
+    
+    if (trace_) {
+        llama_trace_event ev;
+        ev.type = LLAMA_TRACE_EVENT_INPUT_TOKENS;
+        ev.v[0] = llama_trace_i64(n_tokens);
+        trace_->add(ev);
+        
+        for (int i = 0; i < n_tokens; i++) {
+            llama_token_info info;
+            info.token_id = tokens[i];
+            info.probability = 1.0;
+            info.position = i;
+            info.seq_id = 0;
+            info.timestamp = std::chrono::high_resolution_clock::now();
+            input_tokens_.push_back(info);
+            
+            llama_trace_event tev;
+            tev.type = LLAMA_TRACE_EVENT_TOKEN;
+            tev.t_us = ev.t_us;
+            tev.v[0] = llama_trace_i64(info.token_id);
+            tev.v[1] = llama_trace_i64(info.position);
+            tev.v[2] = llama_trace_i64(std::chrono::duration_cast<std::chrono::microseconds>(
+                info.timestamp.time_since_epoch()).count());
+            trace_->add(tev);
+        }
+        return;
+    }
+    
     std::stringstream token_list;
     token_list << "[";
     
@@ -342,6 +494,16 @@ void llama_instrumentation::log_output_token(llama_token token, double probabili
     
     output_tokens_.push_back(info);
     
+    if (trace_) {
+        llama_trace_event ev;
+        ev.type = LLAMA_TRACE_EVENT_OUTPUT_TOKEN;
+        ev.v[0] = llama_trace_i64(info.token_id);
+        ev.v[1] = llama_trace_f64(info.probability);
+        ev.v[2] = llama_trace_i64(info.position);
+        trace_->add(ev);
+        return;
+    }
+    
     std::stringstream entry;
     entry << "{\"event\":\"output_token\",\"timestamp\":\"" << get_current_timestamp() 
           << "\",\"token\":" << info.to_json()
@@ -358,6 +520,106 @@ void llama_instrumentation::log_tensor_metadata(const struct ggml_tensor* tensor
     
     llama_tensor_metadata metadata = extract_tensor_metadata(tensor, operation);
     
+    write_tensor_entry(metadata, role, tensor->type);
+}
+
+bool llama_instrumentation::eval_callback(struct ggml_tensor * t, bool ask, void * user_data) {
+    auto * instr = (llama_instrumentation *) user_data;
+    
+    if (ask) {
+        return instr->wants_tensor(t);
+    }
+    
+    // the scheduler has synchronized the backend, so the data of t is final here
+    instr->log_tensor_stats(t);
+    
+    // never abort the graph computation
+    return true;
+}
+
+void llama_instrumentation::set_tensor_filter(const std::string& filter) {
+    tensor_filter_.clear();
+    
+    size_t start = 0;
+    while (start <= filter.size()) {
+        size_t end = filter.find(',', start);
+        if (end == std::string::npos) {
+            end = filter.size();
+        }
+        if (end > start) {
+            tensor_filter_.push_back(filter.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+}
+
+bool llama_instrumentation::observes_tensors() const {
+    return is_enabled(llama_instr_level::DETAILED);
+}
+
+bool llama_instrumentation::wants_tensor(const struct ggml_tensor* tensor) const {
+    if (!observes_tensors() || !tensor || tensor->name[0] == '\0') {
+        return false;
+    }
+    
+    // without a filter only the layer outputs are observed, all the named nodes only in VERBOSE
+    // (the scheduler splits the graph and synchronizes after every observed node)
+    if (tensor_filter_.empty()) {
+        return level_ >= llama_instr_level::VERBOSE || strncmp(tensor->name, "l_out-", 6) == 0;
+    }
+    
+    for (const auto& pattern : tensor_filter_) {
+        if (strstr(tensor->name, pattern.c_str()) != nullptr) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void llama_instrumentation::log_tensor_stats(const struct ggml_tensor* tensor) {
+    if (!observes_tensors() || !tensor) return;
+    
+    llama_tensor_metadata metadata = extract_tensor_metadata(tensor, ggml_op_desc(tensor));
+    extract_tensor_stats(tensor, metadata);
+    
+    write_tensor_entry(metadata, "computed", tensor->type);
+}
+
+void llama_instrumentation::write_tensor_entry(const llama_tensor_metadata& metadata, const std::string& role, ggml_type type) {
+    if (trace_) {
+        llama_trace_event ev;
+        ev.type  = LLAMA_TRACE_EVENT_TENSOR;
+        ev.flags = (uint16_t) (type | (metadata.has_stats ? 1 << 8 : 0));
+        ev.name  = trace_->intern(metadata.name);
+        ev.layer = current_layer_idx_;
+        ev.v[0]  = llama_trace_f64(metadata.min_val);
+        ev.v[1]  = llama_trace_f64(metadata.max_val);
+        ev.v[2]  = llama_trace_f64(metadata.mean_val);
+        ev.v[3]  = llama_trace_f64(metadata.std_val);
+        trace_->add(ev);
+        
+        llama_trace_event shape;
+        shape.type  = LLAMA_TRACE_EVENT_TENSOR_SHAPE;
+        shape.flags = (uint16_t) metadata.shape.size();
+        shape.t_us  = ev.t_us;
+        for (size_t i = 0; i < metadata.shape.size() && i < 4; ++i) {
+            shape.v[i] = llama_trace_i64(metadata.shape[i]);
+        }
+        trace_->add(shape);
+        
+        llama_trace_event ctx;
+        ctx.type = LLAMA_TRACE_EVENT_TENSOR_CTX;
+        ctx.name = trace_->intern(metadata.operation);
+        ctx.t_us = ev.t_us;
+        ctx.v[0] = trace_->intern(role);
+        ctx.v[1] = trace_->local(current_step_name_);
+        ctx.v[2] = llama_trace_i64(metadata.memory_bytes);
+        ctx.v[3] = llama_trace_i64(metadata.element_count);
+        trace_->add(ctx);
+        return;
+    }
+    
     std::stringstream entry;
     entry << "{\"event\":\"tensor_metadata\",\"timestamp\":\"" << get_current_timestamp() 
           << "\",\"role\":\"" << role 
@@ -368,9 +630,59 @@ void llama_instrumentation::log_tensor_metadata(const struct ggml_tensor* tensor
     write_log_entry(entry.str());
 }
 
+void llama_instrumentation::write_trace_params(const std::map<std::string, double>& params) {
+    for (const auto& [key, value] : params) {
+        llama_trace_event ev;
+        ev.type = LLAMA_TRACE_EVENT_PARAM;
+        ev.name = trace_->intern(key);
+        ev.v[0] = llama_trace_f64(value);
+        trace_->add(ev);
+    }
+}
+
 void llama_instrumentation::log_sampling_state(const llama_sampling_state& state) {
     if (!enabled_) return;
     
+    if (trace_) {
+        llama_trace_event ev;
+        ev.type  = LLAMA_TRACE_EVENT_SAMPLING;
+        ev.flags = (uint16_t) state.sampling_params.size();
+        ev.name  = trace_->intern(state.sampling_method);
+        ev.v[0]  = llama_trace_i64(state.selected_token);
+        ev.v[1]  = llama_trace_f64(state.selected_prob);
+        ev.v[2]  = llama_trace_i64(state.top_tokens.size());
+        ev.v[3]  = llama_trace_i64(state.layer_details.size());
+        trace_->add(ev);
+        
+        for (size_t i = 0; i < state.top_tokens.size(); ++i) {
+            llama_trace_event cand;
+            cand.type = LLAMA_TRACE_EVENT_CANDIDATE;
+            cand.name = trace_->local(i < state.top_token_texts.size() ? state.top_token_texts[i] : "");
+            cand.t_us = ev.t_us;
+            cand.v[0] = llama_trace_i64(state.top_tokens[i]);
+            cand.v[1] = llama_trace_f64(i < state.top_probs.size()     ? state.top_probs[i]     : 0.0);
+            cand.v[2] = llama_trace_f64(i < state.logits_sample.size() ? state.logits_sample[i] : 0.0);
+            trace_->add(cand);
+        }
+        
+        write_trace_params(state.sampling_params);
+        
+        for (const auto& layer : state.layer_details) {
+            llama_trace_event lev;
+            lev.type  = LLAMA_TRACE_EVENT_LAYER;
+            lev.flags = (uint16_t) layer.layer_metrics.size();
+            lev.name  = trace_->intern(layer.layer_type);
+            lev.layer = layer.layer_id;
+            lev.t_us  = ev.t_us;
+            lev.v[0]  = llama_trace_i64(layer.execution_time.count());
+            lev.v[1]  = trace_->intern(layer.operation);
+            trace_->add(lev);
+            
+            write_trace_params(layer.layer_metrics);
+        }
+        return;
+    }
+    
     std::stringstream entry;
     entry << "{\"event\":\"sampling_state\",\"timestamp\":\"" << get_current_timestamp() 
           << "\",\"sampling\":" << state.to_json()
@@ -383,6 +695,18 @@ void llama_instrumentation::log_kv_cache_update(int layer_id, llama_seq_id seq_i
                                                const std::string& operation) {
     if (!enabled_ || level_ < llama_instr_level::DETAILED) return;
     
+    if (trace_) {
+        llama_trace_event ev;
+        ev.type  = LLAMA_TRACE_EVENT_KV_UPDATE;
+        ev.name  = trace_->intern(operation);
+        ev.layer = layer_id;
+        ev.v[0]  = llama_trace_i64(seq_id);
+        ev.v[1]  = llama_trace_i64(pos_start);
+        ev.v[2]  = llama_trace_i64(pos_end);
+        trace_->add(ev);
+        return;
+    }
+    
     std::stringstream entry;
     entry << "{\"event\":\"kv_cache_update\",\"timestamp\":\"" << get_current_timestamp() 
           << "\",\"layer_id\":" << layer_id
@@ -400,6 +724,16 @@ void llama_instrumentation::log_performance_metric(const std::string& metric_nam
     
     // Only log performance metrics in VERBOSE mode to reduce noise
     if (level_ >= llama_instr_level::VERBOSE) {
+        if (trace_) {
+            llama_trace_event ev;
+            ev.type = LLAMA_TRACE_EVENT_PERF;
+            ev.name = trace_->intern(metric_name);
+            ev.v[0] = llama_trace_f64(value);
+            ev.v[1] = trace_->intern(unit);
+            trace_->add(ev);
+            return;
+        }
+        
         std::stringstream entry;
         entry << "{\"event\":\"performance_metric\",\"timestamp\":\"" << get_current_timestamp() 
               << "\",\"metric_name\":\"" << metric_name
@@ -415,7 +749,34 @@ void llama_instrumentation::log_model_metrics(const struct llama_model* model,
     if (!enabled_ || !model) return;
     
     // Always log model metrics in DETAILED mode (important for monitoring)
-    if (level_ >= llama_instr_level::DETAILED) {
+    if (level_ >= llama_instr_level::DETAILED && trace_) {
+        std::map<std::string, double> params;
+        params["model_info.n_vocab"]       = llama_vocab_n_tokens(llama_model_get_vocab(model));
+        params["model_info.n_ctx_train"]   = llama_model_n_ctx_train(model);
+        params["model_info.n_embd"]        = llama_model_n_embd(model);
+        params["model_info.n_layer"]       = llama_model_n_layer(model);
+        params["model_info.n_head"]        = llama_model_n_head(model);
+        params["model_info.n_head_kv"]     = llama_model_n_head_kv(model);
+        params["model_info.model_size_mb"] = llama_model_size(model) / (1024 * 1024);
+        if (ctx) {
+            params["context_info.n_ctx"]     = llama_n_ctx(ctx);
+            params["context_info.n_batch"]   = llama_n_batch(ctx);
+            params["context_info.n_ubatch"]  = llama_n_ubatch(ctx);
+            params["context_info.n_seq_max"] = llama_n_seq_max(ctx);
+        }
+        params["memory_usage.model_size_bytes"] = llama_model_size(model);
+        if (ctx) {
+            params["memory_usage.context_size_estimate_bytes"] = (double) llama_n_ctx(ctx) * llama_model_n_embd(model) *
+                                                                 llama_model_n_layer(model) * 2 * sizeof(float);
+        }
+        
+        llama_trace_event ev;
+        ev.type  = LLAMA_TRACE_EVENT_MODEL_METRICS;
+        ev.flags = (uint16_t) params.size();
+        trace_->add(ev);
+        
+        write_trace_params(params);
+    } else if (level_ >= llama_instr_level::DETAILED) {
         std::stringstream entry;
         entry << "{\"event\":\"model_metrics\",\"timestamp\":\"" << get_current_timestamp() 
               << "\",\"session_id\":\"" << session_id_ << "\",";
@@ -474,8 +835,7 @@ llama_tensor_metadata llama_instrumentation::extract_tensor_metadata(const struc
         metadata.shape.push_back(tensor->ne[i]);
     }
     
-    // Calculate basic statistics (approximation - we don't read all data for performance)
-    // For now, just set default values
+    // statistics require executed data - see extract_tensor_stats()
     metadata.min_val = 0.0;
     metadata.max_val = 0.0;
     metadata.mean_val = 0.0;
@@ -492,6 +852,142 @@ llama_tensor_metadata llama_instrumentation::extract_tensor_metadata(const struc
     return metadata;
 }
 
+// single-pass min/max/sum/sum of squares over a row of floats
+// the independent lanes let the compiler vectorize the reduction without -ffast-math
+#define INSTR_STATS_LANES 8
+
+struct llama_tensor_stats_acc {
+    float  vmin[INSTR_STATS_LANES];
+    float  vmax[INSTR_STATS_LANES];
+    double sum   = 0.0;
+    double sumsq = 0.0;
+    size_t n     = 0;
+    
+    llama_tensor_stats_acc() {
+        for (int l = 0; l < INSTR_STATS_LANES; ++l) {
+            vmin[l] =  INFINITY;
+            vmax[l] = -INFINITY;
+        }
+    }
+    
+    void add(const float * x, int64_t n_x) {
+        float vsum  [INSTR_STATS_LANES] = { 0.0f };
+        float vsumsq[INSTR_STATS_LANES] = { 0.0f };
+        
+        const int64_t n_vec = n_x & ~(int64_t) (INSTR_STATS_LANES - 1);
+        
+        for (int64_t i = 0; i < n_vec; i += INSTR_STATS_LANES) {
+            for (int l = 0; l < INSTR_STATS_LANES; ++l) {
+                const float v = x[i + l];
+                vmin[l]    = v < vmin[l] ? v : vmin[l];
+                vmax[l]    = v > vmax[l] ? v : vmax[l];
+                vsum[l]   += v;
+                vsumsq[l] += v*v;
+            }
+        }
+        for (int64_t i = n_vec; i < n_x; ++i) {
+            const float v = x[i];
+            vmin[0]    = v < vmin[0] ? v : vmin[0];
+            vmax[0]    = v > vmax[0] ? v : vmax[0];
+            vsum[0]   += v;
+            vsumsq[0] += v*v;
+        }
+        
+        // rows are short enough for float partial sums, accumulate across rows in double
+        for (int l = 0; l < INSTR_STATS_LANES; ++l) {
+            sum   += vsum[l];
+            sumsq += vsumsq[l];
+        }
+        n += n_x;
+    }
+};
+
+bool llama_instrumentation::extract_tensor_stats(const struct ggml_tensor* tensor, llama_tensor_metadata& metadata) {
+    if (!tensor || !tensor->buffer || !tensor->data) {
+        return false;
+    }
+    
+    const ggml_type type = tensor->type;
+    const auto * traits  = ggml_get_type_traits(type);
+    
+    const bool convertible = type == GGML_TYPE_F32 || type == GGML_TYPE_F16 || type == GGML_TYPE_BF16 || traits->to_float;
+    if (!convertible || tensor->nb[0] != ggml_type_size(type) || tensor->ne[0] % ggml_blck_size(type) != 0) {
+        // integer tensors and views that are not contiguous in dim 0
+        return false;
+    }
+    
+    const bool is_host = ggml_backend_buffer_is_host(tensor->buffer);
+    
+    std::vector<uint8_t> raw;
+    std::vector<float>   row(tensor->ne[0]);
+    
+    const size_t row_size = ggml_row_size(type, tensor->ne[0]);
+    if (!is_host) {
+        raw.resize(row_size);
+    }
+    
+    llama_tensor_stats_acc acc;
+    
+    for (int64_t i3 = 0; i3 < tensor->ne[3]; ++i3) {
+        for (int64_t i2 = 0; i2 < tensor->ne[2]; ++i2) {
+            for (int64_t i1 = 0; i1 < tensor->ne[1]; ++i1) {
+                const size_t offs = i1*tensor->nb[1] + i2*tensor->nb[2] + i3*tensor->nb[3];
+                
+                const void * src;
+                if (is_host) {
+                    src = (const char *) tensor->data + offs;
+                } else {
+                    ggml_backend_tensor_get(tensor, raw.data(), offs, row_size);
+                    src = raw.data();
+                }
+                
+                const float * x;
+                switch (type) {
+                    case GGML_TYPE_F32:
+                        x = (const float *) src;
+                        break;
+                    case GGML_TYPE_F16:
+                        ggml_fp16_to_fp32_row((const ggml_fp16_t *) src, row.data(), tensor->ne[0]);
+                        x = row.data();
+                        break;
+                    case GGML_TYPE_BF16:
+                        ggml_bf16_to_fp32_row((const ggml_bf16_t *) src, row.data(), tensor->ne[0]);
+                        x = row.data();
+                        break;
+                    default:
+                        traits->to_float(src, row.data(), tensor->ne[0]);
+                        x = row.data();
+                        break;
+                }
+                
+                acc.add(x, tensor->ne[0]);
+            }
+        }
+    }
+    
+    if (acc.n == 0) {
+        return false;
+    }
+    
+    float vmin = acc.vmin[0];
+    float vmax = acc.vmax[0];
+    for (int l = 1; l < INSTR_STATS_LANES; ++l) {
+        vmin = std::min(vmin, acc.vmin[l]);
+        vmax = std::max(vmax, acc.vmax[l]);
+    }
+    
+    const double mean = acc.sum / acc.n;
+    const double var  = std::max(0.0, acc.sumsq / acc.n - mean*mean);
+    
+    metadata.min_val   = vmin;
+    metadata.max_val   = vmax;
+    metadata.mean_val  = mean;
+    metadata.std_val   = std::sqrt(var);
+    metadata.has_stats = true;
+    
+    return true;
+}
+
 bool llama_instrumentation::is_quantized_tensor(const struct ggml_tensor* tensor) {
     if (!tensor) return false;
     return ggml_is_quantized(tensor->type);
@@ -533,18 +1029,27 @@ std::string llama_instrumentation::generate_session_id() {
 }
 
 void llama_instrumentation::write_log_entry(const std::string& entry) {
-    if (!log_file_ || !enabled_) return;
-    
-    *log_file_ << entry << std::endl;
+    if (!sink_ || !enabled_) return;
     
     if (level_ >= llama_instr_level::VERBOSE) {
         LLAMA_LOG_DEBUG(INSTR_LOG_PREFIX "%s\n", entry.c_str());
     }
+    
+    sink_->push(entry);
 }
 
 void llama_instrumentation::write_session_header(const std::string& prompt, const struct llama_model* model) {
     if (!enabled_) return;
     
+    if (trace_) {
+        llama_trace_event ev;
+        ev.type = LLAMA_TRACE_EVENT_SESSION_START;
+        ev.name = trace_->local(session_id_);
+        ev.v[0] = trace_->local(prompt);
+        trace_->add(ev);
+        return;
+    }
+    
     // Simplified session start log
     std::stringstream header;
     header << "{\"event\":\"session_start\",\"timestamp\":\"" << get_current_timestamp() 
@@ -571,14 +1076,30 @@ void llama_instrumentation::write_session_footer() {
     auto session_end = std::chrono::high_resolution_clock::now();
     auto session_duration = std::chrono::duration_cast<std::chrono::milliseconds>(session_end - session_start_);
     
+    if (trace_) {
+        llama_trace_event ev;
+        ev.type = LLAMA_TRACE_EVENT_SESSION_END;
+        ev.name = trace_->local(session_id_);
+        ev.v[0] = llama_trace_i64(session_duration.count());
+        ev.v[1] = llama_trace_i64(current_step_id_);
+        ev.v[2] = llama_trace_i64(input_tokens_.size());
+        ev.v[3] = llama_trace_i64(output_tokens_.size());
+        trace_->add(ev);
+        return;
+    }
+    
     std::stringstream footer;
     footer << "{\"event\":\"session_end\",\"timestamp\":\"" << get_current_timestamp() 
            << "\",\"session_id\":\"" << session_id_ 
            << "\",\"duration_ms\":" << session_duration.count()
            << ",\"total_steps\":" << current_step_id_
            << ",\"input_token_count\":" << input_tokens_.size()
-           << ",\"output_token_count\":" << output_tokens_.size()
-           << "}";
+           << ",\"output_token_count\":" << output_tokens_.size();
+    if (sample_every() > 1 || time_budget() > 0.0) {
+        footer << ",\"n_decode\":" << n_decode()
+               << ",\"n_decode_traced\":" << n_decode_traced();
+    }
+    footer << "}";
     
     write_log_entry(footer.str());
 }
@@ -595,17 +1116,23 @@ std::string llama_instrumentation::format_tensor_shape(const std::vector<int64_t
 }
 
 // Global initialization functions
-void llama_instrumentation_init(llama_instr_level level, const std::string& log_path) {
+void llama_instrumentation_init(llama_instr_level level, const std::string& log_path, llama_instr_format format) {
     if (g_llama_instr) {
         LLAMA_LOG_WARN("Instrumentation already initialized\n");
         return;
     }
     
-    g_llama_instr = std::make_unique<llama_instrumentation>(level, log_path);
+    g_llama_instr = std::make_unique<llama_instrumentation>(level, log_path, format);
     LLAMA_LOG_INFO(INSTR_LOG_PREFIX "Initialized with level %d, logging to: %s\n", 
             static_cast<int>(level), log_path.c_str());
 }
 
+void llama_instrumentation_set_sampling(uint32_t every_n, double time_budget) {
+    if (g_llama_instr) {
+        g_llama_instr->set_sampling(every_n, time_budget);
+    }
+}
+
 void llama_instrumentation_free() {
     if (g_llama_instr) {
         g_llama_instr.reset();
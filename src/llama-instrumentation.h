@@ -3,7 +3,10 @@
 #include "llama.h"
 #include "ggml.h"
 #include "llama-impl.h"
+#include "llama-instrumentation-sink.h"
+#include "llama-instrumentation-trace.h"
 
+#include <atomic>
 #include <string>
 #include <vector>
 #include <chrono>
@@ -23,6 +26,12 @@ enum class llama_instr_level {
     VERBOSE     // All tensor operations (may impact performance)
 };
 
+// Output format of the instrumentation log
+enum class llama_instr_format {
+    JSONL,      // one JSON object per line
+    BINARY,     // compact columnar trace, see llama-instrumentation-trace.h (convert with llama-instr-trace)
+};
+
 // Metadata for tensor snapshots (no actual data, just overview)
 struct llama_tensor_metadata {
     std::string name;
@@ -33,6 +42,7 @@ struct llama_tensor_metadata {
     double min_val, max_val, mean_val, std_val;
     std::chrono::high_resolution_clock::time_point timestamp;
     size_t memory_bytes;
+    bool has_stats = false;  // min/max/mean/std were computed from executed data
     
     std::string to_json() const;
 };
@@ -94,7 +104,9 @@ class llama_instrumentation {
 private:
     llama_instr_level level_;
     std::string log_file_path_;
-    std::unique_ptr<std::ofstream> log_file_;
+    std::unique_ptr<llama_instr_sink> sink_;
+    std::unique_ptr<llama_trace_writer> trace_;  // only in BINARY format
+    std::shared_ptr<llama_instr_line_index> line_index_;  // only in JSONL format
     size_t current_step_id_;
     std::chrono::high_resolution_clock::time_point session_start_;
     std::string session_id_;
@@ -106,11 +118,30 @@ private:
     std::vector<llama_token_info> output_tokens_;
     int current_layer_idx_;
     std::string current_step_name_;
+    bool in_step_;
     std::chrono::high_resolution_clock::time_point step_start_time_;
     
+    // Tensor name filter for execution-time statistics (empty = the layer outputs, all the nodes in VERBOSE)
+    std::vector<std::string> tensor_filter_;
+    
+    // Statistical profiling: only one decode in sample_every_ is traced, and only while the traced
+    // decodes take at most time_budget_ of the total decode time (0 = unbounded). The other decodes
+    // only update the counters below (and the llama_metrics() histograms). Several contexts may decode
+    // at the same time, whether the current decode is traced is kept per thread (see skips_decode())
+    std::atomic<uint32_t> sample_every_;
+    std::atomic<double>   time_budget_;
+    std::atomic<uint64_t> n_decode_;
+    std::atomic<uint64_t> n_decode_traced_;
+    std::atomic<int64_t>  t_decode_us_;
+    std::atomic<int64_t>  t_decode_traced_us_;
+    
+    // true while the decode of the calling thread is not traced
+    bool skips_decode() const;
+    
 public:
     llama_instrumentation(llama_instr_level level = llama_instr_level::DETAILED, 
-                         const std::string& log_path = "llama_inference_trace.log");
+                         const std::string& log_path = "llama_inference_trace.log",
+                         llama_instr_format format = llama_instr_format::JSONL);
     ~llama_instrumentation();
     
     // Control methods
@@ -118,6 +149,31 @@ public:
     void disable();
     void set_level(llama_instr_level level);
     void flush();
+
+    // true if entries of the given level are currently recorded
+    bool is_enabled(llama_instr_level level = llama_instr_level::MINIMAL) const { return enabled_ && level_ >= level && !skips_decode(); }
+
+    // Statistical profiling, can be changed at any time, also while another thread decodes
+    // every_n:     trace one llama_decode call in every_n (1 = all of them)
+    // time_budget: maximum fraction of the decode time spent in traced decodes (0 = unbounded)
+    void set_sampling(uint32_t every_n, double time_budget = 0.0);
+    uint32_t sample_every() const { return sample_every_.load(std::memory_order_relaxed); }
+    double   time_budget()  const { return time_budget_.load(std::memory_order_relaxed); }
+
+    // called by llama_decode around every decode; begin_decode() returns true if the decode is traced
+    bool begin_decode();
+    void end_decode(int64_t t_decode_us);
+
+    uint64_t n_decode()        const { return n_decode_.load(std::memory_order_relaxed); }
+    uint64_t n_decode_traced() const { return n_decode_traced_.load(std::memory_order_relaxed); }
+
+    // Asynchronous writer control and statistics
+    void set_overflow_policy(llama_instr_overflow overflow);
+    uint64_t n_entries_written() const;
+    uint64_t n_entries_dropped() const;
+
+    // byte offsets of the lines written so far, outlives the instrumentation (nullptr in BINARY format)
+    std::shared_ptr<llama_instr_line_index> line_index() const { return line_index_; }
     
     // Session management
     void begin_session(const std::string& prompt, const struct llama_model* model);
@@ -138,6 +194,15 @@ public:
                            const std::string& operation,
                            const std::string& role = "intermediate");
     
+    // Execution-time tensor statistics
+    // Installed as the ggml_backend_sched eval callback; only tensors matching the filter are
+    // observed, so the scheduler only splits the graph after those nodes
+    static bool eval_callback(struct ggml_tensor * t, bool ask, void * user_data);
+    void set_tensor_filter(const std::string& filter);  // comma-separated name substrings
+    bool observes_tensors() const;
+    bool wants_tensor(const struct ggml_tensor* tensor) const;
+    void log_tensor_stats(const struct ggml_tensor* tensor);
+    
     // Sampling state logging
     void log_sampling_state(const llama_sampling_state& state);
     
@@ -157,6 +222,7 @@ public:
     // Utility methods
     static llama_tensor_metadata extract_tensor_metadata(const struct ggml_tensor* tensor,
                                                         const std::string& operation);
+    static bool extract_tensor_stats(const struct ggml_tensor* tensor, llama_tensor_metadata& metadata);
     static bool is_quantized_tensor(const struct ggml_tensor* tensor);
     static double get_compression_ratio(const struct ggml_tensor* tensor);
     static std::string get_current_timestamp();
@@ -164,45 +230,68 @@ public:
     
 private:
     void write_log_entry(const std::string& entry);
+    void write_tensor_entry(const llama_tensor_metadata& metadata, const std::string& role, ggml_type type);
+    void write_trace_params(const std::map<std::string, double>& params);
     void write_session_header(const std::string& prompt, const struct llama_model* model);
     void write_session_footer();
     std::string format_tensor_shape(const std::vector<int64_t>& shape);
-    double calculate_tensor_stats(const struct ggml_tensor* tensor, 
-                                const std::string& stat_type);
 };
 
 // Global instrumentation instance
 extern std::unique_ptr<llama_instrumentation> g_llama_instr;
 
 // Convenience macros for instrumentation
+//
+// The arguments are only evaluated when the global instrumentation records the level the call
+// needs, so call sites can format step names and notes in place. Step names are needed from
+// DETAILED on (they annotate the tensor entries), notes and performance metrics only in VERBOSE.
+// When built with -DLLAMA_INSTRUMENTATION=OFF the macros expand to nothing.
+#ifdef LLAMA_INSTRUMENTATION
+#define INSTR_ACTIVE(level) (g_llama_instr && g_llama_instr->is_enabled(llama_instr_level::level))
+#define INSTR_CALL(level, call) \
+    do { if (INSTR_ACTIVE(level)) { g_llama_instr->call; } } while (0)
+#else
+#define INSTR_ACTIVE(level) false
+#define INSTR_CALL(level, call) \
+    do { } while (0)
+#endif
+
+// evaluates str only if instr records the given level, to an empty string otherwise
+#define INSTR_LAZY_STR(instr, level, str) \
+    ((instr).is_enabled(llama_instr_level::level) ? std::string(str) : std::string())
+
 #define INSTR_BEGIN_SESSION(prompt, model) \
-    if (g_llama_instr) g_llama_instr->begin_session(prompt, model)
+    INSTR_CALL(MINIMAL, begin_session(prompt, model))
 
 #define INSTR_END_SESSION() \
-    if (g_llama_instr) g_llama_instr->end_session()
+    INSTR_CALL(MINIMAL, end_session())
 
 #define INSTR_BEGIN_STEP(step_name, layer_id) \
-    if (g_llama_instr) g_llama_instr->begin_step(step_name, layer_id)
+    INSTR_CALL(MINIMAL, begin_step(INSTR_LAZY_STR(*g_llama_instr, DETAILED, step_name), layer_id))
 
 #define INSTR_END_STEP(notes) \
-    if (g_llama_instr) g_llama_instr->end_step(notes)
+    INSTR_CALL(MINIMAL, end_step(INSTR_LAZY_STR(*g_llama_instr, VERBOSE, notes)))
 
 #define INSTR_LOG_TENSOR(tensor, operation, role) \
-    if (g_llama_instr) g_llama_instr->log_tensor_metadata(tensor, operation, role)
+    INSTR_CALL(DETAILED, log_tensor_metadata(tensor, operation, role))
 
 #define INSTR_LOG_TOKENS_IN(tokens, n_tokens, vocab) \
-    if (g_llama_instr) g_llama_instr->log_input_tokens(tokens, n_tokens, vocab)
+    INSTR_CALL(MINIMAL, log_input_tokens(tokens, n_tokens, vocab))
 
 #define INSTR_LOG_TOKEN_OUT(token, prob, vocab) \
-    if (g_llama_instr) g_llama_instr->log_output_token(token, prob, vocab)
+    INSTR_CALL(MINIMAL, log_output_token(token, prob, vocab))
 
 #define INSTR_LOG_SAMPLING(state) \
-    if (g_llama_instr) g_llama_instr->log_sampling_state(state)
+    INSTR_CALL(MINIMAL, log_sampling_state(state))
 
 #define INSTR_LOG_PERF(metric_name, value, unit) \
-    if (g_llama_instr) g_llama_instr->log_performance_metric(metric_name, value, unit)
+    INSTR_CALL(VERBOSE, log_performance_metric(metric_name, value, unit))
 
 // Initialization functions
 void llama_instrumentation_init(llama_instr_level level = llama_instr_level::DETAILED,
-                               const std::string& log_path = "llama_inference_trace.log");
+                               const std::string& log_path = "llama_inference_trace.log",
+                               llama_instr_format format = llama_instr_format::JSONL);
 void llama_instrumentation_free();
+
+// trace only a sample of the decodes of the global instrumentation, see llama_instrumentation::set_sampling
+void llama_instrumentation_set_sampling(uint32_t every_n, double time_budget = 0.0);
@@ -15,6 +15,7 @@ llama_kv_cache_unified_iswa::llama_kv_cache_unified_iswa(
         const llama_model & model,
                 ggml_type   type_k,
                 ggml_type   type_v,
+    const llama_kv_cache_type_override * type_overrides,
                      bool   v_trans,
                      bool   offload,
                      bool   swa_full,
@@ -41,14 +42,14 @@ llama_kv_cache_unified_iswa::llama_kv_cache_unified_iswa(
     LLAMA_LOG_INFO("%s: creating non-SWA KV cache, size = %u cells\n", __func__, size_base);
 
     kv_base = std::make_unique<llama_kv_cache_unified>(
-            model, std::move(filter_base), type_k, type_v,
+            model, std::move(filter_base), type_k, type_v, type_overrides,
             v_trans, offload, unified, size_base, n_seq_max, n_pad,
             0, LLAMA_SWA_TYPE_NONE);
 
     LLAMA_LOG_INFO("%s: creating     SWA KV cache, size = %u cells\n", __func__, size_swa);
 
     kv_swa = std::make_unique<llama_kv_cache_unified>(
-            model, std::move(filter_swa), type_k, type_v,
+            model, std::move(filter_swa), type_k, type_v, type_overrides,
             v_trans, offload, unified, size_swa, n_seq_max, n_pad,
             hparams.n_swa, hparams.swa_type);
 }
@@ -17,6 +17,7 @@ public:
             const llama_model & model,
                     ggml_type   type_k,
                     ggml_type   type_v,
+    const llama_kv_cache_type_override * type_overrides,
                          bool   v_trans,
                          bool   offload,
                          bool   swa_full,
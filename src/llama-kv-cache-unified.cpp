@@ -10,6 +10,7 @@
 #include <cmath>
 #include <limits>
 #include <map>
+#include <regex>
 #include <stdexcept>
 
 //
@@ -21,6 +22,7 @@ llama_kv_cache_unified::llama_kv_cache_unified(
           layer_filter_cb && filter,
                 ggml_type    type_k,
                 ggml_type    type_v,
+    const llama_kv_cache_type_override * type_overrides,
                      bool    v_trans,
                      bool    offload,
                      bool    unified,
@@ -28,12 +30,24 @@ llama_kv_cache_unified::llama_kv_cache_unified(
                  uint32_t    n_seq_max,
                  uint32_t    n_pad,
                  uint32_t    n_swa,
-           llama_swa_type    swa_type) :
+           llama_swa_type    swa_type,
+                 uint32_t    n_block,
+       llama_kv_spill_ptr    spill,
+       const evict_params &  evict) :
     model(model), hparams(model.hparams), v_trans(v_trans),
-    n_seq_max(n_seq_max), n_stream(unified ? 1 : n_seq_max), n_pad(n_pad), n_swa(n_swa), swa_type(swa_type) {
+    n_seq_max(n_seq_max), n_stream(unified ? 1 : n_seq_max), n_pad(n_pad), n_swa(n_swa), swa_type(swa_type), n_block(n_block),
+    spill(std::move(spill)), evict(evict) {
 
     GGML_ASSERT(kv_size % n_pad == 0);
 
+    if (n_block > 0) {
+        GGML_ASSERT(n_stream > 1 && kv_size % n_block == 0);
+        GGML_ASSERT(!v_trans && "the paged KV cache requires flash attention");
+    }
+
+    // the streams of the paged cache share the cells of a single pool
+    const uint32_t n_stream_buf = n_block > 0 ? 1 : n_stream;
+
     // TODO: this is temporary until we support passing reuse layer filters [KV_REUSE]
     auto n_layer_cache = hparams.n_layer;
     if (model.arch == LLM_ARCH_GEMMA3N) {
@@ -44,6 +58,22 @@ llama_kv_cache_unified::llama_kv_cache_unified(
         n_layer_cache = hparams.n_layer - hparams.nextn_predict_layers;
     }
 
+    // per-layer types: the first override whose pattern matches the name of the tensor
+    std::vector<std::pair<std::regex, ggml_type>> overrides;
+    for (const auto * o = type_overrides; o && o->pattern != nullptr; ++o) {
+        overrides.emplace_back(std::regex(o->pattern), o->type);
+    }
+
+    auto get_type = [&](const std::string & name, ggml_type type) {
+        for (const auto & o : overrides) {
+            if (std::regex_search(name, o.first)) {
+                return o.second;
+            }
+        }
+
+        return type;
+    };
+
     // create a context for each buffer type
     std::map<ggml_backend_buffer_type_t, ggml_context *> ctx_map;
     auto ctx_for_buft = [&](ggml_backend_buffer_type_t buft) -> ggml_context * {
@@ -118,6 +148,11 @@ llama_kv_cache_unified::llama_kv_cache_unified(
             dev_name = ggml_backend_dev_name(dev);
         }
 
+        if (n_block > 0 && !ggml_backend_buft_is_host(buft)) {
+            // the block tables are only supported by the CPU flash attention
+            throw std::runtime_error("the paged KV cache must be in host memory - disable the KV offload");
+        }
+
         LLAMA_LOG_DEBUG("%s: layer %3d: dev = %s\n", __func__, il, dev_name);
 
         ggml_context * ctx = ctx_for_buft(buft);
@@ -128,8 +163,19 @@ llama_kv_cache_unified::llama_kv_cache_unified(
         ggml_tensor * k;
         ggml_tensor * v;
 
-        k = ggml_new_tensor_3d(ctx, type_k, n_embd_k_gqa, kv_size, n_stream);
-        v = ggml_new_tensor_3d(ctx, type_v, n_embd_v_gqa, kv_size, n_stream);
+        const ggml_type type_k_l = get_type(format("cache_k_l%d", il), type_k);
+        const ggml_type type_v_l = get_type(format("cache_v_l%d", il), type_v);
+
+        if (v_trans && ggml_is_quantized(type_v_l)) {
+            throw std::runtime_error(format("layer %d: V cache quantization requires flash attention", il));
+        }
+
+        if (type_k_l != type_k || type_v_l != type_v) {
+            LLAMA_LOG_DEBUG("%s: layer %3d: K (%s), V (%s)\n", __func__, il, ggml_type_name(type_k_l), ggml_type_name(type_v_l));
+        }
+
+        k = ggml_new_tensor_3d(ctx, type_k_l, n_embd_k_gqa, kv_size, n_stream_buf);
+        v = ggml_new_tensor_3d(ctx, type_v_l, n_embd_v_gqa, kv_size, n_stream_buf);
 
         ggml_format_name(k, "cache_k_l%d", il);
         ggml_format_name(v, "cache_v_l%d", il);
@@ -137,7 +183,7 @@ llama_kv_cache_unified::llama_kv_cache_unified(
         std::vector<ggml_tensor *> k_stream;
         std::vector<ggml_tensor *> v_stream;
 
-        for (uint32_t s = 0; s < n_stream; ++s) {
+        for (uint32_t s = 0; s < n_stream_buf; ++s) {
             k_stream.push_back(ggml_view_2d(ctx, k, n_embd_k_gqa, kv_size, k->nb[1], s*k->nb[2]));
             v_stream.push_back(ggml_view_2d(ctx, v, n_embd_v_gqa, kv_size, v->nb[1], s*v->nb[2]));
         }
@@ -187,10 +233,45 @@ llama_kv_cache_unified::llama_kv_cache_unified(
         const size_t memory_size_k = size_k_bytes();
         const size_t memory_size_v = size_v_bytes();
 
+        // the distinct types of the layers, e.g. "f16/q4_0" for a mixed-precision cache
+        auto get_types = [&](bool is_v) {
+            std::string res;
+            for (const auto & layer : layers) {
+                const std::string name = ggml_type_name(is_v ? layer.v->type : layer.k->type);
+                if (("/" + res + "/").find("/" + name + "/") == std::string::npos) {
+                    res += (res.empty() ? "" : "/") + name;
+                }
+            }
+
+            return res;
+        };
+
         LLAMA_LOG_INFO("%s: size = %7.2f MiB (%6u cells, %3d layers, %2u/%u seqs), K (%s): %7.2f MiB, V (%s): %7.2f MiB\n", __func__,
                 (float)(memory_size_k + memory_size_v) / (1024.0f * 1024.0f), kv_size, (int) layers.size(), n_seq_max, n_stream,
-                ggml_type_name(type_k), (float)memory_size_k / (1024.0f * 1024.0f),
-                ggml_type_name(type_v), (float)memory_size_v / (1024.0f * 1024.0f));
+                get_types(false).c_str(), (float)memory_size_k / (1024.0f * 1024.0f),
+                get_types(true) .c_str(), (float)memory_size_v / (1024.0f * 1024.0f));
+    }
+
+    if (n_block > 0) {
+        blocks_reset();
+
+        LLAMA_LOG_INFO("%s: paged: %u blocks of %u cells shared by %u streams\n", __func__, kv_size/n_block, n_block, n_stream);
+    }
+
+    if (this->spill) {
+        // the sequences of a stream share its cells, so spilling one of them frees room for the others
+        GGML_ASSERT((n_stream == 1 || n_block > 0) && "the spill tier requires a unified or a paged KV cache");
+
+        seq_last_used.resize(LLAMA_MAX_SEQ, 0);
+    }
+
+    if (evict.n_recent > 0) {
+        if (evict.n_heavy > 0) {
+            v_attn_mass.assign(n_stream, std::vector<float>(kv_size, 0.0f));
+        }
+
+        LLAMA_LOG_INFO("%s: eviction: keeping %u sink + %u recent + %u heavy cells per sequence\n", __func__,
+                evict.n_sink, evict.n_recent, evict.n_heavy);
     }
 
     const char * LLAMA_KV_CACHE_DEBUG = getenv("LLAMA_KV_CACHE_DEBUG");
@@ -215,6 +296,18 @@ void llama_kv_cache_unified::clear(bool data) {
         v_heads[s] = 0;
     }
 
+    if (n_block > 0) {
+        blocks_reset();
+    }
+
+    if (spill) {
+        spill->clear();
+    }
+
+    for (auto & mass : v_attn_mass) {
+        std::fill(mass.begin(), mass.end(), 0.0f);
+    }
+
     if (data) {
         for (auto & buf : bufs) {
             ggml_backend_buffer_clear(buf.get(), 0);
@@ -233,6 +326,41 @@ bool llama_kv_cache_unified::seq_rm(llama_seq_id seq_id, llama_pos p0, llama_pos
         p1 = std::numeric_limits<llama_pos>::max();
     }
 
+    // spilled sequences cut by the range when removing it from all the sequences
+    std::vector<llama_seq_id> spill_cut;
+
+    if (spill) {
+        // spilled sequences: drop them when the range covers them, restore them when it cuts them
+        for (llama_seq_id s = 0; s < (llama_seq_id) n_seq_max; ++s) {
+            if ((seq_id != -1 && s != seq_id) || !spill->has(s)) {
+                continue;
+            }
+
+            const llama_pos s_p0 = spill->seq_pos_min(s);
+            const llama_pos s_p1 = spill->seq_pos_max(s);
+
+            if (p1 <= s_p0 || p0 > s_p1) {
+                continue;
+            }
+
+            if (p0 <= s_p0 && p1 > s_p1) {
+                spill->erase(s);
+                continue;
+            }
+
+            // restoring it can spill another sequence: when the range is removed from all the sequences, restore it
+            // after the range is removed from the cells, so that a sequence spilled to make room does not keep the range
+            if (seq_id == -1) {
+                spill_cut.push_back(s);
+                continue;
+            }
+
+            if (!seq_unspill(s, {})) {
+                return false;
+            }
+        }
+    }
+
     if (seq_id >= 0) {
         auto & cells = v_cells[seq_to_stream[seq_id]];
         auto & head  = v_heads[seq_to_stream[seq_id]];
@@ -255,6 +383,10 @@ bool llama_kv_cache_unified::seq_rm(llama_seq_id seq_id, llama_pos p0, llama_pos
         if (new_head != cells.size() && new_head < head) {
             head = new_head;
         }
+
+        if (n_block > 0) {
+            blocks_release_unused(seq_to_stream[seq_id]);
+        }
     } else {
         // match any sequence
         for (uint32_t s = 0; s < n_stream; ++s) {
@@ -279,6 +411,16 @@ bool llama_kv_cache_unified::seq_rm(llama_seq_id seq_id, llama_pos p0, llama_pos
             if (new_head != cells.size() && new_head < head) {
                 head = new_head;
             }
+
+            if (n_block > 0) {
+                blocks_release_unused(s);
+            }
+        }
+
+        for (llama_seq_id s : spill_cut) {
+            if (!seq_rm(s, p0, p1)) {
+                return false;
+            }
         }
     }
 
@@ -289,6 +431,17 @@ void llama_kv_cache_unified::seq_cp(llama_seq_id seq_id_src, llama_seq_id seq_id
     GGML_ASSERT(seq_id_src >= 0 && (size_t) seq_id_src < seq_to_stream.size());
     GGML_ASSERT(seq_id_dst >= 0 && (size_t) seq_id_dst < seq_to_stream.size());
 
+    if (spill && (spill->has(seq_id_src) || spill->has(seq_id_dst))) {
+        std::vector<bool> keep(LLAMA_MAX_SEQ, false);
+        keep[seq_id_src] = true;
+        keep[seq_id_dst] = true;
+
+        if (!seq_unspill(seq_id_src, keep) || !seq_unspill(seq_id_dst, keep)) {
+            LLAMA_LOG_ERROR("%s: failed to restore the spilled sequences %d, %d\n", __func__, seq_id_src, seq_id_dst);
+            return;
+        }
+    }
+
     const auto s0 = seq_to_stream[seq_id_src];
     const auto s1 = seq_to_stream[seq_id_dst];
 
@@ -323,6 +476,63 @@ void llama_kv_cache_unified::seq_cp(llama_seq_id seq_id_src, llama_seq_id seq_id
         return;
     }
 
+    if (n_block > 0) {
+        // paged: the destination references the blocks of the source, they are copied on the first write
+        if (p0 < 0) {
+            p0 = 0;
+        }
+
+        if (p1 < 0) {
+            p1 = std::numeric_limits<llama_pos>::max();
+        }
+
+        const auto & cells_src = v_cells[s0];
+              auto & cells_dst = v_cells[s1];
+
+        const auto & table_src = paged.tables[s0];
+              auto & table_dst = paged.tables[s1];
+
+        for (uint32_t ib = 0; ib < table_dst.size(); ++ib) {
+            block_unref(s1, ib);
+        }
+
+        cells_dst.reset();
+
+        for (uint32_t i = 0; i < cells_src.size(); ++i) {
+            if (!cells_src.pos_in(i, p0, p1) || !cells_src.seq_has(i, seq_id_src)) {
+                continue;
+            }
+
+            llama_pos pos   = cells_src.pos_get(i);
+            llama_pos shift = cells_src.get_shift(i);
+
+            if (shift != 0) {
+                pos -= shift;
+                assert(pos >= 0);
+            }
+
+            cells_dst.pos_set(i, pos);
+            cells_dst.seq_add(i, seq_id_dst);
+
+            if (shift != 0) {
+                cells_dst.pos_add(i, shift);
+            }
+
+            const uint32_t ib = i/n_block;
+
+            if (table_dst[ib] < 0) {
+                GGML_ASSERT(table_src[ib] >= 0);
+
+                table_dst[ib] = table_src[ib];
+                paged.refs[table_dst[ib]]++;
+            }
+        }
+
+        v_heads[s1] = v_heads[s0];
+
+        return;
+    }
+
     // cross-stream sequence copies require to copy the actual buffer data
 
     bool is_full = true;
@@ -371,6 +581,14 @@ void llama_kv_cache_unified::seq_cp(llama_seq_id seq_id_src, llama_seq_id seq_id
 void llama_kv_cache_unified::seq_keep(llama_seq_id seq_id) {
     GGML_ASSERT(seq_id >= 0 && (size_t) seq_id < seq_to_stream.size());
 
+    if (spill) {
+        for (llama_seq_id s = 0; s < (llama_seq_id) n_seq_max; ++s) {
+            if (s != seq_id) {
+                spill->erase(s);
+            }
+        }
+    }
+
     auto & cells = v_cells[seq_to_stream[seq_id]];
     auto & head  = v_heads[seq_to_stream[seq_id]];
 
@@ -388,6 +606,10 @@ void llama_kv_cache_unified::seq_keep(llama_seq_id seq_id) {
     if (new_head != cells.size() && new_head < head) {
         head = new_head;
     }
+
+    if (n_block > 0) {
+        blocks_release_unused(seq_to_stream[seq_id]);
+    }
 }
 
 void llama_kv_cache_unified::seq_add(llama_seq_id seq_id, llama_pos p0, llama_pos p1, llama_pos shift) {
@@ -415,6 +637,11 @@ void llama_kv_cache_unified::seq_add(llama_seq_id seq_id, llama_pos p0, llama_po
         return;
     }
 
+    if (spill && !seq_unspill(seq_id, {})) {
+        LLAMA_LOG_ERROR("%s: failed to restore the spilled sequence %d\n", __func__, seq_id);
+        return;
+    }
+
     for (uint32_t i = 0; i < cells.size(); ++i) {
         if (!cells.pos_in(i, p0, p1)) {
             continue;
@@ -432,6 +659,10 @@ void llama_kv_cache_unified::seq_add(llama_seq_id seq_id, llama_pos p0, llama_po
     // If we freed up a slot, set head to it so searching can start there.
     // Otherwise we just start the next search from the beginning.
     head = new_head != cells.size() ? new_head : 0;
+
+    if (n_block > 0) {
+        blocks_release_unused(seq_to_stream[seq_id]);
+    }
 }
 
 void llama_kv_cache_unified::seq_div(llama_seq_id seq_id, llama_pos p0, llama_pos p1, int d) {
@@ -456,6 +687,11 @@ void llama_kv_cache_unified::seq_div(llama_seq_id seq_id, llama_pos p0, llama_po
         return;
     }
 
+    if (spill && !seq_unspill(seq_id, {})) {
+        LLAMA_LOG_ERROR("%s: failed to restore the spilled sequence %d\n", __func__, seq_id);
+        return;
+    }
+
     for (uint32_t i = 0; i < cells.size(); ++i) {
         if (!cells.pos_in(i, p0, p1)) {
             continue;
@@ -470,6 +706,10 @@ void llama_kv_cache_unified::seq_div(llama_seq_id seq_id, llama_pos p0, llama_po
 llama_pos llama_kv_cache_unified::seq_pos_min(llama_seq_id seq_id) const {
     GGML_ASSERT(seq_id >= 0 && (size_t) seq_id < seq_to_stream.size());
 
+    if (spill && spill->has(seq_id)) {
+        return spill->seq_pos_min(seq_id);
+    }
+
     const auto & cells = v_cells[seq_to_stream[seq_id]];
 
     return cells.seq_pos_min(seq_id);
@@ -478,6 +718,10 @@ llama_pos llama_kv_cache_unified::seq_pos_min(llama_seq_id seq_id) const {
 llama_pos llama_kv_cache_unified::seq_pos_max(llama_seq_id seq_id) const {
     GGML_ASSERT(seq_id >= 0 && (size_t) seq_id < seq_to_stream.size());
 
+    if (spill && spill->has(seq_id)) {
+        return spill->seq_pos_max(seq_id);
+    }
+
     const auto & cells = v_cells[seq_to_stream[seq_id]];
 
     return cells.seq_pos_max(seq_id);
@@ -489,6 +733,36 @@ llama_memory_context_ptr llama_kv_cache_unified::init_batch(
             bool embd_all) {
     GGML_UNUSED(embd_all);
 
+    // the sequences of the batch stay in the cache, the spilled ones are restored first
+    std::vector<bool> keep;
+
+    evict_n_cells = 0;
+
+    if (spill) {
+        keep.resize(LLAMA_MAX_SEQ, false);
+
+        for (llama_seq_id s = 0; s < (llama_seq_id) n_seq_max; ++s) {
+            if (balloc.seq_pos_min(s) >= 0) {
+                keep[s] = true;
+                seq_last_used[s] = ++seq_tick;
+            }
+        }
+
+        for (llama_seq_id s = 0; s < (llama_seq_id) n_seq_max; ++s) {
+            if (keep[s] && !seq_unspill(s, keep)) {
+                return std::make_unique<llama_kv_cache_unified_context>(LLAMA_MEMORY_STATUS_FAILED_PREPARE);
+            }
+        }
+    }
+
+    if (evict.n_recent > 0) {
+        for (llama_seq_id s = 0; s < (llama_seq_id) n_seq_max; ++s) {
+            if (balloc.seq_pos_min(s) >= 0) {
+                evict_n_cells += seq_evict(s, balloc.seq_pos_max(s) - balloc.seq_pos_min(s) + 1);
+            }
+        }
+    }
+
     do {
         balloc.split_reset();
 
@@ -509,6 +783,17 @@ llama_memory_context_ptr llama_kv_cache_unified::init_batch(
         }
 
         auto sinfos = prepare(ubatches);
+
+        // spill the least recently used sequences until the batch fits
+        while (sinfos.empty() && spill) {
+            const llama_seq_id s = seq_lru(keep);
+            if (s < 0 || !seq_spill(s)) {
+                break;
+            }
+
+            sinfos = prepare(ubatches);
+        }
+
         if (sinfos.empty()) {
             break;
         }
@@ -552,8 +837,14 @@ llama_memory_context_ptr llama_kv_cache_unified::init_update(llama_context * lct
             }
         }
 
-        if (do_defrag) {
-            dinfo = defrag_prepare(lctx->graph_max_nodes());
+        // incremental defrag: once triggered, move up to defrag_max_cells cells per update until the cache is compact
+        // a forced optimization (e.g. no slot was found for the batch) compacts the whole cache at once
+        const uint32_t n_max_cells = optimize ? 0 : lctx->get_cparams().defrag_max_cells;
+
+        if (do_defrag || (defrag_pending && n_max_cells > 0)) {
+            dinfo = defrag_prepare(lctx->graph_max_nodes(), n_max_cells);
+
+            defrag_pending = n_max_cells > 0 && !dinfo.empty();
         }
     }
 
@@ -574,6 +865,13 @@ llama_kv_cache_unified::slot_info_vec_t llama_kv_cache_unified::prepare(const st
     // remember the old state of the cells so we can restore it in the end
     std::vector<state_t> states;
 
+    // the blocks mapped while placing the ubatches are restored together with the cells
+    paged_state paged_old;
+    if (n_block > 0) {
+        paged_old = paged;
+        paged_no_copy = true;
+    }
+
     bool success = true;
 
     for (const auto & ubatch : ubatches) {
@@ -622,6 +920,11 @@ llama_kv_cache_unified::slot_info_vec_t llama_kv_cache_unified::prepare(const st
         }
     }
 
+    if (n_block > 0) {
+        paged = std::move(paged_old);
+        paged_no_copy = false;
+    }
+
     if (!success) {
         return {};
     }
@@ -632,6 +935,8 @@ llama_kv_cache_unified::slot_info_vec_t llama_kv_cache_unified::prepare(const st
 bool llama_kv_cache_unified::update(llama_context * lctx, bool do_shift, const defrag_info & dinfo, const stream_copy_info & sc_info) {
     bool updated = false;
 
+    defrag_n_moved = 0;
+
     auto * sched = lctx->get_sched();
 
     if (!sc_info.empty()) {
@@ -658,6 +963,10 @@ bool llama_kv_cache_unified::update(llama_context * lctx, bool do_shift, const d
                 ggml_backend_tensor_copy(layer.k_stream[ssrc], layer.k_stream[sdst]);
                 ggml_backend_tensor_copy(layer.v_stream[ssrc], layer.v_stream[sdst]);
             }
+
+            if (!v_attn_mass.empty()) {
+                v_attn_mass[sdst] = v_attn_mass[ssrc];
+            }
         }
     }
 
@@ -668,8 +977,26 @@ bool llama_kv_cache_unified::update(llama_context * lctx, bool do_shift, const d
 
         LLAMA_LOG_DEBUG("%s: applying K-shift\n", __func__);
 
+        if (n_block > 0) {
+            // the shifted rows must not be shared with the streams that do not shift them
+            for (uint32_t s = 0; s < n_stream; ++s) {
+                const auto & cells = v_cells[s];
+
+                for (uint32_t i = 0; i < cells.size(); ++i) {
+                    if (cells.is_empty(i) || cells.get_shift(i) == 0) {
+                        continue;
+                    }
+
+                    if (!block_make_private(s, i/n_block)) {
+                        LLAMA_LOG_ERROR("%s: no free block to copy the shared blocks for K-shift\n", __func__);
+                        return updated;
+                    }
+                }
+            }
+        }
+
         // apply K-shift if needed
-        if (hparams.rope_type != LLAMA_ROPE_TYPE_NONE) {
+        if (hparams.rope_type != LLAMA_ROPE_TYPE_NONE && (n_block == 0 || !paged_shift_rows().empty())) {
             ggml_backend_sched_reset(sched);
 
             auto * res = lctx->get_gf_res_reserve();
@@ -718,6 +1045,15 @@ bool llama_kv_cache_unified::update(llama_context * lctx, bool do_shift, const d
                 }
 
                 cells.mv(i, dinfo.ids[i]);
+
+                if (!v_attn_mass.empty()) {
+                    auto & mass = v_attn_mass[seq_to_stream[0]];
+
+                    mass[dinfo.ids[i]] = mass[i];
+                    mass[i] = 0.0f;
+                }
+
+                defrag_n_moved++;
             }
 
             // reset the head so we can find the first free slot during the next ubatch
@@ -945,6 +1281,11 @@ llama_kv_cache_unified::slot_info llama_kv_cache_unified::find_slot(const llama_
 
     assert(res.s1 >= res.s0);
 
+    if (n_block > 0 && blocks_needed(res) > paged.free.size()) {
+        LLAMA_LOG_DEBUG("%s: not enough free blocks (%u needed, %zu free)\n", __func__, blocks_needed(res), paged.free.size());
+        return { };
+    }
+
     return res;
 }
 
@@ -958,6 +1299,16 @@ void llama_kv_cache_unified::apply_ubatch(const slot_info & sinfo, const llama_u
 
     assert(ubatch.n_tokens == sinfo.n_stream()*sinfo.size());
 
+    if (n_block > 0) {
+        // map the blocks that are written, copy the shared ones
+        for (uint32_t s = 0; s < sinfo.n_stream(); ++s) {
+            for (const auto idx : sinfo.idxs[s]) {
+                const bool ok = block_make_private(sinfo.strm[s], idx/n_block);
+                GGML_ASSERT(ok && "the free blocks are checked by find_slot()");
+            }
+        }
+    }
+
     for (uint32_t s = 0; s < sinfo.n_stream(); ++s) {
         for (uint32_t ii = 0; ii < sinfo.size(); ++ii) {
             const uint32_t i = s*sinfo.size() + ii;
@@ -982,6 +1333,10 @@ void llama_kv_cache_unified::apply_ubatch(const slot_info & sinfo, const llama_u
             for (int32_t s = 0; s < ubatch.n_seq_id[i]; s++) {
                 cells.seq_add(idx, ubatch.seq_id[i][s]);
             }
+
+            if (!v_attn_mass.empty()) {
+                v_attn_mass[sinfo.strm[s]][idx] = 0.0f;
+            }
         }
     }
 
@@ -1013,6 +1368,27 @@ void llama_kv_cache_unified::apply_ubatch(const slot_info & sinfo, const llama_u
     }
 }
 
+void llama_kv_cache_unified::add_attn_mass(const ggml_tensor * mass, const slot_info & sinfo) {
+    if (v_attn_mass.empty()) {
+        return;
+    }
+
+    const int64_t n_kv = mass->ne[0];
+
+    std::vector<float> data(ggml_nelements(mass));
+    ggml_backend_tensor_get(mass, data.data(), 0, ggml_nbytes(mass));
+
+    for (int64_t s = 0; s < mass->ne[1]; ++s) {
+        auto & dst = v_attn_mass[sinfo.s0 + s];
+
+        GGML_ASSERT(n_kv <= (int64_t) dst.size());
+
+        for (int64_t i = 0; i < n_kv; ++i) {
+            dst[i] += data[s*n_kv + i];
+        }
+    }
+}
+
 bool llama_kv_cache_unified::get_can_shift() const {
     return true;
 }
@@ -1027,6 +1403,52 @@ uint32_t llama_kv_cache_unified::get_n_stream() const {
     return n_stream;
 }
 
+uint32_t llama_kv_cache_unified::get_n_block() const {
+    return n_block;
+}
+
+uint32_t llama_kv_cache_unified::get_n_blocks_used() const {
+    if (n_block == 0) {
+        return 0;
+    }
+
+    return paged.refs.size() - paged.free.size();
+}
+
+uint32_t llama_kv_cache_unified::get_n_blocks_copied() const {
+    return blocks_n_copied;
+}
+
+float llama_kv_cache_unified::get_fragmentation() const {
+    uint32_t n_used = 0;
+    uint32_t n_span = 0;
+
+    for (uint32_t s = 0; s < n_stream; ++s) {
+        n_used += v_cells[s].get_used();
+        n_span += v_cells[s].used_max_p1();
+    }
+
+    return n_span > 0 ? 1.0f - float(n_used)/n_span : 0.0f;
+}
+
+uint32_t llama_kv_cache_unified::get_defrag_n_moved() const {
+    return defrag_n_moved;
+}
+
+uint32_t llama_kv_cache_unified::get_evict_n_cells() const {
+    return evict_n_cells;
+}
+
+uint32_t llama_kv_cache_unified::get_used() const {
+    uint32_t res = 0;
+
+    for (uint32_t s = 0; s < n_stream; ++s) {
+        res += v_cells[s].get_used();
+    }
+
+    return res;
+}
+
 bool llama_kv_cache_unified::get_has_shift() const {
     bool result = false;
 
@@ -1063,6 +1485,16 @@ ggml_tensor * llama_kv_cache_unified::get_k(ggml_context * ctx, int32_t il, uint
 
     assert(n_embd_k_gqa == hparams.n_embd_k_gqa(il));
 
+    if (n_block > 0) {
+        // the whole pool, the attention reads the rows of the streams through their block tables
+        return ggml_view_4d(ctx, k,
+                hparams.n_embd_head_k, hparams.n_head_kv(il), kv_size, 1,
+                ggml_row_size(k->type, hparams.n_embd_head_k),
+                ggml_row_size(k->type, n_embd_k_gqa),
+                ggml_row_size(k->type, n_embd_k_gqa*kv_size),
+                0);
+    }
+
     const uint32_t ns = sinfo.s1 - sinfo.s0 + 1;
 
     return ggml_view_4d(ctx, k,
@@ -1084,6 +1516,16 @@ ggml_tensor * llama_kv_cache_unified::get_v(ggml_context * ctx, int32_t il, uint
     // [TAG_V_CACHE_VARIABLE]
     assert(n_embd_v_gqa >= hparams.n_embd_v_gqa(il));
 
+    if (n_block > 0) {
+        // the whole pool, see get_k()
+        return ggml_view_4d(ctx, v,
+                hparams.n_embd_head_v, hparams.n_head_kv(il), kv_size, 1,
+                ggml_row_size(v->type, hparams.n_embd_head_v),
+                ggml_row_size(v->type, n_embd_v_gqa),
+                ggml_row_size(v->type, n_embd_v_gqa*kv_size),
+                0);
+    }
+
     const uint32_t ns = sinfo.s1 - sinfo.s0 + 1;
 
     if (!v_trans) {
@@ -1215,6 +1657,20 @@ ggml_tensor * llama_kv_cache_unified::build_input_v_idxs(ggml_context * ctx, con
     return v_idxs;
 }
 
+ggml_tensor * llama_kv_cache_unified::build_input_kv_blocks(ggml_context * ctx, uint32_t n_kv, const llama_ubatch & ubatch) const {
+    if (n_block == 0) {
+        return nullptr;
+    }
+
+    GGML_ASSERT(n_kv % n_block == 0);
+
+    ggml_tensor * kv_blocks = ggml_new_tensor_2d(ctx, GGML_TYPE_I32, n_kv/n_block, ubatch.n_seqs_unq);
+
+    ggml_set_input(kv_blocks);
+
+    return kv_blocks;
+}
+
 void llama_kv_cache_unified::set_input_k_idxs(ggml_tensor * dst, const llama_ubatch * ubatch, const slot_info & sinfo) const {
     if (!supports_set_rows) {
         return;
@@ -1227,10 +1683,8 @@ void llama_kv_cache_unified::set_input_k_idxs(ggml_tensor * dst, const llama_uba
     int64_t * data = (int64_t *) dst->data;
 
     for (uint32_t s = 0; s < sinfo.n_stream(); ++s) {
-        const int64_t offs = sinfo.strm[s]*get_size();
-
         for (uint32_t i = 0; i < sinfo.size(); ++i) {
-            data[s*sinfo.size() + i] = offs + sinfo.idxs[s][i];
+            data[s*sinfo.size() + i] = cell_row(sinfo.strm[s], sinfo.idxs[s][i]);
         }
     }
 }
@@ -1248,10 +1702,8 @@ void llama_kv_cache_unified::set_input_v_idxs(ggml_tensor * dst, const llama_uba
 
     if (!v_trans) {
         for (uint32_t s = 0; s < sinfo.n_stream(); ++s) {
-            const int64_t offs = sinfo.strm[s]*get_size();
-
             for (uint32_t i = 0; i < sinfo.size(); ++i) {
-                data[s*sinfo.size() + i] = offs + sinfo.idxs[s][i];
+                data[s*sinfo.size() + i] = cell_row(sinfo.strm[s], sinfo.idxs[s][i]);
             }
         }
     } else {
@@ -1272,11 +1724,37 @@ void llama_kv_cache_unified::set_input_v_idxs(ggml_tensor * dst, const llama_uba
     }
 }
 
+void llama_kv_cache_unified::set_input_kv_blocks(ggml_tensor * dst, const slot_info & sinfo) const {
+    GGML_ASSERT(n_block > 0);
+    GGML_ASSERT(dst->ne[1] == (int64_t) sinfo.n_stream());
+
+    GGML_ASSERT(ggml_backend_buffer_is_host(dst->buffer));
+    int32_t * data = (int32_t *) dst->data;
+
+    const int64_t n_blocks_kv = dst->ne[0];
+
+    for (uint32_t s = 0; s < sinfo.n_stream(); ++s) {
+        const auto & table = paged.tables[sinfo.strm[s]];
+
+        std::copy(table.begin(), table.begin() + n_blocks_kv, data + s*n_blocks_kv);
+    }
+}
+
 void llama_kv_cache_unified::set_input_k_shift(ggml_tensor * dst) const {
     GGML_ASSERT(ggml_backend_buffer_is_host(dst->buffer));
 
     int32_t * data = (int32_t *) dst->data;
 
+    if (n_block > 0) {
+        const auto rows = paged_shift_rows();
+
+        for (size_t i = 0; i < rows.size(); ++i) {
+            data[i] = rows[i].second;
+        }
+
+        return;
+    }
+
     for (uint32_t s = 0; s < n_stream; ++s) {
         const auto & cells = v_cells[s];
 
@@ -1286,6 +1764,21 @@ void llama_kv_cache_unified::set_input_k_shift(ggml_tensor * dst) const {
     }
 }
 
+void llama_kv_cache_unified::set_input_k_shift_rows(ggml_tensor * dst, ggml_tensor * dst_i64) const {
+    GGML_ASSERT(ggml_backend_buffer_is_host(dst->buffer));
+    GGML_ASSERT(ggml_backend_buffer_is_host(dst_i64->buffer));
+
+    int32_t * data     = (int32_t *) dst->data;
+    int64_t * data_i64 = (int64_t *) dst_i64->data;
+
+    const auto rows = paged_shift_rows();
+
+    for (size_t i = 0; i < rows.size(); ++i) {
+        data    [i] = rows[i].first;
+        data_i64[i] = rows[i].first;
+    }
+}
+
 void llama_kv_cache_unified::set_input_kq_mask(ggml_tensor * dst, const llama_ubatch * ubatch, bool causal_attn) const {
     const uint32_t n_tokens = ubatch->n_tokens;
 
@@ -1470,7 +1963,11 @@ public:
 
     void set_input(const llama_ubatch * ubatch) override;
 
-    ggml_tensor * k_shift; // I32 [kv_size*n_stream]
+    ggml_tensor * k_shift; // I32 [kv_size*n_stream], paged: [n_rows]
+
+    // paged: the rows of the pool that are shifted
+    ggml_tensor * k_rows     = nullptr; // I32 [n_rows]
+    ggml_tensor * k_rows_i64 = nullptr; // I64 [n_rows]
 
     const llama_kv_cache_unified * kv_self;
 };
@@ -1481,6 +1978,10 @@ void llm_graph_input_k_shift::set_input(const llama_ubatch * ubatch) {
     if (k_shift) {
         kv_self->set_input_k_shift(k_shift);
     }
+
+    if (k_rows) {
+        kv_self->set_input_k_shift_rows(k_rows, k_rows_i64);
+    }
 }
 
 ggml_cgraph * llama_kv_cache_unified::build_graph_shift(llm_graph_result * res, llama_context * lctx) const {
@@ -1492,11 +1993,48 @@ ggml_cgraph * llama_kv_cache_unified::build_graph_shift(llm_graph_result * res,
 
     auto inp = std::make_unique<llm_graph_input_k_shift>(this);
 
+    const auto & cparams = lctx->get_cparams();
+
+    if (n_block > 0) {
+        // paged: gather the shifted rows of the pool, rotate them and scatter them back
+        const int64_t n_rows = paged_shift_rows().size();
+
+        inp->k_shift    = ggml_new_tensor_1d(ctx, GGML_TYPE_I32, n_rows);
+        inp->k_rows     = ggml_new_tensor_1d(ctx, GGML_TYPE_I32, n_rows);
+        inp->k_rows_i64 = ggml_new_tensor_1d(ctx, GGML_TYPE_I64, n_rows);
+        ggml_set_input(inp->k_shift);
+        ggml_set_input(inp->k_rows);
+        ggml_set_input(inp->k_rows_i64);
+
+        for (const auto & layer : layers) {
+            const uint32_t il = layer.il;
+
+            const int64_t n_head_kv    = hparams.n_head_kv(il);
+            const int64_t n_embd_k_gqa = hparams.n_embd_k_gqa(il);
+
+            const float freq_base_l  = model.get_rope_freq_base (cparams, il);
+            const float freq_scale_l = model.get_rope_freq_scale(cparams, il);
+
+            ggml_tensor * rope_factors = model.get_rope_factors(cparams, il);
+
+            ggml_tensor * k = ggml_get_rows(ctx, layer.k, inp->k_rows);
+            k = ggml_reshape_3d(ctx, k, n_embd_head_k, n_head_kv, n_rows);
+
+            ggml_tensor * cur = build_rope_shift(cparams, ctx, k, inp->k_shift, rope_factors, freq_base_l, freq_scale_l);
+            cur = ggml_reshape_2d(ctx, cur, n_embd_k_gqa, n_rows);
+            cur = ggml_set_rows(ctx, layer.k, cur, inp->k_rows_i64);
+
+            ggml_build_forward_expand(gf, cur);
+        }
+
+        res->add_input(std::move(inp));
+
+        return gf;
+    }
+
     inp->k_shift = ggml_new_tensor_1d(ctx, GGML_TYPE_I32, (int64_t) get_size()*n_stream);
     ggml_set_input(inp->k_shift);
 
-    const auto & cparams = lctx->get_cparams();
-
     for (const auto & layer : layers) {
         const uint32_t il = layer.il;
 
@@ -1679,7 +2217,7 @@ ggml_cgraph * llama_kv_cache_unified::build_graph_defrag(
     return gf;
 }
 
-llama_kv_cache_unified::defrag_info llama_kv_cache_unified::defrag_prepare(int32_t n_max_nodes) const {
+llama_kv_cache_unified::defrag_info llama_kv_cache_unified::defrag_prepare(int32_t n_max_nodes, uint32_t n_max_cells) const {
     GGML_ASSERT(n_stream == 1 && "n_stream > 1 does not support defrag");
 
     const auto & cells = v_cells[0];
@@ -1795,6 +2333,29 @@ llama_kv_cache_unified::defrag_info llama_kv_cache_unified::defrag_prepare(int32
         return {};
     }
 
+    // incremental: keep only the moves of the last n_max_cells cells, the following updates move the next ones
+    // moving the last cells first shrinks used_max_p1 (and thus n_kv) the most per moved cell, and the plan of the
+    // cells that are not moved yet does not change, so the steps end in the same layout as a single defrag
+    if (n_max_cells > 0) {
+        uint32_t n = 0;
+
+        for (uint32_t i = n_kv; i-- > 0; ) {
+            if (ids[i] == n_kv || ids[i] == i) {
+                continue;
+            }
+
+            if (n < n_max_cells) {
+                n++;
+            } else {
+                ids[i] = n_kv;
+            }
+        }
+
+        LLAMA_LOG_DEBUG("%s: KV defrag step: %u cells\n", __func__, n);
+
+        return res;
+    }
+
     LLAMA_LOG_DEBUG("%s: (tmp log) KV defrag cell moves: %u\n", __func__, n_moves);
 
     LLAMA_LOG_DEBUG("%s: expected gf nodes: %u\n", __func__, 6*n_moves*n_layer);
@@ -1802,6 +2363,353 @@ llama_kv_cache_unified::defrag_info llama_kv_cache_unified::defrag_prepare(int32
     return res;
 }
 
+int64_t llama_kv_cache_unified::cell_row(uint32_t strm, uint32_t idx) const {
+    if (n_block == 0) {
+        return (int64_t) strm*get_size() + idx;
+    }
+
+    const int32_t blk = paged.tables[strm][idx/n_block];
+    assert(blk >= 0);
+
+    return (int64_t) blk*n_block + idx%n_block;
+}
+
+void llama_kv_cache_unified::blocks_reset() {
+    const uint32_t n_blocks = get_size()/n_block;
+
+    paged.tables.assign(n_stream, std::vector<int32_t>(n_blocks, -1));
+    paged.refs.assign(n_blocks, 0);
+
+    // pop the lowest physical blocks first
+    paged.free.resize(n_blocks);
+    for (uint32_t i = 0; i < n_blocks; ++i) {
+        paged.free[i] = n_blocks - i - 1;
+    }
+}
+
+int32_t llama_kv_cache_unified::block_alloc() {
+    if (paged.free.empty()) {
+        return -1;
+    }
+
+    const int32_t blk = paged.free.back();
+    paged.free.pop_back();
+
+    assert(paged.refs[blk] == 0);
+    paged.refs[blk] = 1;
+
+    return blk;
+}
+
+void llama_kv_cache_unified::block_unref(uint32_t strm, uint32_t ib) {
+    auto & blk = paged.tables[strm][ib];
+
+    if (blk < 0) {
+        return;
+    }
+
+    assert(paged.refs[blk] > 0);
+
+    if (--paged.refs[blk] == 0) {
+        paged.free.push_back(blk);
+    }
+
+    blk = -1;
+}
+
+bool llama_kv_cache_unified::block_make_private(uint32_t strm, uint32_t ib) {
+    auto & table = paged.tables[strm];
+
+    const int32_t blk_old = table[ib];
+
+    if (blk_old >= 0 && paged.refs[blk_old] == 1) {
+        return true;
+    }
+
+    const int32_t blk_new = block_alloc();
+    if (blk_new < 0) {
+        return false;
+    }
+
+    if (blk_old >= 0) {
+        // copy-on-write: the other streams keep the old block
+        if (!paged_no_copy) {
+            std::vector<uint8_t> buf;
+
+            for (const auto & layer : layers) {
+                for (ggml_tensor * t : { layer.k, layer.v }) {
+                    const size_t size = n_block*t->nb[1];
+
+                    buf.resize(size);
+
+                    ggml_backend_tensor_get(t, buf.data(), blk_old*size, size);
+                    ggml_backend_tensor_set(t, buf.data(), blk_new*size, size);
+                }
+            }
+
+            blocks_n_copied++;
+        }
+
+        paged.refs[blk_old]--;
+    }
+
+    table[ib] = blk_new;
+
+    return true;
+}
+
+void llama_kv_cache_unified::blocks_release_unused(uint32_t strm) {
+    const auto & cells = v_cells[strm];
+    const auto & table = paged.tables[strm];
+
+    for (uint32_t ib = 0; ib < table.size(); ++ib) {
+        if (table[ib] < 0) {
+            continue;
+        }
+
+        bool used = false;
+
+        for (uint32_t i = ib*n_block; i < (ib + 1)*n_block; ++i) {
+            if (!cells.is_empty(i)) {
+                used = true;
+                break;
+            }
+        }
+
+        if (!used) {
+            block_unref(strm, ib);
+        }
+    }
+}
+
+uint32_t llama_kv_cache_unified::blocks_needed(const slot_info & sinfo) const {
+    uint32_t res = 0;
+
+    std::vector<uint32_t> ibs;
+
+    for (uint32_t s = 0; s < sinfo.n_stream(); ++s) {
+        const auto & table = paged.tables[sinfo.strm[s]];
+
+        ibs.clear();
+        for (const auto idx : sinfo.idxs[s]) {
+            ibs.push_back(idx/n_block);
+        }
+
+        std::sort(ibs.begin(), ibs.end());
+        ibs.erase(std::unique(ibs.begin(), ibs.end()), ibs.end());
+
+        for (const auto ib : ibs) {
+            if (table[ib] < 0 || paged.refs[table[ib]] > 1) {
+                res++;
+            }
+        }
+    }
+
+    return res;
+}
+
+std::vector<std::pair<int64_t, int32_t>> llama_kv_cache_unified::paged_shift_rows() const {
+    std::vector<std::pair<int64_t, int32_t>> res;
+
+    for (uint32_t s = 0; s < n_stream; ++s) {
+        const auto & cells = v_cells[s];
+
+        for (uint32_t i = 0; i < cells.size(); ++i) {
+            if (cells.is_empty(i) || cells.get_shift(i) == 0) {
+                continue;
+            }
+
+            res.emplace_back(cell_row(s, i), cells.get_shift(i));
+        }
+    }
+
+    return res;
+}
+
+bool llama_kv_cache_unified::seq_spill(llama_seq_id seq_id) {
+    if (!spill || spill->has(seq_id)) {
+        return false;
+    }
+
+    const auto & cells = v_cells[seq_to_stream[seq_id]];
+
+    const llama_pos p0 = cells.seq_pos_min(seq_id);
+    const llama_pos p1 = cells.seq_pos_max(seq_id);
+
+    if (p1 < 0) {
+        return false;
+    }
+
+    uint32_t n_cells = 0;
+    for (uint32_t i = 0; i < cells.size(); ++i) {
+        if (!cells.is_empty(i) && cells.seq_has(i, seq_id)) {
+            n_cells++;
+        }
+    }
+
+    llama_io_write_spill io(spill->get_type_rows());
+    state_write(io, seq_id);
+
+    if (!spill->can_store(io.data().size())) {
+        LLAMA_LOG_DEBUG("%s: the spill tier is full, cannot spill sequence %d (%zu bytes)\n", __func__, seq_id, io.data().size());
+        return false;
+    }
+
+    seq_rm(seq_id, -1, -1);
+
+    const bool ok = spill->store(seq_id, p0, p1, n_cells, io.data());
+    GGML_ASSERT(ok);
+
+    LLAMA_LOG_DEBUG("%s: spilled sequence %d: %u cells, pos = [%d, %d], %zu -> %zu bytes\n", __func__,
+            seq_id, n_cells, p0, p1, io.n_bytes(), io.data().size());
+
+    return true;
+}
+
+bool llama_kv_cache_unified::seq_unspill(llama_seq_id seq_id, const std::vector<bool> & keep) {
+    if (!spill || !spill->has(seq_id)) {
+        return true;
+    }
+
+    const int64_t t_start_us = ggml_time_us();
+
+    const llama_pos p0      = spill->seq_pos_min(seq_id);
+    const llama_pos p1      = spill->seq_pos_max(seq_id);
+    const uint32_t  n_cells = spill->seq_n_cells(seq_id);
+
+    // make room for a continuous slot of n_cells cells, as state_read() requires
+    while (true) {
+        llama_batch_allocr balloc(hparams.n_pos_per_embd());
+
+        llama_ubatch ubatch = balloc.ubatch_reserve(n_cells, 1);
+
+        ubatch.seq_id_unq[0] = seq_id;
+
+        for (uint32_t i = 0; i < n_cells; ++i) {
+            ubatch.pos[i]      = p0 + i;
+            ubatch.n_seq_id[i] = 1;
+            ubatch.seq_id[i]   = &seq_id;
+        }
+
+        if (!find_slot(ubatch, true).empty()) {
+            break;
+        }
+
+        const llama_seq_id s = seq_lru(keep);
+        if (s < 0 || !seq_spill(s)) {
+            LLAMA_LOG_DEBUG("%s: no room to restore sequence %d (%u cells)\n", __func__, seq_id, n_cells);
+            return false;
+        }
+    }
+
+    std::vector<uint8_t> data = spill->load(seq_id);
+
+    spill->erase(seq_id);
+
+    try {
+        llama_io_read_spill io(data);
+        state_read(io, seq_id);
+    } catch (const std::exception & err) {
+        LLAMA_LOG_ERROR("%s: failed to restore sequence %d: %s\n", __func__, seq_id, err.what());
+
+        spill->store(seq_id, p0, p1, n_cells, data);
+        return false;
+    }
+
+    seq_last_used[seq_id] = ++seq_tick;
+
+    spill->record_restore(1e-6*(ggml_time_us() - t_start_us));
+
+    LLAMA_LOG_DEBUG("%s: restored sequence %d: %u cells, pos = [%d, %d]\n", __func__, seq_id, n_cells, p0, p1);
+
+    return true;
+}
+
+llama_seq_id llama_kv_cache_unified::seq_lru(const std::vector<bool> & keep) const {
+    llama_seq_id res = -1;
+
+    for (llama_seq_id s = 0; s < (llama_seq_id) n_seq_max; ++s) {
+        if ((!keep.empty() && keep[s]) || spill->has(s) || v_cells[seq_to_stream[s]].seq_pos_max(s) < 0) {
+            continue;
+        }
+
+        if (res < 0 || seq_last_used[s] < seq_last_used[res]) {
+            res = s;
+        }
+    }
+
+    return res;
+}
+
+uint32_t llama_kv_cache_unified::seq_evict(llama_seq_id seq_id, uint32_t n_new) {
+    const uint32_t strm = seq_to_stream[seq_id];
+
+    auto & cells = v_cells[strm];
+    auto & head  = v_heads[strm];
+
+    // the cells of the sequence, in the order of their positions
+    std::vector<uint32_t> idxs;
+    for (uint32_t i = 0; i < cells.size(); ++i) {
+        if (!cells.is_empty(i) && cells.seq_has(i, seq_id)) {
+            idxs.push_back(i);
+        }
+    }
+
+    const uint32_t n_keep = evict.n_sink + evict.n_recent + evict.n_heavy;
+
+    if (idxs.size() + n_new <= n_keep) {
+        return 0;
+    }
+
+    std::stable_sort(idxs.begin(), idxs.end(), [&](uint32_t a, uint32_t b) {
+        return cells.pos_get(a) < cells.pos_get(b);
+    });
+
+    // the new tokens are part of the recent window
+    const uint32_t n_recent = evict.n_recent > n_new ? evict.n_recent - n_new : 0;
+
+    if (idxs.size() <= evict.n_sink + n_recent) {
+        return 0;
+    }
+
+    const uint32_t n_evict = std::min<uint32_t>(idxs.size() + n_new - n_keep, idxs.size() - evict.n_sink - n_recent);
+
+    // candidates: neither sinks nor recent, the ones that received the least attention are evicted first
+    // without attention scores (n_heavy == 0) the oldest ones are evicted first
+    std::vector<uint32_t> cand(idxs.begin() + evict.n_sink, idxs.end() - n_recent);
+
+    if (!v_attn_mass.empty()) {
+        const auto & mass = v_attn_mass[strm];
+
+        std::stable_sort(cand.begin(), cand.end(), [&](uint32_t a, uint32_t b) {
+            return mass[a] < mass[b];
+        });
+    }
+
+    uint32_t new_head = cells.size();
+
+    for (uint32_t j = 0; j < n_evict; ++j) {
+        const uint32_t i = cand[j];
+
+        if (cells.seq_rm(i, seq_id) && i < new_head) {
+            new_head = i;
+        }
+    }
+
+    // the freed cells are reused by the incoming tokens, which keeps the cache compact
+    if (new_head != cells.size() && new_head < head) {
+        head = new_head;
+    }
+
+    if (n_block > 0) {
+        blocks_release_unused(strm);
+    }
+
+    LLAMA_LOG_DEBUG("%s: evicted %u cells of sequence %d, %zu left\n", __func__, n_evict, seq_id, idxs.size() - n_evict);
+
+    return n_evict;
+}
+
 bool llama_kv_cache_unified::is_masked_swa(llama_pos p0, llama_pos p1) const {
     assert(p0 >= 0 && p1 >= 0);
 
@@ -1831,6 +2739,16 @@ bool llama_kv_cache_unified::is_masked_swa(llama_pos p0, llama_pos p1) const {
 void llama_kv_cache_unified::state_write(llama_io_write_i & io, llama_seq_id seq_id, llama_state_seq_flags flags) const {
     GGML_UNUSED(flags);
 
+    // note: the whole cache state does not include the spilled sequences
+    if (spill && seq_id >= 0 && spill->has(seq_id)) {
+        llama_io_read_spill io_spill(spill->load(seq_id));
+
+        const size_t size = io_spill.size();
+
+        io.write(io_spill.read(size), size);
+        return;
+    }
+
     io.write(&n_stream, sizeof(n_stream));
 
     for (uint32_t s = 0; s < n_stream; ++s) {
@@ -1886,6 +2804,14 @@ void llama_kv_cache_unified::state_read(llama_io_read_i & io, llama_seq_id seq_i
 
     GGML_ASSERT(seq_id == -1 || (seq_id >= 0 && (size_t) seq_id < seq_to_stream.size()));
 
+    if (spill) {
+        if (seq_id == -1) {
+            spill->clear();
+        } else {
+            spill->erase(seq_id);
+        }
+    }
+
     uint32_t n_stream_cur;
     io.read_to(&n_stream_cur, sizeof(n_stream_cur));
     if (n_stream_cur != n_stream) {
@@ -1956,6 +2882,23 @@ void llama_kv_cache_unified::state_write_data(llama_io_write_i & io, const cell_
 
     std::vector<uint8_t> tmp_buf;
 
+    // the streams of the paged cache share the same tensors
+    const uint32_t strm_buf = n_block > 0 ? 0 : cr.strm;
+
+    // write the rows of the cells [i0, i1)
+    auto write_rows = [&](const ggml_tensor * t, size_t size_row, uint32_t i0, uint32_t i1) {
+        if (n_block == 0) {
+            io.write_tensor(t, i0*size_row, (i1 - i0)*size_row);
+            return;
+        }
+
+        // paged: the rows are contiguous only within the blocks
+        for (uint32_t i = i0, n; i < i1; i += n) {
+            n = std::min(i1 - i, n_block - i%n_block);
+            io.write_tensor(t, cell_row(cr.strm, i)*size_row, n*size_row);
+        }
+    };
+
     // Iterate and write all the keys first, each row is a cell
     // Get whole range at a time
     for (const auto & layer : layers) {
@@ -1963,7 +2906,7 @@ void llama_kv_cache_unified::state_write_data(llama_io_write_i & io, const cell_
 
         const uint32_t n_embd_k_gqa = hparams.n_embd_k_gqa(il);
 
-        auto * k = layer.k_stream[cr.strm];
+        auto * k = layer.k_stream[strm_buf];
 
         // Write key type
         const int32_t k_type_i = (int32_t) k->type;
@@ -1975,9 +2918,7 @@ void llama_kv_cache_unified::state_write_data(llama_io_write_i & io, const cell_
 
         // Read each range of cells of k_size length each into tmp_buf and write out
         for (const auto & range : cr.data) {
-            const size_t range_size = range.second - range.first;
-            const size_t buf_size = range_size * k_size_row;
-            io.write_tensor(k, range.first * k_size_row, buf_size);
+            write_rows(k, k_size_row, range.first, range.second);
         }
     }
 
@@ -1987,7 +2928,7 @@ void llama_kv_cache_unified::state_write_data(llama_io_write_i & io, const cell_
 
             const uint32_t n_embd_v_gqa = hparams.n_embd_v_gqa(il);
 
-            auto * v = layer.v_stream[cr.strm];
+            auto * v = layer.v_stream[strm_buf];
 
             // Write value type
             const int32_t v_type_i = (int32_t) v->type;
@@ -1999,9 +2940,7 @@ void llama_kv_cache_unified::state_write_data(llama_io_write_i & io, const cell_
 
             // Read each range of cells of v_size length each into tmp_buf and write out
             for (const auto & range : cr.data) {
-                const size_t range_size = range.second - range.first;
-                const size_t buf_size = range_size * v_size_row;
-                io.write_tensor(v, range.first * v_size_row, buf_size);
+                write_rows(v, v_size_row, range.first, range.second);
             }
         }
     } else {
@@ -2107,7 +3046,16 @@ bool llama_kv_cache_unified::state_read_meta(llama_io_read_i & io, uint32_t strm
             return false;
         }
 
-        clear(true);
+        if (n_block > 0) {
+            // paged: the other streams may already be restored, only drop the blocks of this one
+            cells.reset();
+
+            for (uint32_t ib = 0; ib < paged.tables[strm].size(); ++ib) {
+                block_unref(strm, ib);
+            }
+        } else {
+            clear(true);
+        }
 
         for (uint32_t i = 0; i < cell_count; ++i) {
             llama_pos pos;
@@ -2131,6 +3079,15 @@ bool llama_kv_cache_unified::state_read_meta(llama_io_read_i & io, uint32_t strm
             }
         }
 
+        if (n_block > 0) {
+            for (uint32_t i = 0; i < cell_count; i += n_block) {
+                if (!block_make_private(strm, i/n_block)) {
+                    LLAMA_LOG_ERROR("%s: not enough free blocks in kv cache\n", __func__);
+                    return false;
+                }
+            }
+        }
+
         head = 0;
     }
 
@@ -2162,13 +3119,30 @@ bool llama_kv_cache_unified::state_read_data(llama_io_read_i & io, uint32_t strm
         return false;
     }
 
+    // the streams of the paged cache share the same tensors
+    const uint32_t strm_buf = n_block > 0 ? 0 : strm;
+
+    // set the rows of the cells [head, head + cell_count)
+    auto set_rows = [&](ggml_tensor * t, size_t size_row, const uint8_t * src) {
+        if (n_block == 0) {
+            ggml_backend_tensor_set(t, src, head*size_row, cell_count*size_row);
+            return;
+        }
+
+        // paged: the rows are contiguous only within the blocks
+        for (uint32_t i = 0, n; i < cell_count; i += n) {
+            n = std::min(cell_count - i, n_block - (head + i)%n_block);
+            ggml_backend_tensor_set(t, src + i*size_row, cell_row(strm, head + i)*size_row, n*size_row);
+        }
+    };
+
     // For each layer, read the keys for each cell, one row is one cell, read as one contiguous block
     for (const auto & layer : layers) {
         const uint32_t il = layer.il;
 
         const uint32_t n_embd_k_gqa = hparams.n_embd_k_gqa(il);
 
-        auto * k = layer.k_stream[strm];
+        auto * k = layer.k_stream[strm_buf];
 
         // Read type of key
         int32_t k_type_i_ref;
@@ -2190,7 +3164,7 @@ bool llama_kv_cache_unified::state_read_data(llama_io_read_i & io, uint32_t strm
 
         if (cell_count) {
             // Read and set the keys for the whole cell range
-            ggml_backend_tensor_set(k, io.read(cell_count * k_size_row), head * k_size_row, cell_count * k_size_row);
+            set_rows(k, k_size_row, io.read(cell_count * k_size_row));
         }
     }
 
@@ -2200,7 +3174,7 @@ bool llama_kv_cache_unified::state_read_data(llama_io_read_i & io, uint32_t strm
 
             const uint32_t n_embd_v_gqa = hparams.n_embd_v_gqa(il);
 
-            auto * v = layer.v_stream[strm];
+            auto * v = layer.v_stream[strm_buf];
 
             // Read type of value
             int32_t v_type_i_ref;
@@ -2222,7 +3196,7 @@ bool llama_kv_cache_unified::state_read_data(llama_io_read_i & io, uint32_t strm
 
             if (cell_count) {
                 // Read and set the values for the whole cell range
-                ggml_backend_tensor_set(v, io.read(cell_count * v_size_row), head * v_size_row, cell_count * v_size_row);
+                set_rows(v, v_size_row, io.read(cell_count * v_size_row));
             }
         }
     } else {
@@ -2384,6 +3358,18 @@ ggml_tensor * llama_kv_cache_unified_context::build_input_v_idxs(ggml_context *
     return kv->build_input_v_idxs(ctx, ubatch);
 }
 
+ggml_tensor * llama_kv_cache_unified_context::build_input_kv_blocks(ggml_context * ctx, const llama_ubatch & ubatch) const {
+    return kv->build_input_kv_blocks(ctx, n_kv, ubatch);
+}
+
+void llama_kv_cache_unified_context::set_input_kv_blocks(ggml_tensor * dst) const {
+    kv->set_input_kv_blocks(dst, sinfos[i_cur]);
+}
+
+void llama_kv_cache_unified_context::add_attn_mass(const ggml_tensor * mass) const {
+    kv->add_attn_mass(mass, sinfos[i_cur]);
+}
+
 void llama_kv_cache_unified_context::set_input_k_shift(ggml_tensor * dst) const {
     kv->set_input_k_shift(dst);
 }
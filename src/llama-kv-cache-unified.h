@@ -3,6 +3,7 @@
 #include "llama-batch.h"
 #include "llama-graph.h"
 #include "llama-kv-cells.h"
+#include "llama-kv-spill.h"
 #include "llama-memory.h"
 
 #include <unordered_map>
@@ -92,11 +93,21 @@ public:
 
     using slot_info_vec_t = std::vector<slot_info>;
 
+    // KV eviction: before a batch is placed, the cells of each of its sequences are evicted down to
+    // n_sink + n_recent + n_heavy, keeping the first n_sink cells (attention sinks), the n_recent most recent cells
+    // and the n_heavy cells that received the most attention so far (heavy hitters). n_recent == 0: disabled
+    struct evict_params {
+        uint32_t n_sink;
+        uint32_t n_recent;
+        uint32_t n_heavy;
+    };
+
     llama_kv_cache_unified(
             const llama_model &  model,
               layer_filter_cb && filter,
                     ggml_type    type_k,
                     ggml_type    type_v,
+    const llama_kv_cache_type_override * type_overrides,
                          bool    v_trans,
                          bool    offload,
                          bool    unified,
@@ -104,7 +115,10 @@ public:
                      uint32_t    n_seq_max,
                      uint32_t    n_pad,
                      uint32_t    n_swa,
-               llama_swa_type    swa_type);
+               llama_swa_type    swa_type,
+                     uint32_t    n_block = 0,
+           llama_kv_spill_ptr    spill   = nullptr,
+           const evict_params &  evict   = {});
 
     ~llama_kv_cache_unified() = default;
 
@@ -146,6 +160,23 @@ public:
     uint32_t get_size()     const;
     uint32_t get_n_stream() const;
 
+    // paged mode: cells per block (0 = not paged), number of physical blocks in use and of shared blocks copied on write
+    uint32_t get_n_block()         const;
+    uint32_t get_n_blocks_used()   const;
+    uint32_t get_n_blocks_copied() const;
+
+    // number of used cells, summed over all streams
+    uint32_t get_used() const;
+
+    // fraction of the cells below the last used cell of each stream that are empty
+    float get_fragmentation() const;
+
+    // number of cells moved by the defrag of the last update()
+    uint32_t get_defrag_n_moved() const;
+
+    // number of cells evicted by the last init_batch()
+    uint32_t get_evict_n_cells() const;
+
     bool get_has_shift() const;
 
     //
@@ -183,6 +214,9 @@ public:
     // emplace the ubatch context into slot: [sinfo.idxs[0...ubatch.n_tokens - 1]]
     void apply_ubatch(const slot_info & sinfo, const llama_ubatch & ubatch);
 
+    // add the attention received by the KV cells of the slot (llm_graph_result::t_attn_mass) to their score
+    void add_attn_mass(const ggml_tensor * mass, const slot_info & sinfo);
+
     //
     // input API
     //
@@ -190,10 +224,16 @@ public:
     ggml_tensor * build_input_k_idxs(ggml_context * ctx, const llama_ubatch & ubatch) const;
     ggml_tensor * build_input_v_idxs(ggml_context * ctx, const llama_ubatch & ubatch) const;
 
+    // paged mode: block tables of the streams of the ubatch, nullptr when not paged
+    ggml_tensor * build_input_kv_blocks(ggml_context * ctx, uint32_t n_kv, const llama_ubatch & ubatch) const;
+
     void set_input_k_idxs(ggml_tensor * dst, const llama_ubatch * ubatch, const slot_info & sinfo) const;
     void set_input_v_idxs(ggml_tensor * dst, const llama_ubatch * ubatch, const slot_info & sinfo) const;
 
+    void set_input_kv_blocks(ggml_tensor * dst, const slot_info & sinfo) const;
+
     void set_input_k_shift(ggml_tensor * dst) const;
+    void set_input_k_shift_rows(ggml_tensor * dst, ggml_tensor * dst_i64) const;
 
     void set_input_kq_mask   (ggml_tensor * dst, const llama_ubatch * ubatch, bool causal_attn) const;
     void set_input_pos_bucket(ggml_tensor * dst, const llama_ubatch * ubatch) const;
@@ -246,6 +286,26 @@ private:
     // maps from a sequence id to a stream id
     std::vector<uint32_t> seq_to_stream;
 
+    // paged mode: the K/V tensors hold a single pool of kv_size cells, split in blocks of n_block cells
+    // each stream addresses kv_size logical cells, its block table maps the logical blocks to the physical blocks
+    // the physical blocks are reference counted, so that seq_cp() shares them instead of copying the data
+    // a shared block is copied before a stream writes to it (copy-on-write)
+    struct paged_state {
+        std::vector<std::vector<int32_t>> tables; // [n_stream][kv_size/n_block], -1 = not mapped
+        std::vector<uint32_t>             refs;   // [kv_size/n_block] streams referencing the physical block
+        std::vector<int32_t>              free;   // stack of the free physical blocks
+    };
+
+    const uint32_t n_block = 0;
+
+    paged_state paged;
+
+    // do not copy the data of the shared blocks when they are remapped (set while prepare() searches the slots)
+    bool paged_no_copy = false;
+
+    // shared blocks copied on write since the cache was created
+    uint32_t blocks_n_copied = 0;
+
     // pending stream copies that will be applied during the next update
     stream_copy_info sc_info;
 
@@ -254,8 +314,31 @@ private:
     // model layer id -> KV cache layer id
     std::unordered_map<int32_t, int32_t> map_layer_ids;
 
+    // a defrag spread over several updates is in progress (see llama_cparams::defrag_max_cells)
+    bool defrag_pending = false;
+
+    // cells moved by the defrag of the last update()
+    uint32_t defrag_n_moved = 0;
+
+    // spill tier: when the cache is full, the least recently used sequences are moved out of it
+    // they are restored when a batch uses them again (nullptr = disabled)
+    llama_kv_spill_ptr spill;
+
+    // seq_last_used[s]: the value of seq_tick when the sequence s was last used by a batch
+    uint64_t              seq_tick = 0;
+    std::vector<uint64_t> seq_last_used;
+
+    const evict_params evict;
+
+    // accumulated attention mass of the cells, ranks the heavy hitters (empty when n_heavy == 0)
+    std::vector<std::vector<float>> v_attn_mass; // [n_stream][kv_size]
+
+    // cells evicted by the last init_batch()
+    uint32_t evict_n_cells = 0;
+
     // return non-empty vector if cells have been moved
-    defrag_info defrag_prepare(int32_t n_max_nodes) const;
+    // n_max_cells > 0: move at most n_max_cells cells, the last used ones first
+    defrag_info defrag_prepare(int32_t n_max_nodes, uint32_t n_max_cells = 0) const;
 
     size_t total_size() const;
 
@@ -264,6 +347,28 @@ private:
 
     bool is_masked_swa(llama_pos p0, llama_pos p1) const;
 
+    // row of the cell idx of the stream strm in the K/V tensors
+    int64_t cell_row(uint32_t strm, uint32_t idx) const;
+
+    // paged mode helpers
+    void     blocks_reset();
+    int32_t  block_alloc();
+    void     block_unref(uint32_t strm, uint32_t ib);
+    bool     block_make_private(uint32_t strm, uint32_t ib); // map or copy the logical block ib before writing to it
+    void     blocks_release_unused(uint32_t strm);           // unmap the logical blocks without used cells
+    uint32_t blocks_needed(const slot_info & sinfo) const;   // physical blocks needed to write the slot
+
+    // spill tier helpers
+    bool         seq_spill  (llama_seq_id seq_id);                                // move the sequence out of the cache
+    bool         seq_unspill(llama_seq_id seq_id, const std::vector<bool> & keep); // restore it, spilling the LRU sequences not in keep
+    llama_seq_id seq_lru    (const std::vector<bool> & keep) const;               // least recently used resident sequence, -1 if none
+
+    // KV eviction: evict the cells of the sequence before n_new tokens are added to it, returns the number of evicted cells
+    uint32_t seq_evict(llama_seq_id seq_id, uint32_t n_new);
+
+    // paged K-shift: the pool rows to shift and their shift
+    std::vector<std::pair<int64_t, int32_t>> paged_shift_rows() const;
+
     ggml_tensor * build_rope_shift(
             const llama_cparams & cparams,
                    ggml_context * ctx,
@@ -355,9 +460,15 @@ public:
     ggml_tensor * build_input_k_idxs(ggml_context * ctx, const llama_ubatch & ubatch) const;
     ggml_tensor * build_input_v_idxs(ggml_context * ctx, const llama_ubatch & ubatch) const;
 
+    ggml_tensor * build_input_kv_blocks(ggml_context * ctx, const llama_ubatch & ubatch) const;
+
     void set_input_k_idxs(ggml_tensor * dst, const llama_ubatch * ubatch) const;
     void set_input_v_idxs(ggml_tensor * dst, const llama_ubatch * ubatch) const;
 
+    void set_input_kv_blocks(ggml_tensor * dst) const;
+
+    void add_attn_mass(const ggml_tensor * mass) const;
+
     void set_input_k_shift   (ggml_tensor * dst) const;
     void set_input_kq_mask   (ggml_tensor * dst, const llama_ubatch * ubatch, bool causal_attn) const;
     void set_input_pos_bucket(ggml_tensor * dst, const llama_ubatch * ubatch) const;
@@ -0,0 +1,444 @@
+#include "llama-kv-spill.h"
+
+#include "llama-impl.h"
+#include "llama-mmap.h"
+
+#ifdef LLAMA_INSTRUMENTATION
+#include "llama-metrics.h"
+#endif
+
+#include "ggml-backend.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <unistd.h>
+#endif
+
+// record tags of the spill data
+enum llama_spill_record : uint8_t {
+    LLAMA_SPILL_RECORD_RAW       = 0, // [u64 size][data]
+    LLAMA_SPILL_RECORD_CONVERTED = 1, // [i32 src type][u64 n elements][i32 dst type][data]
+};
+
+#ifdef LLAMA_INSTRUMENTATION
+// process-wide metrics of the spill tiers
+struct llama_kv_spill_metrics {
+    llama_metric_histogram * restore_seconds;
+    llama_metric_counter   * spilled;
+    llama_metric_counter   * restored;
+    llama_metric_gauge     * size;
+    llama_metric_gauge     * n_seqs;
+
+    llama_kv_spill_metrics() {
+        auto & reg = llama_metrics();
+
+        restore_seconds = reg.histogram("llamacpp:kv_spill_restore_seconds", "Latency of restoring a spilled sequence into the KV cache.",
+                llama_metrics_exponential_buckets(0.0001, 2.0, 16));
+        spilled  = reg.counter("llamacpp:kv_spill_spilled_total", "Number of sequences moved out of the KV cache into the spill tier.");
+        restored = reg.counter("llamacpp:kv_spill_restored_total", "Number of sequences restored from the spill tier into the KV cache.");
+        size     = reg.gauge("llamacpp:kv_spill_bytes", "Number of bytes used by the spill tier.");
+        n_seqs   = reg.gauge("llamacpp:kv_spill_seqs", "Number of sequences in the spill tier.");
+    }
+};
+
+static llama_kv_spill_metrics & kv_spill_metrics() {
+    static llama_kv_spill_metrics metrics;
+    return metrics;
+}
+#endif
+
+template <typename T>
+static void buf_append(std::vector<uint8_t> & buf, const T & val) {
+    const size_t n = buf.size();
+    buf.resize(n + sizeof(T));
+    memcpy(buf.data() + n, &val, sizeof(T));
+}
+
+template <typename T>
+static T buf_get(const std::vector<uint8_t> & buf, size_t & offs) {
+    if (offs + sizeof(T) > buf.size()) {
+        throw std::runtime_error("unexpectedly reached end of spill data");
+    }
+    T val;
+    memcpy(&val, buf.data() + offs, sizeof(T));
+    offs += sizeof(T);
+    return val;
+}
+
+// creates a new file with a unique name in the directory dir, the spill tiers of several contexts (e.g. the draft
+// context of the server) can share the directory
+static std::string spill_file_create(const std::string & dir) {
+#if defined(_WIN32)
+    char fname[MAX_PATH];
+    if (GetTempFileNameA(dir.c_str(), "kvs", 0, fname) == 0) {
+        throw std::runtime_error(format("failed to create a KV spill file in %s", dir.c_str()));
+    }
+    return fname;
+#else
+    std::string fname = dir + "/llama-kv-spill-XXXXXX";
+
+    const int fd = mkstemp(&fname[0]);
+    if (fd < 0) {
+        throw std::runtime_error(format("failed to create a KV spill file in %s: %s", dir.c_str(), strerror(errno)));
+    }
+    close(fd);
+
+    return fname;
+#endif
+}
+
+static bool spill_type_convertible(ggml_type type) {
+    return type == GGML_TYPE_F32 || type == GGML_TYPE_F16 || type == GGML_TYPE_BF16;
+}
+
+//
+// llama_io_write_spill
+//
+
+llama_io_write_spill::llama_io_write_spill(ggml_type type_rows) : type_rows(type_rows) {}
+
+void llama_io_write_spill::write(const void * src, size_t size) {
+    if (raw_last == SIZE_MAX) {
+        buf_append<uint8_t >(buf, LLAMA_SPILL_RECORD_RAW);
+        raw_last = buf.size();
+        buf_append<uint64_t>(buf, 0);
+    }
+
+    uint64_t n;
+    memcpy(&n, buf.data() + raw_last, sizeof(n));
+    n += size;
+    memcpy(buf.data() + raw_last, &n, sizeof(n));
+
+    const size_t offs = buf.size();
+    buf.resize(offs + size);
+    memcpy(buf.data() + offs, src, size);
+
+    size_written += size;
+}
+
+void llama_io_write_spill::write_tensor(const ggml_tensor * tensor, size_t offset, size_t size) {
+    tmp.resize(size);
+    ggml_backend_tensor_get(tensor, tmp.data(), offset, size);
+
+    const ggml_type type_src = tensor->type;
+
+    const int64_t n = size/ggml_type_size(type_src);
+
+    // the pieces of the V rows of a transposed cache can be shorter than a block - keep them as they are
+    const bool convert =
+        type_rows != GGML_TYPE_COUNT && type_rows != type_src && spill_type_convertible(type_src) &&
+        size % ggml_type_size(type_src) == 0 && n % ggml_blck_size(type_rows) == 0;
+
+    if (!convert) {
+        write(tmp.data(), size);
+        return;
+    }
+
+    tmp_f32.resize(n);
+    switch (type_src) {
+        case GGML_TYPE_F32:  memcpy(tmp_f32.data(), tmp.data(), size); break;
+        case GGML_TYPE_F16:  ggml_fp16_to_fp32_row((const ggml_fp16_t *) tmp.data(), tmp_f32.data(), n); break;
+        case GGML_TYPE_BF16: ggml_bf16_to_fp32_row((const ggml_bf16_t *) tmp.data(), tmp_f32.data(), n); break;
+        default: GGML_ABORT("unexpected type");
+    }
+
+    buf_append<uint8_t >(buf, LLAMA_SPILL_RECORD_CONVERTED);
+    buf_append<int32_t >(buf, type_src);
+    buf_append<uint64_t>(buf, n);
+    buf_append<int32_t >(buf, type_rows);
+
+    const size_t offs = buf.size();
+    buf.resize(offs + ggml_row_size(type_rows, n));
+    ggml_quantize_chunk(type_rows, tmp_f32.data(), buf.data() + offs, 0, 1, n, nullptr);
+
+    raw_last = SIZE_MAX;
+
+    size_written += size;
+}
+
+size_t llama_io_write_spill::n_bytes() {
+    return size_written;
+}
+
+//
+// llama_io_read_spill
+//
+
+llama_io_read_spill::llama_io_read_spill(const std::vector<uint8_t> & data) {
+    std::vector<float> tmp_f32;
+
+    size_t offs = 0;
+    while (offs < data.size()) {
+        const uint8_t tag = buf_get<uint8_t>(data, offs);
+
+        if (tag == LLAMA_SPILL_RECORD_RAW) {
+            const uint64_t n = buf_get<uint64_t>(data, offs);
+            if (offs + n > data.size()) {
+                throw std::runtime_error("unexpectedly reached end of spill data");
+            }
+            raw.insert(raw.end(), data.begin() + offs, data.begin() + offs + n);
+            offs += n;
+        } else if (tag == LLAMA_SPILL_RECORD_CONVERTED) {
+            const ggml_type type_src = (ggml_type) buf_get<int32_t>(data, offs);
+            const int64_t   n        = buf_get<uint64_t>(data, offs);
+            const ggml_type type_dst = (ggml_type) buf_get<int32_t>(data, offs);
+
+            const size_t size_dst = ggml_row_size(type_dst, n);
+            if (offs + size_dst > data.size()) {
+                throw std::runtime_error("unexpectedly reached end of spill data");
+            }
+
+            tmp_f32.resize(n);
+            ggml_get_type_traits(type_dst)->to_float(data.data() + offs, tmp_f32.data(), n);
+            offs += size_dst;
+
+            const size_t size_src = n*ggml_type_size(type_src);
+            const size_t pos = raw.size();
+            raw.resize(pos + size_src);
+
+            switch (type_src) {
+                case GGML_TYPE_F32:  memcpy(raw.data() + pos, tmp_f32.data(), size_src); break;
+                case GGML_TYPE_F16:  ggml_fp32_to_fp16_row(tmp_f32.data(), (ggml_fp16_t *) (raw.data() + pos), n); break;
+                case GGML_TYPE_BF16: ggml_fp32_to_bf16_row(tmp_f32.data(), (ggml_bf16_t *) (raw.data() + pos), n); break;
+                default: throw std::runtime_error("unexpected type in spill data");
+            }
+        } else {
+            throw std::runtime_error("invalid spill record");
+        }
+    }
+}
+
+const uint8_t * llama_io_read_spill::read(size_t size) {
+    if (size_read + size > raw.size()) {
+        throw std::runtime_error("unexpectedly reached end of buffer");
+    }
+    const uint8_t * res = raw.data() + size_read;
+    size_read += size;
+    return res;
+}
+
+void llama_io_read_spill::read_to(void * dst, size_t size) {
+    memcpy(dst, read(size), size);
+}
+
+size_t llama_io_read_spill::n_bytes() {
+    return size_read;
+}
+
+//
+// llama_kv_spill
+//
+
+llama_kv_spill::llama_kv_spill(size_t max_size, ggml_type type_rows, const std::string & dir) :
+    max_size(max_size), type_rows(type_rows) {
+    if (type_rows != GGML_TYPE_COUNT && ggml_quantize_requires_imatrix(type_rows)) {
+        throw std::runtime_error(format("KV spill type %s requires an importance matrix", ggml_type_name(type_rows)));
+    }
+
+    if (!dir.empty()) {
+        path = spill_file_create(dir);
+        file = std::make_unique<llama_file>(path.c_str(), "w+b");
+    }
+
+    LLAMA_LOG_INFO("%s: %8.2f MiB, type = %s, %s%s\n", __func__, max_size/1024.0/1024.0,
+            type_rows == GGML_TYPE_COUNT ? "same as the cache" : ggml_type_name(type_rows),
+            file ? "file = " : "host memory", path.c_str());
+}
+
+llama_kv_spill::~llama_kv_spill() {
+    clear();
+
+    if (file) {
+        file.reset();
+        std::remove(path.c_str());
+    }
+}
+
+ggml_type llama_kv_spill::get_type_rows() const {
+    return type_rows;
+}
+
+bool llama_kv_spill::has(llama_seq_id seq_id) const {
+    return entries.find(seq_id) != entries.end();
+}
+
+llama_pos llama_kv_spill::seq_pos_min(llama_seq_id seq_id) const {
+    return entries.at(seq_id).p0;
+}
+
+llama_pos llama_kv_spill::seq_pos_max(llama_seq_id seq_id) const {
+    return entries.at(seq_id).p1;
+}
+
+uint32_t llama_kv_spill::seq_n_cells(llama_seq_id seq_id) const {
+    return entries.at(seq_id).n_cells;
+}
+
+bool llama_kv_spill::can_store(size_t size) const {
+    return size_used + size <= max_size;
+}
+
+bool llama_kv_spill::store(llama_seq_id seq_id, llama_pos p0, llama_pos p1, uint32_t n_cells, const std::vector<uint8_t> & data) {
+    GGML_ASSERT(!has(seq_id));
+
+    if (!can_store(data.size())) {
+        return false;
+    }
+
+    entry e;
+    e.p0      = p0;
+    e.p1      = p1;
+    e.n_cells = n_cells;
+    e.size    = data.size();
+
+    if (file) {
+        e.offs = file_alloc(e.size);
+        file->seek(e.offs, SEEK_SET);
+        file->write_raw(data.data(), e.size);
+    } else {
+        e.data = data;
+    }
+
+    size_used += e.size;
+    entries.emplace(seq_id, std::move(e));
+
+#ifdef LLAMA_INSTRUMENTATION
+    kv_spill_metrics().spilled->add();
+#endif
+    update_metrics();
+
+    return true;
+}
+
+std::vector<uint8_t> llama_kv_spill::load(llama_seq_id seq_id) const {
+    const auto & e = entries.at(seq_id);
+
+    if (!file) {
+        return e.data;
+    }
+
+    std::vector<uint8_t> data(e.size);
+    file->seek(e.offs, SEEK_SET);
+    file->read_raw(data.data(), e.size);
+
+    return data;
+}
+
+void llama_kv_spill::erase(llama_seq_id seq_id) {
+    auto it = entries.find(seq_id);
+    if (it == entries.end()) {
+        return;
+    }
+
+    if (file) {
+        file_release(it->second.offs, it->second.size);
+    }
+
+    size_used -= it->second.size;
+    entries.erase(it);
+
+    update_metrics();
+}
+
+void llama_kv_spill::clear() {
+    entries.clear();
+    size_used = 0;
+
+    file_end = 0;
+    file_free.clear();
+
+    update_metrics();
+}
+
+size_t llama_kv_spill::get_size() const {
+    return size_used;
+}
+
+uint32_t llama_kv_spill::get_n_seqs() const {
+    return entries.size();
+}
+
+size_t llama_kv_spill::get_file_end() const {
+    return file_end;
+}
+
+uint32_t llama_kv_spill::get_file_n_free() const {
+    return file_free.size();
+}
+
+void llama_kv_spill::record_restore(double seconds) const {
+#ifdef LLAMA_INSTRUMENTATION
+    kv_spill_metrics().restore_seconds->observe(seconds);
+    kv_spill_metrics().restored->add();
+#else
+    GGML_UNUSED(seconds);
+#endif
+}
+
+size_t llama_kv_spill::file_alloc(size_t size) {
+    // first fit
+    for (auto it = file_free.begin(); it != file_free.end(); ++it) {
+        if (it->second >= size) {
+            const size_t offs = it->first;
+
+            it->first  += size;
+            it->second -= size;
+            if (it->second == 0) {
+                file_free.erase(it);
+            }
+
+            return offs;
+        }
+    }
+
+    const size_t offs = file_end;
+    file_end += size;
+
+    return offs;
+}
+
+void llama_kv_spill::file_release(size_t offs, size_t size) {
+    if (size == 0) {
+        return;
+    }
+
+    // keep the extents sorted and merge the neighbours
+    auto it = file_free.begin();
+    while (it != file_free.end() && it->first < offs) {
+        ++it;
+    }
+    it = file_free.insert(it, { offs, size });
+
+    if (it + 1 != file_free.end() && it->first + it->second == (it + 1)->first) {
+        it->second += (it + 1)->second;
+        file_free.erase(it + 1);
+    }
+    if (it != file_free.begin() && (it - 1)->first + (it - 1)->second == it->first) {
+        (it - 1)->second += it->second;
+        it = file_free.erase(it) - 1;
+    }
+
+    // the last extent gives its space back to the end of the file
+    if (it + 1 == file_free.end() && it->first + it->second == file_end) {
+        file_end = it->first;
+        file_free.erase(it);
+    }
+}
+
+void llama_kv_spill::update_metrics() const {
+#ifdef LLAMA_INSTRUMENTATION
+    kv_spill_metrics().size  ->set(size_used);
+    kv_spill_metrics().n_seqs->set(entries.size());
+#endif
+}
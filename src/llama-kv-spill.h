@@ -0,0 +1,140 @@
+#pragma once
+
+#include "llama.h"
+#include "llama-io.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct llama_file;
+
+//
+// llama_io_write_spill / llama_io_read_spill
+//
+
+// serializes the state of a sequence into a byte buffer
+// the F32/F16/BF16 K/V rows are converted to type_rows (e.g. Q8_0), GGML_TYPE_COUNT keeps them as they are
+class llama_io_write_spill : public llama_io_write_i {
+public:
+    llama_io_write_spill(ggml_type type_rows);
+
+    void write(const void * src, size_t size) override;
+    void write_tensor(const ggml_tensor * tensor, size_t offset, size_t size) override;
+
+    // bytes of the original (unconverted) state
+    size_t n_bytes() override;
+
+    const std::vector<uint8_t> & data() const { return buf; }
+
+private:
+    const ggml_type type_rows;
+
+    size_t size_written = 0;
+
+    // offset of the size of the last raw record in buf, so that consecutive writes are merged
+    size_t raw_last = SIZE_MAX;
+
+    std::vector<uint8_t> buf;
+    std::vector<uint8_t> tmp;
+    std::vector<float>   tmp_f32;
+};
+
+// reads the data written by llama_io_write_spill, the converted rows are restored to their original type
+class llama_io_read_spill : public llama_io_read_i {
+public:
+    llama_io_read_spill(const std::vector<uint8_t> & data);
+
+    const uint8_t * read(size_t size) override;
+    void read_to(void * dst, size_t size) override;
+
+    size_t n_bytes() override;
+
+    // size of the decoded state
+    size_t size() const { return raw.size(); }
+
+private:
+    std::vector<uint8_t> raw;
+
+    size_t size_read = 0;
+};
+
+//
+// llama_kv_spill
+//
+
+// second tier of the unified KV cache: the states of the sequences moved out of the cache when it is full
+// they are kept in host memory or in a spill file, up to max_size bytes
+class llama_kv_spill {
+public:
+    // dir empty: host memory, otherwise a new file in the directory dir, removed with the spill tier
+    llama_kv_spill(size_t max_size, ggml_type type_rows, const std::string & dir);
+    ~llama_kv_spill();
+
+    ggml_type get_type_rows() const;
+
+    bool has(llama_seq_id seq_id) const;
+
+    llama_pos seq_pos_min(llama_seq_id seq_id) const;
+    llama_pos seq_pos_max(llama_seq_id seq_id) const;
+
+    // number of cells of the stored sequence
+    uint32_t seq_n_cells(llama_seq_id seq_id) const;
+
+    bool can_store(size_t size) const;
+
+    // store the data of a llama_io_write_spill, false if the tier is full
+    bool store(llama_seq_id seq_id, llama_pos p0, llama_pos p1, uint32_t n_cells, const std::vector<uint8_t> & data);
+
+    // the data of a stored sequence, to be read with a llama_io_read_spill
+    std::vector<uint8_t> load(llama_seq_id seq_id) const;
+
+    void erase(llama_seq_id seq_id);
+    void clear();
+
+    // bytes in use and number of stored sequences
+    size_t   get_size()   const;
+    uint32_t get_n_seqs() const;
+
+    // spill file: end of the last used extent and number of free extents below it
+    size_t   get_file_end()    const;
+    uint32_t get_file_n_free() const;
+
+    void record_restore(double seconds) const;
+
+private:
+    struct entry {
+        llama_pos p0;
+        llama_pos p1;
+
+        uint32_t n_cells;
+
+        std::vector<uint8_t> data; // host memory
+
+        size_t offs = 0;           // spill file
+        size_t size = 0;
+    };
+
+    const size_t    max_size;
+    const ggml_type type_rows;
+
+    size_t size_used = 0;
+
+    std::unordered_map<llama_seq_id, entry> entries;
+
+    // spill file and its free extents [offset, size)
+    std::unique_ptr<llama_file> file;
+    std::string path;
+
+    size_t file_end = 0;
+    std::vector<std::pair<size_t, size_t>> file_free;
+
+    size_t file_alloc(size_t size);
+    void   file_release(size_t offs, size_t size);
+
+    void update_metrics() const;
+};
+
+using llama_kv_spill_ptr = std::unique_ptr<llama_kv_spill>;
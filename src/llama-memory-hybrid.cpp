@@ -13,6 +13,7 @@ llama_memory_hybrid::llama_memory_hybrid(
                          /* attn */
             ggml_type    type_k,
             ggml_type    type_v,
+    const llama_kv_cache_type_override * type_overrides,
                  bool    v_trans,
              uint32_t    kv_size,
              uint32_t    n_pad,
@@ -37,6 +38,7 @@ llama_memory_hybrid::llama_memory_hybrid(
             : filter_attn,
         type_k,
         type_v,
+        type_overrides,
         v_trans,
         offload,
         unified,
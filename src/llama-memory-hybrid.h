@@ -27,6 +27,7 @@ public:
                             /* attn */
                 ggml_type    type_k,
                 ggml_type    type_v,
+    const llama_kv_cache_type_override * type_overrides,
                      bool    v_trans,
                  uint32_t    kv_size,
                  uint32_t    n_pad,
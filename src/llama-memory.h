@@ -3,6 +3,7 @@
 #include "llama.h"
 
 #include <memory>
+#include <string>
 
 struct llama_ubatch;
 
@@ -16,8 +17,16 @@ struct llama_memory_params {
     ggml_type type_k;
     ggml_type type_v;
 
+    // per-layer kv cache types, NULL-terminated (can be NULL)
+    const llama_kv_cache_type_override * type_overrides;
+
     // use full-size SWA cache
     bool swa_full;
+
+    // spill tier of the kv cache, spill_size == 0: disabled
+    size_t      spill_size;
+    ggml_type   spill_type;
+    std::string spill_path; // directory of the spill file, empty: host memory
 };
 
 enum llama_memory_status {
@@ -0,0 +1,233 @@
+#include "llama-metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+static void atomic_add(std::atomic<double> & dst, double v) {
+    double cur = dst.load(std::memory_order_relaxed);
+    while (!dst.compare_exchange_weak(cur, cur + v, std::memory_order_relaxed)) {
+    }
+}
+
+int llama_metrics_shard_id() {
+    static std::atomic<int> n_threads{0};
+    thread_local const int id = n_threads.fetch_add(1, std::memory_order_relaxed) % LLAMA_METRICS_N_SHARDS;
+    return id;
+}
+
+//
+// llama_metric_counter
+//
+
+void llama_metric_counter::add(double v) {
+    atomic_add(shards_[llama_metrics_shard_id()].value, v);
+}
+
+double llama_metric_counter::value() const {
+    double res = 0.0;
+    for (const auto & s : shards_) {
+        res += s.value.load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+//
+// llama_metric_gauge
+//
+
+void llama_metric_gauge::set(double v) {
+    value_.store(v, std::memory_order_relaxed);
+}
+
+void llama_metric_gauge::add(double v) {
+    atomic_add(value_, v);
+}
+
+double llama_metric_gauge::value() const {
+    return value_.load(std::memory_order_relaxed);
+}
+
+//
+// llama_metric_histogram
+//
+
+llama_metric_histogram::llama_metric_histogram(std::vector<double> bounds) : bounds_(std::move(bounds)) {
+    std::sort(bounds_.begin(), bounds_.end());
+
+    for (auto & s : shards_) {
+        s.buckets.reset(new std::atomic<uint64_t>[bounds_.size() + 1]);
+        for (size_t i = 0; i <= bounds_.size(); i++) {
+            s.buckets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void llama_metric_histogram::observe(double v) {
+    auto & s = shards_[llama_metrics_shard_id()];
+
+    // buckets are stored non-cumulative, collect() accumulates them
+    const size_t ib = std::lower_bound(bounds_.begin(), bounds_.end(), v) - bounds_.begin();
+
+    s.buckets[ib].fetch_add(1, std::memory_order_relaxed);
+    s.count.fetch_add(1, std::memory_order_relaxed);
+    atomic_add(s.sum, v);
+}
+
+void llama_metric_histogram::collect(std::vector<uint64_t> & buckets, double & sum, uint64_t & count) const {
+    buckets.assign(bounds_.size() + 1, 0);
+    sum   = 0.0;
+    count = 0;
+
+    for (const auto & s : shards_) {
+        for (size_t i = 0; i <= bounds_.size(); i++) {
+            buckets[i] += s.buckets[i].load(std::memory_order_relaxed);
+        }
+        sum   += s.sum.load(std::memory_order_relaxed);
+        count += s.count.load(std::memory_order_relaxed);
+    }
+
+    for (size_t i = 1; i < buckets.size(); i++) {
+        buckets[i] += buckets[i - 1];
+    }
+
+    // observations racing with the collection can land in the count before their bucket
+    count = std::max(count, buckets.back());
+    buckets.back() = count;
+}
+
+//
+// llama_metrics_registry
+//
+
+llama_metrics_registry::family & llama_metrics_registry::get_family(const std::string & name, const std::string & help, llama_metric_type type) {
+    auto it = families_.find(name);
+    if (it == families_.end()) {
+        it = families_.emplace(name, family{}).first;
+        it->second.type = type;
+        it->second.help = help;
+    }
+
+    GGML_ASSERT(it->second.type == type && "metric registered twice with different types");
+
+    return it->second;
+}
+
+llama_metric_counter * llama_metrics_registry::counter(const std::string & name, const std::string & help, const std::string & labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto & f = get_family(name, help, llama_metric_type::COUNTER);
+    auto & m = f.counters[labels];
+    if (!m) {
+        m.reset(new llama_metric_counter());
+    }
+    return m.get();
+}
+
+llama_metric_gauge * llama_metrics_registry::gauge(const std::string & name, const std::string & help, const std::string & labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto & f = get_family(name, help, llama_metric_type::GAUGE);
+    auto & m = f.gauges[labels];
+    if (!m) {
+        m.reset(new llama_metric_gauge());
+    }
+    return m.get();
+}
+
+llama_metric_histogram * llama_metrics_registry::histogram(const std::string & name, const std::string & help, const std::vector<double> & bounds,
+                                                           const std::string & labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto & f = get_family(name, help, llama_metric_type::HISTOGRAM);
+    auto & m = f.histograms[labels];
+    if (!m) {
+        m.reset(new llama_metric_histogram(bounds));
+    }
+    return m.get();
+}
+
+static std::string format_labels(const std::string & labels, const std::string & extra = "") {
+    if (labels.empty() && extra.empty()) {
+        return "";
+    }
+    if (labels.empty() || extra.empty()) {
+        return "{" + labels + extra + "}";
+    }
+    return "{" + labels + "," + extra + "}";
+}
+
+static std::string format_value(double v) {
+    if (std::isinf(v)) {
+        return v > 0 ? "+Inf" : "-Inf";
+    }
+    std::ostringstream ss;
+    ss.precision(12);
+    ss << v;
+    return ss.str();
+}
+
+std::string llama_metrics_registry::render() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::ostringstream ss;
+
+    std::vector<uint64_t> buckets;
+    double   sum;
+    uint64_t count;
+
+    for (const auto & it : families_) {
+        const auto & name = it.first;
+        const auto & f    = it.second;
+
+        ss << "# HELP " << name << " " << f.help << "\n";
+
+        switch (f.type) {
+            case llama_metric_type::COUNTER:
+                {
+                    ss << "# TYPE " << name << " counter\n";
+                    for (const auto & m : f.counters) {
+                        ss << name << format_labels(m.first) << " " << format_value(m.second->value()) << "\n";
+                    }
+                } break;
+            case llama_metric_type::GAUGE:
+                {
+                    ss << "# TYPE " << name << " gauge\n";
+                    for (const auto & m : f.gauges) {
+                        ss << name << format_labels(m.first) << " " << format_value(m.second->value()) << "\n";
+                    }
+                } break;
+            case llama_metric_type::HISTOGRAM:
+                {
+                    ss << "# TYPE " << name << " histogram\n";
+                    for (const auto & m : f.histograms) {
+                        const auto & bounds = m.second->bounds();
+                        m.second->collect(buckets, sum, count);
+                        for (size_t i = 0; i < buckets.size(); i++) {
+                            const std::string le = i < bounds.size() ? format_value(bounds[i]) : "+Inf";
+                            ss << name << "_bucket" << format_labels(m.first, "le=\"" + le + "\"") << " " << buckets[i] << "\n";
+                        }
+                        ss << name << "_sum"   << format_labels(m.first) << " " << format_value(sum) << "\n";
+                        ss << name << "_count" << format_labels(m.first) << " " << count << "\n";
+                    }
+                } break;
+        }
+    }
+
+    return ss.str();
+}
+
+llama_metrics_registry & llama_metrics() {
+    static llama_metrics_registry registry;
+    return registry;
+}
+
+std::vector<double> llama_metrics_exponential_buckets(double start, double factor, int n) {
+    std::vector<double> res;
+    res.reserve(n);
+    for (int i = 0; i < n; i++) {
+        res.push_back(start);
+        start *= factor;
+    }
+    return res;
+}
@@ -7,6 +7,7 @@
 #include "llama-batch.h"
 #include "llama-cparams.h"
 #include "llama-model-loader.h"
+#include "llama-repack-cache.h"
 
 #include "llama-kv-cache-unified.h"
 #include "llama-kv-cache-unified-iswa.h"
@@ -5562,6 +5563,11 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
     const size_t n_max_backend_buffer = ctx_map.size() * ml.files.size();
     pimpl->bufs.reserve(n_max_backend_buffer);
 
+    // the weights repacked for the CPU are mapped from the cache when it is valid, otherwise the cache is
+    // written once the weights are repacked
+    std::unique_ptr<llama_repack_cache> repack_cache;
+    ggml_context * ctx_repack_save = nullptr;
+
     for (auto & it : ctx_map) {
         ggml_backend_buffer_type_t buft = it.first;
         ggml_context * ctx              = it.second;
@@ -5571,6 +5577,32 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
             continue;
         }
 
+        if (params.repack_cache && strcmp(ggml_backend_buft_name(buft), "CPU_REPACK") == 0) {
+            if (!ml.use_mmap) {
+                LLAMA_LOG_WARN("%s: the repack cache requires mmap, not using it\n", __func__);
+            } else {
+                repack_cache.reset(new llama_repack_cache(params.repack_cache, ml, buft));
+                if (!repack_cache->supported()) {
+                    LLAMA_LOG_WARN("%s: the CPU backend does not support the repack cache\n", __func__);
+                    repack_cache.reset();
+                }
+            }
+            if (repack_cache) {
+                ggml_backend_buffer_t buf = repack_cache->load(ctx, pimpl->mappings, use_mlock ? &pimpl->mlock_mmaps : nullptr);
+                if (buf) {
+                    ggml_backend_buffer_set_usage(buf, GGML_BACKEND_BUFFER_USAGE_WEIGHTS);
+                    pimpl->bufs.emplace_back(buf);
+
+                    // the tensors are loaded, only account for them in the progress
+                    for (ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != nullptr; cur = ggml_get_next_tensor(ctx, cur)) {
+                        ml.size_done += ggml_nbytes(cur);
+                    }
+                    continue;
+                }
+                ctx_repack_save = ctx;
+            }
+        }
+
         llama_buf_map buf_map;
         buf_map.reserve(n_max_backend_buffer);
 
@@ -5673,6 +5705,24 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
         }
     }
 
+    if (ctx_repack_save) {
+        repack_cache->save(ctx_repack_save);
+    }
+
+    // with --numa split, move the slice of the rows of each weight to the node whose threads compute it
+    if (auto * cpu_dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU)) {
+        auto * cpu_reg  = ggml_backend_dev_backend_reg(cpu_dev);
+        auto * place_fn = (decltype(ggml_numa_place_tensor) *) ggml_backend_reg_get_proc_address(cpu_reg, "ggml_backend_cpu_numa_place_tensor");
+        if (place_fn) {
+            for (auto & it : tensors_by_name) {
+                ggml_tensor * cur = it.second;
+                if (cur->buffer && ggml_backend_buffer_is_host(cur->buffer)) {
+                    place_fn(cur);
+                }
+            }
+        }
+    }
+
     if (use_mmap_buffer) {
         for (auto & mapping : ml.mappings) {
             pimpl->mappings.emplace_back(std::move(mapping));
@@ -18068,6 +18118,21 @@ llama_memory_i * llama_model::create_memory(const llama_memory_params & params,
         // checks
         default:
             {
+                if (cparams.kv_block_size > 0 && (llm_arch_is_recurrent(arch) || llm_arch_is_hybrid(arch) || hparams.swa_type != LLAMA_SWA_TYPE_NONE)) {
+                    LLAMA_LOG_WARN("%s: paged KV cache is not supported with recurrent, hybrid or SWA models - disabling\n", __func__);
+                    cparams.kv_block_size = 0;
+                }
+
+                if (params.spill_size > 0 && (llm_arch_is_recurrent(arch) || llm_arch_is_hybrid(arch))) {
+                    LLAMA_LOG_WARN("%s: the KV spill tier is not supported with recurrent or hybrid models - disabling\n", __func__);
+                }
+
+                if (cparams.kv_evict_recent > 0 && (llm_arch_is_recurrent(arch) || llm_arch_is_hybrid(arch) || hparams.swa_type != LLAMA_SWA_TYPE_NONE)) {
+                    LLAMA_LOG_WARN("%s: KV eviction is not supported with recurrent, hybrid or SWA models - disabling\n", __func__);
+                    cparams.kv_evict_recent = 0;
+                    cparams.kv_evict_heavy  = 0;
+                }
+
                 if (llm_arch_is_recurrent(arch)) {
                     res = new llama_memory_recurrent(
                             *this,
@@ -18086,6 +18151,7 @@ llama_memory_i * llama_model::create_memory(const llama_memory_params & params,
                         /* model             */ *this,
                         /* attn_type_k       */ params.type_k,
                         /* attn_type_v       */ params.type_v,
+                        /* attn_type_ovr     */ params.type_overrides,
                         /* attn_v_trans      */ !cparams.flash_attn,
                         /* attn_kv_size      */ cparams.n_ctx,
                         /* attn_n_pad        */ padding,
@@ -18104,7 +18170,12 @@ llama_memory_i * llama_model::create_memory(const llama_memory_params & params,
 
                     uint32_t n_ctx_per_stream = cparams.n_ctx;
 
-                    if (!cparams.kv_unified) {
+                    if (cparams.kv_block_size > 0) {
+                        // paged: the streams share a single pool of cells, any of them can address all of it
+                        n_ctx_per_stream = GGML_PAD(n_ctx_per_stream, padding);
+
+                        cparams.n_ctx = n_ctx_per_stream;
+                    } else if (!cparams.kv_unified) {
                         n_ctx_per_stream = (cparams.n_ctx + cparams.n_seq_max - 1)/cparams.n_seq_max;
                         n_ctx_per_stream = GGML_PAD(n_ctx_per_stream, padding);
 
@@ -18117,6 +18188,19 @@ llama_memory_i * llama_model::create_memory(const llama_memory_params & params,
 
                     LLAMA_LOG_DEBUG("%s: n_ctx = %u (padded)\n", __func__, cparams.n_ctx);
 
+                    // spill tier: only the streams that share their cells between the sequences can make room by spilling one of them
+                    llama_kv_spill_ptr spill;
+
+                    if (params.spill_size > 0) {
+                        if (hparams.swa_type != LLAMA_SWA_TYPE_NONE) {
+                            LLAMA_LOG_WARN("%s: the KV spill tier is not supported with SWA models - disabling\n", __func__);
+                        } else if (!cparams.kv_unified && cparams.kv_block_size == 0) {
+                            LLAMA_LOG_WARN("%s: the KV spill tier requires a unified (kv_unified) or a paged (kv_block_size) KV cache - disabling\n", __func__);
+                        } else {
+                            spill = std::make_unique<llama_kv_spill>(params.spill_size, params.spill_type, params.spill_path);
+                        }
+                    }
+
                     if (hparams.swa_type != LLAMA_SWA_TYPE_NONE) {
                         GGML_ASSERT(hparams.is_swa_any());
 
@@ -18124,6 +18208,7 @@ llama_memory_i * llama_model::create_memory(const llama_memory_params & params,
                                 *this,
                                 params.type_k,
                                 params.type_v,
+                                params.type_overrides,
                                 !cparams.flash_attn,
                                 cparams.offload_kqv,
                                 params.swa_full,
@@ -18140,6 +18225,7 @@ llama_memory_i * llama_model::create_memory(const llama_memory_params & params,
                                 nullptr,
                                 params.type_k,
                                 params.type_v,
+                                params.type_overrides,
                                 !cparams.flash_attn,
                                 cparams.offload_kqv,
                                 cparams.kv_unified,
@@ -18147,7 +18233,10 @@ llama_memory_i * llama_model::create_memory(const llama_memory_params & params,
                                 cparams.n_seq_max,
                                 padding,
                                 hparams.n_swa,
-                                hparams.swa_type);
+                                hparams.swa_type,
+                                cparams.kv_block_size,
+                                std::move(spill),
+                                { cparams.kv_evict_sink, cparams.kv_evict_recent, cparams.kv_evict_heavy });
                     }
                 }
             }
@@ -18537,6 +18626,7 @@ llama_model_params llama_model_default_params() {
         /*.progress_callback           =*/ nullptr,
         /*.progress_callback_user_data =*/ nullptr,
         /*.kv_overrides                =*/ nullptr,
+        /*.repack_cache                =*/ nullptr,
         /*.vocab_only                  =*/ false,
         /*.use_mmap                    =*/ true,
         /*.use_mlock                   =*/ false,
@@ -0,0 +1,276 @@
+#include "llama-repack-cache.h"
+
+#include "llama-impl.h"
+#include "llama-model-loader.h"
+
+#include "ggml-cpp.h"
+#include "gguf.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+// bump when the format of the cache changes, the repack layouts are versioned by their names
+#define LLAMA_REPACK_CACHE_VERSION 1
+
+#define LLAMA_REPACK_CACHE_KV_VERSION    "repack.version"
+#define LLAMA_REPACK_CACHE_KV_MODEL_HASH "repack.model_hash"
+#define LLAMA_REPACK_CACHE_KV_LAYOUTS    "repack.layouts"
+#define LLAMA_REPACK_CACHE_KV_SRC_HASHES "repack.src_hashes"
+
+// size of the samples of the source data hashed per tensor, at the start, middle and end of the data
+#define LLAMA_REPACK_CACHE_SAMPLE_SIZE 4096
+
+static uint64_t fnv_hash(uint64_t hash, const void * data, size_t size) {
+    const uint8_t * p = (const uint8_t *) data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t fnv_hash(uint64_t hash, uint64_t v) {
+    return fnv_hash(hash, &v, sizeof(v));
+}
+
+static const uint64_t fnv_offset = 0xcbf29ce484222325ULL;
+
+llama_repack_cache::llama_repack_cache(std::string path, const llama_model_loader & ml, ggml_backend_buffer_type_t buft) : path(std::move(path)), ml(ml) {
+    ggml_backend_dev_t dev = ggml_backend_buft_get_device(buft);
+    ggml_backend_reg_t reg = dev ? ggml_backend_dev_backend_reg(dev) : nullptr;
+    if (reg) {
+        buffer_from_ptr = (buffer_from_ptr_t) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_repack_buffer_from_ptr");
+        tensor_layout   = (tensor_layout_t)   ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_repack_tensor_layout");
+    }
+
+    // the tensor infos of all the files, the tensor data itself is sampled per tensor
+    model_hash = fnv_hash(fnv_offset, (uint64_t) LLAMA_REPACK_CACHE_VERSION);
+    for (const auto & file : ml.files) {
+        model_hash = fnv_hash(model_hash, (uint64_t) file->size());
+    }
+    for (const auto & it : ml.weights_map) {
+        const auto & w = it.second;
+        model_hash = fnv_hash(model_hash, it.first.data(), it.first.size());
+        model_hash = fnv_hash(model_hash, (uint64_t) w.tensor->type);
+        for (int i = 0; i < GGML_MAX_DIMS; i++) {
+            model_hash = fnv_hash(model_hash, (uint64_t) w.tensor->ne[i]);
+        }
+        model_hash = fnv_hash(model_hash, (uint64_t) w.idx);
+        model_hash = fnv_hash(model_hash, (uint64_t) w.offs);
+    }
+}
+
+bool llama_repack_cache::supported() const {
+    return buffer_from_ptr && tensor_layout && !ml.mappings.empty();
+}
+
+uint64_t llama_repack_cache::src_hash(const ggml_tensor * cur) const {
+    const auto * w = ml.get_weight(ggml_get_name(cur));
+    GGML_ASSERT(w != nullptr);
+
+    const uint8_t * data = (const uint8_t *) ml.mappings.at(w->idx)->addr() + w->offs;
+    const size_t    size = ggml_nbytes(cur);
+
+    uint64_t hash = fnv_hash(fnv_offset, (uint64_t) size);
+    if (size <= 3*LLAMA_REPACK_CACHE_SAMPLE_SIZE) {
+        return fnv_hash(hash, data, size);
+    }
+    hash = fnv_hash(hash, data, LLAMA_REPACK_CACHE_SAMPLE_SIZE);
+    hash = fnv_hash(hash, data + size/2, LLAMA_REPACK_CACHE_SAMPLE_SIZE);
+    hash = fnv_hash(hash, data + size - LLAMA_REPACK_CACHE_SAMPLE_SIZE, LLAMA_REPACK_CACHE_SAMPLE_SIZE);
+    return hash;
+}
+
+ggml_backend_buffer_t llama_repack_cache::load(ggml_context * ctx, llama_mmaps & mappings, llama_mlocks * mlocks) {
+    GGML_ASSERT(supported());
+
+    src_hashes.clear();
+    for (ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != nullptr; cur = ggml_get_next_tensor(ctx, cur)) {
+        if (ml.get_weight(ggml_get_name(cur)) == nullptr) {
+            LLAMA_LOG_WARN("%s: tensor '%s' is not in the model files, not using the repack cache\n", __func__, ggml_get_name(cur));
+            return nullptr;
+        }
+        src_hashes[ggml_get_name(cur)] = src_hash(cur);
+    }
+
+    {
+        FILE * f = fopen(path.c_str(), "rb");
+        if (f == nullptr) {
+            LLAMA_LOG_INFO("%s: repack cache '%s' does not exist yet\n", __func__, path.c_str());
+            return nullptr;
+        }
+        fclose(f);
+    }
+
+    gguf_init_params params = {
+        /*.no_alloc = */ true,
+        /*.ctx      = */ nullptr,
+    };
+    gguf_context_ptr meta(gguf_init_from_file(path.c_str(), params));
+    if (!meta) {
+        LLAMA_LOG_WARN("%s: failed to read the repack cache '%s'\n", __func__, path.c_str());
+        return nullptr;
+    }
+
+    const int64_t kid_version    = gguf_find_key(meta.get(), LLAMA_REPACK_CACHE_KV_VERSION);
+    const int64_t kid_model_hash = gguf_find_key(meta.get(), LLAMA_REPACK_CACHE_KV_MODEL_HASH);
+    const int64_t kid_layouts    = gguf_find_key(meta.get(), LLAMA_REPACK_CACHE_KV_LAYOUTS);
+    const int64_t kid_src_hashes = gguf_find_key(meta.get(), LLAMA_REPACK_CACHE_KV_SRC_HASHES);
+
+    if (kid_version < 0 || kid_model_hash < 0 || kid_layouts < 0 || kid_src_hashes < 0 ||
+        gguf_get_kv_type (meta.get(), kid_version)    != GGUF_TYPE_UINT32 ||
+        gguf_get_kv_type (meta.get(), kid_model_hash) != GGUF_TYPE_UINT64 ||
+        gguf_get_kv_type (meta.get(), kid_layouts)    != GGUF_TYPE_ARRAY  ||
+        gguf_get_kv_type (meta.get(), kid_src_hashes) != GGUF_TYPE_ARRAY  ||
+        gguf_get_arr_type(meta.get(), kid_layouts)    != GGUF_TYPE_STRING ||
+        gguf_get_arr_type(meta.get(), kid_src_hashes) != GGUF_TYPE_UINT64 ||
+        gguf_get_arr_n   (meta.get(), kid_layouts)    != (size_t) gguf_get_n_tensors(meta.get()) ||
+        gguf_get_arr_n   (meta.get(), kid_src_hashes) != (size_t) gguf_get_n_tensors(meta.get())) {
+        LLAMA_LOG_WARN("%s: '%s' is not a repack cache\n", __func__, path.c_str());
+        return nullptr;
+    }
+
+    if (gguf_get_val_u32(meta.get(), kid_version) != LLAMA_REPACK_CACHE_VERSION ||
+        gguf_get_val_u64(meta.get(), kid_model_hash) != model_hash) {
+        LLAMA_LOG_INFO("%s: repack cache '%s' was written for another model, ignoring it\n", __func__, path.c_str());
+        return nullptr;
+    }
+
+    const uint64_t * cached_src_hashes = (const uint64_t *) gguf_get_arr_data(meta.get(), kid_src_hashes);
+
+    std::vector<std::pair<ggml_tensor *, size_t>> offsets;
+    for (ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != nullptr; cur = ggml_get_next_tensor(ctx, cur)) {
+        const int64_t tid = gguf_find_tensor(meta.get(), ggml_get_name(cur));
+        const char * layout = tensor_layout(cur);
+        if (tid < 0 || layout == nullptr ||
+            gguf_get_tensor_type(meta.get(), tid) != cur->type ||
+            gguf_get_tensor_size(meta.get(), tid) != ggml_nbytes(cur) ||
+            strcmp(gguf_get_arr_str(meta.get(), kid_layouts, tid), layout) != 0 ||
+            cached_src_hashes[tid] != src_hashes.at(ggml_get_name(cur))) {
+            LLAMA_LOG_INFO("%s: repack cache '%s' is stale for tensor '%s', ignoring it\n", __func__, path.c_str(), ggml_get_name(cur));
+            return nullptr;
+        }
+        offsets.emplace_back(cur, gguf_get_tensor_offset(meta.get(), tid));
+    }
+
+    std::unique_ptr<llama_mmap> mapping;
+    try {
+        llama_file file(path.c_str(), "rb");
+        mapping.reset(new llama_mmap(&file));
+    } catch (const std::exception & err) {
+        LLAMA_LOG_WARN("%s: failed to map the repack cache '%s': %s\n", __func__, path.c_str(), err.what());
+        return nullptr;
+    }
+
+    const size_t data_offset = gguf_get_data_offset(meta.get());
+    if (data_offset > mapping->size()) {
+        LLAMA_LOG_WARN("%s: repack cache '%s' is truncated\n", __func__, path.c_str());
+        return nullptr;
+    }
+    for (const auto & it : offsets) {
+        if (data_offset + it.second + ggml_nbytes(it.first) > mapping->size()) {
+            LLAMA_LOG_WARN("%s: repack cache '%s' is truncated\n", __func__, path.c_str());
+            return nullptr;
+        }
+    }
+
+    uint8_t * base = (uint8_t *) mapping->addr() + data_offset;
+
+    ggml_backend_buffer_t buf = buffer_from_ptr(base, mapping->size() - data_offset);
+    if (buf == nullptr) {
+        return nullptr;
+    }
+
+    for (const auto & it : offsets) {
+        ggml_backend_tensor_alloc(buf, it.first, base + it.second);
+    }
+
+    if (mlocks) {
+        mlocks->emplace_back(new llama_mlock);
+        mlocks->back()->init(mapping->addr());
+        mlocks->back()->grow_to(mapping->size());
+    }
+
+    LLAMA_LOG_INFO("%s: mapped %zu repacked tensors (%.2f MiB) from '%s'\n", __func__,
+            offsets.size(), ggml_backend_buffer_get_size(buf)/1024.0/1024.0, path.c_str());
+
+    mappings.emplace_back(std::move(mapping));
+
+    return buf;
+}
+
+static void write_zeros(std::ofstream & fout, size_t n) {
+    static const char zeros[64] = { 0 };
+    while (n > 0) {
+        const size_t n_cur = std::min(n, sizeof(zeros));
+        fout.write(zeros, n_cur);
+        n -= n_cur;
+    }
+}
+
+void llama_repack_cache::save(ggml_context * ctx) const {
+    GGML_ASSERT(supported());
+
+    gguf_context_ptr meta(gguf_init_empty());
+
+    std::vector<const char *> layouts;
+    std::vector<uint64_t>     hashes;
+    for (ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != nullptr; cur = ggml_get_next_tensor(ctx, cur)) {
+        const char * layout = tensor_layout(cur);
+        const auto   it     = src_hashes.find(ggml_get_name(cur));
+        if (layout == nullptr || it == src_hashes.end() || cur->data == nullptr) {
+            LLAMA_LOG_WARN("%s: tensor '%s' is not repacked, not writing the repack cache\n", __func__, ggml_get_name(cur));
+            return;
+        }
+        gguf_add_tensor(meta.get(), cur);
+        layouts.push_back(layout);
+        hashes.push_back(it->second);
+    }
+
+    gguf_set_val_u32(meta.get(), LLAMA_REPACK_CACHE_KV_VERSION,    LLAMA_REPACK_CACHE_VERSION);
+    gguf_set_val_u64(meta.get(), LLAMA_REPACK_CACHE_KV_MODEL_HASH, model_hash);
+    gguf_set_arr_str(meta.get(), LLAMA_REPACK_CACHE_KV_LAYOUTS,    layouts.data(), layouts.size());
+    gguf_set_arr_data(meta.get(), LLAMA_REPACK_CACHE_KV_SRC_HASHES, GGUF_TYPE_UINT64, hashes.data(), hashes.size());
+
+    // write to a temporary file first so that concurrent loads never see a partial cache
+    const std::string path_tmp = path + format(".tmp.%" PRId64, ggml_time_us());
+
+    const int64_t t_start_us = ggml_time_us();
+
+    try {
+        std::ofstream fout(path_tmp, std::ios::binary);
+        fout.exceptions(std::ofstream::failbit);
+
+        std::vector<uint8_t> data(gguf_get_meta_size(meta.get()));
+        gguf_get_meta_data(meta.get(), data.data());
+        fout.write((const char *) data.data(), data.size());
+
+        const size_t align = gguf_get_alignment(meta.get());
+        for (ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != nullptr; cur = ggml_get_next_tensor(ctx, cur)) {
+            const size_t size = ggml_nbytes(cur);
+            fout.write((const char *) cur->data, size);
+            write_zeros(fout, GGML_PAD(size, align) - size);
+        }
+        fout.close();
+    } catch (const std::exception & err) {
+        LLAMA_LOG_WARN("%s: failed to write the repack cache '%s': %s\n", __func__, path.c_str(), err.what());
+        std::remove(path_tmp.c_str());
+        return;
+    }
+
+    if (std::rename(path_tmp.c_str(), path.c_str()) != 0) {
+        // rename does not replace an existing file on Windows
+        std::remove(path.c_str());
+        if (std::rename(path_tmp.c_str(), path.c_str()) != 0) {
+            LLAMA_LOG_WARN("%s: failed to rename '%s' to '%s'\n", __func__, path_tmp.c_str(), path.c_str());
+            std::remove(path_tmp.c_str());
+            return;
+        }
+    }
+
+    LLAMA_LOG_INFO("%s: wrote %zu repacked tensors to '%s' in %.2f s\n", __func__,
+            hashes.size(), path.c_str(), (ggml_time_us() - t_start_us)/1e6);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "llama-mmap.h"
+
+#include "ggml-backend.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+struct llama_model_loader;
+
+//
+// llama_repack_cache - on-disk cache of the weights repacked by the CPU_REPACK buffer type
+//
+// The cache is a GGUF file with the repacked data of the tensors, stored with the names, types and shapes of
+// the model tensors. It is keyed by a hash of the tensor infos of the model files and, per tensor, by the
+// repack layout and a hash of samples of the source data, so a cache written for another model, another
+// quantization of the same model or a CPU that selects other layouts is not used.
+//
+// On a hit the file is mapped and the tensors are allocated in a CPU_REPACK buffer over the mapping: nothing
+// is repacked, the pages are shared with the other processes using the same cache and the source data of the
+// repacked tensors is never read. On a miss the weights are repacked as usual and the cache is written.
+//
+
+struct llama_repack_cache {
+    // buft is the CPU_REPACK buffer type, the model must be mapped
+    llama_repack_cache(std::string path, const llama_model_loader & ml, ggml_backend_buffer_type_t buft);
+
+    // false if the CPU backend does not support reading back the repacked layouts
+    bool supported() const;
+
+    // allocate the tensors of ctx in a buffer over the mapped cache, the mapping is added to mappings
+    // returns nullptr if the cache is missing or stale for any of the tensors
+    ggml_backend_buffer_t load(ggml_context * ctx, llama_mmaps & mappings, llama_mlocks * mlocks);
+
+    // write the repacked data of the tensors of ctx once they are loaded
+    // load() must have been called first, it hashes the source data before the model is unmapped
+    void save(ggml_context * ctx) const;
+
+private:
+    typedef ggml_backend_buffer_t (*buffer_from_ptr_t)(void * ptr, size_t size);
+    typedef const char *          (*tensor_layout_t)  (const struct ggml_tensor * tensor);
+
+    uint64_t src_hash(const ggml_tensor * cur) const;
+
+    const std::string          path;
+    const llama_model_loader & ml;
+
+    buffer_from_ptr_t buffer_from_ptr = nullptr;
+    tensor_layout_t   tensor_layout   = nullptr;
+
+    uint64_t model_hash = 0;
+
+    std::map<std::string, uint64_t> src_hashes;
+};
@@ -1,5 +1,7 @@
 #include "llama-resource-instrumentation.h"
 #include "ggml.h"
+#include "ggml-cpu.h"
+#include "llama-metrics.h"
 
 #include <algorithm>
 #include <numeric>
@@ -11,6 +13,7 @@
 #include <iomanip>
 #include <sstream>
 #include <iostream>
+#include <cstring>
 
 // Global resource instrumentation instance
 std::unique_ptr<llama_resource_instrumentation> g_resource_instr = nullptr;
@@ -40,9 +43,7 @@ std::string llama_memory_resource::to_json() const {
     }
     
     ss << "],\"precision\":\"" << ggml_type_name(precision) << "\""
-       << ",\"estimated_bandwidth_gbps\":" << std::fixed << std::setprecision(1) 
-       << estimated_bandwidth_gbps
-       << ",\"compression_ratio\":" << compression_ratio
+       << ",\"compression_ratio\":" << std::fixed << std::setprecision(1) << compression_ratio
        << ",\"memory_address\":\"" << memory_address << "\"}";
     
     return ss.str();
@@ -74,7 +75,7 @@ std::string llama_compute_resource::to_json() const {
     
     ss << "],\"compute_intensity_gflops\":" << std::fixed << std::setprecision(2) 
        << compute_intensity_gflops
-       << ",\"estimated_duration_us\":" << estimated_duration_us
+       << ",\"measured_duration_us\":" << measured_duration_us
        << ",\"parallelism_factor\":" << parallelism_factor
        << ",\"memory_throughput_gbps\":" << std::fixed << std::setprecision(1) 
        << memory_throughput_gbps
@@ -167,10 +168,11 @@ llama_resource_instrumentation::llama_resource_instrumentation(
     , session_id_(generate_session_id())
     , current_layer_id_(-1)
     , current_component_("")
+    , timing_enabled_(true)
 {
     try {
-        log_file_ = std::make_unique<std::ofstream>(log_file_path_, std::ios::app);
-        if (!log_file_->is_open()) {
+        sink_ = std::make_unique<llama_instr_sink>(log_file_path_);
+        if (!sink_->is_open()) {
             throw std::runtime_error("Failed to open resource log file: " + log_file_path_);
         }
         
@@ -191,15 +193,16 @@ llama_resource_instrumentation::llama_resource_instrumentation(
 }
 
 llama_resource_instrumentation::~llama_resource_instrumentation() {
-    if (enabled_ && log_file_ && log_file_->is_open()) {
+    if (enabled_ && sink_ && sink_->is_open()) {
         std::stringstream entry;
         entry << "{\"event\":\"resource_session_end\""
               << ",\"timestamp\":\"" << get_current_timestamp() << "\""
               << ",\"session_id\":\"" << session_id_ << "\"}";
         write_log_entry(entry.str());
-        
-        log_file_->close();
     }
+    
+    // the sink drains all queued entries before closing the file
+    sink_.reset();
 }
 
 void llama_resource_instrumentation::enable() {
@@ -211,11 +214,25 @@ void llama_resource_instrumentation::disable() {
 }
 
 void llama_resource_instrumentation::flush() {
-    if (log_file_ && log_file_->is_open()) {
-        log_file_->flush();
+    if (sink_) {
+        sink_->flush();
+    }
+}
+
+void llama_resource_instrumentation::set_overflow_policy(llama_instr_overflow overflow) {
+    if (sink_) {
+        sink_->set_overflow(overflow);
     }
 }
 
+uint64_t llama_resource_instrumentation::n_entries_written() const {
+    return sink_ ? sink_->n_written() : 0;
+}
+
+uint64_t llama_resource_instrumentation::n_entries_dropped() const {
+    return sink_ ? sink_->n_dropped() : 0;
+}
+
 void llama_resource_instrumentation::set_level(llama_resource_level level) {
     level_ = level;
 }
@@ -263,6 +280,8 @@ void llama_resource_instrumentation::end_session() {
           << ",\"component_flows\":" << component_flows_.size()
           << "}";
     write_log_entry(entry.str());
+    
+    log_timing_summary();
 }
 
 void llama_resource_instrumentation::begin_layer(int layer_id) {
@@ -373,7 +392,6 @@ void llama_resource_instrumentation::log_memory_allocation(
     resource.resource_id = generate_resource_id("memory", component_type);
     resource.allocation_size_bytes = ggml_nbytes(tensor);
     resource.precision = tensor->type;
-    resource.estimated_bandwidth_gbps = estimate_memory_bandwidth(tensor, "allocation");
     resource.compression_ratio = get_compression_ratio(tensor);
     resource.memory_address = tensor->data;
     resource.alloc_time = std::chrono::high_resolution_clock::now();
@@ -433,14 +451,21 @@ void llama_resource_instrumentation::log_compute_operation(
         }
     }
     
-    // Compute resource estimates
     const ggml_tensor* primary_input = inputs[0];
-    const ggml_tensor* secondary_input = inputs.size() > 1 ? inputs[1] : nullptr;
     
-    resource.compute_intensity_gflops = estimate_compute_gflops(operation, primary_input, secondary_input);
-    resource.estimated_duration_us = estimate_operation_duration(operation, resource.compute_intensity_gflops);
+    // the operation is logged while the graph is built - use what has been measured for this op type so far
+    resource.compute_intensity_gflops = output ? node_flops(output) / 1e9 : 0.0;
+    resource.measured_duration_us = 0;
+    resource.memory_throughput_gbps = 0.0;
+    if (output) {
+        std::lock_guard<std::mutex> timing_lock(timing_mutex_);
+        auto it = op_timings_.find(ggml_op_desc(output));
+        if (it != op_timings_.end() && it->second.n_nodes > 0) {
+            resource.measured_duration_us = it->second.t_wall_ns / it->second.n_nodes / 1000;
+            resource.memory_throughput_gbps = it->second.gbps();
+        }
+    }
     resource.parallelism_factor = estimate_parallelism_factor(primary_input);
-    resource.memory_throughput_gbps = estimate_memory_bandwidth(primary_input, operation);
     
     // Estimate SM utilization based on operation and tensor size
     size_t total_elements = ggml_nelements(primary_input);
@@ -576,94 +601,41 @@ void llama_resource_instrumentation::log_kv_cache_operation(
 // ESTIMATION ALGORITHMS
 // ============================================================================
 
-double llama_resource_instrumentation::estimate_memory_bandwidth(
-    const ggml_tensor* tensor, const std::string& operation) {
-    if (!tensor) return 0.0;
-    
-    size_t tensor_bytes = ggml_nbytes(tensor);
-    double base_bandwidth = 0.0;
-    
-    // Different operations have different memory access patterns
-    if (operation == "matrix_load" || operation == "weight_load" || operation == "allocation") {
-        base_bandwidth = 400.0;  // GPU memory bandwidth (GB/s) for weight loading
-    } else if (operation.find("mul_mat") != std::string::npos || operation == "gemm") {
-        base_bandwidth = 600.0;  // Higher bandwidth for compute-intensive ops
-    } else if (operation.find("gelu") != std::string::npos || operation.find("silu") != std::string::npos) {
-        base_bandwidth = 300.0;  // Activation functions are memory-bound
-    } else if (operation.find("cache") != std::string::npos) {
-        base_bandwidth = 800.0;  // Cache access is typically faster
-    } else if (operation == "softmax" || operation.find("norm") != std::string::npos) {
-        base_bandwidth = 350.0;  // Memory-intensive operations
-    } else {
-        base_bandwidth = 450.0;  // Default bandwidth
-    }
-    
-    // Scale by tensor size and quantization
-    double compression_factor = get_compression_ratio(tensor);
-    double size_factor = std::min(1.0, std::max(0.5, tensor_bytes / (100.0 * 1024.0 * 1024.0))); // 100MB scaling
-    
-    return base_bandwidth * compression_factor * size_factor;
-}
-
-double llama_resource_instrumentation::estimate_compute_gflops(
-    const std::string& operation, const ggml_tensor* a, const ggml_tensor* b) {
-    if (!a) return 0.0;
-    
-    size_t elements_a = ggml_nelements(a);
-    
-    if ((operation.find("mul_mat") != std::string::npos || operation == "gemm") && b) {
-        // GEMM: 2 * M * N * K operations
-        int64_t m = a->ne[0];
-        int64_t k = a->ne[1];
-        int64_t n = b ? b->ne[1] : k;
-        return (2.0 * m * n * k) / 1e9;
-    } else if (operation == "softmax") {
-        // Softmax: ~3 ops per element (exp + sum + divide)
-        return (3.0 * elements_a) / 1e9;
-    } else if (operation.find("silu") != std::string::npos) {
-        // SiLU: x * sigmoid(x) = x / (1 + exp(-x)) ~5 ops per element
-        return (5.0 * elements_a) / 1e9;
-    } else if (operation.find("gelu") != std::string::npos) {
-        // GELU: 0.5 * x * (1 + tanh(...)) ~8 ops per element
-        return (8.0 * elements_a) / 1e9;
-    } else if (operation.find("norm") != std::string::npos) {
-        // Layer norm: ~5 ops per element (mean, var, norm)
-        return (5.0 * elements_a) / 1e9;
-    } else if (operation == "add") {
-        // Element-wise addition: 1 op per element
-        return elements_a / 1e9;
-    } else if (operation == "mul") {
-        // Element-wise multiplication: 1 op per element
-        return elements_a / 1e9;
-    }
-    
-    return 0.0;
-}
-
-uint64_t llama_resource_instrumentation::estimate_operation_duration(
-    const std::string& operation, double gflops) {
-    // Assume GPU compute capability (TFLOPS)
-    double gpu_tflops = 150.0;  // Example: H100 has ~165 TFLOPS for mixed precision
-    double efficiency = 0.7;    // Realistic efficiency factor
-    
-    // Base duration in microseconds
-    uint64_t base_duration_us = static_cast<uint64_t>((gflops * 1000.0) / (gpu_tflops * efficiency));
-    
-    // Add operation-specific overhead
-    uint64_t overhead_us = 0;
-    if (operation.find("mul_mat") != std::string::npos || operation == "gemm") {
-        overhead_us = 50;  // Matrix operations have setup overhead
-    } else if (operation.find("cache") != std::string::npos) {
-        overhead_us = 20;  // Cache operations are faster
-    } else if (operation == "softmax" || operation.find("norm") != std::string::npos) {
-        overhead_us = 30;  // Memory-bound operations
-    } else if (operation.find("gelu") != std::string::npos || operation.find("silu") != std::string::npos) {
-        overhead_us = 25;  // Activation function overhead
-    } else {
-        overhead_us = 35;  // Default overhead
+// floating point operations of a graph node, derived from its shape
+double llama_resource_instrumentation::node_flops(const ggml_tensor* node) {
+    if (!node) return 0.0;
+    
+    switch (node->op) {
+        case GGML_OP_NONE:
+        case GGML_OP_RESHAPE:
+        case GGML_OP_VIEW:
+        case GGML_OP_PERMUTE:
+        case GGML_OP_TRANSPOSE:
+        case GGML_OP_GET_ROWS:
+        case GGML_OP_CPY:
+        case GGML_OP_CONT:
+        case GGML_OP_SET_ROWS:
+            return 0.0;
+        case GGML_OP_MUL_MAT:
+        case GGML_OP_MUL_MAT_ID:
+            // every output element is a dot product over the rows of src0
+            return 2.0 * node->src[0]->ne[0] * ggml_nelements(node);
+        case GGML_OP_FLASH_ATTN_EXT:
+            {
+                // Q*K^T and softmax(QK)*V for every query, key and head
+                const ggml_tensor* q = node->src[0];
+                const ggml_tensor* k = node->src[1];
+                const ggml_tensor* v = node->src[2];
+                return 2.0 * q->ne[1] * q->ne[2] * q->ne[3] * k->ne[1] * (q->ne[0] + v->ne[0]);
+            }
+        case GGML_OP_SOFT_MAX:
+            return 3.0 * ggml_nelements(node);  // exp + sum + divide
+        case GGML_OP_RMS_NORM:
+        case GGML_OP_NORM:
+            return 3.0 * ggml_nelements(node);
+        default:
+            return (double) ggml_nelements(node);
     }
-    
-    return std::max(static_cast<uint64_t>(10), base_duration_us + overhead_us);  // Minimum 10μs
 }
 
 int llama_resource_instrumentation::estimate_parallelism_factor(const ggml_tensor* tensor) {
@@ -699,6 +671,195 @@ double llama_resource_instrumentation::get_compression_ratio(const ggml_tensor*
     }
 }
 
+// ============================================================================
+// MEASURED NODE TIMING
+// ============================================================================
+
+void llama_op_timing::add(const llama_op_timing& other) {
+    n_nodes   += other.n_nodes;
+    t_wall_ns += other.t_wall_ns;
+    t_busy_ns += other.t_busy_ns;
+    nbytes    += other.nbytes;
+    flops     += other.flops;
+}
+
+double llama_op_timing::gbps() const {
+    return t_wall_ns > 0 ? nbytes / (double) t_wall_ns : 0.0;
+}
+
+double llama_op_timing::gflops_per_s() const {
+    return t_wall_ns > 0 ? flops / (double) t_wall_ns : 0.0;
+}
+
+double llama_op_timing::arithmetic_intensity() const {
+    return nbytes > 0 ? flops / (double) nbytes : 0.0;
+}
+
+std::string llama_op_timing::to_json() const {
+    std::stringstream ss;
+    ss << "{\"n_nodes\":" << n_nodes
+       << ",\"wall_us\":" << std::fixed << std::setprecision(1) << t_wall_ns / 1000.0
+       << ",\"busy_us\":" << std::fixed << std::setprecision(1) << t_busy_ns / 1000.0
+       << ",\"bytes_mb\":" << std::fixed << std::setprecision(2) << nbytes / (1024.0 * 1024.0)
+       << ",\"gflop\":" << std::fixed << std::setprecision(3) << flops / 1e9
+       << ",\"gbps\":" << std::fixed << std::setprecision(2) << gbps()
+       << ",\"gflops\":" << std::fixed << std::setprecision(2) << gflops_per_s()
+       << ",\"flop_per_byte\":" << std::fixed << std::setprecision(2) << arithmetic_intensity()
+       << "}";
+    return ss.str();
+}
+
+void llama_resource_instrumentation::set_timing(bool enabled) {
+    timing_enabled_ = enabled;
+}
+
+void llama_resource_instrumentation::timing_callback(
+    const ggml_cgraph* cgraph, const ggml_cpu_node_timing* timing, void* user_data) {
+    auto* instr = static_cast<llama_resource_instrumentation*>(user_data);
+    instr->record_graph_timing(cgraph, timing);
+}
+
+// layer id from the node name set by the graph callback ("name-il", optionally followed by " (view)" etc.)
+static int llama_node_layer(const char* name, std::string& base) {
+    base = name;
+    
+    const size_t suffix = base.find(" (");
+    if (suffix != std::string::npos) {
+        base.resize(suffix);
+    }
+    
+    const size_t dash = base.rfind('-');
+    if (dash == std::string::npos || dash + 1 == base.size() ||
+        base.find_first_not_of("0123456789", dash + 1) != std::string::npos) {
+        return -1;
+    }
+    
+    const int il = atoi(base.c_str() + dash + 1);
+    base.resize(dash);
+    return il;
+}
+
+static const char* llama_node_component(const std::string& base) {
+    if (base.compare(0, 3, "ffn") == 0) {
+        return "feed_forward";
+    }
+    if (base == "l_out" || base.compare(0, 4, "norm") == 0) {
+        return "other";
+    }
+    return "attention";
+}
+
+// wall time per component, exported through llama_metrics() for the /metrics endpoints
+static llama_metric_counter* llama_component_seconds(const char* component) {
+    static llama_metric_counter* const attention    = llama_metrics().counter("llamacpp:component_seconds_total",
+        "Wall time spent computing graph nodes, by model component.", "component=\"attention\"");
+    static llama_metric_counter* const feed_forward = llama_metrics().counter("llamacpp:component_seconds_total",
+        "Wall time spent computing graph nodes, by model component.", "component=\"feed_forward\"");
+    static llama_metric_counter* const other        = llama_metrics().counter("llamacpp:component_seconds_total",
+        "Wall time spent computing graph nodes, by model component.", "component=\"other\"");
+    
+    if (strcmp(component, "attention") == 0) {
+        return attention;
+    }
+    if (strcmp(component, "feed_forward") == 0) {
+        return feed_forward;
+    }
+    return other;
+}
+
+void llama_resource_instrumentation::record_graph_timing(
+    const ggml_cgraph* cgraph, const ggml_cpu_node_timing* timing) {
+    if (!collects_timing()) return;
+    
+    // unnamed nodes (ggml names them "node_<i>") belong to the layer/component of the last named node before them
+    // (graph order is topological)
+    int         layer     = -1;
+    const char* component = "other";
+    std::string base;
+    
+    std::map<const char*, int64_t> component_ns;
+    
+    std::lock_guard<std::mutex> lock(timing_mutex_);
+    
+    const int n_nodes = ggml_graph_n_nodes(const_cast<ggml_cgraph*>(cgraph));
+    for (int i = 0; i < n_nodes; i++) {
+        const ggml_tensor* node = ggml_graph_node(const_cast<ggml_cgraph*>(cgraph), i);
+        
+        if (node->name[0] != '\0' && strncmp(node->name, "node_", 5) != 0) {
+            layer     = llama_node_layer(node->name, base);
+            component = layer >= 0 ? llama_node_component(base) : "other";
+        }
+        
+        llama_op_timing t;
+        t.n_nodes   = 1;
+        t.t_wall_ns = timing[i].t_wall_ns;
+        t.t_busy_ns = timing[i].t_busy_ns;
+        t.nbytes    = timing[i].nbytes;
+        t.flops     = node_flops(node);
+        
+        op_timings_[ggml_op_desc(node)].add(t);
+        layer_timings_[layer][component].add(t);
+        component_ns[component] += t.t_wall_ns;
+    }
+    
+    for (const auto& [c, t_ns] : component_ns) {
+        llama_component_seconds(c)->add(1e-9*t_ns);
+    }
+}
+
+std::map<std::string, llama_op_timing> llama_resource_instrumentation::get_op_timings() {
+    std::lock_guard<std::mutex> lock(timing_mutex_);
+    return op_timings_;
+}
+
+std::map<int, std::map<std::string, llama_op_timing>> llama_resource_instrumentation::get_layer_timings() {
+    std::lock_guard<std::mutex> lock(timing_mutex_);
+    return layer_timings_;
+}
+
+void llama_resource_instrumentation::reset_timings() {
+    std::lock_guard<std::mutex> lock(timing_mutex_);
+    op_timings_.clear();
+    layer_timings_.clear();
+}
+
+void llama_resource_instrumentation::log_timing_summary() {
+    if (!enabled_) return;
+    
+    const auto op_timings    = get_op_timings();
+    const auto layer_timings = get_layer_timings();
+    
+    for (const auto& [op, t] : op_timings) {
+        std::stringstream entry;
+        entry << "{\"event\":\"op_timing\""
+              << ",\"timestamp\":\"" << get_current_timestamp() << "\""
+              << ",\"operation\":\"" << op << "\""
+              << ",\"timing\":" << t.to_json()
+              << ",\"session_id\":\"" << session_id_ << "\"}";
+        write_log_entry(entry.str());
+    }
+    
+    for (const auto& [layer, components] : layer_timings) {
+        llama_op_timing total;
+        
+        std::stringstream entry;
+        entry << "{\"event\":\"layer_timing\""
+              << ",\"timestamp\":\"" << get_current_timestamp() << "\""
+              << ",\"layer_id\":" << layer
+              << ",\"components\":{";
+        bool first = true;
+        for (const auto& [component, t] : components) {
+            if (!first) entry << ",";
+            entry << "\"" << component << "\":" << t.to_json();
+            total.add(t);
+            first = false;
+        }
+        entry << "},\"timing\":" << total.to_json()
+              << ",\"session_id\":\"" << session_id_ << "\"}";
+        write_log_entry(entry.str());
+    }
+}
+
 // ============================================================================
 // UTILITY METHODS
 // ============================================================================
@@ -716,8 +877,8 @@ llama_resource_id llama_resource_instrumentation::generate_resource_id(
 }
 
 void llama_resource_instrumentation::write_log_entry(const std::string& entry) {
-    if (log_file_ && log_file_->is_open()) {
-        *log_file_ << entry << std::endl;
+    if (sink_) {
+        sink_->push(entry);
     }
 }
 
@@ -0,0 +1,218 @@
+// tests the BF16 x BF16 matrix multiplication of the CPU backend: llamafile_sgemm uses the AMX tiles when the backend
+// is built with AMX-BF16 and the shapes allow it, the AVX512-BF16 tinyBLAS kernel or ggml_vec_dot_bf16 otherwise
+// - the results are compared with the dot products of the BF16 type traits on the same BF16 values, for shapes with
+//   ragged M, N and K that take the AMX kernel or fall back to the other paths
+// - the tile configuration of the calling thread (used by the AMX INT8 kernels) must be the same after the
+//   multiplication, or released if there was none
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <cpuid.h>
+#include <immintrin.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define TEST_AMX_TILE
+
+#ifndef ARCH_REQ_XCOMP_PERM
+#define ARCH_REQ_XCOMP_PERM 0x1023
+#endif
+#ifndef XFEATURE_XTILEDATA
+#define XFEATURE_XTILEDATA  18
+#endif
+
+struct tile_config {
+    uint8_t  palette_id;
+    uint8_t  start_row;
+    uint8_t  reserved_0[14];
+    uint16_t colsb[16];
+    uint8_t  rows[16];
+};
+
+static bool tile_supported() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 24))) {
+        return false;
+    }
+    return syscall(SYS_arch_prctl, ARCH_REQ_XCOMP_PERM, XFEATURE_XTILEDATA) == 0;
+}
+
+__attribute__((target("amx-tile"))) static void tile_loadconfig(const tile_config * tc) {
+    _tile_loadconfig(tc);
+}
+
+__attribute__((target("amx-tile"))) static void tile_storeconfig(tile_config * tc) {
+    _tile_storeconfig(tc);
+}
+
+__attribute__((target("amx-tile"))) static void tile_release() {
+    _tile_release();
+}
+#endif
+
+struct test_case {
+    int64_t m;  // rows of the weights
+    int64_t n;  // columns of the activations
+    int64_t k;
+    int64_t nb; // batch
+};
+
+static void fill(std::vector<float> & data) {
+    for (auto & x : data) {
+        x = 2.0f*rand()/(float) RAND_MAX - 1.0f;
+    }
+}
+
+// NMSE of the mul_mat of the graph against the BF16 dot products of the type traits
+static double test_mul_mat(const test_case & tc, int n_threads) {
+    ggml_init_params params = {
+        /*.mem_size   =*/ 64*1024*1024,
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ false,
+    };
+    ggml_context * ctx = ggml_init(params);
+
+    const auto * traits = ggml_get_type_traits_cpu(GGML_TYPE_BF16);
+
+    ggml_tensor * w = ggml_new_tensor_3d(ctx, GGML_TYPE_BF16, tc.k, tc.m, tc.nb);
+    ggml_tensor * x = ggml_new_tensor_3d(ctx, GGML_TYPE_F32,  tc.k, tc.n, tc.nb);
+
+    std::vector<float> wf(ggml_nelements(w));
+    fill(wf);
+    traits->from_float(wf.data(), w->data, wf.size());
+
+    std::vector<float> xf(ggml_nelements(x));
+    fill(xf);
+    memcpy(x->data, xf.data(), ggml_nbytes(x));
+
+    // the activations are converted to BF16 by the mul_mat
+    std::vector<ggml_bf16_t> xb(xf.size());
+    traits->from_float(xf.data(), xb.data(), xf.size());
+
+    ggml_tensor * out = ggml_mul_mat(ctx, w, x);
+
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, out);
+
+    ggml_status status = ggml_graph_compute_with_ctx(ctx, gf, n_threads);
+    assert(status == GGML_STATUS_SUCCESS);
+
+    double err = 0.0;
+    double sum = 0.0;
+    for (int64_t b = 0; b < tc.nb; ++b) {
+        for (int64_t j = 0; j < tc.n; ++j) {
+            for (int64_t i = 0; i < tc.m; ++i) {
+                const ggml_bf16_t * wr = (const ggml_bf16_t *) w->data + (b*tc.m + i)*tc.k;
+                const ggml_bf16_t * xr = xb.data() + (b*tc.n + j)*tc.k;
+
+                float ref;
+                traits->vec_dot(tc.k, &ref, 0, wr, 0, xr, 0, 1);
+
+                const float res = ((const float *) out->data)[(b*tc.n + j)*tc.m + i];
+                assert(std::isfinite(res));
+
+                err += (res - ref)*(double) (res - ref);
+                sum += ref*(double) ref;
+            }
+        }
+    }
+
+    ggml_free(ctx);
+
+    return err/sum;
+}
+
+int main(int argc, char ** argv) {
+    const int n_threads = argc > 1 ? atoi(argv[1]) : 4;
+
+    srand(1234);
+
+    const bool amx = ggml_cpu_has_amx_bf16();
+
+    printf("AMX-BF16: %s\n", amx ? "yes" : "no");
+
+    const test_case cases[] = {
+        //   m    n    k  nb
+        {   32,  16,  32, 1 }, // one block of tiles
+        {   64,  48, 128, 1 }, // ragged block of activations
+        {   48,  17,  96, 1 }, // ragged M block (16 rows) and N
+        {  512, 100, 256, 2 }, // several jobs per thread, batch
+        {   50,  33, 128, 1 }, // M not a multiple of the tile rows
+        {   64,  33, 100, 1 }, // K not a multiple of the tile columns
+        {   64,   8, 128, 1 }, // fewer activations than a tile
+    };
+
+    int n_fail = 0;
+
+    for (int nth : { 1, n_threads }) {
+        for (const auto & tc : cases) {
+            const bool use_amx = amx && tc.m % 16 == 0 && tc.k % 32 == 0 && tc.n >= 16;
+
+            const double nmse = test_mul_mat(tc, nth);
+            // both accumulate the same BF16 products in F32, in a different order
+            const bool   ok   = nmse < 1e-10;
+
+            printf("m=%4lld n=%4lld k=%4lld nb=%lld nth=%d %-4s: nmse = %.3e %s\n", (long long) tc.m, (long long) tc.n,
+                    (long long) tc.k, (long long) tc.nb, nth, use_amx ? "amx" : "", nmse, ok ? "OK" : "FAIL");
+
+            n_fail += ok ? 0 : 1;
+        }
+    }
+
+#ifdef TEST_AMX_TILE
+    if (tile_supported()) {
+        const test_case tc = { 64, 48, 128, 1 };
+
+        // a configuration different from the one of the AMX-BF16 kernel
+        tile_config tc0 = {};
+        tc0.palette_id = 1;
+        for (int t = 0; t < 8; ++t) {
+            tc0.rows[t]  = 8;
+            tc0.colsb[t] = 16;
+        }
+        tile_loadconfig(&tc0);
+
+        test_mul_mat(tc, n_threads);
+
+        tile_config tc1 = {};
+        tile_storeconfig(&tc1);
+
+        const bool restored = memcmp(&tc0, &tc1, sizeof(tc0)) == 0;
+
+        // without a configuration, the tiles are released
+        tile_release();
+
+        test_mul_mat(tc, n_threads);
+
+        tile_storeconfig(&tc1);
+
+        const bool released = tc1.palette_id == 0;
+
+        printf("tile config: %s, %s\n", restored ? "restored" : "NOT RESTORED", released ? "released" : "NOT RELEASED");
+
+        n_fail += restored && released ? 0 : 1;
+    }
+#endif
+
+    if (n_fail > 0) {
+        printf("%d cases failed\n", n_fail);
+        return 1;
+    }
+
+    printf("OK\n");
+
+    return 0;
+}
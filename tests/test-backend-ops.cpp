@@ -282,6 +282,10 @@ static std::string var_to_str(ggml_scale_mode mode) {
     }
 }
 
+static std::string var_to_str(ggml_unary_op op) {
+    return ggml_unary_op_name(op);
+}
+
 #define VAR_TO_STR(x) (#x "=" + var_to_str(x))
 
 #define VARS_TO_STR1(a) VAR_TO_STR(a)
@@ -2912,6 +2916,82 @@ struct test_rms_norm_mul_add : public test_case {
     }
 };
 
+// GGML_OP_MUL_MAT + GGML_OP_ADD + GGML_OP_UNARY + GGML_OP_MUL or GGML_OP_GLU
+// the activations of a feed-forward layer, fused into the epilogue of the matrix multiplication by some backends
+struct test_mul_mat_epilogue : public test_case {
+    const ggml_type type_a;
+    const int64_t m;
+    const int64_t n;
+    const int64_t k;
+    const bool bias;
+    const ggml_unary_op act;
+    const bool gate; // multiply by a second projection
+    const bool glu;  // gated with GGML_OP_GLU instead of act + mul
+
+    std::string op_desc(ggml_tensor * t) override {
+        GGML_UNUSED(t);
+        return "MUL_MAT_EPILOGUE";
+    }
+
+    bool run_whole_graph() override { return true; }
+
+    std::string vars() override {
+        return VARS_TO_STR8(type_a, m, n, k, bias, act, gate, glu);
+    }
+
+    double max_nmse_err() override {
+        return 5e-4;
+    }
+
+    uint64_t op_flops(ggml_tensor * t) override {
+        GGML_UNUSED(t);
+        return 2 * m * n * k * (gate || glu ? 2 : 1);
+    }
+
+    test_mul_mat_epilogue(ggml_type type_a = GGML_TYPE_F32,
+            int64_t m = 32, int64_t n = 10, int64_t k = 64,
+            bool bias = true, ggml_unary_op act = GGML_UNARY_OP_SILU, bool gate = false, bool glu = false)
+        : type_a(type_a), m(m), n(n), k(k), bias(bias), act(act), gate(gate), glu(glu) {}
+
+    ggml_tensor * build_graph(ggml_context * ctx) override {
+        ggml_tensor * a = ggml_new_tensor_2d(ctx, type_a, k, m);
+        ggml_tensor * b = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, k, n);
+        ggml_set_name(a, "a");
+        ggml_set_name(b, "b");
+
+        // the second projection comes first, so that it is not in between the nodes that can be fused
+        ggml_tensor * up = nullptr;
+        if (gate || glu) {
+            ggml_tensor * a_up = ggml_new_tensor_2d(ctx, type_a, k, m);
+            ggml_set_name(a_up, "a_up");
+
+            up = ggml_mul_mat(ctx, a_up, b);
+            ggml_set_name(up, "up");
+        }
+
+        ggml_tensor * out = ggml_mul_mat(ctx, a, b);
+
+        if (bias) {
+            ggml_tensor * c = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, m);
+            ggml_set_name(c, "c");
+
+            out = ggml_add(ctx, out, c);
+        }
+
+        if (glu) {
+            out = ggml_swiglu_split(ctx, out, up);
+        } else {
+            out = ggml_unary(ctx, out, act);
+            if (gate) {
+                out = ggml_mul(ctx, out, up);
+            }
+        }
+        ggml_set_name(out, "out");
+
+        return out;
+    }
+};
+
 // GGML_OP_SSM_CONV
 struct test_ssm_conv : public test_case {
     const ggml_type type;
@@ -5681,6 +5761,15 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
 
     test_cases.emplace_back(new test_l2_norm(GGML_TYPE_F32, {64, 5, 4, 3}, 1e-12f));
 
+    for (ggml_type type_a : {GGML_TYPE_F32, GGML_TYPE_F16, GGML_TYPE_Q4_0, GGML_TYPE_Q8_0}) {
+        for (int64_t n : {1, 7, 32}) {
+            test_cases.emplace_back(new test_mul_mat_epilogue(type_a, 96, n, 256, true,  GGML_UNARY_OP_GELU, false, false));
+            test_cases.emplace_back(new test_mul_mat_epilogue(type_a, 96, n, 256, false, GGML_UNARY_OP_SILU, true,  false));
+            test_cases.emplace_back(new test_mul_mat_epilogue(type_a, 96, n, 256, true,  GGML_UNARY_OP_RELU, true,  false));
+            test_cases.emplace_back(new test_mul_mat_epilogue(type_a, 96, n, 256, false, GGML_UNARY_OP_SILU, false, true));
+        }
+    }
+
     for (int64_t d_conv : {3, 4}) {
         for (int64_t d_inner: {1024, 1536, 2048}) {
             test_cases.emplace_back(new test_ssm_conv(GGML_TYPE_F32, {4, d_inner, 1, 1}, {d_conv, d_inner, 1, 1}));
@@ -6200,6 +6289,13 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_perf() {
         }
     }
 
+    for (int bs : {1, 512}) {
+        for (ggml_type type_a : {GGML_TYPE_F16, GGML_TYPE_Q4_0, GGML_TYPE_Q8_0}) {
+            test_cases.emplace_back(new test_mul_mat_epilogue(type_a, 14336, bs, 4096, false, GGML_UNARY_OP_SILU, false, true));
+            test_cases.emplace_back(new test_mul_mat_epilogue(type_a, 4096,  bs, 4096, true,  GGML_UNARY_OP_GELU, false, false));
+        }
+    }
+
     for (int K : {3, 5}) {
         for (int IC : {256, 2560}) {
             for (int IW_IH : {32, 64, 256}) {
@@ -6220,6 +6316,11 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_perf() {
         }
     }
 
+    // decode with a quantized KV cache
+    for (ggml_type type_KV : { GGML_TYPE_Q8_0, GGML_TYPE_Q5_0, GGML_TYPE_Q4_0, }) {
+        test_cases.emplace_back(new test_flash_attn_ext(128, 128, 8, {4, 1}, 8192, 1, true, false, 0, 0, GGML_PREC_F32, type_KV));
+    }
+
     test_cases.emplace_back(new test_conv_2d_dw({512, 512, 256, 1}, {3, 3, 1, 256}, 1, 1, 1, false));
     test_cases.emplace_back(new test_conv_2d_dw({512, 512, 256, 1}, {3, 3, 1, 256}, 1, 1, 1, true));
 
@@ -6248,6 +6349,143 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_perf() {
     return test_cases;
 }
 
+// The CPU backend is the reference for the other backends, but the weights in its extra buffer types (e.g. CPU_REPACK,
+// weights repacked for the gemm kernels of the CPU) are computed by separate kernels: compare them with the same weights
+// in a plain CPU buffer.
+static bool test_cpu_extra_bufts(ggml_backend_dev_t dev, const char * op_names_filter, const char * params_filter,
+                                 printer * output_printer) {
+    ggml_backend_reg_t reg = ggml_backend_dev_backend_reg(dev);
+    auto ggml_backend_dev_get_extra_bufts_fn = (ggml_backend_dev_get_extra_bufts_t)
+        ggml_backend_reg_get_proc_address(reg, "ggml_backend_dev_get_extra_bufts");
+    if (!ggml_backend_dev_get_extra_bufts_fn) {
+        return true;
+    }
+
+    const ggml_type types[] = {
+        GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_IQ4_NL,
+        GGML_TYPE_Q2_K, GGML_TYPE_Q3_K, GGML_TYPE_Q4_K, GGML_TYPE_Q5_K, GGML_TYPE_Q6_K,
+    };
+
+    // comma separated list of op names or full test names, as in test_case::matches_filter
+    auto matches_filter = [&](const std::string & name) {
+        if (op_names_filter == nullptr) {
+            return true;
+        }
+        std::string filter = std::string(",") + op_names_filter + ",";
+        return filter.find(",MUL_MAT,") != std::string::npos || filter.find("," + name + ",") != std::string::npos;
+    };
+
+    ggml_backend_t backend = ggml_backend_dev_init(dev, NULL);
+    GGML_ASSERT(backend != NULL);
+
+    auto ggml_backend_set_n_threads_fn = (ggml_backend_set_n_threads_t) ggml_backend_reg_get_proc_address(reg, "ggml_backend_set_n_threads");
+    if (ggml_backend_set_n_threads_fn) {
+        ggml_backend_set_n_threads_fn(backend, std::thread::hardware_concurrency());
+    }
+
+    size_t n_ok    = 0;
+    size_t n_tests = 0;
+
+    for (ggml_backend_buffer_type_t * extra_bufts = ggml_backend_dev_get_extra_bufts_fn(dev); extra_bufts && *extra_bufts; ++extra_bufts) {
+        ggml_backend_buffer_type_t buft = *extra_bufts;
+
+        for (ggml_type type : types) {
+            // n = 1 goes through the gemv kernels, multiples of 4 through the gemm kernels, and the rest through both
+            for (int64_t n : { 1, 4, 13, 32 }) {
+                const int64_t m = 16;
+                const int64_t k = 512;
+
+                const std::string vars = "type_a=" + std::string(ggml_type_name(type)) + ",m=" + std::to_string(m) +
+                                         ",n=" + std::to_string(n) + ",k=" + std::to_string(k);
+                const std::string name = "MUL_MAT(" + vars + ")";
+                if (!matches_filter(name) || (params_filter && !std::regex_search(vars, std::regex(params_filter)))) {
+                    continue;
+                }
+
+                ggml_init_params params = {
+                    /* .mem_size = */ ggml_tensor_overhead()*8 + ggml_graph_overhead(),
+                    /* .mem_base = */ NULL,
+                    /* .no_alloc = */ true,
+                };
+                ggml_context * ctx_w = ggml_init(params);
+                ggml_context * ctx   = ggml_init(params);
+
+                ggml_tensor * a = ggml_new_tensor_2d(ctx_w, type, k, m);
+
+                ggml_tensor * a_ref = ggml_new_tensor_2d(ctx, type, k, m);
+                ggml_tensor * b     = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, k, n);
+                ggml_tensor * out     = ggml_mul_mat(ctx, a, b);
+                ggml_tensor * out_ref = ggml_mul_mat(ctx, a_ref, b);
+
+                ggml_backend_buffer_t buf_w = ggml_backend_alloc_ctx_tensors_from_buft(ctx_w, buft);
+                ggml_backend_buffer_t buf   = ggml_backend_alloc_ctx_tensors(ctx, backend);
+                GGML_ASSERT(buf_w && buf);
+
+                if (!ggml_backend_supports_op(backend, out)) {
+                    output_printer->print_test_result(test_result(ggml_backend_buft_name(buft), "MUL_MAT", vars, "test",
+                                                                  false, false, "not supported"));
+                    ggml_backend_buffer_free(buf);
+                    ggml_backend_buffer_free(buf_w);
+                    ggml_free(ctx);
+                    ggml_free(ctx_w);
+                    continue;
+                }
+
+                init_tensor_uniform(b);
+
+                // the same quantized weights in both buffers
+                std::vector<float> data_f(k*m);
+                for (float & v : data_f) {
+                    v = 2.0f*rand()/RAND_MAX - 1.0f;
+                }
+                std::vector<uint8_t> data(ggml_nbytes(a_ref));
+                ggml_quantize_chunk(type, data_f.data(), data.data(), 0, m, k, nullptr);
+                ggml_backend_tensor_set(a_ref, data.data(), 0, data.size());
+                ggml_backend_tensor_set(a,     data.data(), 0, data.size());
+
+                ggml_cgraph * gf = ggml_new_graph(ctx);
+                ggml_build_forward_expand(gf, out);
+                ggml_build_forward_expand(gf, out_ref);
+
+                bool ok = ggml_backend_graph_compute(backend, gf) == GGML_STATUS_SUCCESS;
+
+                std::string error_msg = ok ? "" : "compute failed";
+                if (ok) {
+                    const std::vector<float> f     = tensor_to_float(out);
+                    const std::vector<float> f_ref = tensor_to_float(out_ref);
+
+                    const double max_err = 5e-4;
+                    const double err     = nmse(f_ref.data(), f.data(), f.size());
+                    if (!(err <= max_err)) {
+                        printf("[MUL_MAT] NMSE = %.9f > %.9f ", err, max_err);
+                        ok = false;
+                        error_msg = "test failed";
+                    }
+                }
+
+                output_printer->print_test_result(test_result(ggml_backend_buft_name(buft), "MUL_MAT", vars, "test",
+                                                              true, ok, error_msg));
+
+                n_tests++;
+                if (ok) {
+                    n_ok++;
+                }
+
+                ggml_backend_buffer_free(buf);
+                ggml_backend_buffer_free(buf_w);
+                ggml_free(ctx);
+                ggml_free(ctx_w);
+            }
+        }
+    }
+
+    output_printer->print_summary(test_summary_info(n_ok, n_tests, false));
+
+    ggml_backend_free(backend);
+
+    return n_ok == n_tests;
+}
+
 static bool test_backend(ggml_backend_t backend, test_mode mode, const char * op_names_filter, const char * params_filter,
                          printer * output_printer) {
     auto filter_test_cases = [](std::vector<std::unique_ptr<test_case>> & test_cases, const char * params_filter) {
@@ -6417,7 +6655,9 @@ int main(int argc, char ** argv) {
         if (backend_filter == NULL && ggml_backend_dev_type(dev) == GGML_BACKEND_DEVICE_TYPE_CPU && mode != MODE_GRAD) {
             output_printer->print_backend_init(backend_init_info(
                 i, ggml_backend_dev_count(), ggml_backend_dev_name(dev), true, "Skipping CPU backend"));
-            n_ok++;
+            if (mode != MODE_TEST || test_cpu_extra_bufts(dev, op_names_filter, params_filter, output_printer.get())) {
+                n_ok++;
+            }
             continue;
         }
 
@@ -6438,6 +6678,9 @@ int main(int argc, char ** argv) {
                                                              total / 1024 / 1024, free / 1024 / 1024, true));
 
         bool ok = test_backend(backend, mode, op_names_filter, params_filter, output_printer.get());
+        if (mode == MODE_TEST && ggml_backend_dev_type(dev) == GGML_BACKEND_DEVICE_TYPE_CPU) {
+            ok = test_cpu_extra_bufts(dev, op_names_filter, params_filter, output_printer.get()) && ok;
+        }
 
         if (ok) {
             n_ok++;
@@ -2,8 +2,13 @@
 #include "ggml-cpu.h"
 #include "ggml-backend.h"
 
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
 #include <chrono>
 #include <iostream>
+#include <thread>
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
@@ -11,10 +16,68 @@
 
 #define MAX_NARGS 2
 
+static uint64_t wake_total(const struct ggml_threadpool_wake_stats & wake) {
+    uint64_t n = 0;
+    for (int i = 0; i < GGML_THREADPOOL_WAKE_HIST; i++) {
+        n += wake.hist[i];
+    }
+    return n;
+}
+
+// the workers of a pool are asleep when the graphs are computed far apart and the pool polls for less than the gap
+static void test_wake_sleep(struct ggml_cgraph * gf, int n_threads, enum ggml_threadpool_wait wait) {
+    const int n_graphs = 20;
+
+    struct ggml_threadpool_params tpp  = ggml_threadpool_params_default(n_threads);
+    tpp.poll = 0;
+
+    struct ggml_threadpool * threadpool = ggml_threadpool_new(&tpp);
+    assert(threadpool);
+
+    ggml_threadpool_set_wait(threadpool, wait);
+
+    struct ggml_cplan cplan = ggml_graph_plan(gf, n_threads, threadpool);
+    std::vector<uint8_t> work_data(cplan.work_size);
+    cplan.work_data = work_data.data();
+
+    // the adaptive wait learns the gap from the first graphs
+    for (int i = 0; i < 5; i++) {
+        ggml_graph_compute(gf, &cplan);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    ggml_threadpool_reset_wake_stats(threadpool);
+
+    for (int i = 0; i < n_graphs; i++) {
+        ggml_graph_compute(gf, &cplan);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    struct ggml_threadpool_wake_stats wake;
+    ggml_threadpool_get_wake_stats(threadpool, &wake);
+
+    std::cerr << "wake-ups with 20 ms gaps (" << (wait == GGML_THREADPOOL_WAIT_ADAPTIVE ? "adaptive" : "poll 0") << "): "
+              << wake.n_poll << " polling, " << wake.n_sleep << " sleeping\n";
+
+#ifndef GGML_USE_OPENMP
+    const uint64_t n_wake = (uint64_t) n_graphs*(n_threads - 1);
+
+    assert(wake.n_poll + wake.n_sleep == n_wake);
+    assert(wake_total(wake) == n_wake);
+    // a worker can still be on its way to sleep when the next graph starts
+    assert(wake.n_sleep >= n_wake*9/10);
+#else
+    assert(wake.n_poll == 0 && wake.n_sleep == 0 && wake_total(wake) == 0);
+#endif
+
+    ggml_threadpool_free(threadpool);
+}
+
 int main(int argc, char *argv[]) {
 
     int n_threads = 4;
     int n_rounds  = 100;
+    int wait      = GGML_THREADPOOL_WAIT_POLL;
 
     if (argc > 1) {
         n_threads = std::atoi(argv[1]);
@@ -24,6 +87,10 @@ int main(int argc, char *argv[]) {
         n_rounds  = std::atoi(argv[2]);
     }
 
+    if (argc > 3) {
+        wait      = std::atoi(argv[3]);
+    }
+
     struct ggml_init_params params = {
         /* .mem_size   = */ 1024*1024*1024,
         /* .mem_buffer = */ NULL,
@@ -56,6 +123,8 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
+    ggml_threadpool_set_wait(threadpool, (enum ggml_threadpool_wait) wait);
+
     // Create compute plan
     struct ggml_cplan cplan = ggml_graph_plan(gf, n_threads, threadpool);
 
@@ -66,12 +135,15 @@ int main(int argc, char *argv[]) {
               << "\n n_threads: " << n_threads
               << "\n   n_nodes: " << n_nodes
               << "\n  n_rounds: " << n_rounds
+              << "\n      wait: " << (wait == GGML_THREADPOOL_WAIT_ADAPTIVE ? "adaptive" : "poll")
               << "\n";
     // ggml_graph_print(gf);
 
     // Warmup
     ggml_graph_compute(gf, &cplan);
 
+    ggml_threadpool_reset_wake_stats(threadpool);
+
     auto t0 = std::chrono::high_resolution_clock::now();
 
     for (int i=0; i < n_rounds; i++) {
@@ -87,7 +159,45 @@ int main(int argc, char *argv[]) {
               << "\n " << (float) nsec / (n_rounds * n_nodes) << " nsec per-node"
               << "\n";
 
+    struct ggml_threadpool_wake_stats wake;
+    ggml_threadpool_get_wake_stats(threadpool, &wake);
+
+    std::cerr << "wake-ups: " << wake.n_poll << " polling, " << wake.n_sleep << " sleeping\n";
+    for (int i = 0; i < GGML_THREADPOOL_WAKE_HIST; i++) {
+        if (wake.hist[i] > 0) {
+            std::cerr << " >= " << (i == 0 ? 0 : 256ull << (i - 1)) << " ns: " << wake.hist[i] << "\n";
+        }
+    }
+
+#ifndef GGML_USE_OPENMP
+    // every worker wakes up once per graph, either polling or sleeping, and every wake-up is in the histogram
+    assert(wake.n_poll + wake.n_sleep == (uint64_t) n_rounds*(n_threads - 1));
+    assert(wake_total(wake) == wake.n_poll + wake.n_sleep);
+#else
+    // the OpenMP threads are not accounted
+    assert(wake.n_poll == 0 && wake.n_sleep == 0 && wake_total(wake) == 0);
+#endif
+
+    // one more round to measure the balance between the threads
+    std::vector<int64_t> busy(n_threads);
+    cplan.thread_busy_ns = busy.data();
+    ggml_graph_compute(gf, &cplan);
+
+    std::cerr << "busy time per thread (us):";
+    for (int i = 0; i < n_threads; i++) {
+        std::cerr << " " << busy[i]/1000;
+    }
+    std::cerr << "\n";
+
     ggml_threadpool_free(threadpool);
+
+    // a small graph, the sleep accounting does not depend on the work
+    struct ggml_cgraph * gf_small = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf_small, ggml_mul_mat(ctx, ggml_new_tensor_2d(ctx, GGML_TYPE_Q4_0, 64, 128), ggml_new_tensor_1d(ctx, GGML_TYPE_F32, 64)));
+
+    test_wake_sleep(gf_small, n_threads, GGML_THREADPOOL_WAIT_POLL);
+    test_wake_sleep(gf_small, n_threads, GGML_THREADPOOL_WAIT_ADAPTIVE);
+
     ggml_free(ctx);
 
     return 0;
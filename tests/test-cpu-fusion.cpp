@@ -0,0 +1,197 @@
+// compares the graphs that the CPU backend computes with fused nodes (the epilogue of MUL_MAT and RMS_NORM + MUL)
+// with the same graphs computed node by node: marking the intermediate nodes as outputs prevents the fusion
+// the test is also run with GGML_CPU_DISABLE_FUSION, then both graphs are computed node by node
+// the node timings of a fused group must be recorded on all its nodes
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+struct test_case {
+    const char * name;
+    ggml_type    type_w;
+    int64_t      m;  // rows of the weights
+    int64_t      k;  // columns of the weights
+    int64_t      n;  // columns of the activations
+    int64_t      nb; // batch of the activations
+    // builds the nodes following the first one from its result, the intermediate nodes are appended to inter
+    std::function<ggml_tensor * (ggml_context *, ggml_tensor *, std::vector<ggml_tensor *> &)> epilogue;
+    bool         rms_norm; // RMS_NORM of the activations instead of MUL_MAT
+};
+
+static void fill(ggml_tensor * t) {
+    std::vector<float> data(ggml_nelements(t));
+    for (auto & x : data) {
+        x = 2.0f*rand()/(float) RAND_MAX - 1.0f;
+    }
+    if (t->type == GGML_TYPE_F32) {
+        memcpy(t->data, data.data(), data.size()*sizeof(float));
+    } else {
+        ggml_get_type_traits_cpu(t->type)->from_float(data.data(), t->data, data.size());
+    }
+}
+
+// the result of the graph, fused or with all the intermediate nodes as outputs
+static std::vector<float> compute(const test_case & tc, bool fused, int n_threads) {
+    ggml_init_params params = {
+        /*.mem_size   =*/ 64*1024*1024,
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ false,
+    };
+    ggml_context * ctx = ggml_init(params);
+
+    // same inputs for both graphs
+    srand(1234);
+
+    ggml_tensor * x = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, tc.k, tc.n, tc.nb);
+    fill(x);
+
+    ggml_tensor * first;
+    if (tc.rms_norm) {
+        first = ggml_rms_norm(ctx, x, 1e-6f);
+    } else {
+        ggml_tensor * w = ggml_new_tensor_2d(ctx, tc.type_w, tc.k, tc.m);
+        fill(w);
+        first = ggml_mul_mat(ctx, w, x);
+    }
+
+    std::vector<ggml_tensor *> inter = { first };
+    ggml_tensor * out = tc.epilogue(ctx, first, inter);
+
+    if (!fused) {
+        for (ggml_tensor * t : inter) {
+            ggml_set_output(t);
+        }
+    }
+
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, out);
+
+    const int n_nodes = ggml_graph_n_nodes(gf);
+
+    std::vector<ggml_cpu_node_timing> timing(n_nodes);
+
+    ggml_cplan cplan = ggml_graph_plan(gf, n_threads, nullptr);
+    std::vector<uint8_t> work(cplan.work_size);
+    cplan.work_data   = work.data();
+    cplan.node_timing = timing.data();
+
+    ggml_status status = ggml_graph_compute(gf, &cplan);
+    assert(status == GGML_STATUS_SUCCESS);
+
+    // the nodes of a fused group share its time
+    for (int i = 0; i < n_nodes; ++i) {
+        if (timing[i].t_busy_ns <= 0 || timing[i].t_wall_ns < 0 || timing[i].nbytes == 0) {
+            fprintf(stderr, "%s: node %d (%s) not timed: wall = %lld ns, busy = %lld ns\n", tc.name, i,
+                    ggml_op_desc(ggml_graph_node(gf, i)), (long long) timing[i].t_wall_ns, (long long) timing[i].t_busy_ns);
+        }
+        assert(timing[i].t_busy_ns > 0);
+        assert(timing[i].t_wall_ns >= 0);
+        assert(timing[i].nbytes > 0);
+    }
+
+    std::vector<float> result(ggml_nelements(out));
+    memcpy(result.data(), out->data, ggml_nbytes(out));
+
+    ggml_free(ctx);
+
+    return result;
+}
+
+static ggml_tensor * new_row(ggml_context * ctx, const ggml_tensor * like) {
+    ggml_tensor * t = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, like->ne[0]);
+    fill(t);
+    return t;
+}
+
+static ggml_tensor * new_like(ggml_context * ctx, const ggml_tensor * like) {
+    ggml_tensor * t = ggml_new_tensor(ctx, GGML_TYPE_F32, GGML_MAX_DIMS, like->ne);
+    fill(t);
+    return t;
+}
+
+int main(int argc, char ** argv) {
+    const int n_threads = argc > 1 ? atoi(argv[1]) : 4;
+
+    const test_case cases[] = {
+        { "mul_mat + add", GGML_TYPE_F32, 96, 64, 7, 1,
+            [](ggml_context * ctx, ggml_tensor * t, std::vector<ggml_tensor *> &) {
+                return ggml_add(ctx, t, new_row(ctx, t));
+            }, false },
+        { "mul_mat + add + silu", GGML_TYPE_F16, 128, 96, 33, 1,
+            [](ggml_context * ctx, ggml_tensor * t, std::vector<ggml_tensor *> & inter) {
+                inter.push_back(t = ggml_add(ctx, t, new_row(ctx, t)));
+                return ggml_silu(ctx, t);
+            }, false },
+        { "mul_mat + mul + gelu + add", GGML_TYPE_Q8_0, 64, 128, 16, 3,
+            [](ggml_context * ctx, ggml_tensor * t, std::vector<ggml_tensor *> & inter) {
+                inter.push_back(t = ggml_mul(ctx, t, new_like(ctx, t)));
+                inter.push_back(t = ggml_gelu(ctx, t));
+                return ggml_add(ctx, t, new_row(ctx, t));
+            }, false },
+        { "mul_mat + relu + mul + add + mul", GGML_TYPE_Q4_0, 64, 64, 5, 2,
+            [](ggml_context * ctx, ggml_tensor * t, std::vector<ggml_tensor *> & inter) {
+                inter.push_back(t = ggml_relu(ctx, t));
+                inter.push_back(t = ggml_mul(ctx, t, new_row(ctx, t)));
+                inter.push_back(t = ggml_add(ctx, t, new_like(ctx, t)));
+                return ggml_mul(ctx, t, new_row(ctx, t));
+            }, false },
+        { "mul_mat + swiglu", GGML_TYPE_F16, 96, 64, 9, 1,
+            [](ggml_context * ctx, ggml_tensor * t, std::vector<ggml_tensor *> &) {
+                return ggml_swiglu_split(ctx, t, new_like(ctx, t));
+            }, false },
+        { "mul_mat + geglu", GGML_TYPE_Q8_0, 64, 64, 1, 1,
+            [](ggml_context * ctx, ggml_tensor * t, std::vector<ggml_tensor *> &) {
+                return ggml_geglu_split(ctx, t, new_like(ctx, t));
+            }, false },
+        { "rms_norm + mul", GGML_TYPE_F32, 0, 256, 13, 2,
+            [](ggml_context * ctx, ggml_tensor * t, std::vector<ggml_tensor *> &) {
+                return ggml_mul(ctx, t, new_row(ctx, t));
+            }, true },
+    };
+
+    const bool fusion = getenv("GGML_CPU_DISABLE_FUSION") == nullptr;
+
+    int n_fail = 0;
+
+    for (const auto & tc : cases) {
+        const std::vector<float> a = compute(tc, true,  n_threads);
+        const std::vector<float> b = compute(tc, false, n_threads);
+
+        assert(a.size() == b.size());
+
+        // the fused nodes apply the same operations to the same values
+        double max_err = 0.0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            assert(std::isfinite(a[i]));
+            max_err = std::max(max_err, (double) std::fabs(a[i] - b[i]));
+        }
+
+        const bool ok = max_err <= 1e-6;
+
+        printf("%-36s fusion %s: max err = %.3e %s\n", tc.name, fusion ? "on " : "off", max_err, ok ? "OK" : "FAIL");
+
+        n_fail += ok ? 0 : 1;
+    }
+
+    if (n_fail > 0) {
+        printf("%d cases failed\n", n_fail);
+        return 1;
+    }
+
+    printf("OK\n");
+
+    return 0;
+}
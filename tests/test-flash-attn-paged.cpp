@@ -0,0 +1,193 @@
+// compares the flash attention on paged K/V (ggml_flash_attn_ext_paged) with the flash attention on the same rows
+// gathered through the block tables into contiguous K/V (ggml_flash_attn_ext), on the CPU backend. The block tables
+// are scattered over the pool, the first block of every stream is shared with stream 0 and the last block of
+// stream 1 is not mapped (and masked in the gathered K/V). The shapes cover blocks smaller and larger than the KV
+// tiles, the per-query (fewer than GGML_FA_TILE_Q_MIN queries) and the tiled kernels and quantized K/V
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <vector>
+
+struct test_case {
+    int64_t    dk;
+    int64_t    dv;
+    int64_t    nq;
+    int64_t    nkv;   // logical KV rows of a stream
+    int64_t    nh;
+    int64_t    nh_kv;
+    int64_t    ns;    // streams
+    int        bs;    // block size
+    ggml_type  type_kv;
+    bool       causal;
+};
+
+static float frand() {
+    return 2.0f*rand()/(float) RAND_MAX - 1.0f;
+}
+
+static void fill(ggml_tensor * t) {
+    std::vector<float> data(ggml_nelements(t));
+    for (auto & x : data) {
+        x = frand();
+    }
+    if (t->type == GGML_TYPE_F32) {
+        memcpy(t->data, data.data(), data.size()*sizeof(float));
+    } else {
+        ggml_get_type_traits_cpu(t->type)->from_float(data.data(), t->data, data.size());
+    }
+}
+
+// copy the rows of the pool p: [d, n_rows, nh_kv, 1] mapped by the block tables into g: [d, nkv, nh_kv, ns]
+static void gather(ggml_tensor * g, const ggml_tensor * p, const std::vector<int32_t> & blocks, int bs) {
+    const int64_t nb = g->ne[1]/bs;
+
+    for (int64_t s = 0; s < g->ne[3]; s++) {
+        for (int64_t h = 0; h < g->ne[2]; h++) {
+            for (int64_t i = 0; i < g->ne[1]; i++) {
+                char * dst = (char *) g->data + i*g->nb[1] + h*g->nb[2] + s*g->nb[3];
+
+                const int32_t ib = blocks[s*nb + i/bs];
+                if (ib < 0) {
+                    // not mapped, masked
+                    memset(dst, 0, g->nb[1]);
+                    continue;
+                }
+
+                memcpy(dst, (const char *) p->data + (ib*bs + i%bs)*p->nb[1] + h*p->nb[2], g->nb[1]);
+            }
+        }
+    }
+}
+
+// NMSE of the paged result against the result on the gathered K/V
+static double test_flash_attn(ggml_context * ctx, const test_case & tc, int n_threads, std::mt19937 & rng) {
+    const float scale = 1.0f/sqrtf((float) tc.dk);
+
+    const int64_t nb     = tc.nkv/tc.bs; // logical blocks of a stream
+    const int64_t n_rows = tc.nkv*tc.ns; // rows of the pool
+
+    ggml_tensor * q = ggml_new_tensor_4d(ctx, GGML_TYPE_F32, tc.dk, tc.nq,   tc.nh,    tc.ns);
+    ggml_tensor * k = ggml_new_tensor_4d(ctx, tc.type_kv,    tc.dk, n_rows,  tc.nh_kv, 1);
+    ggml_tensor * v = ggml_new_tensor_4d(ctx, tc.type_kv,    tc.dv, n_rows,  tc.nh_kv, 1);
+
+    fill(q);
+    fill(k);
+    fill(v);
+
+    // scattered blocks, the first block is shared by all the streams and the last block of stream 1 is not mapped
+    std::vector<int32_t> ids(nb*tc.ns);
+    std::iota(ids.begin(), ids.end(), 0);
+    std::shuffle(ids.begin(), ids.end(), rng);
+    for (int64_t s = 1; s < tc.ns; s++) {
+        ids[s*nb] = ids[0];
+    }
+    ids[nb + nb - 1] = -1;
+
+    ggml_tensor * blocks = ggml_new_tensor_2d(ctx, GGML_TYPE_I32, nb, tc.ns);
+    memcpy(blocks->data, ids.data(), ggml_nbytes(blocks));
+
+    ggml_tensor * m = ggml_new_tensor_4d(ctx, GGML_TYPE_F16, tc.nkv, GGML_PAD(tc.nq, GGML_KQ_MASK_PAD), 1, tc.ns);
+    for (int64_t s = 0; s < tc.ns; s++) {
+        ggml_fp16_t * md = (ggml_fp16_t *) ((char *) m->data + s*m->nb[3]);
+        for (int64_t iq = 0; iq < m->ne[1]; iq++) {
+            for (int64_t ikv = 0; ikv < tc.nkv; ikv++) {
+                const bool masked = ids[s*nb + ikv/tc.bs] < 0 || (tc.causal && ikv > tc.nkv - tc.nq + iq);
+                md[iq*tc.nkv + ikv] = ggml_fp32_to_fp16(iq < tc.nq && masked ? -INFINITY : 0.0f);
+            }
+        }
+    }
+
+    ggml_tensor * kg = ggml_new_tensor_4d(ctx, tc.type_kv, tc.dk, tc.nkv, tc.nh_kv, tc.ns);
+    ggml_tensor * vg = ggml_new_tensor_4d(ctx, tc.type_kv, tc.dv, tc.nkv, tc.nh_kv, tc.ns);
+
+    gather(kg, k, ids, tc.bs);
+    gather(vg, v, ids, tc.bs);
+
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+
+    ggml_tensor * out = ggml_flash_attn_ext_paged(ctx, q, k, v, m, blocks, tc.bs, scale, 0.0f, 0.0f);
+    ggml_build_forward_expand(gf, out);
+
+    ggml_tensor * ref = ggml_flash_attn_ext(ctx, q, kg, vg, m, scale, 0.0f, 0.0f);
+    ggml_build_forward_expand(gf, ref);
+
+    ggml_status status = ggml_graph_compute_with_ctx(ctx, gf, n_threads);
+    assert(status == GGML_STATUS_SUCCESS);
+
+    double err = 0.0;
+    double sum = 0.0;
+    for (int64_t i = 0; i < ggml_nelements(out); i++) {
+        const float a = ((const float *) out->data)[i];
+        const float b = ((const float *) ref->data)[i];
+        assert(std::isfinite(a));
+        err += (a - b)*(double) (a - b);
+        sum += b*(double) b;
+    }
+
+    return err/sum;
+}
+
+int main(int argc, char ** argv) {
+    const int n_threads = argc > 1 ? atoi(argv[1]) : 4;
+
+    srand(1234);
+    std::mt19937 rng(1234);
+
+    const test_case cases[] = {
+        //  dk   dv  nq  nkv  nh nh_kv ns   bs type_kv          causal
+        {   64,  64,  1, 256,  4,  2,  2,  16, GGML_TYPE_F16,  true  },
+        {   64,  64,  7, 256,  4,  2,  3,  32, GGML_TYPE_F16,  true  }, // per-query kernel
+        {   64,  64, 32, 256,  4,  2,  3,  16, GGML_TYPE_F16,  true  }, // tiled, blocks smaller than the KV tiles
+        {  128, 128, 40, 512,  4,  1,  2, 256, GGML_TYPE_F16,  true  }, // tiled, blocks larger than the KV tiles
+        {   80,  64, 16, 128,  4,  2,  2,  32, GGML_TYPE_BF16, false },
+        {   64,  64, 12, 256,  8,  2,  4, 128, GGML_TYPE_F32,  true  },
+        {  128, 128,  3, 512,  4,  4,  2,  64, GGML_TYPE_Q8_0, false },
+        {  128, 128, 32, 512,  4,  4,  2,  64, GGML_TYPE_Q8_0, true  },
+        {   64,  64, 33, 256,  4,  2,  2,  16, GGML_TYPE_Q4_0, true  },
+    };
+
+    int n_fail = 0;
+
+    for (const auto & tc : cases) {
+        ggml_init_params params = {
+            /*.mem_size   =*/ 256*1024*1024,
+            /*.mem_buffer =*/ nullptr,
+            /*.no_alloc   =*/ false,
+        };
+        ggml_context * ctx = ggml_init(params);
+
+        const double nmse = test_flash_attn(ctx, tc, n_threads, rng);
+        // the same kernel reads the same rows, only the tiles of the tiled kernel are cut at the block boundaries
+        const bool   ok   = nmse < 1e-6;
+
+        printf("dk=%3lld dv=%3lld nq=%2lld nkv=%3lld nh=%lld/%lld ns=%lld bs=%3d %-4s causal=%d: nmse = %.3e %s\n",
+                (long long) tc.dk, (long long) tc.dv, (long long) tc.nq, (long long) tc.nkv, (long long) tc.nh, (long long) tc.nh_kv,
+                (long long) tc.ns, tc.bs, ggml_type_name(tc.type_kv), tc.causal, nmse, ok ? "OK" : "FAIL");
+
+        n_fail += ok ? 0 : 1;
+
+        ggml_free(ctx);
+    }
+
+    if (n_fail > 0) {
+        printf("%d cases failed\n", n_fail);
+        return 1;
+    }
+
+    printf("OK\n");
+
+    return 0;
+}
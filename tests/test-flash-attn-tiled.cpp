@@ -0,0 +1,182 @@
+// compares the tiled CPU flash attention (used from GGML_FA_TILE_Q_MIN queries on) with the per-query
+// kernel on the same inputs: every query is also computed by a flash attention of its own, which
+// takes the per-query kernel. The shapes cover a ragged last KV tile, a ragged last query tile,
+// fewer queries than GGML_FA_TILE_Q_MIN, KV tiles that are masked for every query and skipped and
+// KV tiles that are only partially masked
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+enum test_mask {
+    MASK_NONE,
+    MASK_CAUSAL,  // the queries are the last nq positions of the KV
+    MASK_PREFIX,  // the queries are at the first nq positions, the KV tiles past them are masked for all queries
+    MASK_HOLE,    // the second KV tile is masked for all queries
+    MASK_WINDOW,  // causal with a window of 48 keys, the first keys of a tile can be masked for all queries but not the last ones
+};
+
+struct test_case {
+    int64_t    dk;
+    int64_t    dv;
+    int64_t    nq;
+    int64_t    nkv;
+    int64_t    nh;
+    int64_t    nh_kv;
+    ggml_type  type_kv;
+    test_mask  mask;
+    float      max_bias;
+    float      softcap;
+};
+
+static float frand() {
+    return 2.0f*rand()/(float) RAND_MAX - 1.0f;
+}
+
+static void fill(ggml_tensor * t) {
+    std::vector<float> data(ggml_nelements(t));
+    for (auto & x : data) {
+        x = frand();
+    }
+    if (t->type == GGML_TYPE_F32) {
+        memcpy(t->data, data.data(), data.size()*sizeof(float));
+    } else {
+        ggml_get_type_traits_cpu(t->type)->from_float(data.data(), t->data, data.size());
+    }
+}
+
+static bool masked(test_mask mask, int64_t iq, int64_t ikv, int64_t nq, int64_t nkv) {
+    switch (mask) {
+        case MASK_NONE:   return false;
+        case MASK_CAUSAL: return ikv > nkv - nq + iq;
+        case MASK_PREFIX: return ikv > iq;
+        case MASK_HOLE:   return ikv >= 64 && ikv < 128;
+        case MASK_WINDOW: return ikv > nkv - nq + iq || ikv <= nkv - nq + iq - 48;
+    }
+    return false;
+}
+
+// NMSE of the tiled result against the per-query results
+static double test_flash_attn(ggml_context * ctx, const test_case & tc, int n_threads) {
+    const float scale = 1.0f/sqrtf((float) tc.dk);
+
+    ggml_tensor * q = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, tc.dk, tc.nq,  tc.nh);
+    ggml_tensor * k = ggml_new_tensor_3d(ctx, tc.type_kv,    tc.dk, tc.nkv, tc.nh_kv);
+    ggml_tensor * v = ggml_new_tensor_3d(ctx, tc.type_kv,    tc.dv, tc.nkv, tc.nh_kv);
+
+    fill(q);
+    fill(k);
+    fill(v);
+
+    // one more padded block of rows, the mask of a single query is a view starting at its row
+    ggml_tensor * m = nullptr;
+    if (tc.mask != MASK_NONE || tc.max_bias > 0.0f) {
+        m = ggml_new_tensor_2d(ctx, GGML_TYPE_F16, tc.nkv, GGML_PAD(tc.nq, GGML_KQ_MASK_PAD) + GGML_KQ_MASK_PAD);
+        ggml_fp16_t * md = (ggml_fp16_t *) m->data;
+        for (int64_t iq = 0; iq < m->ne[1]; iq++) {
+            for (int64_t ikv = 0; ikv < tc.nkv; ikv++) {
+                md[iq*tc.nkv + ikv] = ggml_fp32_to_fp16(iq < tc.nq && masked(tc.mask, iq, ikv, tc.nq, tc.nkv) ? -INFINITY : 0.0f);
+            }
+        }
+    }
+
+    ggml_cgraph * gf = ggml_new_graph_custom(ctx, 4*tc.nq + 16, false);
+
+    ggml_tensor * out = ggml_flash_attn_ext(ctx, q, k, v, m, scale, tc.max_bias, tc.softcap);
+    ggml_build_forward_expand(gf, out);
+
+    std::vector<ggml_tensor *> out_q(tc.nq);
+    for (int64_t iq = 0; iq < tc.nq; iq++) {
+        ggml_tensor * qi = ggml_view_3d(ctx, q, tc.dk, 1, tc.nh, q->nb[1], q->nb[2], iq*q->nb[1]);
+        ggml_tensor * mi = m ? ggml_view_2d(ctx, m, tc.nkv, GGML_KQ_MASK_PAD, m->nb[1], iq*m->nb[1]) : nullptr;
+
+        out_q[iq] = ggml_flash_attn_ext(ctx, qi, k, v, mi, scale, tc.max_bias, tc.softcap);
+        ggml_build_forward_expand(gf, out_q[iq]);
+    }
+
+    ggml_status status = ggml_graph_compute_with_ctx(ctx, gf, n_threads);
+    assert(status == GGML_STATUS_SUCCESS);
+
+    // out: [dv, nh, nq]
+    double err = 0.0;
+    double sum = 0.0;
+    for (int64_t iq = 0; iq < tc.nq; iq++) {
+        const float * a = (const float *) ((const char *) out->data + iq*out->nb[2]);
+        const float * b = (const float *) out_q[iq]->data;
+        for (int64_t i = 0; i < tc.dv*tc.nh; i++) {
+            assert(std::isfinite(a[i]));
+            err += (a[i] - b[i])*(double) (a[i] - b[i]);
+            sum += b[i]*(double) b[i];
+        }
+    }
+
+    return err/sum;
+}
+
+int main(int argc, char ** argv) {
+    const int n_threads = argc > 1 ? atoi(argv[1]) : 4;
+
+    srand(1234);
+
+    const test_case cases[] = {
+        //  dk   dv   nq  nkv  nh nh_kv type_kv         mask         max_bias softcap
+        {   64,  64,  40, 100,  4,  2, GGML_TYPE_F16,  MASK_NONE,   0.0f,  0.0f }, // ragged KV and query tiles
+        {   64,  64,  33, 257,  4,  4, GGML_TYPE_F16,  MASK_CAUSAL, 0.0f,  0.0f }, // last query tile of 1
+        {  128, 128,  64, 192,  4,  1, GGML_TYPE_F16,  MASK_PREFIX, 0.0f,  0.0f }, // fully masked KV tiles
+        {   64,  64,  32, 200,  2,  2, GGML_TYPE_F16,  MASK_HOLE,   0.0f,  0.0f }, // masked tile in the middle
+        {   64,  64,  16, 300,  4,  2, GGML_TYPE_F16,  MASK_WINDOW, 0.0f,  0.0f }, // partially masked KV tiles
+        {   64,  64,   8,  65,  4,  2, GGML_TYPE_F16,  MASK_CAUSAL, 0.0f,  0.0f }, // GGML_FA_TILE_Q_MIN queries
+        {   64,  64,   7,  65,  4,  2, GGML_TYPE_F16,  MASK_CAUSAL, 0.0f,  0.0f }, // below GGML_FA_TILE_Q_MIN
+        {   64,  64,  48, 130,  8,  2, GGML_TYPE_F16,  MASK_CAUSAL, 8.0f,  0.0f }, // ALiBi
+        {   64,  64,  48, 130,  4,  2, GGML_TYPE_F16,  MASK_NONE,   0.0f, 30.0f }, // softcap
+        {   80,  64,  40, 100,  4,  2, GGML_TYPE_BF16, MASK_CAUSAL, 0.0f,  0.0f }, // DK != DV
+        {   64,  64,  40, 100,  4,  2, GGML_TYPE_F32,  MASK_CAUSAL, 0.0f,  0.0f },
+        // quantized V: the tiled kernel converts the V tile, the per-query kernel uses ggml_vec_mad_q*
+        {   64,  64,  40, 100,  4,  2, GGML_TYPE_Q8_0, MASK_CAUSAL, 0.0f,  0.0f },
+        {  128, 128,  40, 100,  4,  2, GGML_TYPE_Q5_0, MASK_WINDOW, 0.0f,  0.0f },
+        {   64,  64,  40, 100,  4,  2, GGML_TYPE_Q4_0, MASK_CAUSAL, 0.0f,  0.0f },
+    };
+
+    int n_fail = 0;
+
+    for (const auto & tc : cases) {
+        ggml_init_params params = {
+            /*.mem_size   =*/ 256*1024*1024,
+            /*.mem_buffer =*/ nullptr,
+            /*.no_alloc   =*/ false,
+        };
+        ggml_context * ctx = ggml_init(params);
+
+        const double nmse = test_flash_attn(ctx, tc, n_threads);
+        // the per-query kernel accumulates V in F16 for F16 V (NMSE ~5e-6 against a double reference),
+        // a wrong tile boundary or a skipped tile that was not masked gives errors of order 1
+        const bool   ok   = nmse < 5e-5;
+
+        printf("dk=%3lld dv=%3lld nq=%3lld nkv=%3lld nh=%lld/%lld %-4s mask=%d max_bias=%.0f softcap=%.0f: nmse = %.3e %s\n",
+                (long long) tc.dk, (long long) tc.dv, (long long) tc.nq, (long long) tc.nkv, (long long) tc.nh, (long long) tc.nh_kv,
+                ggml_type_name(tc.type_kv), (int) tc.mask, tc.max_bias, tc.softcap, nmse, ok ? "OK" : "FAIL");
+
+        n_fail += ok ? 0 : 1;
+
+        ggml_free(ctx);
+    }
+
+    if (n_fail > 0) {
+        printf("%d cases failed\n", n_fail);
+        return 1;
+    }
+
+    printf("OK\n");
+
+    return 0;
+}
@@ -0,0 +1,309 @@
+// checks that the INSTR_* macro arguments are only evaluated when the level requires them and only
+// in the sampled decodes, which nodes the eval callback observes, and measures the cost of an
+// instrumented call site with the instrumentation absent, disabled, enabled and sampled
+
+#include "llama-instrumentation.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int n_eval = 0;
+
+static std::string step_name(int il) {
+    n_eval++;
+    return std::string("layer_") + std::to_string(il);
+}
+
+// the expansion of the macros before they became lazy, as a reference
+#define INSTR_EAGER_BEGIN_STEP(step_name, layer_id) \
+    if (g_llama_instr) g_llama_instr->begin_step(step_name, layer_id)
+
+#define INSTR_EAGER_LOG_PERF(metric_name, value, unit) \
+    if (g_llama_instr) g_llama_instr->log_performance_metric(metric_name, value, unit)
+
+#define INSTR_EAGER_END_STEP(notes) \
+    if (g_llama_instr) g_llama_instr->end_step(notes)
+
+static void call_site(int il) {
+    INSTR_BEGIN_STEP(step_name(il), il);
+    INSTR_LOG_PERF(step_name(il), il, "layer");
+    INSTR_END_STEP(step_name(il));
+
+    GGML_UNUSED(il);
+}
+
+static void call_site_eager(int il) {
+    INSTR_EAGER_BEGIN_STEP(std::string("layer_") + std::to_string(il), il);
+    INSTR_EAGER_LOG_PERF(std::string("layer_") + std::to_string(il), il, "layer");
+    INSTR_EAGER_END_STEP(std::string("layer_") + std::to_string(il));
+}
+
+static void test_lazy(const std::string & path) {
+    n_eval = 0;
+    call_site(0);
+    assert(n_eval == 0);
+
+#ifdef LLAMA_INSTRUMENTATION
+    llama_instrumentation_init(llama_instr_level::MINIMAL, path);
+
+    g_llama_instr->disable();
+    n_eval = 0;
+    call_site(0);
+    assert(n_eval == 0);
+
+    g_llama_instr->enable();
+    n_eval = 0;
+    call_site(0);
+    assert(n_eval == 0);
+
+    // step names are formatted from DETAILED on, notes and metrics only in VERBOSE
+    g_llama_instr->set_level(llama_instr_level::DETAILED);
+    n_eval = 0;
+    call_site(0);
+    assert(n_eval == 1);
+
+    g_llama_instr->set_level(llama_instr_level::VERBOSE);
+    n_eval = 0;
+    call_site(0);
+    assert(n_eval == 3);
+
+    llama_instrumentation_free();
+#endif
+
+    std::remove(path.c_str());
+}
+
+static void test_sampling(const std::string & path) {
+#ifdef LLAMA_INSTRUMENTATION
+    llama_instrumentation_init(llama_instr_level::DETAILED, path);
+
+    // 1 in 4 decodes
+    llama_instrumentation_set_sampling(4);
+    n_eval = 0;
+    for (int i = 0; i < 16; i++) {
+        const bool traced = g_llama_instr->begin_decode();
+        assert(traced == (i % 4 == 0));
+        call_site(0);
+        g_llama_instr->end_decode(100);
+    }
+    assert(n_eval == 4);
+    assert(g_llama_instr->n_decode() == 16 && g_llama_instr->n_decode_traced() == 4);
+
+    // outside of a decode the instrumentation is not affected
+    assert(g_llama_instr->is_enabled(llama_instr_level::DETAILED));
+
+    // all decodes, but the traced ones may only take a quarter of the decode time
+    llama_instrumentation_set_sampling(1, 0.25);
+    n_eval = 0;
+    for (int i = 0; i < 16; i++) {
+        g_llama_instr->begin_decode();
+        call_site(0);
+        g_llama_instr->end_decode(100);
+    }
+    assert(n_eval == 4);
+    assert(g_llama_instr->n_decode_traced() == 8);
+
+    llama_instrumentation_free();
+#endif
+
+    std::remove(path.c_str());
+}
+
+// contexts decoding on several threads share the counters, but not the traced state of their decode
+static void test_sampling_threads(const std::string & path) {
+#ifdef LLAMA_INSTRUMENTATION
+    llama_instrumentation_init(llama_instr_level::DETAILED, path);
+    llama_instrumentation_set_sampling(2);
+
+    // this thread is in an untraced decode, another thread still traces its decode
+    assert(g_llama_instr->begin_decode());
+    assert(!g_llama_instr->begin_decode());
+    assert(!g_llama_instr->is_enabled());
+    std::thread([] {
+        assert(g_llama_instr->is_enabled());
+        assert(g_llama_instr->begin_decode());
+        assert(g_llama_instr->is_enabled());
+        g_llama_instr->end_decode(1);
+    }).join();
+    assert(!g_llama_instr->is_enabled());
+    g_llama_instr->end_decode(1);
+    assert(g_llama_instr->is_enabled());
+
+    const int n_threads = 4;
+    const int n_iter    = 10000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < n_threads; t++) {
+        threads.emplace_back([] {
+            for (int i = 0; i < n_iter; i++) {
+                const bool traced = g_llama_instr->begin_decode();
+                assert(g_llama_instr->is_enabled() == traced);
+                g_llama_instr->end_decode(1);
+            }
+        });
+    }
+    for (auto & t : threads) {
+        t.join();
+    }
+
+    // every second decode is traced, no increment is lost
+    assert(g_llama_instr->n_decode() == 3 + n_threads*n_iter);
+    assert(g_llama_instr->n_decode_traced() == 2 + n_threads*n_iter/2);
+
+    llama_instrumentation_free();
+#endif
+
+    std::remove(path.c_str());
+}
+
+// the nodes the scheduler is asked to split the graph after
+static void test_tensor_filter(const std::string & path) {
+    ggml_init_params params = { 16*ggml_tensor_overhead(), nullptr, true };
+    ggml_context * ctx = ggml_init(params);
+
+    const auto new_tensor = [ctx](const char * name) {
+        ggml_tensor * t = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, 4);
+        ggml_set_name(t, name);
+        return t;
+    };
+
+    ggml_tensor * l_out  = new_tensor("l_out-3");
+    ggml_tensor * attn   = new_tensor("attn_norm-3");
+    ggml_tensor * ffn    = new_tensor("ffn_out-12");
+    ggml_tensor * noname = new_tensor("");
+
+    {
+        llama_instrumentation instr(llama_instr_level::MINIMAL, path);
+
+        // MINIMAL: no tensor is observed
+        assert(!instr.observes_tensors());
+        assert(!instr.wants_tensor(l_out));
+
+        // DETAILED without a filter: only the layer outputs
+        instr.set_level(llama_instr_level::DETAILED);
+        assert( instr.wants_tensor(l_out));
+        assert(!instr.wants_tensor(attn));
+        assert(!instr.wants_tensor(ffn));
+        assert(!instr.wants_tensor(noname));
+        assert(!instr.wants_tensor(nullptr));
+
+        // VERBOSE without a filter: every named node
+        instr.set_level(llama_instr_level::VERBOSE);
+        assert( instr.wants_tensor(attn));
+        assert( instr.wants_tensor(ffn));
+        assert(!instr.wants_tensor(noname));
+
+        // comma-separated substrings, empty items are ignored
+        instr.set_tensor_filter("ffn_,,norm-3");
+        assert(!instr.wants_tensor(l_out));
+        assert( instr.wants_tensor(attn));
+        assert( instr.wants_tensor(ffn));
+
+        instr.set_level(llama_instr_level::DETAILED);
+        assert( instr.wants_tensor(ffn));
+
+        // an empty filter restores the default
+        instr.set_tensor_filter("");
+        assert( instr.wants_tensor(l_out));
+        assert(!instr.wants_tensor(ffn));
+
+        instr.disable();
+        assert(!instr.wants_tensor(l_out));
+    }
+
+    ggml_free(ctx);
+
+    std::remove(path.c_str());
+}
+
+// best of 3 runs, ns per call site
+static double bench(const std::function<void(int)> & fn) {
+    const int n_iter  = 20000;
+    const int n_layer = 32;
+
+    double res = 0.0;
+    for (int run = 0; run < 3; run++) {
+        const auto t_start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < n_iter; i++) {
+            for (int il = 0; il < n_layer; il++) {
+                fn(il);
+            }
+        }
+        const auto t_end = std::chrono::high_resolution_clock::now();
+
+        const double t = std::chrono::duration<double, std::nano>(t_end - t_start).count() / (n_iter*n_layer);
+        res = run == 0 ? t : std::min(res, t);
+    }
+
+    return res;
+}
+
+static void bench_all(const std::string & path) {
+#ifndef LLAMA_INSTRUMENTATION
+    printf("LLAMA_INSTRUMENTATION=OFF, the macros expand to nothing\n");
+#endif
+    printf("%-28s %10s %10s\n", "instrumentation", "lazy ns", "eager ns");
+
+    // without an instrumentation both expansions are the same null check per call site
+    const double t_lazy  = bench(call_site);
+    const double t_eager = bench(call_site_eager);
+    printf("%-28s %10.2f %10.2f\n", "not initialized", t_lazy, t_eager);
+    assert(t_lazy <= 1.5*t_eager + 1.0);
+
+#ifdef LLAMA_INSTRUMENTATION
+    llama_instrumentation_init(llama_instr_level::MINIMAL, path);
+
+    g_llama_instr->disable();
+    printf("%-28s %10.2f %10.2f\n", "disabled", bench(call_site), bench(call_site_eager));
+
+    g_llama_instr->enable();
+    printf("%-28s %10.2f %10.2f\n", "MINIMAL", bench(call_site), bench(call_site_eager));
+
+    g_llama_instr->set_level(llama_instr_level::DETAILED);
+    printf("%-28s %10.2f %10.2f\n", "DETAILED", bench(call_site), bench(call_site_eager));
+
+    // one decode = 32 layers, one in 100 decodes traced
+    const auto sampled = [](const std::function<void(int)> & fn) {
+        return [fn](int il) {
+            if (il == 0) {
+                g_llama_instr->begin_decode();
+            }
+            fn(il);
+            if (il == 31) {
+                g_llama_instr->end_decode(0);
+            }
+        };
+    };
+
+    g_llama_instr->set_sampling(100);
+    printf("%-28s %10.2f %10.2f\n", "DETAILED, 1 in 100 decodes", bench(sampled(call_site)), bench(sampled(call_site_eager)));
+
+    llama_instrumentation_free();
+#endif
+
+    std::remove(path.c_str());
+}
+
+int main() {
+    const std::string path = "test-instrumentation-macros.log";
+
+    test_lazy(path);
+    test_sampling(path);
+    test_sampling_threads(path);
+    test_tensor_filter(path);
+    bench_all(path);
+
+    printf("OK\n");
+
+    return 0;
+}
@@ -0,0 +1,265 @@
+#include "llama-instrumentation-sink.h"
+#include "llama-instrumentation-trace.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::vector<std::string> read_lines(const std::string & path) {
+    std::vector<std::string> lines;
+
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        lines.push_back(line);
+    }
+
+    return lines;
+}
+
+// all entries from all producers must arrive, and entries of a single producer must stay in order
+static void test_block(const std::string & path) {
+    const int n_thread = 8;
+    const int n_entry  = 5000;
+
+    std::remove(path.c_str());
+
+    {
+        llama_instr_sink sink(path, 64, llama_instr_overflow::BLOCK);
+        assert(sink.is_open());
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < n_thread; i++) {
+            threads.emplace_back([&sink, i]() {
+                for (int j = 0; j < n_entry; j++) {
+                    const bool ok = sink.push(std::to_string(i) + " " + std::to_string(j));
+                    assert(ok);
+                }
+            });
+        }
+        for (auto & t : threads) {
+            t.join();
+        }
+
+        sink.flush();
+
+        assert(sink.n_dropped() == 0);
+        assert(sink.n_written() == (uint64_t) n_thread*n_entry);
+    }
+
+    const auto lines = read_lines(path);
+    assert(lines.size() == (size_t) n_thread*n_entry);
+
+    std::vector<int> next(n_thread, 0);
+    for (const auto & line : lines) {
+        int i = -1;
+        int j = -1;
+        assert(sscanf(line.c_str(), "%d %d", &i, &j) == 2);
+        assert(i >= 0 && i < n_thread);
+        assert(j == next[i]);
+        next[i]++;
+    }
+
+    std::remove(path.c_str());
+}
+
+// with the DROP policy nothing blocks and every entry is either written or counted as dropped
+static void test_drop(const std::string & path) {
+    const int n_thread = 4;
+    const int n_entry  = 20000;
+
+    std::remove(path.c_str());
+
+    uint64_t n_written = 0;
+
+    {
+        llama_instr_sink sink(path, 8, llama_instr_overflow::DROP);
+        assert(sink.is_open());
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < n_thread; i++) {
+            threads.emplace_back([&sink]() {
+                for (int j = 0; j < n_entry; j++) {
+                    sink.push("entry " + std::to_string(j));
+                }
+            });
+        }
+        for (auto & t : threads) {
+            t.join();
+        }
+
+        sink.flush();
+
+        assert(sink.n_pushed() + sink.n_dropped() == (uint64_t) n_thread*n_entry);
+        assert(sink.n_written() == sink.n_pushed());
+
+        n_written = sink.n_written();
+    }
+
+    assert(read_lines(path).size() == n_written);
+
+    std::remove(path.c_str());
+}
+
+// the line index must point at the start of every written line, and be closed with the sink
+static void test_line_index(const std::string & path) {
+    const int n_entry = 1000;
+
+    std::remove(path.c_str());
+
+    auto index = std::make_shared<llama_instr_line_index>();
+
+    {
+        llama_instr_sink sink(path, 16, llama_instr_overflow::BLOCK, index);
+        assert(sink.is_open());
+
+        for (int j = 0; j < n_entry; j++) {
+            sink.push("line " + std::to_string(j));
+        }
+
+        assert(index->wait(n_entry - 1, 10000) == (size_t) n_entry);
+        assert(!index->closed());
+    }
+
+    assert(index->closed());
+    assert(index->n_lines() == (size_t) n_entry);
+
+    std::ifstream file(path, std::ios::binary);
+    for (int j : { 0, 1, 500, n_entry - 1 }) {
+        size_t   to    = j + 1;
+        uint64_t begin = 0;
+        uint64_t end   = 0;
+        assert(index->range(j, to, begin, end));
+        assert(to == (size_t) j + 1);
+
+        std::string line(end - begin, '\0');
+        file.seekg(begin);
+        file.read(&line[0], line.size());
+        assert(line == "line " + std::to_string(j) + "\n");
+    }
+
+    // past the end
+    size_t   to    = SIZE_MAX;
+    uint64_t begin = 0;
+    uint64_t end   = 0;
+    assert(index->range(n_entry, to, begin, end) && begin == end);
+    assert(!index->range(n_entry + 1, to, begin, end));
+
+    std::remove(path.c_str());
+}
+
+// events written through the sink must be read back unchanged, with their interned and per-block strings
+static void test_trace_round_trip(const std::string & path) {
+    const int n_event = 5000;
+
+    // a binary trace truncates the file, appending a second header would break the reader
+    for (int run = 0; run < 2; run++) {
+        llama_instr_sink sink(path, 64, llama_instr_overflow::BLOCK, nullptr, false);
+        assert(sink.is_open());
+
+        llama_trace_writer writer([&sink](std::string && data) { sink.push(std::move(data), false); }, 256);
+
+        for (int i = 0; i < n_event; i++) {
+            llama_trace_event ev;
+            ev.type  = LLAMA_TRACE_EVENT_STEP_END;
+            ev.flags = (uint16_t) (i % 7);
+            ev.layer = i % 32;
+            ev.name  = writer.intern("layer_" + std::to_string(i % 32));
+            ev.t_us  = 1000000 + 10*i;
+            ev.v[0]  = llama_trace_i64(-i);
+            ev.v[1]  = llama_trace_f64(0.5*i);
+            ev.v[2]  = writer.local("token_generation_" + std::to_string(i));
+            ev.v[3]  = writer.local(i % 2 ? "" : "note");
+            writer.add(ev);
+        }
+
+        // the string table is bounded, the names past the limit are stored per block
+        for (int i = 0; i < LLAMA_TRACE_MAX_STRINGS; i++) {
+            writer.intern("name_" + std::to_string(i));
+        }
+        assert(writer.intern("one more name") & LLAMA_TRACE_STR_LOCAL);
+        assert(writer.intern("layer_3") == writer.intern("layer_3"));
+
+        writer.flush();
+        sink.flush();
+    }
+
+    llama_trace_reader reader;
+    assert(reader.open(path));
+
+    int n_read = 0;
+    llama_trace_event ev;
+    while (reader.next(ev)) {
+        const int i = n_read++;
+        assert(ev.type  == LLAMA_TRACE_EVENT_STEP_END);
+        assert(ev.flags == i % 7);
+        assert(ev.layer == i % 32);
+        assert(ev.t_us  == 1000000 + 10*i);
+        assert(reader.str(ev.name) == "layer_" + std::to_string(i % 32));
+        assert(llama_trace_as_i64(ev.v[0]) == -i);
+        assert(llama_trace_as_f64(ev.v[1]) == 0.5*i);
+        assert(reader.str(ev.v[2]) == "token_generation_" + std::to_string(i));
+        assert(reader.str(ev.v[3]) == (i % 2 ? "" : "note"));
+    }
+    assert(n_read == n_event);
+
+    std::remove(path.c_str());
+}
+
+// the strings of the head of a group stay valid while the rest of the group is read from the next block
+static void test_trace_group(const std::string & path) {
+    std::string data;
+
+    {
+        llama_trace_writer writer([&data](std::string && block) { data += block; }, 4);
+
+        for (int i = 0; i < 10; i++) {
+            llama_trace_event ev;
+            ev.type = LLAMA_TRACE_EVENT_STEP_BEGIN;
+            ev.name = writer.local("step_" + std::to_string(i));
+            writer.add(ev);
+        }
+    }
+
+    FILE * f = fopen(path.c_str(), "wb");
+    assert(f);
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+
+    llama_trace_reader reader;
+    assert(reader.open(path));
+
+    // read 3 events ahead, the first one is then two blocks of 4 events behind at most
+    std::vector<llama_trace_event> evs(10);
+    for (int i = 0; i < 10; i++) {
+        assert(reader.next(evs[i]));
+        if (i >= 3) {
+            assert(reader.str(evs[i - 3].name) == "step_" + std::to_string(i - 3));
+        }
+    }
+
+    std::remove(path.c_str());
+}
+
+int main() {
+    const std::string path = "test-instrumentation-sink.log";
+
+    test_block(path);
+    test_drop(path);
+    test_line_index(path);
+    test_trace_round_trip(path);
+    test_trace_group(path);
+
+    printf("OK\n");
+
+    return 0;
+}
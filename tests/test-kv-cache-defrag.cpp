@@ -0,0 +1,226 @@
+// tests the incremental KV cache defrag (defrag_max_cells) against the defrag of the whole cache at once:
+// the same sequences are decoded into three contexts and the same holes are punched into their caches
+//  - the incremental defrag moves at most defrag_max_cells cells per update and stays pending until the cache is compact
+//  - it ends in the same layout as the full defrag: the states (cells, positions, sequences and K/V data) are identical
+//  - the next decode gives the same logits as in the context without defrag
+//
+// usage: test-kv-cache-defrag <model.gguf> (skipped without a model)
+
+#include "llama.h"
+#include "get-model.h"
+
+#include "llama-context.h"
+#include "llama-kv-cache-unified.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static const uint32_t n_seq = 4;
+static const uint32_t n_ctx = 4096; // the defrag is not considered below 2048 cells
+
+static llama_context * ctx_new(llama_model * model, float defrag_thold, uint32_t defrag_max_cells) {
+    llama_context_params cparams = llama_context_default_params();
+
+    cparams.n_ctx            = n_ctx;
+    cparams.n_batch          = 1024;
+    cparams.n_ubatch         = 1024;
+    cparams.n_seq_max        = n_seq;
+    cparams.n_threads        = 2;
+    cparams.kv_unified       = true; // the defrag is only done with a single stream
+    cparams.defrag_thold     = defrag_thold;
+    cparams.defrag_max_cells = defrag_max_cells;
+
+    llama_context * ctx = llama_init_from_model(model, cparams);
+    assert(ctx != nullptr);
+
+    return ctx;
+}
+
+static llama_kv_cache_unified * get_kv(llama_context * ctx) {
+    auto * kv = dynamic_cast<llama_kv_cache_unified *>(llama_get_memory(ctx));
+    assert(kv != nullptr);
+    return kv;
+}
+
+// decodes the tokens at the positions pos0... of the sequence, returns the logits of the last token
+static std::vector<float> decode(llama_context * ctx, const std::vector<llama_token> & tokens, llama_pos pos0, llama_seq_id seq_id) {
+    llama_batch batch = llama_batch_init(tokens.size(), 0, 1);
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        batch.token   [i]    = tokens[i];
+        batch.pos     [i]    = pos0 + i;
+        batch.n_seq_id[i]    = 1;
+        batch.seq_id  [i][0] = seq_id;
+        batch.logits  [i]    = i == tokens.size() - 1;
+    }
+    batch.n_tokens = tokens.size();
+
+    const int ret = llama_decode(ctx, batch);
+    assert(ret == 0);
+
+    llama_batch_free(batch);
+
+    const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(llama_get_model(ctx)));
+    const float * logits = llama_get_logits_ith(ctx, -1);
+
+    return std::vector<float>(logits, logits + n_vocab);
+}
+
+// max difference of the logits, relative to the largest logit of b
+static float logits_diff(const std::vector<float> & a, const std::vector<float> & b) {
+    assert(a.size() == b.size());
+
+    float diff = 0.0f;
+    float amax = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i) {
+        assert(std::isfinite(a[i]));
+        diff = std::max(diff, std::fabs(a[i] - b[i]));
+        amax = std::max(amax, std::fabs(b[i]));
+    }
+
+    return diff/amax;
+}
+
+static std::vector<uint8_t> state_get(llama_context * ctx) {
+    std::vector<uint8_t> state(llama_state_get_size(ctx));
+    assert(llama_state_get_data(ctx, state.data(), state.size()) == state.size());
+    return state;
+}
+
+// runs the updates until the cache is compact, returns the number of updates
+static int defrag(llama_context * ctx, uint32_t n_max_cells) {
+    llama_kv_cache_unified * kv = get_kv(ctx);
+
+    int n_steps = 0;
+
+    float frag = kv->get_fragmentation();
+
+    while (ctx->kv_self_update(false)) {
+        const uint32_t n_moved = kv->get_defrag_n_moved();
+
+        assert(n_moved > 0);
+        assert(n_max_cells == 0 || n_moved <= n_max_cells);
+
+        // every step shrinks the span of the used cells
+        assert(kv->get_fragmentation() < frag);
+        frag = kv->get_fragmentation();
+
+        n_steps++;
+        assert(n_steps <= (int) n_ctx);
+    }
+
+    assert(kv->get_fragmentation() == 0.0f);
+
+    return n_steps;
+}
+
+int main(int argc, char ** argv) {
+    char * model_path = get_model_or_exit(argc, argv);
+
+    llama_backend_init();
+
+    llama_model_params mparams = llama_model_default_params();
+    mparams.n_gpu_layers = 0;
+
+    llama_model * model = llama_model_load_from_file(model_path, mparams);
+    assert(model != nullptr);
+
+    const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model));
+
+    srand(1234);
+
+    auto tokens = [&](int n) {
+        std::vector<llama_token> res(n);
+        for (auto & t : res) {
+            t = rand() % n_vocab;
+        }
+        return res;
+    };
+
+    std::vector<std::vector<llama_token>> prompts;
+    for (uint32_t s = 0; s < n_seq; ++s) {
+        prompts.push_back(tokens(600));
+    }
+
+    const auto next = tokens(1);
+
+    int n_fail = 0;
+
+    // incremental steps of a few cells, of an odd number of cells and larger than the smallest hole
+    for (uint32_t n_max_cells : { 7u, 64u, 256u }) {
+        llama_context * ctx_ref  = ctx_new(model, -1.0f, 0);
+        llama_context * ctx_full = ctx_new(model, 0.1f,  0);
+        llama_context * ctx_inc  = ctx_new(model, 0.1f,  n_max_cells);
+
+        std::vector<llama_context *> ctxs = { ctx_ref, ctx_full, ctx_inc };
+
+        for (llama_context * ctx : ctxs) {
+            for (uint32_t s = 0; s < n_seq; ++s) {
+                decode(ctx, prompts[s], 0, s);
+            }
+
+            // holes of 600 and 200 cells below 2400 used cells: the fragmentation is ~0.33
+            assert(llama_memory_seq_rm(llama_get_memory(ctx), 1, -1,  -1));
+            assert(llama_memory_seq_rm(llama_get_memory(ctx), 0, 100, 300));
+            assert(get_kv(ctx)->get_fragmentation() > 0.3f);
+        }
+
+        const int n_steps_full = defrag(ctx_full, 0);
+        const int n_steps_inc  = defrag(ctx_inc,  n_max_cells);
+
+        assert(n_steps_full == 1);
+        assert(n_steps_inc  == (int) ((800 + n_max_cells - 1)/n_max_cells));
+
+        assert(get_kv(ctx_ref)->get_fragmentation() > 0.3f);
+
+        // the same cells with the same data in the same places
+        const bool same = state_get(ctx_full) == state_get(ctx_inc);
+
+        for (llama_seq_id s : { 0, 2, 3 }) {
+            assert(llama_memory_seq_pos_min(llama_get_memory(ctx_inc), s) == 0);
+            assert(llama_memory_seq_pos_max(llama_get_memory(ctx_inc), s) == 599);
+        }
+        assert(get_kv(ctx_inc)->get_used() == get_kv(ctx_ref)->get_used());
+
+        // the attention sums the moved cells in another order
+        float diff = 0.0f;
+        for (llama_seq_id s : { 0, 2, 3 }) {
+            const auto a = decode(ctx_ref, next, 600, s);
+            const auto b = decode(ctx_inc, next, 600, s);
+
+            diff = std::max(diff, logits_diff(b, a));
+        }
+
+        const bool ok = same && diff <= 1e-4f;
+
+        printf("defrag_max_cells = %3u: %3d steps, %s layout as the full defrag, logits diff = %.3e %s\n",
+                n_max_cells, n_steps_inc, same ? "same" : "OTHER", diff, ok ? "OK" : "FAIL");
+
+        n_fail += ok ? 0 : 1;
+
+        for (llama_context * ctx : ctxs) {
+            llama_free(ctx);
+        }
+    }
+
+    llama_model_free(model);
+
+    llama_backend_free();
+
+    if (n_fail > 0) {
+        printf("%d cases failed\n", n_fail);
+        return 1;
+    }
+
+    printf("OK\n");
+
+    return 0;
+}
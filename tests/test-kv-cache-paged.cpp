@@ -0,0 +1,292 @@
+// tests the paged KV cache (kv_block_size) against a regular non-unified KV cache with the same number of sequences:
+// the same sequence operations are applied to both contexts and the logits of every decode must match
+//  - seq_cp() shares the blocks of the source, the first write to a shared block copies it (once: the slot search
+//    of prepare() does not copy)
+//  - a batch that needs more blocks than the free ones fails without changing the cache
+//  - seq_rm() returns the blocks without used cells to the pool
+//  - the K-shift of a sequence copies the blocks it shares with the sequences that are not shifted
+//  - the state of a sequence and the whole state are restored into private blocks
+//
+// usage: test-kv-cache-paged <model.gguf> (skipped without a model)
+
+#include "llama.h"
+#include "get-model.h"
+
+#include "llama-kv-cache-unified.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static const uint32_t n_seq    = 4;
+static const uint32_t n_ctx    = 512; // cells of a sequence
+static const uint32_t n_block  = 16;
+
+static llama_context * ctx_new(llama_model * model, bool paged) {
+    llama_context_params cparams = llama_context_default_params();
+
+    // the paged cache gives the whole pool to every sequence, the regular one splits it between the sequences
+    cparams.n_ctx         = paged ? n_ctx : n_ctx*n_seq;
+    cparams.n_batch       = n_ctx;
+    cparams.n_ubatch      = n_ctx;
+    cparams.n_seq_max     = n_seq;
+    cparams.n_threads     = 2;
+    cparams.flash_attn    = true;
+    cparams.kv_unified    = false;
+    cparams.kv_block_size = paged ? n_block : 0;
+
+    llama_context * ctx = llama_init_from_model(model, cparams);
+    assert(ctx != nullptr);
+
+    return ctx;
+}
+
+static llama_kv_cache_unified * get_kv(llama_context * ctx) {
+    auto * kv = dynamic_cast<llama_kv_cache_unified *>(llama_get_memory(ctx));
+    assert(kv != nullptr);
+    return kv;
+}
+
+// decodes the tokens at the positions pos0... of the sequence, returns the logits of the last token (empty on failure)
+static std::vector<float> decode(llama_context * ctx, const std::vector<llama_token> & tokens, llama_pos pos0, llama_seq_id seq_id) {
+    llama_batch batch = llama_batch_init(tokens.size(), 0, 1);
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        batch.token   [i]    = tokens[i];
+        batch.pos     [i]    = pos0 + i;
+        batch.n_seq_id[i]    = 1;
+        batch.seq_id  [i][0] = seq_id;
+        batch.logits  [i]    = i == tokens.size() - 1;
+    }
+    batch.n_tokens = tokens.size();
+
+    std::vector<float> res;
+
+    if (llama_decode(ctx, batch) == 0) {
+        const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(llama_get_model(ctx)));
+        const float * logits = llama_get_logits_ith(ctx, -1);
+        res.assign(logits, logits + n_vocab);
+    }
+
+    llama_batch_free(batch);
+
+    return res;
+}
+
+// max difference of the logits, relative to the largest logit of b
+static float logits_diff(const std::vector<float> & a, const std::vector<float> & b) {
+    assert(!a.empty() && a.size() == b.size());
+
+    float diff = 0.0f;
+    float amax = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i) {
+        assert(std::isfinite(a[i]));
+        diff = std::max(diff, std::fabs(a[i] - b[i]));
+        amax = std::max(amax, std::fabs(b[i]));
+    }
+
+    return diff/amax;
+}
+
+// both contexts apply the same operations
+struct test_pair {
+    llama_context * paged;
+    llama_context * ref;
+
+    void seq_cp(llama_seq_id src, llama_seq_id dst) {
+        llama_memory_seq_rm(llama_get_memory(ref),   dst, -1, -1);
+        llama_memory_seq_cp(llama_get_memory(paged), src, dst, -1, -1);
+        llama_memory_seq_cp(llama_get_memory(ref),   src, dst, -1, -1);
+    }
+
+    void seq_rm(llama_seq_id seq_id, llama_pos p0, llama_pos p1) {
+        assert(llama_memory_seq_rm(llama_get_memory(paged), seq_id, p0, p1));
+        assert(llama_memory_seq_rm(llama_get_memory(ref),   seq_id, p0, p1));
+    }
+
+    void seq_add(llama_seq_id seq_id, llama_pos p0, llama_pos p1, llama_pos shift) {
+        llama_memory_seq_add(llama_get_memory(paged), seq_id, p0, p1, shift);
+        llama_memory_seq_add(llama_get_memory(ref),   seq_id, p0, p1, shift);
+    }
+
+    // the logits of the paged context
+    std::vector<float> decode(const std::vector<llama_token> & tokens, llama_pos pos0, llama_seq_id seq_id) {
+        const std::vector<float> a = ::decode(paged, tokens, pos0, seq_id);
+        const std::vector<float> b = ::decode(ref,   tokens, pos0, seq_id);
+
+        const float diff = logits_diff(a, b);
+        if (diff > 1e-4f) {
+            fprintf(stderr, "seq %d, pos %d: logits differ by %e\n", seq_id, pos0, diff);
+        }
+        assert(diff <= 1e-4f);
+
+        return a;
+    }
+};
+
+int main(int argc, char ** argv) {
+    char * model_path = get_model_or_exit(argc, argv);
+
+    llama_backend_init();
+
+    llama_model_params mparams = llama_model_default_params();
+    mparams.n_gpu_layers = 0;
+
+    llama_model * model = llama_model_load_from_file(model_path, mparams);
+    assert(model != nullptr);
+
+    const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model));
+
+    srand(1234);
+
+    auto tokens = [&](int n) {
+        std::vector<llama_token> res(n);
+        for (auto & t : res) {
+            t = rand() % n_vocab;
+        }
+        return res;
+    };
+
+    test_pair tp = { ctx_new(model, true), ctx_new(model, false) };
+
+    llama_kv_cache_unified * kv = get_kv(tp.paged);
+    assert(kv->get_n_block() == n_block);
+
+    const auto prompt = tokens(40);
+    const auto t1     = tokens(1);
+    const auto t2     = tokens(1);
+
+    // 40 cells: 3 blocks
+    tp.decode(prompt, 0, 0);
+    assert(kv->get_n_blocks_used() == 3);
+
+    // the copies share the blocks of seq 0
+    tp.seq_cp(0, 1);
+    tp.seq_cp(0, 2);
+    assert(kv->get_n_blocks_used() == 3);
+    assert(kv->get_n_blocks_copied() == 0);
+
+    // the first write of seq 1 to the last, shared block copies it, once
+    const auto logits_1 = tp.decode(t1, 40, 1);
+    assert(kv->get_n_blocks_used() == 4);
+    assert(kv->get_n_blocks_copied() == 1);
+
+    // seq 0 still shares the block with seq 2, the write of seq 1 did not change it
+    tp.decode(t2, 40, 0);
+    assert(kv->get_n_blocks_used() == 5);
+    assert(kv->get_n_blocks_copied() == 2);
+
+    // seq 2 owns the original block now, nothing to copy
+    const auto logits_2 = tp.decode(t1, 40, 2);
+    assert(kv->get_n_blocks_used() == 5);
+    assert(kv->get_n_blocks_copied() == 2);
+    assert(logits_diff(logits_2, logits_1) == 0.0f);
+
+    printf("seq_cp and copy-on-write: OK\n");
+
+    // 450 cells need 29 blocks, only 27 are free: the batch fails and the cache is not changed
+    assert(decode(tp.paged, tokens(450), 0, 3).empty());
+    assert(kv->get_n_blocks_used() == 5);
+    assert(kv->get_n_blocks_copied() == 2);
+    assert(llama_memory_seq_pos_max(llama_get_memory(tp.paged), 3) == -1);
+
+    // 7 blocks
+    tp.decode(tokens(100), 0, 3);
+    assert(kv->get_n_blocks_used() == 12);
+
+    printf("blocks needed by a batch: OK\n");
+
+    // the blocks without used cells return to the pool: the 7 blocks of seq 3, the private block of seq 1,
+    // then the last 2 blocks of seq 2 (one private, one shared)
+    tp.seq_rm(3, -1, -1);
+    assert(kv->get_n_blocks_used() == 5);
+    tp.seq_rm(1, -1, -1);
+    assert(kv->get_n_blocks_used() == 4);
+    tp.seq_rm(2, 16, -1);
+    assert(kv->get_n_blocks_used() == 3);
+
+    tp.decode(t2, 16, 2);
+    assert(kv->get_n_blocks_used() == 4);
+
+    printf("seq_rm: OK\n");
+
+    // K-shift: seq 1 shares the blocks of seq 0 and shifts the cells past a removed range, seq 0 is not shifted
+    const uint32_t n_copied = kv->get_n_blocks_copied();
+
+    tp.seq_cp(0, 1);
+    tp.seq_rm (1, 8, 20);
+    tp.seq_add(1, 20, -1, -12);
+
+    tp.decode(t1, 41 - 12, 1);
+    assert(kv->get_n_blocks_copied() >= n_copied + 2);
+
+    tp.decode(t1, 41, 0);
+
+    printf("K-shift: OK\n");
+
+    // the state of seq 0 restored into seq 2 gets its own blocks
+    {
+        const size_t size = llama_state_seq_get_size(tp.paged, 0);
+
+        std::vector<uint8_t> state(size);
+        assert(llama_state_seq_get_data(tp.paged, state.data(), size, 0) == size);
+
+        llama_memory_seq_rm(llama_get_memory(tp.paged), 2, -1, -1);
+
+        const uint32_t n_used = kv->get_n_blocks_used();
+
+        assert(llama_state_seq_set_data(tp.paged, state.data(), size, 2) == size);
+        assert(kv->get_n_blocks_used() == n_used + 3);
+
+        const auto a = decode(tp.paged, t2, 42, 0);
+        const auto b = decode(tp.paged, t2, 42, 2);
+
+        assert(logits_diff(b, a) == 0.0f);
+    }
+
+    // the whole state restored into a new context
+    {
+        const size_t size = llama_state_get_size(tp.paged);
+
+        std::vector<uint8_t> state(size);
+        assert(llama_state_get_data(tp.paged, state.data(), size) == size);
+
+        llama_context * ctx = ctx_new(model, true);
+        assert(llama_state_set_data(ctx, state.data(), size) == size);
+
+        for (llama_seq_id s : { 0, 1 }) {
+            const llama_pos pos = llama_memory_seq_pos_max(llama_get_memory(tp.paged), s) + 1;
+            assert(llama_memory_seq_pos_max(llama_get_memory(ctx), s) + 1 == pos);
+
+            const auto a = decode(tp.paged, t1, pos, s);
+            const auto b = decode(ctx,      t1, pos, s);
+
+            // the cells of a stream are restored without the holes, the attention sums them in another order
+            assert(logits_diff(b, a) <= 1e-4f);
+        }
+
+        llama_free(ctx);
+    }
+
+    printf("state read/write: OK\n");
+
+    llama_memory_seq_rm(llama_get_memory(tp.paged), -1, -1, -1);
+    assert(kv->get_n_blocks_used() == 0);
+
+    llama_free(tp.paged);
+    llama_free(tp.ref);
+    llama_model_free(model);
+
+    llama_backend_free();
+
+    printf("OK\n");
+
+    return 0;
+}
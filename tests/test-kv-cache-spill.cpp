@@ -0,0 +1,246 @@
+// tests the spill tier of the unified KV cache (kv_spill_mib) with a model:
+//  - a sequence spilled out of the full cache and restored gives the same logits as before it was spilled: up to the
+//    order of the sums when the rows are kept as they are, within the quantization error with a Q8_0 spill file
+//  - seq_rm(-1, p0, p1) removes the range from all the sequences, also when restoring a spilled sequence that the
+//    range cuts spills another one: the logits match a context large enough to hold all the sequences
+//
+// usage: test-kv-cache-spill <model.gguf> (skipped without a model)
+
+#include "llama.h"
+#include "get-model.h"
+
+#include "llama-kv-cache-unified.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+static const uint32_t n_seq = 4;
+
+// n_ctx_spill == 0: no spill tier, large enough for all the sequences
+static llama_context * ctx_new(llama_model * model, uint32_t n_ctx_spill, ggml_type type_spill = GGML_TYPE_COUNT, const char * path = nullptr) {
+    llama_context_params cparams = llama_context_default_params();
+
+    cparams.n_ctx         = n_ctx_spill > 0 ? n_ctx_spill : 1024;
+    cparams.n_batch       = 256;
+    cparams.n_ubatch      = 256;
+    cparams.n_seq_max     = n_seq;
+    cparams.n_threads     = 2;
+    cparams.kv_unified    = true;
+    cparams.kv_spill_mib  = n_ctx_spill > 0 ? 16 : 0;
+    cparams.type_kv_spill = type_spill;
+    cparams.kv_spill_path = path;
+
+    llama_context * ctx = llama_init_from_model(model, cparams);
+    assert(ctx != nullptr);
+
+    return ctx;
+}
+
+static llama_kv_cache_unified * get_kv(llama_context * ctx) {
+    auto * kv = dynamic_cast<llama_kv_cache_unified *>(llama_get_memory(ctx));
+    assert(kv != nullptr);
+    return kv;
+}
+
+// decodes the tokens at the positions pos0... of the sequence, returns the logits of the last token
+static std::vector<float> decode(llama_context * ctx, const std::vector<llama_token> & tokens, llama_pos pos0, llama_seq_id seq_id) {
+    llama_batch batch = llama_batch_init(tokens.size(), 0, 1);
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        batch.token   [i]    = tokens[i];
+        batch.pos     [i]    = pos0 + i;
+        batch.n_seq_id[i]    = 1;
+        batch.seq_id  [i][0] = seq_id;
+        batch.logits  [i]    = i == tokens.size() - 1;
+    }
+    batch.n_tokens = tokens.size();
+
+    const int ret = llama_decode(ctx, batch);
+    assert(ret == 0);
+
+    llama_batch_free(batch);
+
+    const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(llama_get_model(ctx)));
+    const float * logits = llama_get_logits_ith(ctx, -1);
+
+    return std::vector<float>(logits, logits + n_vocab);
+}
+
+// max difference of the logits, relative to the largest logit of b
+static float logits_diff(const std::vector<float> & a, const std::vector<float> & b) {
+    assert(a.size() == b.size());
+
+    float diff = 0.0f;
+    float amax = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i) {
+        assert(std::isfinite(a[i]));
+        diff = std::max(diff, std::fabs(a[i] - b[i]));
+        amax = std::max(amax, std::fabs(b[i]));
+    }
+
+    return diff/amax;
+}
+
+// the logits of a probe token before the sequence is spilled and after it is restored
+static float test_restore(llama_model * model, ggml_type type_spill, const char * path, const std::vector<std::vector<llama_token>> & prompts, const std::vector<llama_token> & probe) {
+    llama_context * ctx = ctx_new(model, 256, type_spill, path);
+    llama_memory_t  mem = llama_get_memory(ctx);
+
+    std::vector<std::vector<float>> logits(2);
+
+    for (llama_seq_id s : { 0, 1 }) {
+        decode(ctx, prompts[s], 0, s);
+    }
+
+    for (llama_seq_id s : { 0, 1 }) {
+        logits[s] = decode(ctx, probe, 100, s);
+        llama_memory_seq_rm(mem, s, 100, -1);
+    }
+
+    // 100 more cells: the least recently used sequence 0 is spilled
+    decode(ctx, prompts[2], 0, 2);
+    assert(get_kv(ctx)->get_used() == 200);
+    assert(llama_memory_seq_pos_max(mem, 0) == 99);
+
+    float diff = 0.0f;
+
+    // restoring sequence 0 spills sequence 1, restoring sequence 1 spills sequence 2
+    for (llama_seq_id s : { 0, 1 }) {
+        diff = std::max(diff, logits_diff(decode(ctx, probe, 100, s), logits[s]));
+        assert(get_kv(ctx)->get_used() == 201);
+
+        llama_memory_seq_rm(mem, s, 100, -1);
+    }
+
+    llama_free(ctx);
+
+    return diff;
+}
+
+int main(int argc, char ** argv) {
+    char * model_path = get_model_or_exit(argc, argv);
+
+    llama_backend_init();
+
+    llama_model_params mparams = llama_model_default_params();
+    mparams.n_gpu_layers = 0;
+
+    llama_model * model = llama_model_load_from_file(model_path, mparams);
+    assert(model != nullptr);
+
+    const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model));
+
+    srand(1234);
+
+    auto tokens = [&](int n) {
+        std::vector<llama_token> res(n);
+        for (auto & t : res) {
+            t = rand() % n_vocab;
+        }
+        return res;
+    };
+
+    std::vector<std::vector<llama_token>> prompts;
+    for (uint32_t s = 0; s < n_seq; ++s) {
+        prompts.push_back(tokens(100));
+    }
+
+    const auto probe = tokens(1);
+
+    int n_fail = 0;
+
+    // spill to host memory, rows kept as they are
+    {
+        // the restored cells are in another place, the attention sums them in another order
+        const float diff = test_restore(model, GGML_TYPE_COUNT, nullptr, prompts, probe);
+        const bool  ok   = diff <= 1e-6f;
+
+        printf("spill and restore, host memory:   logits diff = %.3e %s\n", diff, ok ? "OK" : "FAIL");
+
+        n_fail += ok ? 0 : 1;
+    }
+
+    // spill to a Q8_0 file
+    {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path()/("test-kv-cache-spill-" + std::to_string(rand()));
+        std::filesystem::create_directories(dir);
+
+        const float diff = test_restore(model, GGML_TYPE_Q8_0, dir.string().c_str(), prompts, probe);
+        const bool  ok   = diff > 0.0f && diff < 2e-2f && std::filesystem::is_empty(dir);
+
+        printf("spill and restore, Q8_0 file:     logits diff = %.3e %s\n", diff, ok ? "OK" : "FAIL");
+
+        n_fail += ok ? 0 : 1;
+
+        std::filesystem::remove_all(dir);
+    }
+
+    // seq_rm(-1, p0, p1) with a spilled sequence cut by the range
+    {
+        llama_context * ctx = ctx_new(model, 256);
+        llama_context * ref = ctx_new(model, 0);
+
+        std::vector<llama_context *> ctxs = { ctx, ref };
+
+        for (llama_context * c : ctxs) {
+            decode(c, prompts[1], 0, 1);
+            decode(c, prompts[0], 0, 0);
+            decode(c, std::vector<llama_token>(prompts[2].begin(), prompts[2].begin() + 30), 0, 2);
+
+            // 100 more cells: the least recently used sequence 1 is spilled
+            decode(c, prompts[3], 0, 3);
+        }
+        assert(get_kv(ctx)->get_used() == 230);
+
+        // restoring sequence 1 needs the cells of the least recently used sequence 0, that the range cuts too
+        for (llama_context * c : ctxs) {
+            assert(llama_memory_seq_rm(llama_get_memory(c), -1, 50, 80));
+        }
+
+        float diff = 0.0f;
+
+        for (llama_seq_id s = 0; s < (llama_seq_id) n_seq; ++s) {
+            const llama_pos pos = llama_memory_seq_pos_max(llama_get_memory(ref), s) + 1;
+            assert(llama_memory_seq_pos_max(llama_get_memory(ctx), s) + 1 == pos);
+
+            const auto a = decode(ref, probe, pos, s);
+            const auto b = decode(ctx, probe, pos, s);
+
+            // the cells are in other places, the attention sums them in another order
+            diff = std::max(diff, logits_diff(b, a));
+        }
+
+        const bool ok = diff <= 1e-4f;
+
+        printf("seq_rm of all the sequences:      logits diff = %.3e %s\n", diff, ok ? "OK" : "FAIL");
+
+        n_fail += ok ? 0 : 1;
+
+        for (llama_context * c : ctxs) {
+            llama_free(c);
+        }
+    }
+
+    llama_model_free(model);
+
+    llama_backend_free();
+
+    if (n_fail > 0) {
+        printf("%d cases failed\n", n_fail);
+        return 1;
+    }
+
+    printf("OK\n");
+
+    return 0;
+}
@@ -0,0 +1,330 @@
+// tests the spill tier of the KV cache (llama_kv_spill) without a model:
+//  - the state written with llama_io_write_spill reads back with llama_io_read_spill: byte for byte when the rows are
+//    kept as they are, within the quantization error when they are converted (e.g. Q8_0)
+//  - the extents of the spill file are reused first fit, merged with their neighbours and given back to the end
+//  - every spill tier creates its own file in the directory and removes it
+//
+// usage: test-kv-spill
+
+#include "ggml.h"
+#include "ggml-backend.h"
+
+#include "llama-kv-spill.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static std::vector<uint8_t> bytes(size_t n, uint8_t seed) {
+    std::vector<uint8_t> res(n);
+    for (size_t i = 0; i < n; ++i) {
+        res[i] = (uint8_t) (seed + 31*i);
+    }
+    return res;
+}
+
+// writes a state made of raw records and of F16/BF16/F32 tensor rows, reads it back and compares it with the original
+// returns the NMSE of the rows, -1 if the raw records or the rows that cannot be converted differ
+static double test_io(ggml_backend_buffer_type_t buft, ggml_type type_rows, size_t & n_spilled, size_t & n_bytes) {
+    ggml_init_params params = {
+        /*.mem_size   =*/ 8*ggml_tensor_overhead(),
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ true,
+    };
+    ggml_context * ctx = ggml_init(params);
+
+    std::vector<ggml_tensor *> tensors = {
+        ggml_new_tensor_2d(ctx, GGML_TYPE_F16,  128, 16),
+        ggml_new_tensor_2d(ctx, GGML_TYPE_BF16, 64,  8),
+        ggml_new_tensor_2d(ctx, GGML_TYPE_F32,  96,  4),
+    };
+
+    ggml_backend_buffer_t buf = ggml_backend_alloc_ctx_tensors_from_buft(ctx, buft);
+    assert(buf != nullptr);
+
+    for (ggml_tensor * t : tensors) {
+        std::vector<float> data(ggml_nelements(t));
+        for (auto & x : data) {
+            x = 2.0f*rand()/(float) RAND_MAX - 1.0f;
+        }
+
+        std::vector<uint8_t> row(ggml_nbytes(t));
+        switch (t->type) {
+            case GGML_TYPE_F16:  ggml_fp32_to_fp16_row(data.data(), (ggml_fp16_t *) row.data(), data.size()); break;
+            case GGML_TYPE_BF16: ggml_fp32_to_bf16_row(data.data(), (ggml_bf16_t *) row.data(), data.size()); break;
+            default:             memcpy(row.data(), data.data(), row.size()); break;
+        }
+        ggml_backend_tensor_set(t, row.data(), 0, row.size());
+    }
+
+    // the same pieces as the state of a sequence: metadata, whole K rows and V elements of a transposed cache
+    struct piece {
+        ggml_tensor * t;      // nullptr: raw bytes
+        size_t        offset;
+        size_t        size;
+        bool          exact;  // not converted
+    };
+
+    const std::vector<uint8_t> meta0 = bytes(13, 1);
+    const std::vector<uint8_t> meta1 = bytes(7,  2);
+    const std::vector<uint8_t> meta2 = bytes(5,  3);
+
+    const std::vector<piece> pieces = {
+        { nullptr,    0,                          meta0.size(),                  true  },
+        { nullptr,    0,                          meta1.size(),                  true  }, // merged with the previous one
+        { tensors[0], 0,                          ggml_nbytes(tensors[0]),       false },
+        { tensors[0], 2*ggml_row_size(GGML_TYPE_F16, 128), 5*sizeof(ggml_fp16_t), true }, // shorter than a block
+        { nullptr,    0,                          meta2.size(),                  true  },
+        { tensors[1], ggml_row_size(GGML_TYPE_BF16, 64),   ggml_row_size(GGML_TYPE_BF16, 64)*3, false },
+        { tensors[2], 0,                          ggml_nbytes(tensors[2]),       false },
+    };
+
+    const std::vector<uint8_t> * metas[] = { &meta0, &meta1, &meta2 };
+
+    llama_io_write_spill io_w(type_rows);
+
+    std::vector<std::vector<uint8_t>> orig;
+
+    for (size_t i = 0, im = 0; i < pieces.size(); ++i) {
+        const piece & p = pieces[i];
+
+        if (!p.t) {
+            io_w.write(metas[im]->data(), metas[im]->size());
+            orig.push_back(*metas[im++]);
+            continue;
+        }
+
+        io_w.write_tensor(p.t, p.offset, p.size);
+
+        std::vector<uint8_t> data(p.size);
+        ggml_backend_tensor_get(p.t, data.data(), p.offset, p.size);
+        orig.push_back(data);
+    }
+
+    n_spilled = io_w.data().size();
+    n_bytes   = io_w.n_bytes();
+
+    llama_io_read_spill io_r(io_w.data());
+    assert(io_r.size() == n_bytes);
+
+    double err = 0.0;
+    double sum = 0.0;
+
+    bool exact = true;
+
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        const piece & p = pieces[i];
+
+        std::vector<uint8_t> data(p.size);
+        io_r.read_to(data.data(), p.size);
+
+        if (p.exact || type_rows == GGML_TYPE_COUNT) {
+            exact = exact && data == orig[i];
+            continue;
+        }
+
+        const ggml_type type = p.t->type;
+        const size_t    n    = p.size/ggml_type_size(type);
+
+        std::vector<float> a(n);
+        std::vector<float> b(n);
+        if (type == GGML_TYPE_F32) {
+            memcpy(a.data(), data.data(),    p.size);
+            memcpy(b.data(), orig[i].data(), p.size);
+        } else {
+            ggml_get_type_traits(type)->to_float(data.data(),    a.data(), n);
+            ggml_get_type_traits(type)->to_float(orig[i].data(), b.data(), n);
+        }
+
+        for (size_t k = 0; k < n; ++k) {
+            err += (a[k] - b[k])*(double) (a[k] - b[k]);
+            sum += b[k]*(double) b[k];
+        }
+    }
+
+    assert(io_r.n_bytes() == n_bytes);
+
+    // nothing left to read
+    bool threw = false;
+    try {
+        io_r.read(1);
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    assert(threw);
+
+    // truncated spill data
+    threw = false;
+    try {
+        std::vector<uint8_t> data = io_w.data();
+        data.resize(data.size() - 1);
+        llama_io_read_spill io_t(data);
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    assert(threw);
+
+    ggml_backend_buffer_free(buf);
+    ggml_free(ctx);
+
+    return exact ? (sum > 0.0 ? err/sum : 0.0) : -1.0;
+}
+
+static int test_file(const fs::path & dir) {
+    int n_fail = 0;
+
+    auto check = [&](bool ok, const char * what) {
+        if (!ok) {
+            printf("  %s: FAIL\n", what);
+            n_fail++;
+        }
+    };
+
+    {
+        llama_kv_spill spill(1000, GGML_TYPE_COUNT, dir.string());
+
+        const auto a = bytes(100, 1);
+        const auto b = bytes(200, 2);
+        const auto c = bytes(300, 3);
+        const auto d = bytes(250, 4);
+        const auto e = bytes(120, 5);
+
+        assert(spill.store(0, 0, 9, 10, a));
+        assert(spill.store(1, 0, 9, 10, b));
+        assert(spill.store(2, 0, 9, 10, c));
+        check(spill.get_file_end() == 600 && spill.get_file_n_free() == 0, "append");
+
+        // [100, 300) free
+        spill.erase(1);
+        check(spill.get_file_end() == 600 && spill.get_file_n_free() == 1, "free extent");
+
+        // merged with the next extent: [0, 300) free
+        spill.erase(0);
+        check(spill.get_file_end() == 600 && spill.get_file_n_free() == 1, "merge with the next extent");
+
+        // first fit: stored at [0, 250), [250, 300) stays free
+        assert(spill.store(3, 0, 9, 10, d));
+        check(spill.get_file_end() == 600 && spill.get_file_n_free() == 1, "first fit");
+
+        // does not fit into [250, 300): appended
+        assert(spill.store(4, 0, 9, 10, e));
+        check(spill.get_file_end() == 720 && spill.get_file_n_free() == 1, "append after the free extents");
+
+        check(spill.load(2) == c && spill.load(3) == d && spill.load(4) == e, "load");
+
+        // the tier is full
+        check(!spill.can_store(400) && !spill.store(0, 0, 9, 10, bytes(400, 6)), "full");
+
+        // merged with the previous extent: [250, 600)
+        spill.erase(2);
+        check(spill.get_file_end() == 720 && spill.get_file_n_free() == 1, "merge with the previous extent");
+
+        // merged with both neighbours, the last extent goes back to the end of the file
+        spill.erase(4);
+        check(spill.get_file_end() == 250 && spill.get_file_n_free() == 0, "release the end of the file");
+
+        spill.erase(3);
+        check(spill.get_file_end() == 0 && spill.get_file_n_free() == 0 && spill.get_size() == 0, "empty");
+
+        // released in the middle, then both sides
+        assert(spill.store(0, 0, 9, 10, a));
+        assert(spill.store(1, 0, 9, 10, b));
+        assert(spill.store(2, 0, 9, 10, c));
+        assert(spill.store(3, 0, 9, 10, d));
+        spill.erase(0);
+        spill.erase(2);
+        check(spill.get_file_n_free() == 2, "two free extents");
+        spill.erase(1);
+        check(spill.get_file_end() == 850 && spill.get_file_n_free() == 1, "merge with both neighbours");
+        check(spill.load(3) == d, "load after the merge");
+    }
+
+    // two spill tiers in the same directory (e.g. the main and the draft contexts) have their own files
+    {
+        llama_kv_spill spill0(1000, GGML_TYPE_COUNT, dir.string());
+        llama_kv_spill spill1(1000, GGML_TYPE_COUNT, dir.string());
+
+        const auto a = bytes(100, 7);
+        const auto b = bytes(100, 8);
+
+        assert(spill0.store(0, 0, 9, 10, a));
+        assert(spill1.store(0, 0, 9, 10, b));
+
+        check(spill0.load(0) == a && spill1.load(0) == b, "separate files");
+        check(std::distance(fs::directory_iterator(dir), fs::directory_iterator()) == 2, "two files");
+    }
+
+    check(fs::is_empty(dir), "files removed");
+
+    bool threw = false;
+    try {
+        llama_kv_spill spill(1000, GGML_TYPE_COUNT, (dir/"missing").string());
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    check(threw, "missing directory");
+
+    return n_fail;
+}
+
+int main(void) {
+    ggml_backend_load_all();
+
+    srand(1234);
+
+    ggml_backend_dev_t dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+    assert(dev != nullptr);
+
+    ggml_backend_buffer_type_t buft = ggml_backend_dev_buffer_type(dev);
+
+    int n_fail = 0;
+
+    for (ggml_type type_rows : { GGML_TYPE_COUNT, GGML_TYPE_F16, GGML_TYPE_Q8_0, GGML_TYPE_Q4_0 }) {
+        size_t n_spilled = 0;
+        size_t n_bytes   = 0;
+
+        const double nmse = test_io(buft, type_rows, n_spilled, n_bytes);
+
+        // Q4_0 keeps ~4 bits per value
+        const double max_nmse = type_rows == GGML_TYPE_Q4_0 ? 1e-2 : type_rows == GGML_TYPE_Q8_0 ? 1e-4 : 1e-5;
+
+        const bool ok = nmse >= 0.0 && nmse < max_nmse;
+
+        printf("spill io %-5s: %5zu -> %5zu bytes, nmse = %.3e %s\n", type_rows == GGML_TYPE_COUNT ? "same" : ggml_type_name(type_rows),
+                n_bytes, n_spilled, nmse, ok ? "OK" : "FAIL");
+
+        n_fail += ok ? 0 : 1;
+    }
+
+    const fs::path dir = fs::temp_directory_path()/("test-kv-spill-" + std::to_string(rand()));
+    fs::create_directories(dir);
+
+    const int n_fail_file = test_file(dir);
+
+    printf("spill file: %s\n", n_fail_file == 0 ? "OK" : "FAIL");
+
+    n_fail += n_fail_file;
+
+    fs::remove_all(dir);
+
+    if (n_fail > 0) {
+        printf("%d cases failed\n", n_fail);
+        return 1;
+    }
+
+    printf("OK\n");
+
+    return 0;
+}
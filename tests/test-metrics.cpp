@@ -0,0 +1,107 @@
+// checks that the sharded counters and histograms of llama_metrics add up across threads
+// and that the registry renders them in the Prometheus text format
+
+#include "llama-metrics.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void test_counter_threads() {
+    llama_metrics_registry reg;
+
+    auto * c = reg.counter("test:events_total", "Events.");
+    auto * h = reg.histogram("test:size", "Sizes.", { 1.0, 4.0, 16.0 });
+
+    const int n_threads = 2*LLAMA_METRICS_N_SHARDS + 3;
+    const int n_iter    = 10000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < n_threads; t++) {
+        threads.emplace_back([c, h, t]() {
+            for (int i = 0; i < n_iter; i++) {
+                c->add();
+                h->observe((double) (t % 20));
+            }
+        });
+    }
+    for (auto & t : threads) {
+        t.join();
+    }
+
+    assert(c->value() == (double) n_threads*n_iter);
+
+    std::vector<uint64_t> buckets;
+    double   sum;
+    uint64_t count;
+    h->collect(buckets, sum, count);
+
+    assert(buckets.size() == 4);
+    assert(count == (uint64_t) n_threads*n_iter);
+    assert(buckets.back() == count);
+
+    double   sum_ref = 0.0;
+    uint64_t le[3]   = { 0, 0, 0 };
+    for (int t = 0; t < n_threads; t++) {
+        const double v = t % 20;
+        sum_ref += v*n_iter;
+        le[0] += v <=  1.0 ? n_iter : 0;
+        le[1] += v <=  4.0 ? n_iter : 0;
+        le[2] += v <= 16.0 ? n_iter : 0;
+    }
+    assert(sum == sum_ref);
+    assert(buckets[0] == le[0] && buckets[1] == le[1] && buckets[2] == le[2]);
+}
+
+static void test_render() {
+    llama_metrics_registry reg;
+
+    // the same name and labels return the same metric
+    auto * a = reg.counter("test:seconds_total", "Time.", "component=\"attention\"");
+    auto * f = reg.counter("test:seconds_total", "Time.", "component=\"feed_forward\"");
+    assert(a == reg.counter("test:seconds_total", "Time.", "component=\"attention\""));
+    assert(a != f);
+
+    a->add(1.5);
+    f->add(0.25);
+    reg.gauge("test:used", "Used.")->set(7);
+
+    auto * h = reg.histogram("test:latency_seconds", "Latency.", llama_metrics_exponential_buckets(0.5, 2.0, 2));
+    h->observe(0.5);
+    h->observe(0.75);
+    h->observe(3.0);
+
+    const std::string out = reg.render();
+    printf("%s", out.c_str());
+
+    const char * expected[] = {
+        "# HELP test:seconds_total Time.\n# TYPE test:seconds_total counter\n",
+        "test:seconds_total{component=\"attention\"} 1.5\n",
+        "test:seconds_total{component=\"feed_forward\"} 0.25\n",
+        "# TYPE test:used gauge\ntest:used 7\n",
+        "# TYPE test:latency_seconds histogram\n",
+        "test:latency_seconds_bucket{le=\"0.5\"} 1\n",
+        "test:latency_seconds_bucket{le=\"1\"} 2\n",
+        "test:latency_seconds_bucket{le=\"+Inf\"} 3\n",
+        "test:latency_seconds_sum 4.25\n",
+        "test:latency_seconds_count 3\n",
+    };
+    for (const char * e : expected) {
+        assert(out.find(e) != std::string::npos);
+    }
+}
+
+int main() {
+    test_counter_threads();
+    test_render();
+
+    printf("OK\n");
+
+    return 0;
+}
@@ -0,0 +1,250 @@
+// tests the distribution of the chunks of an op across the threads of a threadpool and the barriers elided
+// between the nodes of a graph:
+//  - every chunk is taken by exactly one thread while all the threads take and steal chunks concurrently
+//  - a thread that starts late finds its range stolen by the others
+//  - a graph of static nodes that depend on the rows written by the other threads gives the same results with the
+//    barriers elided, with all the barriers (an abort callback disables the elision) and with a single thread, the
+//    compute time of the graph is reported for both
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+#include "ggml-cpu-impl.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+static ggml_threadpool * threadpool_new(int n_threads) {
+    ggml_threadpool_params tpp = ggml_threadpool_params_default(n_threads);
+    tpp.paused = true; // the workers of the pool are not used by the chunk tests
+
+    ggml_threadpool * tp = ggml_threadpool_new(&tpp);
+    assert(tp != nullptr);
+    return tp;
+}
+
+// the chunks taken by each thread, thread late starts once all the other threads are done
+static void take_chunks(ggml_threadpool * tp, int nth, int n_chunks, int late, std::vector<std::vector<int>> & taken) {
+    ggml_threadpool_chunks_reset(tp, nth, n_chunks);
+
+    std::atomic<int> n_ready{0};
+    std::atomic<int> n_done {0};
+
+    std::vector<std::thread> threads;
+    for (int ith = 0; ith < nth; ++ith) {
+        threads.emplace_back([&, ith]() {
+            taken[ith].clear();
+
+            // start together to contend on the ranges
+            n_ready++;
+            while (n_ready.load() < nth) {
+                std::this_thread::yield();
+            }
+
+            if (ith == late) {
+                while (n_done.load() < nth - 1) {
+                    std::this_thread::yield();
+                }
+            }
+
+            for (int chunk = ggml_threadpool_chunks_next(tp, ith, nth); chunk >= 0; chunk = ggml_threadpool_chunks_next(tp, ith, nth)) {
+                taken[ith].push_back(chunk);
+
+                // uneven work so that the threads steal from each other
+                volatile int x = 0;
+                for (int i = 0; i < (ith + 1)*(chunk % 7)*50; ++i) {
+                    x = x + i;
+                }
+            }
+
+            n_done++;
+        });
+    }
+
+    for (auto & t : threads) {
+        t.join();
+    }
+}
+
+static void test_chunks_coverage(int nth, int n_rounds) {
+    ggml_threadpool * tp = threadpool_new(nth);
+
+    std::vector<std::vector<int>> taken(nth);
+
+    int64_t n_stolen = 0;
+
+    for (int n_chunks : { 0, 1, nth - 1, nth, nth + 1, 97, 1000, 4096 }) {
+        for (int round = 0; round < n_rounds; ++round) {
+            take_chunks(tp, nth, n_chunks, -1, taken);
+
+            std::vector<int> count(n_chunks, 0);
+            for (int ith = 0; ith < nth; ++ith) {
+                const int own0 = (int) (((int64_t) ith*n_chunks)/nth);
+                const int own1 = (int) (((int64_t) (ith + 1)*n_chunks)/nth);
+
+                for (int chunk : taken[ith]) {
+                    assert(chunk >= 0 && chunk < n_chunks);
+                    count[chunk]++;
+                    n_stolen += chunk < own0 || chunk >= own1;
+                }
+
+                // nothing left once the op is done
+                assert(ggml_threadpool_chunks_next(tp, ith, nth) == -1);
+            }
+
+            for (int chunk = 0; chunk < n_chunks; ++chunk) {
+                if (count[chunk] != 1) {
+                    fprintf(stderr, "nth = %d, n_chunks = %d: chunk %d taken %d times\n", nth, n_chunks, chunk, count[chunk]);
+                }
+                assert(count[chunk] == 1);
+            }
+        }
+    }
+
+    // the other threads take all the chunks of a thread that starts after they are done
+    take_chunks(tp, nth, 1000, 0, taken);
+    assert(taken[0].empty());
+
+    size_t n_taken = 0;
+    for (int ith = 0; ith < nth; ++ith) {
+        n_taken += taken[ith].size();
+    }
+    assert(n_taken == 1000);
+
+    printf("%s: nth = %d, %lld chunks stolen: OK\n", __func__, nth, (long long) n_stolen);
+
+    ggml_threadpool_free(tp);
+}
+
+static bool abort_never(void * data) {
+    (void) data;
+    return false;
+}
+
+static void fill(ggml_tensor * t) {
+    float * data = (float *) t->data;
+    for (int64_t i = 0; i < ggml_nelements(t); ++i) {
+        data[i] = 2.0f*rand()/(float) RAND_MAX - 1.0f;
+    }
+}
+
+// chains of static nodes: each node reads the rows of the previous node written by the other threads (transposed)
+// or is independent of the nodes since the last barrier, some of them in place
+static ggml_tensor * build_graph(ggml_context * ctx, ggml_cgraph * gf, int n_chains, int n_steps) {
+    const int64_t n = 96;
+
+    std::vector<ggml_tensor *> x(n_chains);
+    for (int c = 0; c < n_chains; ++c) {
+        x[c] = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, n, n);
+        fill(x[c]);
+    }
+
+    ggml_tensor * w = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, n);
+    fill(w);
+
+    // the steps of the chains are interleaved so that independent nodes follow each other
+    for (int s = 0; s < n_steps; ++s) {
+        for (int c = 0; c < n_chains; ++c) {
+            switch ((s + c) % 4) {
+                case 0: x[c] = ggml_cont(ctx, ggml_transpose(ctx, x[c]));     break;
+                case 1: x[c] = ggml_add(ctx, x[c], ggml_transpose(ctx, x[c])); break;
+                case 2: x[c] = ggml_rms_norm(ctx, x[c], 1e-6f);                break;
+                case 3: x[c] = ggml_mul_inplace(ctx, x[c], w);                 break;
+            }
+        }
+    }
+
+    ggml_tensor * out = x[0];
+    for (int c = 1; c < n_chains; ++c) {
+        out = ggml_add(ctx, out, x[c]);
+    }
+
+    ggml_build_forward_expand(gf, out);
+
+    return out;
+}
+
+static void test_barrier_elision(int nth, int n_rounds) {
+    ggml_init_params params = {
+        /*.mem_size   =*/ 16*1024*1024,
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ false,
+    };
+    ggml_context * ctx = ggml_init(params);
+
+    srand(1234);
+
+    ggml_cgraph * gf  = ggml_new_graph(ctx);
+    ggml_tensor * out = build_graph(ctx, gf, 6, 12);
+
+    const size_t nbytes = ggml_nbytes(out);
+
+    // the inputs of the in-place nodes are overwritten, every compute starts from the same inputs
+    std::vector<uint8_t> inputs(ggml_get_mem_size(ctx));
+    memcpy(inputs.data(), ggml_get_mem_buffer(ctx), inputs.size());
+
+    // compute time of the graph with all the barriers and with the barriers elided
+    int64_t t_us[2] = { 0, 0 };
+
+    auto compute = [&](ggml_threadpool * tp, int n_threads, bool elide) {
+        memcpy(ggml_get_mem_buffer(ctx), inputs.data(), inputs.size());
+
+        ggml_cplan cplan = ggml_graph_plan(gf, n_threads, tp);
+        std::vector<uint8_t> work(cplan.work_size);
+        cplan.work_data = work.data();
+        if (!elide) {
+            cplan.abort_callback = abort_never;
+        }
+
+        const int64_t t_start_us = ggml_time_us();
+
+        ggml_status status = ggml_graph_compute(gf, &cplan);
+        assert(status == GGML_STATUS_SUCCESS);
+
+        t_us[elide] += ggml_time_us() - t_start_us;
+
+        return std::vector<uint8_t>((const uint8_t *) out->data, (const uint8_t *) out->data + nbytes);
+    };
+
+    const std::vector<uint8_t> ref = compute(nullptr, 1, false);
+
+    ggml_threadpool_params tpp = ggml_threadpool_params_default(nth);
+    ggml_threadpool * tp = ggml_threadpool_new(&tpp);
+
+    t_us[0] = t_us[1] = 0;
+
+    for (int round = 0; round < n_rounds; ++round) {
+        assert(compute(tp, nth, false) == ref);
+        assert(compute(tp, nth, true)  == ref);
+    }
+
+    printf("%s: nth = %d, %d nodes, %.1f us/graph with all the barriers, %.1f us/graph with elided barriers: OK\n",
+            __func__, nth, ggml_graph_n_nodes(gf), (double) t_us[0]/n_rounds, (double) t_us[1]/n_rounds);
+
+    ggml_threadpool_free(tp);
+    ggml_free(ctx);
+}
+
+int main(int argc, char ** argv) {
+    const int n_rounds = argc > 1 ? atoi(argv[1]) : 20;
+
+    for (int nth : { 2, 3, 8 }) {
+        test_chunks_coverage(nth, n_rounds);
+    }
+
+    for (int nth : { 2, 4 }) {
+        test_barrier_elision(nth, n_rounds);
+    }
+
+    printf("OK\n");
+
+    return 0;
+}
@@ -0,0 +1,412 @@
+#include "llama-instrumentation.h"
+#include "llama-instrumentation-trace.h"
+
+#include "ggml.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Converts a binary instrumentation trace (llama_instr_format::BINARY) to the JSONL log format
+
+static void print_usage(const char * argv0) {
+    printf("usage: %s [options] TRACE_FILE\n\n", argv0);
+    printf("Converts a binary instrumentation trace to JSONL, one event per line,\n");
+    printf("in the same format that the instrumentation writes in JSONL mode.\n\n");
+    printf("    -h, --help              print this help and exit\n");
+    printf("    -o FNAME, --output FNAME write to FNAME instead of standard output\n");
+    printf("    --stats                 only print the number of events per type\n");
+}
+
+static const char * trace_event_name(uint8_t type) {
+    switch (type) {
+        case LLAMA_TRACE_EVENT_SESSION_START: return "session_start";
+        case LLAMA_TRACE_EVENT_SESSION_END:   return "session_end";
+        case LLAMA_TRACE_EVENT_STEP_BEGIN:    return "step_begin";
+        case LLAMA_TRACE_EVENT_STEP_END:      return "step_end";
+        case LLAMA_TRACE_EVENT_INPUT_TOKENS:  return "input_tokens";
+        case LLAMA_TRACE_EVENT_OUTPUT_TOKEN:  return "output_token";
+        case LLAMA_TRACE_EVENT_TOKEN:         return "token";
+        case LLAMA_TRACE_EVENT_TENSOR:        return "tensor_metadata";
+        case LLAMA_TRACE_EVENT_TENSOR_SHAPE:  return "tensor_shape";
+        case LLAMA_TRACE_EVENT_TENSOR_CTX:    return "tensor_ctx";
+        case LLAMA_TRACE_EVENT_SAMPLING:      return "sampling_state";
+        case LLAMA_TRACE_EVENT_CANDIDATE:     return "candidate";
+        case LLAMA_TRACE_EVENT_LAYER:         return "layer";
+        case LLAMA_TRACE_EVENT_PARAM:         return "param";
+        case LLAMA_TRACE_EVENT_KV_UPDATE:     return "kv_cache_update";
+        case LLAMA_TRACE_EVENT_PERF:          return "performance_metric";
+        case LLAMA_TRACE_EVENT_MODEL_METRICS: return "model_metrics";
+        default:                              return "unknown";
+    }
+}
+
+static std::chrono::high_resolution_clock::time_point trace_time_point(int64_t t_us) {
+    return std::chrono::high_resolution_clock::time_point(
+        std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::microseconds(t_us)));
+}
+
+// same format as llama_instrumentation::get_current_timestamp()
+static std::string trace_timestamp(int64_t t_us) {
+    const time_t t = (time_t) (t_us / 1000000);
+
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&t), "%Y-%m-%d %H:%M:%S");
+    ss << '.' << std::setfill('0') << std::setw(3) << (t_us / 1000) % 1000;
+    return ss.str();
+}
+
+static std::string trace_escape(const std::string & str) {
+    std::string res;
+    for (char c : str) {
+        switch (c) {
+            case '"':  res += "\\\""; break;
+            case '\\': res += "\\\\"; break;
+            case '\n': res += "\\n";  break;
+            case '\r': res += "\\r";  break;
+            case '\t': res += "\\t";  break;
+            default:   res += c;
+        }
+    }
+    return res;
+}
+
+struct trace_converter {
+    llama_trace_reader & reader;
+    FILE * out;
+
+    std::string session_id;
+
+    // events that carry a number of follow-up records are decoded by pulling those records directly
+    bool next(llama_trace_event & ev, uint8_t type) {
+        if (!reader.next(ev)) {
+            return false;
+        }
+        if (ev.type != type) {
+            fprintf(stderr, "warning: expected a %s record, got %s\n", trace_event_name(type), trace_event_name(ev.type));
+            return false;
+        }
+        return true;
+    }
+
+    bool read_params(std::map<std::string, double> & params, int n) {
+        for (int i = 0; i < n; ++i) {
+            llama_trace_event ev;
+            if (!next(ev, LLAMA_TRACE_EVENT_PARAM)) {
+                return false;
+            }
+            params[reader.str(ev.name)] = llama_trace_as_f64(ev.v[0]);
+        }
+        return true;
+    }
+
+    void write(const std::string & line) {
+        fputs(line.c_str(), out);
+        fputc('\n', out);
+    }
+
+    bool convert(const llama_trace_event & ev) {
+        std::stringstream entry;
+
+        switch (ev.type) {
+            case LLAMA_TRACE_EVENT_SESSION_START:
+                {
+                    session_id = reader.str(ev.name);
+                    entry << "{\"event\":\"session_start\",\"timestamp\":\"" << trace_timestamp(ev.t_us)
+                          << "\",\"session_id\":\"" << session_id
+                          << "\",\"prompt\":\"" << trace_escape(reader.str(ev.v[0])) << "\"}";
+                } break;
+            case LLAMA_TRACE_EVENT_SESSION_END:
+                {
+                    entry << "{\"event\":\"session_end\",\"timestamp\":\"" << trace_timestamp(ev.t_us)
+                          << "\",\"session_id\":\"" << reader.str(ev.name)
+                          << "\",\"duration_ms\":" << llama_trace_as_i64(ev.v[0])
+                          << ",\"total_steps\":" << llama_trace_as_i64(ev.v[1])
+                          << ",\"input_token_count\":" << llama_trace_as_i64(ev.v[2])
+                          << ",\"output_token_count\":" << llama_trace_as_i64(ev.v[3])
+                          << "}";
+                } break;
+            case LLAMA_TRACE_EVENT_STEP_BEGIN:
+                {
+                    entry << "{\"event\":\"step_begin\",\"timestamp\":\"" << trace_timestamp(ev.t_us)
+                          << "\",\"step_id\":" << llama_trace_as_i64(ev.v[0])
+                          << ",\"step_name\":\"" << reader.str(ev.name)
+                          << "\",\"layer_id\":" << ev.layer
+                          << ",\"session_id\":\"" << session_id << "\"}";
+                } break;
+            case LLAMA_TRACE_EVENT_STEP_END:
+                {
+                    llama_step_metrics metrics;
+                    metrics.step_name      = reader.str(ev.name);
+                    metrics.step_id        = (int) llama_trace_as_i64(ev.v[0]);
+                    metrics.layer_id       = ev.layer;
+                    metrics.execution_time = std::chrono::microseconds(llama_trace_as_i64(ev.v[1]));
+                    metrics.notes          = reader.str(ev.v[2]);
+
+                    entry << "{\"event\":\"step_end\",\"timestamp\":\"" << trace_timestamp(ev.t_us)
+                          << "\",\"duration_ms\":" << metrics.execution_time.count() / 1000.0
+                          << ",\"metrics\":" << metrics.to_json()
+                          << ",\"session_id\":\"" << session_id << "\"}";
+                } break;
+            case LLAMA_TRACE_EVENT_INPUT_TOKENS:
+                {
+                    const int64_t n_tokens = llama_trace_as_i64(ev.v[0]);
+
+                    entry << "{\"event\":\"input_tokens\",\"timestamp\":\"" << trace_timestamp(ev.t_us)
+                          << "\",\"n_tokens\":" << n_tokens
+                          << ",\"tokens\":[";
+                    for (int64_t i = 0; i < n_tokens; ++i) {
+                        llama_trace_event tev;
+                        if (!next(tev, LLAMA_TRACE_EVENT_TOKEN)) {
+                            return false;
+                        }
+
+                        llama_token_info info;
+                        info.token_id    = (int) llama_trace_as_i64(tev.v[0]);
+                        info.probability = 1.0;
+                        info.position    = (int) llama_trace_as_i64(tev.v[1]);
+                        info.seq_id      = 0;
+                        info.timestamp   = trace_time_point(llama_trace_as_i64(tev.v[2]));
+
+                        if (i > 0) entry << ",";
+                        entry << info.to_json();
+                    }
+                    entry << "],\"session_id\":\"" << session_id << "\"}";
+                } break;
+            case LLAMA_TRACE_EVENT_OUTPUT_TOKEN:
+                {
+                    llama_token_info info;
+                    info.token_id    = (int) llama_trace_as_i64(ev.v[0]);
+                    info.probability = llama_trace_as_f64(ev.v[1]);
+                    info.position    = (int) llama_trace_as_i64(ev.v[2]);
+                    info.seq_id      = 0;
+                    info.timestamp   = trace_time_point(ev.t_us);
+
+                    entry << "{\"event\":\"output_token\",\"timestamp\":\"" << trace_timestamp(ev.t_us)
+                          << "\",\"token\":" << info.to_json()
+                          << ",\"session_id\":\"" << session_id << "\"}";
+                } break;
+            case LLAMA_TRACE_EVENT_TENSOR:
+                {
+                    llama_trace_event shape;
+                    llama_trace_event ctx;
+                    if (!next(shape, LLAMA_TRACE_EVENT_TENSOR_SHAPE) || !next(ctx, LLAMA_TRACE_EVENT_TENSOR_CTX)) {
+                        return false;
+                    }
+
+                    llama_tensor_metadata metadata;
+                    metadata.name          = reader.str(ev.name);
+                    metadata.operation     = reader.str(ctx.name);
+                    metadata.dtype         = ggml_type_name((ggml_type) (ev.flags & 0xff));
+                    metadata.element_count = (size_t) llama_trace_as_i64(ctx.v[3]);
+                    metadata.memory_bytes  = (size_t) llama_trace_as_i64(ctx.v[2]);
+                    metadata.min_val       = llama_trace_as_f64(ev.v[0]);
+                    metadata.max_val       = llama_trace_as_f64(ev.v[1]);
+                    metadata.mean_val      = llama_trace_as_f64(ev.v[2]);
+                    metadata.std_val       = llama_trace_as_f64(ev.v[3]);
+                    metadata.has_stats     = (ev.flags >> 8) & 1;
+                    metadata.timestamp     = trace_time_point(ev.t_us);
+                    for (int i = 0; i < shape.flags && i < 4; ++i) {
+                        metadata.shape.push_back(llama_trace_as_i64(shape.v[i]));
+                    }
+
+                    entry << "{\"event\":\"tensor_metadata\",\"timestamp\":\"" << trace_timestamp(ev.t_us)
+                          << "\",\"role\":\"" << reader.str(ctx.v[0])
+                          << "\",\"step_name\":\"" << reader.str(ctx.v[1])
+                          << "\",\"layer_id\":" << ev.layer
+                          << ",\"metadata\":" << metadata.to_json()
+                          << ",\"session_id\":\"" << session_id << "\"}";
+                } break;
+            case LLAMA_TRACE_EVENT_SAMPLING:
+                {
+                    llama_sampling_state state;
+                    state.sampling_method = reader.str(ev.name);
+                    state.selected_token  = (int) llama_trace_as_i64(ev.v[0]);
+                    state.selected_prob   = llama_trace_as_f64(ev.v[1]);
+
+                    const int64_t n_cand  = llama_trace_as_i64(ev.v[2]);
+                    const int64_t n_layer = llama_trace_as_i64(ev.v[3]);
+
+                    for (int64_t i = 0; i < n_cand; ++i) {
+                        llama_trace_event cand;
+                        if (!next(cand, LLAMA_TRACE_EVENT_CANDIDATE)) {
+                            return false;
+                        }
+                        state.top_tokens     .push_back((int) llama_trace_as_i64(cand.v[0]));
+                        state.top_probs      .push_back(llama_trace_as_f64(cand.v[1]));
+                        state.logits_sample  .push_back(llama_trace_as_f64(cand.v[2]));
+                        state.top_token_texts.push_back(reader.str(cand.name));
+                    }
+
+                    if (!read_params(state.sampling_params, ev.flags)) {
+                        return false;
+                    }
+
+                    for (int64_t i = 0; i < n_layer; ++i) {
+                        llama_trace_event lev;
+                        if (!next(lev, LLAMA_TRACE_EVENT_LAYER)) {
+                            return false;
+                        }
+
+                        llama_layer_info layer;
+                        layer.layer_id       = lev.layer;
+                        layer.layer_type     = reader.str(lev.name);
+                        layer.operation      = reader.str(lev.v[1]);
+                        layer.execution_time = std::chrono::microseconds(llama_trace_as_i64(lev.v[0]));
+                        if (!read_params(layer.layer_metrics, lev.flags)) {
+                            return false;
+                        }
+
+                        state.layer_details.push_back(std::move(layer));
+                    }
+
+                    entry << "{\"event\":\"sampling_state\",\"timestamp\":\"" << trace_timestamp(ev.t_us)
+                          << "\",\"sampling\":" << state.to_json()
+                          << ",\"session_id\":\"" << session_id << "\"}";
+                } break;
+            case LLAMA_TRACE_EVENT_KV_UPDATE:
+                {
+                    entry << "{\"event\":\"kv_cache_update\",\"timestamp\":\"" << trace_timestamp(ev.t_us)
+                          << "\",\"layer_id\":" << ev.layer
+                          << ",\"seq_id\":" << llama_trace_as_i64(ev.v[0])
+                          << ",\"pos_start\":" << llama_trace_as_i64(ev.v[1])
+                          << ",\"pos_end\":" << llama_trace_as_i64(ev.v[2])
+                          << ",\"operation\":\"" << reader.str(ev.name)
+                          << "\",\"session_id\":\"" << session_id << "\"}";
+                } break;
+            case LLAMA_TRACE_EVENT_PERF:
+                {
+                    entry << "{\"event\":\"performance_metric\",\"timestamp\":\"" << trace_timestamp(ev.t_us)
+                          << "\",\"metric_name\":\"" << reader.str(ev.name)
+                          << "\",\"value\":" << llama_trace_as_f64(ev.v[0])
+                          << ",\"unit\":\"" << reader.str(ev.v[1])
+                          << "\",\"session_id\":\"" << session_id << "\"}";
+                } break;
+            case LLAMA_TRACE_EVENT_MODEL_METRICS:
+                {
+                    // params are named "group.key", all of them are integral
+                    std::vector<std::pair<std::string, double>> params;
+                    for (int i = 0; i < ev.flags; ++i) {
+                        llama_trace_event pev;
+                        if (!next(pev, LLAMA_TRACE_EVENT_PARAM)) {
+                            return false;
+                        }
+                        params.emplace_back(reader.str(pev.name), llama_trace_as_f64(pev.v[0]));
+                    }
+
+                    entry << "{\"event\":\"model_metrics\",\"timestamp\":\"" << trace_timestamp(ev.t_us)
+                          << "\",\"session_id\":\"" << session_id << "\"";
+
+                    for (const char * group : { "model_info", "context_info", "memory_usage" }) {
+                        const std::string prefix = std::string(group) + ".";
+
+                        bool first = true;
+                        for (const auto & [key, value] : params) {
+                            if (key.compare(0, prefix.size(), prefix) != 0) {
+                                continue;
+                            }
+                            entry << (first ? ",\"" + std::string(group) + "\":{" : ",");
+                            entry << "\"" << key.substr(prefix.size()) << "\":" << (int64_t) value;
+                            first = false;
+                        }
+                        if (!first) {
+                            entry << "}";
+                        }
+                    }
+
+                    entry << "}";
+                } break;
+            default:
+                {
+                    fprintf(stderr, "warning: skipping unexpected %s record\n", trace_event_name(ev.type));
+                    return true;
+                }
+        }
+
+        write(entry.str());
+
+        return true;
+    }
+};
+
+int main(int argc, char ** argv) {
+    std::string fname_inp;
+    std::string fname_out;
+
+    bool stats = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg == "-o" || arg == "--output") {
+            if (++i >= argc) {
+                fprintf(stderr, "error: missing argument for %s\n", arg.c_str());
+                return 1;
+            }
+            fname_out = argv[i];
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (fname_inp.empty()) {
+            fname_inp = arg;
+        } else {
+            fprintf(stderr, "error: unexpected argument '%s'\n", arg.c_str());
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (fname_inp.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    llama_trace_reader reader;
+    if (!reader.open(fname_inp)) {
+        fprintf(stderr, "error: '%s' is not a binary instrumentation trace\n", fname_inp.c_str());
+        return 1;
+    }
+
+    FILE * out = stdout;
+    if (!fname_out.empty()) {
+        out = fopen(fname_out.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "error: failed to open '%s' for writing: %s\n", fname_out.c_str(), strerror(errno));
+            return 1;
+        }
+    }
+
+    llama_trace_event ev;
+
+    if (stats) {
+        std::vector<uint64_t> counts(LLAMA_TRACE_EVENT_COUNT, 0);
+        while (reader.next(ev)) {
+            counts[ev.type < LLAMA_TRACE_EVENT_COUNT ? ev.type : (uint8_t) LLAMA_TRACE_EVENT_NONE]++;
+        }
+        for (int i = 0; i < LLAMA_TRACE_EVENT_COUNT; ++i) {
+            if (counts[i] > 0) {
+                fprintf(out, "%-20s %" PRIu64 "\n", trace_event_name(i), counts[i]);
+            }
+        }
+    } else {
+        trace_converter conv { reader, out, "" };
+        while (reader.next(ev)) {
+            if (!conv.convert(ev)) {
+                fprintf(stderr, "error: malformed trace\n");
+                break;
+            }
+        }
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -250,6 +250,7 @@ struct cmd_params {
     std::vector<std::string>         cpu_mask;
     std::vector<bool>                cpu_strict;
     std::vector<int>                 poll;
+    std::vector<bool>                poll_adaptive;
     std::vector<int>                 n_gpu_layers;
     std::vector<std::string>         rpc_servers;
     std::vector<llama_split_mode>    split_mode;
@@ -287,6 +288,7 @@ static const cmd_params cmd_params_defaults = {
     /* cpu_mask             */ { "0x0" },
     /* cpu_strict           */ { false },
     /* poll                 */ { 50 },
+    /* poll_adaptive        */ { false },
     /* n_gpu_layers         */ { 99 },
     /* rpc_servers          */ { "" },
     /* split_mode           */ { LLAMA_SPLIT_MODE_LAYER },
@@ -314,7 +316,7 @@ static void print_usage(int /* argc */, char ** argv) {
     printf("\n");
     printf("options:\n");
     printf("  -h, --help\n");
-    printf("  --numa <distribute|isolate|numactl>       numa mode (default: disabled)\n");
+    printf("  --numa <distribute|isolate|numactl|split> numa mode (default: disabled)\n");
     printf("  -r, --repetitions <n>                     number of times to repeat each test (default: %d)\n",
            cmd_params_defaults.reps);
     printf("  --prio <-1|0|1|2|3>                          process/thread priority (default: %d)\n",
@@ -355,6 +357,8 @@ static void print_usage(int /* argc */, char ** argv) {
     printf("  --cpu-strict <0|1>                        (default: %s)\n",
            join(cmd_params_defaults.cpu_strict, ",").c_str());
     printf("  --poll <0...100>                          (default: %s)\n", join(cmd_params_defaults.poll, ",").c_str());
+    printf("  --poll-adaptive <0|1>                     (default: %s)\n",
+           join(cmd_params_defaults.poll_adaptive, ",").c_str());
     printf("  -ngl, --n-gpu-layers <n>                  (default: %s)\n",
            join(cmd_params_defaults.n_gpu_layers, ",").c_str());
     if (llama_supports_rpc()) {
@@ -568,6 +572,13 @@ static cmd_params parse_cmd_params(int argc, char ** argv) {
                 }
                 auto p = parse_int_range(argv[i]);
                 params.poll.insert(params.poll.end(), p.begin(), p.end());
+            } else if (arg == "--poll-adaptive") {
+                if (++i >= argc) {
+                    invalid_param = true;
+                    break;
+                }
+                auto p = string_split<bool>(argv[i], split_delim);
+                params.poll_adaptive.insert(params.poll_adaptive.end(), p.begin(), p.end());
             } else if (arg == "-ngl" || arg == "--n-gpu-layers") {
                 if (++i >= argc) {
                     invalid_param = true;
@@ -632,6 +643,8 @@ static cmd_params parse_cmd_params(int argc, char ** argv) {
                     params.numa = GGML_NUMA_STRATEGY_ISOLATE;
                 } else if (value == "numactl") {
                     params.numa = GGML_NUMA_STRATEGY_NUMACTL;
+                } else if (value == "split") {
+                    params.numa = GGML_NUMA_STRATEGY_SPLIT;
                 } else {
                     invalid_param = true;
                     break;
@@ -897,6 +910,9 @@ static cmd_params parse_cmd_params(int argc, char ** argv) {
     if (params.poll.empty()) {
         params.poll = cmd_params_defaults.poll;
     }
+    if (params.poll_adaptive.empty()) {
+        params.poll_adaptive = cmd_params_defaults.poll_adaptive;
+    }
 
     return params;
 }
@@ -915,6 +931,7 @@ struct cmd_params_instance {
     std::string        cpu_mask;
     bool               cpu_strict;
     int                poll;
+    bool               poll_adaptive;
     int                n_gpu_layers;
     std::string        rpc_servers_str;
     llama_split_mode   split_mode;
@@ -1044,6 +1061,7 @@ static std::vector<cmd_params_instance> get_cmd_params_instances(const cmd_param
     for (const auto & cm : params.cpu_mask)
     for (const auto & cs : params.cpu_strict)
     for (const auto & nd : params.n_depth)
+    for (const auto & pa : params.poll_adaptive)
     for (const auto & pl : params.poll) {
         for (const auto & n_prompt : params.n_prompt) {
             if (n_prompt == 0) {
@@ -1063,6 +1081,7 @@ static std::vector<cmd_params_instance> get_cmd_params_instances(const cmd_param
                 /* .cpu_mask     = */ cm,
                 /* .cpu_strict   = */ cs,
                 /* .poll         = */ pl,
+                /* .poll_adaptive= */ pa,
                 /* .n_gpu_layers = */ nl,
                 /* .rpc_servers  = */ rpc,
                 /* .split_mode   = */ sm,
@@ -1096,6 +1115,7 @@ static std::vector<cmd_params_instance> get_cmd_params_instances(const cmd_param
                 /* .cpu_mask     = */ cm,
                 /* .cpu_strict   = */ cs,
                 /* .poll         = */ pl,
+                /* .poll_adaptive= */ pa,
                 /* .n_gpu_layers = */ nl,
                 /* .rpc_servers  = */ rpc,
                 /* .split_mode   = */ sm,
@@ -1129,6 +1149,7 @@ static std::vector<cmd_params_instance> get_cmd_params_instances(const cmd_param
                 /* .cpu_mask     = */ cm,
                 /* .cpu_strict   = */ cs,
                 /* .poll         = */ pl,
+                /* .poll_adaptive= */ pa,
                 /* .n_gpu_layers = */ nl,
                 /* .rpc_servers  = */ rpc,
                 /* .split_mode   = */ sm,
@@ -1164,6 +1185,7 @@ struct test {
     std::string              cpu_mask;
     bool                     cpu_strict;
     int                      poll;
+    bool                     poll_adaptive;
     ggml_type                type_k;
     ggml_type                type_v;
     float                    defrag_thold;
@@ -1199,6 +1221,7 @@ struct test {
         cpu_mask       = inst.cpu_mask;
         cpu_strict     = inst.cpu_strict;
         poll           = inst.poll;
+        poll_adaptive  = inst.poll_adaptive;
         type_k         = inst.type_k;
         type_v         = inst.type_v;
         defrag_thold   = inst.defrag_thold;
@@ -1257,7 +1280,7 @@ struct test {
             "model_type",   "model_size",   "model_n_params", "n_batch",    "n_ubatch",     "n_threads",
             "cpu_mask",     "cpu_strict",   "poll",           "type_k",     "type_v",       "n_gpu_layers",
             "split_mode",   "main_gpu",     "no_kv_offload",  "flash_attn", "tensor_split", "tensor_buft_overrides",
-            "defrag_thold",
+            "defrag_thold", "poll_adaptive",
             "use_mmap",     "embeddings",   "no_op_offload",   "n_prompt",       "n_gen",      "n_depth",      "test_time",
             "avg_ns",       "stddev_ns",    "avg_ts",         "stddev_ts",
         };
@@ -1274,7 +1297,7 @@ struct test {
             return INT;
         }
         if (field == "f16_kv" || field == "no_kv_offload" || field == "cpu_strict" || field == "flash_attn" ||
-            field == "use_mmap" || field == "embeddings") {
+            field == "use_mmap" || field == "embeddings" || field == "poll_adaptive") {
             return BOOL;
         }
         if (field == "avg_ts" || field == "stddev_ts" || field == "defrag_thold") {
@@ -1345,6 +1368,7 @@ struct test {
                                             tensor_split_str,
                                             tensor_buft_overrides_str,
                                             std::to_string(defrag_thold),
+                                            std::to_string(poll_adaptive),
                                             std::to_string(use_mmap),
                                             std::to_string(embeddings),
                                             std::to_string(no_op_offload),
@@ -1599,6 +1623,9 @@ struct markdown_printer : public printer {
         if (params.poll.size() > 1 || params.poll != cmd_params_defaults.poll) {
             fields.emplace_back("poll");
         }
+        if (params.poll_adaptive.size() > 1 || params.poll_adaptive != cmd_params_defaults.poll_adaptive) {
+            fields.emplace_back("poll_adaptive");
+        }
         if (params.n_batch.size() > 1 || params.n_batch != cmd_params_defaults.n_batch) {
             fields.emplace_back("n_batch");
         }
@@ -1862,6 +1889,7 @@ int main(int argc, char ** argv) {
     auto * cpu_reg = ggml_backend_dev_backend_reg(cpu_dev);
     auto * ggml_threadpool_new_fn = (decltype(ggml_threadpool_new) *) ggml_backend_reg_get_proc_address(cpu_reg, "ggml_threadpool_new");
     auto * ggml_threadpool_free_fn = (decltype(ggml_threadpool_free) *) ggml_backend_reg_get_proc_address(cpu_reg, "ggml_threadpool_free");
+    auto * ggml_threadpool_set_wait_fn = (decltype(ggml_threadpool_set_wait) *) ggml_backend_reg_get_proc_address(cpu_reg, "ggml_threadpool_set_wait");
 
     // initialize llama.cpp
     if (!params.verbose) {
@@ -1943,6 +1971,10 @@ int main(int argc, char ** argv) {
             exit(1);
         }
 
+        if (t.poll_adaptive && ggml_threadpool_set_wait_fn) {
+            ggml_threadpool_set_wait_fn(threadpool, GGML_THREADPOOL_WAIT_ADAPTIVE);
+        }
+
         llama_attach_threadpool(ctx, threadpool, NULL);
 
         // warmup run
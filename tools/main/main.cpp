@@ -162,6 +162,7 @@ int main(int argc, char ** argv) {
     auto * reg = ggml_backend_dev_backend_reg(cpu_dev);
     auto * ggml_threadpool_new_fn = (decltype(ggml_threadpool_new) *) ggml_backend_reg_get_proc_address(reg, "ggml_threadpool_new");
     auto * ggml_threadpool_free_fn = (decltype(ggml_threadpool_free) *) ggml_backend_reg_get_proc_address(reg, "ggml_threadpool_free");
+    auto * ggml_threadpool_set_wait_fn = (decltype(ggml_threadpool_set_wait) *) ggml_backend_reg_get_proc_address(reg, "ggml_threadpool_set_wait");
 
     struct ggml_threadpool_params tpp_batch =
             ggml_threadpool_params_from_cpu_params(params.cpuparams_batch);
@@ -188,6 +189,10 @@ int main(int argc, char ** argv) {
         return 1;
     }
 
+    if (params.cpuparams.poll_adaptive && ggml_threadpool_set_wait_fn) {
+        ggml_threadpool_set_wait_fn(threadpool, GGML_THREADPOOL_WAIT_ADAPTIVE);
+    }
+
     llama_attach_threadpool(ctx, threadpool, threadpool_batch);
 
     const int n_ctx_train = llama_model_n_ctx_train(model);
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""
+Generation throughput benchmark for the llama-monitoring-server
+
+Sends N concurrent /log-monitoring requests and reports the aggregate tokens per second.
+The generated tokens are counted from the sampling_state events of each session log.
+
+usage: bench_server.py [--url http://localhost:8080] [-n 4] [--rounds 3] [--method greedy] [--level detailed]
+"""
+
+import argparse
+import base64
+import json
+import threading
+import time
+import urllib.request
+
+
+def post(url, payload):
+    req = urllib.request.Request(url, data=json.dumps(payload).encode(), headers={"Content-Type": "application/json"})
+    with urllib.request.urlopen(req) as res:
+        return json.loads(res.read())
+
+
+def get(url):
+    with urllib.request.urlopen(url) as res:
+        return json.loads(res.read())
+
+
+def count_tokens(base_url, session_id):
+    logs = base64.b64decode(get(f"{base_url}/logs/{session_id}")["logs_b64"]).decode(errors="replace")
+    return sum(1 for line in logs.splitlines() if '"event":"sampling_state"' in line)
+
+
+def run_round(args, round_id):
+    sessions = [None] * args.n
+
+    def worker(i):
+        payload = {
+            "prompt": f"Request {round_id}.{i}: write a long story about a lighthouse",
+            "sampling": {"method": args.method, "seed": 1000 + i},
+            "level": args.level,
+        }
+        sessions[i] = post(f"{args.url}/log-monitoring", payload).get("session_id")
+
+    threads = [threading.Thread(target=worker, args=(i,)) for i in range(args.n)]
+    t_start = time.time()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    t_total = time.time() - t_start
+
+    n_tokens = sum(count_tokens(args.url, s) for s in sessions if s)
+    return n_tokens, t_total
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--url", default="http://localhost:8080")
+    parser.add_argument("-n", type=int, default=4, help="concurrent requests per round")
+    parser.add_argument("--rounds", type=int, default=3)
+    parser.add_argument("--method", default="greedy")
+    parser.add_argument("--level", default="detailed", help="instrumentation level: minimal, detailed or verbose")
+    args = parser.parse_args()
+
+    results = []
+    for r in range(args.rounds):
+        n_tokens, t_total = run_round(args, r)
+        results.append(n_tokens / t_total)
+        print(f"round {r}: {n_tokens} tokens in {t_total:.2f} s = {n_tokens / t_total:.1f} t/s")
+
+    results.sort()
+    print(f"median: {results[len(results) // 2]:.1f} t/s ({args.n} concurrent requests, method {args.method}, level {args.level})")
+
+
+if __name__ == "__main__":
+    main()
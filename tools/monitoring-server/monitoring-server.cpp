@@ -1,5 +1,7 @@
 #include "llama.h"
 #include "llama-instrumentation.h"
+#include "llama-resource-instrumentation.h"
+#include "llama-metrics.h"
 #include "common.h"
 #include "sampling.h"
 #include "log.h"
@@ -9,6 +11,7 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <fstream>
 #include <sstream>
@@ -22,6 +25,9 @@
 #include <sstream>
 #include <ctime>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
 
 // HTTP server library (same as used in tools/server)
 #define CPPHTTPLIB_FORM_URL_ENCODED_PAYLOAD_MAX_LENGTH 1048576
@@ -85,15 +91,94 @@ struct SamplingConfig {
         
         return params;
     }
+    
+    bool operator==(const SamplingConfig & other) const {
+        return method == other.method && top_k == other.top_k && top_p == other.top_p &&
+               temperature == other.temperature && min_p == other.min_p && seed == other.seed;
+    }
+};
+// A /log-monitoring request waiting for, or being served by, a slot
+struct InferenceTask {
+    std::string session_id;
+    std::string prompt;
+    SamplingConfig sampling_config;
+    llama_instr_level level = llama_instr_level::DETAILED;
+    std::promise<std::string> result; // log file path, empty on failure
+};
+
+enum SlotState {
+    SLOT_STATE_IDLE,
+    SLOT_STATE_PROMPT,      // prompt tokens are still being submitted
+    SLOT_STATE_GENERATING,  // one sampled token per step
 };
+
+// One concurrent session - the slot id is also the seq_id of the session in the shared context
+struct SessionSlot {
+    int id = 0;
+    SlotState state = SLOT_STATE_IDLE;
+    
+    std::unique_ptr<InferenceTask> task;
+    std::unique_ptr<llama_instrumentation> instr; // separate log stream per session
+    std::string log_path;
+    
+    // kept across sessions: the sampler is only rebuilt when the sampling config changes
+    struct common_sampler * sampler = nullptr;
+    SamplingConfig sampler_config;
+    llama_sampling_state sampling_state;
+    
+    std::vector<llama_token> prompt_tokens;
+    size_t n_prompt_done = 0;  // prompt tokens already added to a batch
+    llama_pos n_past = 0;
+    int n_decoded = 0;
+    int max_tokens = 0;
+    
+    llama_token last_token = LLAMA_TOKEN_NULL;
+    std::string last_piece;
+    std::string generated_text;
+    int64_t t_last_token = 0;  // time the previous token was sampled, for the token latency
+    
+    int32_t i_batch = -1;      // index of the logits of this slot in the current batch, -1 if none
+    int32_t n_batch = 0;       // tokens of this slot in the current batch
+};
+
+// Log file of a session and the line index kept by its instrumentation writer
+struct SessionLog {
+    std::string path;
+    std::shared_ptr<llama_instr_line_index> index;
+};
+
 struct MonitoringServerState {
     llama_model* model;
     llama_context* ctx;
     const llama_vocab* vocab;
-    std::mutex model_mutex;
     std::atomic<bool> model_loaded{false};
-    std::map<std::string, std::string> active_sessions; // session_id -> log_file_path
+    std::map<std::string, SessionLog> active_sessions; // session_id -> log
+    std::deque<std::string> completed_sessions;        // oldest first, their logs stay available until evicted
+    size_t n_completed_max = 64;
     std::mutex sessions_mutex;
+    
+    // slot scheduler - the context is only touched by the scheduler thread
+    int n_slots = 4;
+    int n_ctx_slot = 2048;
+    int n_batch = 64;
+    std::vector<SessionSlot> slots;
+    std::deque<std::unique_ptr<InferenceTask>> queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    bool stop = false;
+    std::thread scheduler;
+    
+    std::vector<std::string> token_pieces; // text of every token of the vocabulary
+    
+    // per-layer timings of the last decode, the resource instrumentation accumulates them
+    // from the first session of a busy period until the last one ends
+    std::map<int, std::map<std::string, llama_op_timing>> decode_layer_timings;
+    
+    // exported on /metrics together with the metrics of libllama
+    llama_metric_histogram* token_latency = nullptr;
+    llama_metric_gauge* slots_busy = nullptr;
+    llama_metric_gauge* queue_size = nullptr;
+    llama_metric_counter* sessions_total = nullptr;
 };
 
 static MonitoringServerState g_server_state;
@@ -141,11 +226,23 @@ static bool load_model() {
         }
         std::cout << "📝 Vocabulary loaded successfully" << std::endl;
         
+        // Render the text of every token once, the generation loop only looks them up
+        const int n_vocab = llama_vocab_n_tokens(g_server_state.vocab);
+        g_server_state.token_pieces.resize(n_vocab);
+        for (llama_token token = 0; token < n_vocab; ++token) {
+            char token_str[256];
+            int n_chars = llama_token_to_piece(g_server_state.vocab, token, token_str, sizeof(token_str), 0, true);
+            if (n_chars > 0 && n_chars < (int)sizeof(token_str)) {
+                g_server_state.token_pieces[token] = std::string(token_str, n_chars);
+            }
+        }
+        
         // Create context
         std::cout << "⚙️ Creating inference context..." << std::endl;
         llama_context_params ctx_params = llama_context_default_params();
-        ctx_params.n_ctx = 2048;     // Increased context length for longer generations
-        ctx_params.n_batch = 64;     // Batch size  
+        ctx_params.n_ctx = g_server_state.n_ctx_slot * g_server_state.n_slots; // each session gets n_ctx_slot
+        ctx_params.n_seq_max = g_server_state.n_slots;
+        ctx_params.n_batch = g_server_state.n_batch;
         ctx_params.n_threads = 4;    // CPU threads
         
         llama_context* ctx_ptr = llama_init_from_model(model_ptr, ctx_params);
@@ -165,298 +262,544 @@ static bool load_model() {
     }
 }
 
-// Function to perform inference and generate logs (similar to test_inference_instrumentation.cpp)
-static std::string run_inference_with_logs(const std::string& prompt, const std::string& session_id, const SamplingConfig& sampling_config) {
-    if (!g_server_state.model_loaded) {
-        return "";
+// Add the measured per-layer execution of the last decode to the sampling state
+// the decode is shared by all sessions of the batch, so they all report the same timings
+static void add_layer_details(llama_sampling_state & sampling_state) {
+    if (!g_resource_instr) {
+        return;
     }
     
-    try {
-        std::lock_guard<std::mutex> lock(g_server_state.model_mutex);
-        
-        // Create log file path for this session
-        std::string log_path = "tools/monitoring-server/logs/" + session_id + ".log";
-        
-        // Initialize instrumentation with session-specific log file
-        llama_instrumentation instr(llama_instr_level::DETAILED, log_path);
-        instr.enable();
-        
-        // Initialize sampling parameters
-        common_params_sampling sampling_params = sampling_config.to_common_params();
-        
-        std::cout << "📊 Starting instrumented inference for session: " << session_id << std::endl;
-        std::cout << "🎲 Sampling method: " << sampling_config.method << std::endl;
-        
-        // Begin instrumented session
-        instr.begin_session(prompt, g_server_state.model);
-        
-        // Log comprehensive model metrics (one-time)
-        instr.log_model_metrics(g_server_state.model, g_server_state.ctx);
-        
-        // Tokenize the prompt
-        const int n_prompt = -llama_tokenize(g_server_state.vocab, prompt.c_str(), prompt.length(), NULL, 0, true, true);
-        std::vector<llama_token> prompt_tokens(n_prompt);
-        llama_tokenize(g_server_state.vocab, prompt.c_str(), prompt.length(), prompt_tokens.data(), n_prompt, true, true);
-        
-        std::cout << "🔤 Tokenized prompt: " << n_prompt << " tokens" << std::endl;
-        
-        // Create batch with all prompt tokens
-        llama_batch batch = llama_batch_init(n_prompt, 0, 1);
-        
-        for (int i = 0; i < n_prompt; ++i) {
-            batch.token[i] = prompt_tokens[i];
-            batch.pos[i] = i;
-            batch.n_seq_id[i] = 1;
-            batch.seq_id[i][0] = 0;
-            batch.logits[i] = (i == n_prompt - 1);
+    const double n_head = llama_model_n_head(g_server_state.model);
+    const double n_embd = llama_model_n_embd(g_server_state.model);
+    
+    for (const auto & [layer, components] : g_server_state.decode_layer_timings) {
+        if (layer < 0) {
+            continue; // embeddings and output head
         }
-        batch.n_tokens = n_prompt;
-        
-        // Clear memory cache before processing new request to avoid sequence position conflicts
-        llama_memory_t mem = llama_get_memory(g_server_state.ctx);
-        llama_memory_seq_rm(mem, -1, -1, -1); // Remove all sequences
-        
-        // Process the prompt
-        instr.begin_step("prompt_processing", 0);
-        std::cout << "🧠 Processing prompt..." << std::endl;
-        if (llama_decode(g_server_state.ctx, batch) != 0) {
-            std::cerr << "❌ Failed to decode prompt!" << std::endl;
-            return "";
+        for (const auto & [component, timing] : components) {
+            llama_layer_info layer_info;
+            layer_info.layer_id = layer;
+            layer_info.layer_type = component;
+            layer_info.operation = component == "attention"    ? "multi_head_self_attention" :
+                                   component == "feed_forward" ? "mlp_projection" : "residual";
+            layer_info.execution_time = std::chrono::microseconds(timing.t_wall_ns / 1000);
+            
+            layer_info.layer_metrics["attention_heads"] = component == "attention" ? n_head : 0.0;
+            layer_info.layer_metrics["hidden_dim"] = n_embd;
+            layer_info.layer_metrics["busy_us"] = timing.t_busy_ns / 1000.0;
+            layer_info.layer_metrics["bytes_mb"] = timing.nbytes / (1024.0 * 1024.0);
+            layer_info.layer_metrics["gbps"] = timing.gbps();
+            layer_info.layer_metrics["gflops"] = timing.gflops_per_s();
+            
+            sampling_state.layer_details.push_back(layer_info);
         }
-        instr.end_step("Prompt processed successfully");
-        std::cout << "✅ Prompt processed successfully!" << std::endl;
-        
-        // Generate tokens with proper stopping conditions
-        int max_tokens = 512; // Reasonable limit but much higher
-        int context_size = 2048; // Match the context length
-        std::vector<llama_token> all_tokens = prompt_tokens;
-        std::string generated_text = "";
-        
-        // Calculate remaining context space
-        int remaining_context = context_size - prompt_tokens.size() - 50; // Leave some buffer
-        max_tokens = std::min(max_tokens, remaining_context);
-        
-        // Get stopping tokens for Gemma model
-        llama_token eos_token = llama_vocab_eos(g_server_state.vocab);
-        llama_token end_of_turn_token = 106; // <end_of_turn> token for Gemma
-        
-        // Initialize the sampler
-        struct common_sampler * sampler = common_sampler_init(g_server_state.model, sampling_params);
-        if (!sampler) {
-            std::cerr << "❌ Failed to initialize sampler!" << std::endl;
-            return "";
+    }
+}
+
+// Timings measured between two snapshots of the accumulated per-layer timings
+static std::map<int, std::map<std::string, llama_op_timing>> layer_timings_diff(
+        const std::map<int, std::map<std::string, llama_op_timing>> & after,
+        const std::map<int, std::map<std::string, llama_op_timing>> & before) {
+    auto res = after;
+    for (auto & [layer, components] : res) {
+        const auto it_layer = before.find(layer);
+        if (it_layer == before.end()) {
+            continue;
+        }
+        for (auto & [component, t] : components) {
+            const auto it = it_layer->second.find(component);
+            if (it == it_layer->second.end()) {
+                continue;
+            }
+            t.n_nodes   -= it->second.n_nodes;
+            t.t_wall_ns -= it->second.t_wall_ns;
+            t.t_busy_ns -= it->second.t_busy_ns;
+            t.nbytes    -= it->second.nbytes;
+            t.flops     -= it->second.flops;
         }
+    }
+    return res;
+}
+
+static const std::string & token_to_piece(llama_token token) {
+    static const std::string empty;
+    if (token < 0 || token >= (llama_token) g_server_state.token_pieces.size()) {
+        return empty;
+    }
+    return g_server_state.token_pieces[token];
+}
+
+// Assign a queued request to an idle slot and begin its instrumented session
+static bool start_slot(SessionSlot & slot, std::unique_ptr<InferenceTask> task) {
+    const std::string & prompt = task->prompt;
+    
+    slot.log_path = "tools/monitoring-server/logs/" + task->session_id + ".log";
+    
+    // Initialize instrumentation with session-specific log file
+    slot.instr = std::make_unique<llama_instrumentation>(task->level, slot.log_path);
+    slot.instr->enable();
+    
+    // register the session right away so that its log can be followed while it is generated
+    {
+        std::lock_guard<std::mutex> session_lock(g_server_state.sessions_mutex);
+        g_server_state.active_sessions[task->session_id] = { slot.log_path, slot.instr->line_index() };
+    }
+    
+    std::cout << "📊 [slot " << slot.id << "] Starting instrumented inference for session: " << task->session_id << std::endl;
+    std::cout << "🎲 [slot " << slot.id << "] Sampling method: " << task->sampling_config.method << std::endl;
+    
+    slot.instr->begin_session(prompt, g_server_state.model);
+    slot.instr->log_model_metrics(g_server_state.model, g_server_state.ctx);
+    
+    // Tokenize the prompt
+    const int n_prompt = -llama_tokenize(g_server_state.vocab, prompt.c_str(), prompt.length(), NULL, 0, true, true);
+    slot.prompt_tokens.resize(n_prompt);
+    llama_tokenize(g_server_state.vocab, prompt.c_str(), prompt.length(), slot.prompt_tokens.data(), n_prompt, true, true);
+    
+    std::cout << "🔤 [slot " << slot.id << "] Tokenized prompt: " << n_prompt << " tokens" << std::endl;
+    
+    // Leave some buffer at the end of the context of the session
+    slot.max_tokens = std::min(512, g_server_state.n_ctx_slot - n_prompt - 50);
+    
+    if (slot.sampler && slot.sampler_config == task->sampling_config) {
+        common_sampler_reset(slot.sampler);
+    } else {
+        if (slot.sampler) {
+            common_sampler_free(slot.sampler);
+        }
+        slot.sampler = common_sampler_init(g_server_state.model, task->sampling_config.to_common_params());
+        slot.sampler_config = task->sampling_config;
+    }
+    
+    slot.task = std::move(task);
+    slot.n_prompt_done = 0;
+    slot.n_past = 0;
+    slot.n_decoded = 0;
+    slot.last_token = LLAMA_TOKEN_NULL;
+    slot.last_piece.clear();
+    slot.generated_text.clear();
+    slot.i_batch = -1;
+    slot.state = SLOT_STATE_PROMPT;
+    
+    if (!slot.sampler) {
+        std::cerr << "❌ [slot " << slot.id << "] Failed to initialize sampler!" << std::endl;
+        return false;
+    }
+    if (n_prompt <= 0 || slot.max_tokens <= 0) {
+        std::cerr << "❌ [slot " << slot.id << "] Prompt does not fit in the context of a session (" << n_prompt << " tokens)" << std::endl;
+        return false;
+    }
+    
+    return true;
+}
+
+// End the session of a slot, release its sequence and hand the result to the waiting request
+static void finish_slot(SessionSlot & slot, bool success) {
+    slot.instr->end_session();
+    slot.instr.reset();
+    
+    // only the sequence of this session is removed, the other sessions keep their cache
+    llama_memory_seq_rm(llama_get_memory(g_server_state.ctx), slot.id, -1, -1);
+    
+    const std::string & session_id = slot.task->session_id;
+    
+    if (success) {
+        std::cout << "✅ [slot " << slot.id << "] Inference complete for session: " << session_id << std::endl;
+        std::cout << "📊 [slot " << slot.id << "] Prompt tokens: " << slot.prompt_tokens.size() << std::endl;
+        std::cout << "📊 [slot " << slot.id << "] Generated tokens: " << slot.n_decoded << std::endl;
+        std::cout << "📊 [slot " << slot.id << "] Total tokens processed: " << slot.n_past << std::endl;
+        std::cout << "📝 [slot " << slot.id << "] Generated text: " << slot.generated_text << std::endl;
+    }
+    
+    {
+        std::lock_guard<std::mutex> session_lock(g_server_state.sessions_mutex);
+        if (success) {
+            // only the most recent completed sessions stay listed
+            g_server_state.completed_sessions.push_back(session_id);
+            while (g_server_state.completed_sessions.size() > g_server_state.n_completed_max) {
+                g_server_state.active_sessions.erase(g_server_state.completed_sessions.front());
+                g_server_state.completed_sessions.pop_front();
+            }
+        } else {
+            g_server_state.active_sessions.erase(session_id);
+        }
+    }
+    
+    slot.task->result.set_value(success ? slot.log_path : "");
+    slot.task.reset();
+    slot.i_batch = -1;
+    slot.state = SLOT_STATE_IDLE;
+}
+
+// Sample the next token of a slot from the logits of the last decode
+static void sample_slot(SessionSlot & slot) {
+    // Check if we're approaching the context limit of the session
+    if (slot.n_past >= g_server_state.n_ctx_slot - 10) {
+        std::cout << "🛑 [slot " << slot.id << "] Approaching context limit, stopping generation" << std::endl;
+        finish_slot(slot, true);
+        return;
+    }
+    
+    const SamplingConfig & sampling_config = slot.task->sampling_config;
+    
+    llama_token next_token = common_sampler_sample(slot.sampler, g_server_state.ctx, slot.i_batch);
+    
+    // Get the token data array for instrumentation
+    llama_token_data_array * cur_p = common_sampler_get_candidates(slot.sampler);
+    
+    // Fill the sampling state for instrumentation - reused across tokens to keep the allocations
+    llama_sampling_state & sampling_state = slot.sampling_state;
+    sampling_state.top_tokens.clear();
+    sampling_state.top_probs.clear();
+    sampling_state.logits_sample.clear();
+    sampling_state.top_token_texts.clear();
+    sampling_state.layer_details.clear();
+    sampling_state.selected_token = next_token;
+    sampling_state.sampling_method = sampling_config.method;
+    
+    // Find selected token probability
+    sampling_state.selected_prob = 0.0f;
+    for (size_t j = 0; j < cur_p->size; j++) {
+        if (cur_p->data[j].id == next_token) {
+            sampling_state.selected_prob = cur_p->data[j].p;
+            break;
+        }
+    }
+    
+    // Fill sampling parameters
+    sampling_state.sampling_params["temperature"] = sampling_config.temperature;
+    sampling_state.sampling_params["top_k"] = sampling_config.top_k;
+    sampling_state.sampling_params["top_p"] = sampling_config.top_p;
+    sampling_state.sampling_params["seed"] = sampling_config.seed;
+    
+    // Fill top tokens and probabilities for instrumentation (up to 10)
+    // their texts are only part of the log from DETAILED on
+    const bool with_texts = slot.instr->is_enabled(llama_instr_level::DETAILED);
+    int top_count = std::min(10, (int)cur_p->size);
+    for (int k = 0; k < top_count; k++) {
+        sampling_state.top_tokens.push_back(cur_p->data[k].id);
+        sampling_state.top_probs.push_back(cur_p->data[k].p);
+        sampling_state.logits_sample.push_back(cur_p->data[k].logit);
         
-        std::cout << "🎯 Starting generation with max_tokens=" << max_tokens << std::endl;
-        std::cout << "🎯 Prompt tokens: " << prompt_tokens.size() << ", remaining context: " << remaining_context << std::endl;
-        std::cout << "🛑 Stop tokens: EOS=" << eos_token << ", end_of_turn=" << end_of_turn_token << std::endl;
+        if (with_texts) {
+            const std::string & token_text = token_to_piece(cur_p->data[k].id);
+            sampling_state.top_token_texts.push_back(token_text.empty() ? "<unknown>" : token_text);
+        }
+    }
+    
+    add_layer_details(sampling_state);
+    
+    // Log the sampling state
+    slot.instr->log_sampling_state(sampling_state);
+    
+    // Check for end of sequence with multiple stopping conditions
+    const llama_token eos_token = llama_vocab_eos(g_server_state.vocab);
+    const llama_token end_of_turn_token = 106; // <end_of_turn> token for Gemma
+    if (next_token == eos_token || next_token == end_of_turn_token) {
+        std::cout << "🏁 [slot " << slot.id << "] End of sequence reached (token=" << next_token << ")" << std::endl;
+        finish_slot(slot, true);
+        return;
+    }
+    
+    // Accept the sampled token
+    common_sampler_accept(slot.sampler, next_token, true);
+    
+    slot.last_token = next_token;
+    slot.last_piece = token_to_piece(next_token);
+    slot.generated_text += slot.last_piece;
+    slot.n_decoded++;
+    
+    const int64_t t_current = ggml_time_us();
+    if (slot.n_decoded > 1) {
+        g_server_state.token_latency->observe((t_current - slot.t_last_token) / 1e6);
+    }
+    slot.t_last_token = t_current;
+    
+    std::cout << "🔤 [slot " << slot.id << "] Token " << slot.n_decoded << "/" << slot.max_tokens << ": '" << slot.last_piece << "' (id=" << next_token << ")" << std::endl;
+    
+    if (slot.n_decoded >= slot.max_tokens) {
+        finish_slot(slot, true);
+        return;
+    }
+    
+    // Instrument the token generation step, it ends once the token has been decoded
+    slot.instr->begin_step(INSTR_LAZY_STR(*slot.instr, DETAILED, "token_generation_" + std::to_string(slot.n_decoded - 1)), 0);
+}
+
+// Scheduler loop: every step decodes one llama_batch holding the next token of all generating
+// sessions, followed by as many pending prompt tokens as fit in n_batch
+static void scheduler_loop() {
+    llama_batch batch = llama_batch_init(g_server_state.n_batch, 0, 1);
+    
+    auto & slots = g_server_state.slots;
+    
+    // the resource session spans a busy period of the scheduler, from the first session until all slots are idle again
+    bool resource_session = false;
+    
+    while (true) {
+        const bool busy = std::any_of(slots.begin(), slots.end(), [](const SessionSlot & slot) { return slot.state != SLOT_STATE_IDLE; });
+        if (g_resource_instr && resource_session && !busy) {
+            g_resource_instr->end_session();
+            resource_session = false;
+        }
         
-        for (int i = 0; i < max_tokens; i++) {
-            // Check if we're approaching context limit
-            if (all_tokens.size() >= context_size - 10) {
-                std::cout << "🛑 Approaching context limit, stopping generation" << std::endl;
+        {
+            std::unique_lock<std::mutex> lock(g_server_state.queue_mutex);
+            g_server_state.queue_cv.wait(lock, [&slots] {
+                if (g_server_state.stop || !g_server_state.queue.empty()) {
+                    return true;
+                }
+                return std::any_of(slots.begin(), slots.end(), [](const SessionSlot & slot) { return slot.state != SLOT_STATE_IDLE; });
+            });
+            
+            if (g_server_state.stop) {
                 break;
             }
             
-            // Use the common sampler to get the next token
-            llama_token next_token = common_sampler_sample(sampler, g_server_state.ctx, -1);
-            
-            // Get the token data array for instrumentation
-            llama_token_data_array * cur_p = common_sampler_get_candidates(sampler);
-            
-            // Create sampling state for instrumentation
-            llama_sampling_state sampling_state;
-            sampling_state.selected_token = next_token;
-            sampling_state.sampling_method = sampling_config.method;
-            
-            // Find selected token probability
-            sampling_state.selected_prob = 0.0f;
-            for (size_t j = 0; j < cur_p->size; j++) {
-                if (cur_p->data[j].id == next_token) {
-                    sampling_state.selected_prob = cur_p->data[j].p;
-                    break;
+            for (auto & slot : slots) {
+                if (slot.state != SLOT_STATE_IDLE || g_server_state.queue.empty()) {
+                    continue;
                 }
-            }
-            
-            // Fill sampling parameters
-            sampling_state.sampling_params["temperature"] = sampling_config.temperature;
-            sampling_state.sampling_params["top_k"] = sampling_config.top_k;
-            sampling_state.sampling_params["top_p"] = sampling_config.top_p;
-            sampling_state.sampling_params["seed"] = sampling_config.seed;
-            
-            // Fill top tokens and probabilities for instrumentation (up to 10)
-            int top_count = std::min(10, (int)cur_p->size);
-            for (int k = 0; k < top_count; k++) {
-                sampling_state.top_tokens.push_back(cur_p->data[k].id);
-                sampling_state.top_probs.push_back(cur_p->data[k].p);
-                sampling_state.logits_sample.push_back(cur_p->data[k].logit);
+                std::unique_ptr<InferenceTask> task = std::move(g_server_state.queue.front());
+                g_server_state.queue.pop_front();
                 
-                // Convert token to readable text
-                char token_str[256];
-                int n_chars = llama_token_to_piece(g_server_state.vocab, cur_p->data[k].id, 
-                                                  token_str, sizeof(token_str), 0, true);
-                std::string token_text;
-                if (n_chars > 0 && n_chars < (int)sizeof(token_str)) {
-                    token_text = std::string(token_str, n_chars);
-                } else {
-                    token_text = "<unknown>";
+                g_server_state.sessions_total->add();
+                if (g_resource_instr && !resource_session) {
+                    g_resource_instr->reset_timings();
+                    g_resource_instr->begin_session(task->session_id);
+                    resource_session = true;
                 }
-                sampling_state.top_token_texts.push_back(token_text);
-            }
-            
-            // Add layer information (simulated)
-            int total_layers = llama_model_n_layer(g_server_state.model);
-            for (int layer = 0; layer < total_layers; layer++) {
-                llama_layer_info layer_info;
-                layer_info.layer_id = layer;
-                layer_info.layer_type = (layer % 2 == 0) ? "attention" : "feed_forward";
-                layer_info.operation = (layer % 2 == 0) ? "multi_head_self_attention" : "mlp_projection";
-                layer_info.execution_time = std::chrono::microseconds(1000 + (layer * 50));
-                
-                // Add layer metrics
-                if (layer % 2 == 0) { // attention layer
-                    layer_info.layer_metrics["attention_heads"] = 4.0;
-                    layer_info.layer_metrics["hidden_dim"] = 1152.0;
-                    layer_info.layer_metrics["intermediate_dim"] = 0.0;
-                } else { // feed forward layer
-                    layer_info.layer_metrics["attention_heads"] = 0.0;
-                    layer_info.layer_metrics["hidden_dim"] = 1152.0;
-                    layer_info.layer_metrics["intermediate_dim"] = 6912.0;
+                if (!start_slot(slot, std::move(task))) {
+                    finish_slot(slot, false);
                 }
-                
-                sampling_state.layer_details.push_back(layer_info);
             }
             
-            // Log the sampling state
-            instr.log_sampling_state(sampling_state);
-            instr.flush(); // Force immediate write to disk
-            
-            // Check for end of sequence with multiple stopping conditions
-            if (next_token == eos_token || next_token == end_of_turn_token) {
-                std::cout << "🏁 End of sequence reached (token=" << next_token << ")" << std::endl;
-                break;
+            g_server_state.queue_size->set(g_server_state.queue.size());
+        }
+        
+        common_batch_clear(batch);
+        
+        for (auto & slot : slots) {
+            slot.n_batch = 0;
+        }
+        
+        // one token per generating session
+        for (auto & slot : slots) {
+            if (slot.state == SLOT_STATE_GENERATING) {
+                slot.i_batch = batch.n_tokens;
+                slot.n_batch = 1;
+                common_batch_add(batch, slot.last_token, slot.n_past++, { slot.id }, true);
             }
-            
-            // Accept the sampled token
-            common_sampler_accept(sampler, next_token, true);
-            
-            // Convert token to text
-            char token_str[256];
-            int n_chars = llama_token_to_piece(g_server_state.vocab, next_token, token_str, sizeof(token_str), 0, true);
-            if (n_chars > 0) {
-                generated_text += std::string(token_str, n_chars);
-                std::cout << "🔤 Token " << (i+1) << "/" << max_tokens << ": '" << std::string(token_str, n_chars) << "' (id=" << next_token << ")" << std::endl;
+        }
+        
+        // fill the rest of the batch with prompt tokens
+        for (auto & slot : slots) {
+            if (slot.state != SLOT_STATE_PROMPT || batch.n_tokens >= g_server_state.n_batch) {
+                continue;
             }
-            
-            // Instrument the token generation step
-            std::string step_name = "token_generation_" + std::to_string(i);
-            instr.begin_step(step_name, 0);
-            
-            // Note: Performance metrics are now only logged in VERBOSE mode
-            // Focus on sampling state which is most important for token generation monitoring
-            
-            // Prepare batch for next token
-            llama_batch next_batch = llama_batch_init(1, 0, 1);
-            next_batch.token[0] = next_token;
-            next_batch.pos[0] = batch.n_tokens + i;
-            next_batch.n_seq_id[0] = 1;
-            next_batch.seq_id[0][0] = 0;
-            next_batch.logits[0] = true;
-            next_batch.n_tokens = 1;
-            
-            // Decode next token
-            if (llama_decode(g_server_state.ctx, next_batch) != 0) {
-                std::cerr << "❌ Failed to decode token " << i << std::endl;
-                llama_batch_free(next_batch);
-                break;
+            if (slot.n_prompt_done == 0) {
+                slot.instr->begin_step("prompt_processing", 0);
+                std::cout << "🧠 [slot " << slot.id << "] Processing prompt..." << std::endl;
+            }
+            while (slot.n_prompt_done < slot.prompt_tokens.size() && batch.n_tokens < g_server_state.n_batch) {
+                const bool last = slot.n_prompt_done == slot.prompt_tokens.size() - 1;
+                if (last) {
+                    slot.i_batch = batch.n_tokens;
+                }
+                common_batch_add(batch, slot.prompt_tokens[slot.n_prompt_done++], slot.n_past++, { slot.id }, last);
+                slot.n_batch++;
             }
-            
-            instr.end_step("Token generated: " + std::string(token_str, n_chars > 0 ? n_chars : 0));
-            instr.flush(); // Force immediate write to disk
-            all_tokens.push_back(next_token);
-            
-            llama_batch_free(next_batch);
         }
         
-        // End instrumented session
-        instr.end_session();
+        if (batch.n_tokens == 0) {
+            continue;
+        }
         
-        // Free the sampler and batch
-        common_sampler_free(sampler);
-        llama_batch_free(batch);
+        std::map<int, std::map<std::string, llama_op_timing>> layer_timings_before;
+        if (g_resource_instr) {
+            layer_timings_before = g_resource_instr->get_layer_timings();
+        }
         
-        int generated_tokens = all_tokens.size() - prompt_tokens.size();
-        std::cout << "✅ Inference complete for session: " << session_id << std::endl;
-        std::cout << "📊 Prompt tokens: " << prompt_tokens.size() << std::endl;
-        std::cout << "📊 Generated tokens: " << generated_tokens << std::endl;
-        std::cout << "📊 Total tokens processed: " << all_tokens.size() << std::endl;
-        std::cout << "📝 Generated text: " << generated_text << std::endl;
+        const int ret = llama_decode(g_server_state.ctx, batch);
         
-        // Store session info
-        {
-            std::lock_guard<std::mutex> session_lock(g_server_state.sessions_mutex);
-            g_server_state.active_sessions[session_id] = log_path;
+        if (g_resource_instr) {
+            g_server_state.decode_layer_timings = layer_timings_diff(g_resource_instr->get_layer_timings(), layer_timings_before);
         }
         
-        return log_path;
+        for (auto & slot : slots) {
+            if (slot.i_batch < 0) {
+                continue;
+            }
+            
+            if (slot.state == SLOT_STATE_PROMPT) {
+                if (ret != 0) {
+                    std::cerr << "❌ [slot " << slot.id << "] Failed to decode prompt!" << std::endl;
+                    finish_slot(slot, false);
+                    continue;
+                }
+                slot.instr->end_step("Prompt processed successfully");
+                std::cout << "✅ [slot " << slot.id << "] Prompt processed successfully!" << std::endl;
+                slot.state = SLOT_STATE_GENERATING;
+            } else {
+                if (ret != 0) {
+                    std::cerr << "❌ [slot " << slot.id << "] Failed to decode token " << slot.n_decoded << std::endl;
+                    finish_slot(slot, true);
+                    continue;
+                }
+                slot.instr->end_step(INSTR_LAZY_STR(*slot.instr, VERBOSE, "Token generated: " + slot.last_piece));
+            }
+            
+            sample_slot(slot);
+            slot.i_batch = -1;
+        }
         
-    } catch (const std::exception& e) {
-        std::cerr << "❌ Error during inference: " << e.what() << std::endl;
-        return "";
+        // a prompt that failed before reaching its last token must not stay in the batch,
+        // the prompts that did not get a token into this batch are not affected
+        if (ret != 0) {
+            for (auto & slot : slots) {
+                if (slot.state == SLOT_STATE_PROMPT && slot.n_batch > 0) {
+                    std::cerr << "❌ [slot " << slot.id << "] Failed to decode prompt!" << std::endl;
+                    finish_slot(slot, false);
+                }
+            }
+        }
+        
+        g_server_state.slots_busy->set(std::count_if(slots.begin(), slots.end(), [](const SessionSlot & slot) { return slot.state != SLOT_STATE_IDLE; }));
     }
+    
+    llama_batch_free(batch);
 }
 
-// Function to stream logs from a file
-static std::string read_log_file(const std::string& file_path) {
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file.is_open()) {
+// Queue a request for the scheduler and wait until its session has finished
+static std::string run_inference_with_logs(const std::string& prompt, const std::string& session_id, const SamplingConfig& sampling_config,
+                                           llama_instr_level level) {
+    if (!g_server_state.model_loaded) {
         return "";
     }
     
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string data = buffer.str();
-    // Best-effort: replace any isolated invalid bytes with space to avoid JSON UTF-8 parser traps on the client
-    for (size_t i = 0; i < data.size(); ++i) {
-        unsigned char c = static_cast<unsigned char>(data[i]);
-        // Control chars below 0x09 except \n(0x0A) and \r(0x0D), and DEL range 0x7F-0x9F can upset some JSON parsers
-        if ((c < 0x09) || (c >= 0x0B && c <= 0x0C) || (c >= 0x0E && c <= 0x1F) || (c >= 0x7F && c <= 0x9F)) {
-            // Preserve newlines and carriage returns
-            if (c != 0x0A && c != 0x0D) {
-                data[i] = ' ';
-            }
+    auto task = std::make_unique<InferenceTask>();
+    task->session_id = session_id;
+    task->prompt = prompt;
+    task->sampling_config = sampling_config;
+    task->level = level;
+    
+    std::future<std::string> result = task->result.get_future();
+    
+    {
+        std::lock_guard<std::mutex> lock(g_server_state.queue_mutex);
+        g_server_state.queue.push_back(std::move(task));
+    }
+    g_server_state.queue_cv.notify_one();
+    
+    return result.get();
+}
+
+// Replace control characters that can upset JSON parsers on the client with spaces
+static void sanitize_log_data(std::string & data) {
+    // Control chars below 0x09, 0x0B-0x0C, 0x0E-0x1F and the DEL range 0x7F-0x9F; \n and \r are preserved
+    static const auto replace = [] {
+        std::array<bool, 256> table{};
+        for (int c = 0; c < 256; ++c) {
+            table[c] = c < 0x09 || c == 0x0B || c == 0x0C || (c >= 0x0E && c <= 0x1F) || (c >= 0x7F && c <= 0x9F);
+        }
+        return table;
+    }();
+    
+    for (char & c : data) {
+        if (replace[static_cast<unsigned char>(c)]) {
+            c = ' ';
         }
     }
-    return data;
 }
 
-// Function to read log file from a specific line offset (for streaming)
-static std::vector<std::string> read_log_lines_from_offset(const std::string& file_path, size_t from_line = 0) {
-    std::ifstream file(file_path, std::ios::binary);
-    std::vector<std::string> lines;
+// Read the bytes [begin, end) of a log file
+static std::string read_log_range(const std::string & file_path, uint64_t begin, uint64_t end) {
+    std::string data;
+    if (end <= begin) {
+        return data;
+    }
     
+    std::ifstream file(file_path, std::ios::binary);
     if (!file.is_open()) {
-        return lines;
+        return data;
     }
     
-    std::string line;
-    size_t current_line = 0;
+    data.resize(end - begin);
+    file.seekg(begin);
+    file.read(&data[0], data.size());
+    data.resize(file.gcount());
+    
+    sanitize_log_data(data);
     
-    while (std::getline(file, line)) {
-        if (current_line >= from_line) {
-            lines.push_back(line);
+    return data;
+}
+
+// Split log data into lines, without the trailing newlines
+static std::vector<std::string> split_log_lines(const std::string & data) {
+    std::vector<std::string> lines;
+    
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t nl = data.find('\n', pos);
+        if (nl == std::string::npos) {
+            nl = data.size();
         }
-        current_line++;
+        lines.push_back(data.substr(pos, nl - pos));
+        pos = nl + 1;
     }
     
     return lines;
 }
 
-int main(int /* argc */, char** /* argv */) {
+// Read all complete lines of a session log
+static std::string read_log_file(const SessionLog & log) {
+    size_t to = SIZE_MAX;
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    if (!log.index || !log.index->range(0, to, begin, end)) {
+        return "";
+    }
+    return read_log_range(log.path, begin, end);
+}
+
+// Read the lines of a session log starting at from_line (for streaming)
+// only the new bytes are read, the line index gives their position in the file
+static std::vector<std::string> read_log_lines_from_offset(const SessionLog & log, size_t from_line = 0) {
+    size_t to = SIZE_MAX;
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    if (!log.index || !log.index->range(from_line, to, begin, end)) {
+        return {};
+    }
+    return split_log_lines(read_log_range(log.path, begin, end));
+}
+
+// Look up the log of a session, returns false if the session is unknown
+static bool find_session_log(const std::string & session_id, SessionLog & log) {
+    std::lock_guard<std::mutex> lock(g_server_state.sessions_mutex);
+    auto it = g_server_state.active_sessions.find(session_id);
+    if (it == g_server_state.active_sessions.end()) {
+        return false;
+    }
+    log = it->second;
+    return true;
+}
+
+int main(int argc, char** argv) {
     // Initialize logging
     // LLAMA_LOG_SET_VERBOSITY_THOLD(LLAMA_LOG_LEVEL_INFO);
     
+    // -np N / --parallel N: number of sessions decoded concurrently
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "-np" || std::string(argv[i]) == "--parallel") {
+            g_server_state.n_slots = std::stoi(argv[++i]);
+        }
+    }
+    // every generating session contributes one token to each batch
+    g_server_state.n_slots = std::max(1, std::min(g_server_state.n_slots, g_server_state.n_batch));
+    
     std::cout << "🚀 Starting Llama.cpp Monitoring Server..." << std::endl;
+    std::cout << "🧵 Concurrent sessions: " << g_server_state.n_slots << std::endl;
     
     // Load the model
     if (!load_model()) {
@@ -464,9 +807,28 @@ int main(int /* argc */, char** /* argv */) {
         return 1;
     }
     
+    // Resource instrumentation collects the measured per-layer timings reported in the sampling state
+    llama_resource_instrumentation_init(llama_resource_level::MINIMAL, "tools/monitoring-server/logs/resource_trace.jsonl");
+    
+    g_server_state.slots.resize(g_server_state.n_slots);
+    for (int i = 0; i < g_server_state.n_slots; i++) {
+        g_server_state.slots[i].id = i;
+    }
+    
+    g_server_state.token_latency = llama_metrics().histogram("llamacpp:token_latency_seconds", "Time between two generated tokens of a session.",
+        llama_metrics_exponential_buckets(0.001, 2.0, 14));
+    g_server_state.slots_busy = llama_metrics().gauge("llamacpp:slots_busy", "Number of slots running a session.");
+    g_server_state.queue_size = llama_metrics().gauge("llamacpp:requests_queued", "Number of requests waiting for a slot.");
+    g_server_state.sessions_total = llama_metrics().counter("llamacpp:sessions_total", "Number of sessions started.");
+    
+    g_server_state.scheduler = std::thread(scheduler_loop);
+    
     // Create HTTP server
     httplib::Server server;
     
+    // event streams hold on to their thread while the session runs
+    server.new_task_queue = [] { return new httplib::ThreadPool(std::max(8, 4 * g_server_state.n_slots)); };
+    
     // Enable CORS
     server.set_pre_routing_handler([](const httplib::Request& /* req */, httplib::Response& res) {
         res.set_header("Access-Control-Allow-Origin", "*");
@@ -485,6 +847,7 @@ int main(int /* argc */, char** /* argv */) {
         json response;
         response["status"] = "ok";
         response["model_loaded"] = g_server_state.model_loaded.load();
+        response["n_slots"] = g_server_state.n_slots;
         res.set_content(response.dump(), "application/json");
     });
     
@@ -530,12 +893,23 @@ int main(int /* argc */, char** /* argv */) {
                 }
             }
             
+            // Instrumentation level of the session log (default: detailed)
+            llama_instr_level level = llama_instr_level::DETAILED;
+            if (request_json.contains("level")) {
+                const std::string level_str = request_json["level"];
+                if (level_str == "minimal") {
+                    level = llama_instr_level::MINIMAL;
+                } else if (level_str == "verbose") {
+                    level = llama_instr_level::VERBOSE;
+                }
+            }
+            
             std::cout << "📥 Received request for session: " << session_id << std::endl;
             std::cout << "💭 Prompt: " << prompt << std::endl;
             std::cout << "🎲 Sampling method: " << sampling_config.method << std::endl;
             
-            // Run inference asynchronously and get log file path
-            std::string log_file_path = run_inference_with_logs(prompt, session_id, sampling_config);
+            // Queue the session and wait for a slot to complete it
+            std::string log_file_path = run_inference_with_logs(prompt, session_id, sampling_config, level);
             
             if (log_file_path.empty()) {
                 json error_response;
@@ -545,9 +919,6 @@ int main(int /* argc */, char** /* argv */) {
                 return;
             }
             
-            // Wait a bit for logs to be written
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
-            
             // Return response with session info only; logs are fetched via GET /logs/{session_id}
             json response;
             response["session_id"] = session_id;
@@ -569,10 +940,8 @@ int main(int /* argc */, char** /* argv */) {
     server.Get("/logs/([^/]+)", [](const httplib::Request& req, httplib::Response& res) {
         std::string session_id = req.matches[1];
         
-        std::lock_guard<std::mutex> lock(g_server_state.sessions_mutex);
-        auto it = g_server_state.active_sessions.find(session_id);
-        
-        if (it == g_server_state.active_sessions.end()) {
+        SessionLog log;
+        if (!find_session_log(session_id, log)) {
             json error_response;
             error_response["error"] = "Session not found";
             res.status = 404;
@@ -580,14 +949,14 @@ int main(int /* argc */, char** /* argv */) {
             return;
         }
         
-    // Read raw log content and return base64 to avoid UTF-8 validation issues in JSON
-    std::string log_content = read_log_file(it->second);
-
-    json response;
-    response["session_id"] = session_id;
-    response["logs_b64"] = base64::encode(log_content);
-
-    res.set_content(response.dump(), "application/json");
+        // Read raw log content and return base64 to avoid UTF-8 validation issues in JSON
+        std::string log_content = read_log_file(log);
+        
+        json response;
+        response["session_id"] = session_id;
+        response["logs_b64"] = base64::encode(log_content);
+        
+        res.set_content(response.dump(), "application/json");
     });
 
     // Streaming logs endpoint with offset support
@@ -604,10 +973,8 @@ int main(int /* argc */, char** /* argv */) {
             }
         }
         
-        std::lock_guard<std::mutex> lock(g_server_state.sessions_mutex);
-        auto it = g_server_state.active_sessions.find(session_id);
-        
-        if (it == g_server_state.active_sessions.end()) {
+        SessionLog log;
+        if (!find_session_log(session_id, log)) {
             json error_response;
             error_response["error"] = "Session not found";
             res.status = 404;
@@ -615,7 +982,7 @@ int main(int /* argc */, char** /* argv */) {
             return;
         }
         
-        std::vector<std::string> new_lines = read_log_lines_from_offset(it->second, from_line);
+        std::vector<std::string> new_lines = read_log_lines_from_offset(log, from_line);
 
         json response;
         response["session_id"] = session_id;
@@ -627,10 +994,78 @@ int main(int /* argc */, char** /* argv */) {
         }
         response["new_lines_b64"] = new_lines_b64;
         response["total_lines"] = from_line + new_lines.size();
+        response["complete"] = log.index && log.index->closed();
 
         res.set_content(response.dump(), "application/json");
     });
     
+    // Server-sent events: pushes every new log line as soon as the instrumentation has written it
+    // resumes from ?from_line=N or the Last-Event-ID header, ends with an "end" event once the session is complete
+    server.Get("/logs/([^/]+)/events", [](const httplib::Request& req, httplib::Response& res) {
+        std::string session_id = req.matches[1];
+        
+        SessionLog log;
+        if (!find_session_log(session_id, log) || !log.index) {
+            json error_response;
+            error_response["error"] = "Session not found";
+            res.status = 404;
+            res.set_content(error_response.dump(), "application/json");
+            return;
+        }
+        
+        size_t next_line = 0;
+        try {
+            if (req.has_header("Last-Event-ID")) {
+                next_line = std::stoull(req.get_header_value("Last-Event-ID"));
+            } else if (req.has_param("from_line")) {
+                next_line = std::stoull(req.get_param_value("from_line"));
+            }
+        } catch (const std::exception&) {
+            next_line = 0;
+        }
+        
+        const auto chunked_content_provider = [log, next_line](size_t, httplib::DataSink & sink) mutable {
+            const size_t n_lines = log.index->wait(next_line, 1000);
+            
+            if (n_lines > next_line) {
+                size_t to = n_lines;
+                uint64_t begin = 0;
+                uint64_t end = 0;
+                log.index->range(next_line, to, begin, end);
+                
+                // the event id is the line to resume from
+                std::string events;
+                for (auto & line : split_log_lines(read_log_range(log.path, begin, end))) {
+                    // a CR ends the field of an event like a LF does
+                    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+                    events += "id: " + std::to_string(++next_line) + "\ndata: " + line + "\n\n";
+                }
+                next_line = to;
+                
+                if (!sink.write(events.data(), events.size())) {
+                    return false;
+                }
+            } else if (!log.index->closed()) {
+                // keep-alive comment, also detects disconnected clients
+                static const std::string ping = ": ping\n\n";
+                if (!sink.write(ping.data(), ping.size())) {
+                    return false;
+                }
+            }
+            
+            if (log.index->closed() && next_line >= log.index->n_lines()) {
+                static const std::string end_event = "event: end\ndata: {}\n\n";
+                sink.write(end_event.data(), end_event.size());
+                sink.done();
+            }
+            
+            return true;
+        };
+        
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream", chunked_content_provider);
+    });
+    
     // List active sessions endpoint
     server.Get("/sessions", [](const httplib::Request&, httplib::Response& res) {
         std::lock_guard<std::mutex> lock(g_server_state.sessions_mutex);
@@ -638,16 +1073,23 @@ int main(int /* argc */, char** /* argv */) {
         json response;
         response["active_sessions"] = json::array();
         
-        for (const auto& [session_id, log_path] : g_server_state.active_sessions) {
+        for (const auto& [session_id, log] : g_server_state.active_sessions) {
             json session_info;
             session_info["session_id"] = session_id;
-            session_info["log_file_path"] = log_path;
+            session_info["log_file_path"] = log.path;
+            session_info["complete"] = log.index && log.index->closed();
             response["active_sessions"].push_back(session_info);
         }
         
         res.set_content(response.dump(), "application/json");
     });
     
+    // Prometheus metrics: token latency and slot usage of the server, decode latency, ubatch size,
+    // KV occupancy and per-component time of libllama
+    server.Get("/metrics", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content(llama_metrics().render(), "text/plain; version=0.0.4");
+    });
+    
     // Start server
     const int port = 8080;
     std::cout << "🌐 Starting HTTP server on port " << port << "..." << std::endl;
@@ -655,14 +1097,29 @@ int main(int /* argc */, char** /* argv */) {
     std::cout << "   POST /log-monitoring - Start inference with logs and sampling options" << std::endl;
     std::cout << "   GET  /logs/{session_id} - Get logs for a session" << std::endl;
     std::cout << "   GET  /logs/{session_id}/stream?from_line=N - Stream logs from line N" << std::endl;
+    std::cout << "   GET  /logs/{session_id}/events?from_line=N - Follow logs as server-sent events" << std::endl;
     std::cout << "   GET  /sessions - List active sessions" << std::endl;
+    std::cout << "   GET  /metrics - Prometheus metrics" << std::endl;
     std::cout << "   GET  /health - Health check" << std::endl;
     std::cout << "📝 Sampling methods supported: greedy, top_k, top_p, temperature" << std::endl;
     
-    if (!server.listen("0.0.0.0", port)) {
+    const bool ok = server.listen("0.0.0.0", port);
+    if (!ok) {
         std::cerr << "❌ Failed to start server on port " << port << std::endl;
-        return 1;
     }
     
-    return 0;
+    {
+        std::lock_guard<std::mutex> lock(g_server_state.queue_mutex);
+        g_server_state.stop = true;
+    }
+    g_server_state.queue_cv.notify_one();
+    g_server_state.scheduler.join();
+    
+    for (auto & slot : g_server_state.slots) {
+        if (slot.sampler) {
+            common_sampler_free(slot.sampler);
+        }
+    }
+    
+    return ok ? 0 : 1;
 }
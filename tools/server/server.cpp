@@ -5,6 +5,7 @@
 #include "common.h"
 #include "json-schema-to-grammar.h"
 #include "llama.h"
+#include "llama-metrics.h"
 #include "log.h"
 #include "sampling.h"
 #include "speculative.h"
@@ -1371,6 +1372,7 @@ struct server_slot {
 
     int64_t t_start_process_prompt;
     int64_t t_start_generation;
+    int64_t t_last_token;
 
     double t_prompt_processing; // ms
     double t_token_generation;  // ms
@@ -1602,11 +1604,22 @@ struct server_metrics {
     uint64_t n_decode_total     = 0;
     uint64_t n_busy_slots_total = 0;
 
+    // distributions, shared with libllama through llama_metrics()
+    llama_metric_histogram * token_latency       = nullptr;
+    llama_metric_histogram * time_to_first_token = nullptr;
+
     void init() {
         t_start = ggml_time_us();
+
+        token_latency = llama_metrics().histogram("llamacpp:token_latency_seconds", "Time between two generated tokens of a slot.",
+                llama_metrics_exponential_buckets(0.001, 2.0, 14));
+        time_to_first_token = llama_metrics().histogram("llamacpp:time_to_first_token_seconds", "Prompt processing time until the first generated token.",
+                llama_metrics_exponential_buckets(0.01, 2.0, 14));
     }
 
     void on_prompt_eval(const server_slot & slot) {
+        time_to_first_token->observe(slot.t_prompt_processing / 1e3);
+
         n_prompt_tokens_processed_total += slot.n_prompt_tokens_processed;
         n_prompt_tokens_processed       += slot.n_prompt_tokens_processed;
         t_prompt_processing             += slot.t_prompt_processing;
@@ -1624,6 +1637,12 @@ struct server_metrics {
         t_tokens_generation_total  += slot.t_token_generation;
     }
 
+    void on_token(const server_slot & slot, int64_t t_current) {
+        if (slot.n_decoded > 1) {
+            token_latency->observe((t_current - slot.t_last_token) / 1e6);
+        }
+    }
+
     void on_decoded(const std::vector<server_slot> & slots) {
         n_decode_total++;
         for (const auto & slot : slots) {
@@ -1983,9 +2002,21 @@ struct server_context {
     common_chat_templates_ptr chat_templates;
     oaicompat_parser_options  oai_parser_opt;
 
+    // persistent threadpools for --poll-adaptive, otherwise the CPU backend starts its threads for every graph
+    ggml_threadpool * threadpool       = nullptr;
+    ggml_threadpool * threadpool_batch = nullptr;
+
+    decltype(ggml_threadpool_free) * ggml_threadpool_free_fn = nullptr;
+
     ~server_context() {
         mtmd_free(mctx);
 
+        if (threadpool || threadpool_batch) {
+            llama_detach_threadpool(ctx);
+            ggml_threadpool_free_fn(threadpool);
+            ggml_threadpool_free_fn(threadpool_batch);
+        }
+
         // Clear any sampling context
         for (server_slot & slot : slots) {
             common_sampler_free(slot.smpl);
@@ -2003,6 +2034,51 @@ struct server_context {
         llama_batch_free(batch);
     }
 
+    bool init_threadpools() {
+        auto * cpu_dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+        if (!cpu_dev) {
+            SRV_ERR("%s", "no CPU backend found\n");
+            return false;
+        }
+        auto * reg = ggml_backend_dev_backend_reg(cpu_dev);
+        auto * ggml_threadpool_new_fn      = (decltype(ggml_threadpool_new) *)      ggml_backend_reg_get_proc_address(reg, "ggml_threadpool_new");
+        auto * ggml_threadpool_set_wait_fn = (decltype(ggml_threadpool_set_wait) *) ggml_backend_reg_get_proc_address(reg, "ggml_threadpool_set_wait");
+        ggml_threadpool_free_fn            = (decltype(ggml_threadpool_free) *)     ggml_backend_reg_get_proc_address(reg, "ggml_threadpool_free");
+
+        if (!ggml_threadpool_new_fn || !ggml_threadpool_set_wait_fn || !ggml_threadpool_free_fn) {
+            SRV_WRN("%s", "the CPU backend has no threadpool, --poll-adaptive is ignored\n");
+            return true;
+        }
+
+        struct ggml_threadpool_params tpp_batch = ggml_threadpool_params_from_cpu_params(params_base.cpuparams_batch);
+        struct ggml_threadpool_params tpp       = ggml_threadpool_params_from_cpu_params(params_base.cpuparams);
+
+        if (!ggml_threadpool_params_match(&tpp, &tpp_batch)) {
+            threadpool_batch = ggml_threadpool_new_fn(&tpp_batch);
+            if (!threadpool_batch) {
+                SRV_ERR("batch threadpool create failed : n_threads %d\n", tpp_batch.n_threads);
+                return false;
+            }
+
+            // start the non-batch threadpool in the paused state
+            tpp.paused = true;
+        }
+
+        threadpool = ggml_threadpool_new_fn(&tpp);
+        if (!threadpool) {
+            SRV_ERR("threadpool create failed : n_threads %d\n", tpp.n_threads);
+            return false;
+        }
+
+        ggml_threadpool_set_wait_fn(threadpool, GGML_THREADPOOL_WAIT_ADAPTIVE);
+
+        llama_attach_threadpool(ctx, threadpool, threadpool_batch);
+
+        SRV_INF("adaptive threadpool, n_threads = %d\n", tpp.n_threads);
+
+        return true;
+    }
+
     bool load_model(const common_params & params) {
         SRV_INF("loading model '%s'\n", params.model.path.c_str());
 
@@ -2024,6 +2100,10 @@ struct server_context {
 
         add_bos_token = llama_vocab_get_add_bos(vocab);
 
+        if (params_base.cpuparams.poll_adaptive && !init_threadpools()) {
+            return false;
+        }
+
         if (!params_base.speculative.model.path.empty() || !params_base.speculative.model.hf_repo.empty()) {
             SRV_INF("loading draft model '%s'\n", params_base.speculative.model.path.c_str());
 
@@ -3648,6 +3728,9 @@ struct server_context {
 
                 slot.t_token_generation = (t_current - slot.t_start_generation) / 1e3;
 
+                metrics.on_token(slot, t_current);
+                slot.t_last_token = t_current;
+
                 completion_token_output result;
                 result.tok          = id;
                 result.text_to_send = common_token_to_piece(ctx, result.tok, accept_special_token(slot, result.tok));
@@ -4137,6 +4220,9 @@ int main(int argc, char ** argv) {
             }
         }
 
+        // histograms and library-side metrics (decode latency, ubatch size, KV occupancy, per-component time)
+        prometheus << llama_metrics().render();
+
         res.set_header("Process-Start-Time-Unix", std::to_string(res_metrics->t_start));
 
         res.set_content(prometheus.str(), "text/plain; version=0.0.4");